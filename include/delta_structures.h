@@ -76,6 +76,25 @@ typedef struct {
 	uint32_t	matches_capacity;       // Capacity of matches array
 } DeltaState;
 
+// Parameters of the rolling hash search of delta_create()
+#define DELTA_WINDOW_SIZE 32            // Bytes hashed per window
+#define DELTA_BUCKET_COUNT 65536        // Buckets indexing the original's windows
+#define DELTA_INITIAL_MATCHES 100       // Matches allocated before the first search
+
+// Working memory of delta_create_in(), kept between calls so that diffing
+// file after file allocates only when a file is larger than any before it
+typedef struct {
+	HashTable	index;                  // Windows of the original; buckets allocated on first use
+	HashEntry *	entries;                // Pool the index's entries are taken from
+	uint32_t	entries_capacity;       // Entries allocated in the pool
+	RollingHash	hash;                   // Rolling hash of the new file's windows
+	uint8_t		window[DELTA_WINDOW_SIZE]; // Circular buffer of hash
+	DeltaState	state;                  // Matches found in the new file
+	DeltaOperation *operations;             // Operations of the last delta
+	uint32_t	operations_capacity;    // Operations allocated
+	DeltaInfo	delta;                  // Last delta returned
+} DeltaContext;
+
 // ============================================================================
 // File Buffer (reusing from your exercises)
 // ============================================================================
@@ -92,6 +111,10 @@ typedef struct {
 
 // Delta creation and application
 DeltaInfo * delta_create(const uint8_t *original_data, uint32_t original_size, const uint8_t *new_data, uint32_t new_size);
+DeltaContext * delta_context_new(void);
+const DeltaInfo * delta_create_in(DeltaContext *context, const uint8_t *original_data, uint32_t original_size, const uint8_t *new_data, uint32_t new_size);
+size_t delta_context_footprint(const DeltaContext *context);
+void delta_context_free(DeltaContext *context);
 int delta_apply(const uint8_t *original_data, uint32_t original_size, const DeltaInfo *delta, uint8_t *output_buffer);
 void delta_free(DeltaInfo *delta);
 
@@ -99,6 +122,7 @@ void delta_free(DeltaInfo *delta);
 RollingHash * rolling_hash_new(uint32_t window_size);
 void rolling_hash_update(RollingHash *rh, uint8_t byte);
 uint32_t rolling_hash_get(RollingHash *rh);
+void rolling_hash_reset(RollingHash *rh);
 void rolling_hash_free(RollingHash *rh);
 
 // Hash table functions
@@ -117,6 +141,47 @@ FileBuffer * file_buffer_new(size_t initial_capacity);
 int file_buffer_append(FileBuffer *fb, const uint8_t *data, size_t data_size);
 void file_buffer_free(FileBuffer *fb);
 
+// ============================================================================
+// Thread Pool
+// ============================================================================
+
+// Fixed-size pool of worker threads (opaque, see thread_pool.c)
+typedef struct ThreadPool ThreadPool;
+
+// Work item executed by a pool worker
+typedef void (*ThreadPoolTask)(void *arg);
+
+ThreadPool * thread_pool_new(uint32_t thread_count);
+uint32_t thread_pool_size(const ThreadPool *pool);
+uint32_t thread_pool_cpu_count(void);
+int thread_pool_submit(ThreadPool *pool, ThreadPoolTask fn, void *arg);
+void thread_pool_wait(ThreadPool *pool);
+int thread_pool_run(ThreadPool *pool, ThreadPoolTask fn, void *args, uint32_t count, size_t arg_size);
+void thread_pool_free(ThreadPool *pool);
+
+// ============================================================================
+// Content Hashing
+// ============================================================================
+
+// Bytes of the content hash stored with every version (BLAKE3, truncated)
+#define CONTENT_HASH_SIZE 16
+
+// Incremental BLAKE3 hasher
+typedef struct {
+	uint32_t	cv[8];                  // Chaining value of the current chunk
+	uint64_t	chunk_counter;          // Index of the current chunk
+	uint8_t		block[64];              // Buffered input of the current block
+	uint8_t		block_len;              // Bytes in block
+	uint8_t		blocks_compressed;      // Blocks of the current chunk already compressed
+	uint8_t		stack_len;              // Entries in stack
+	uint32_t	stack[54][8];           // Chaining values of completed subtrees
+} Blake3Hasher;
+
+void blake3_init(Blake3Hasher *hasher);
+void blake3_update(Blake3Hasher *hasher, const void *data, size_t length);
+void blake3_final(const Blake3Hasher *hasher, uint8_t *out, size_t out_length);
+void blake3_hash(const void *data, size_t length, uint8_t *out, size_t out_length);
+
 // ============================================================================
 // Storage System Structures
 // ============================================================================
@@ -129,15 +194,164 @@ typedef struct {
 	uint32_t	delta_size;             // Size of delta data
 	uint32_t	operation_count;        // Number of delta operations
 	time_t		timestamp;              // Creation timestamp
-	char		checksum[64];           // File checksum (for integrity)
+	char		checksum[64];           // Hex content hash of the version (for integrity)
 	char		message[256];           // Message associated with the version
 } FileMetadata;
 
+// Record flags of a ManifestEntry
+#define MANIFEST_ENTRY_PACKED 0x1       // The delta lives in the file's pack, not in loose files
+
+// Header and record layout of a per-file version manifest (<key>.manifest):
+// a MANIFEST_HEADER_SIZE header (magic, format version, record size, header
+// size, canonical path of the file, state of the file when last tracked),
+// then one MANIFEST_RECORD_SIZE little-endian record per version
+#define MANIFEST_MAGIC 0x4e4d5646       // "FVMN"
+#define MANIFEST_FORMAT_VERSION 1
+#define MANIFEST_PATH_OFFSET 16
+#define MANIFEST_PATH_SIZE 256
+#define MANIFEST_STATE_OFFSET (MANIFEST_PATH_OFFSET + MANIFEST_PATH_SIZE)
+#define MANIFEST_STATE_SIZE 48
+#define MANIFEST_HEADER_SIZE (MANIFEST_STATE_OFFSET + MANIFEST_STATE_SIZE)
+#define MANIFEST_RECORD_SIZE 80
+
+// One decoded manifest record
+typedef struct {
+	uint32_t	version;                // Version number
+	uint32_t	flags;                  // MANIFEST_ENTRY_* flags
+	uint64_t	offset;                 // Offset of the delta in the pack (0 for loose files)
+	uint32_t	size;                   // Bytes of stored delta data
+	uint32_t	file_size;              // Size of the version's contents
+	int64_t		timestamp;              // Creation time (seconds since the epoch)
+	uint32_t	checksum;               // calculate_hash() of the stored delta bytes
+	uint32_t	operation_count;        // Number of delta operations
+	uint32_t	delta_size;             // Size of the delta data
+	uint32_t	message_length;         // Bytes of the message, 0 for none
+	uint64_t	message_offset;         // Offset of the message in <name>.messages
+	uint8_t		content_hash[CONTENT_HASH_SIZE]; // BLAKE3 of the contents, all zero if unknown
+	uint32_t	original_size;          // Size of the version the delta applies to
+} ManifestEntry;
+
+// Working file as it was when it was last tracked, kept in the manifest header
+typedef struct {
+	uint32_t	version;                // Version the file's contents matched, 0 if unknown
+	uint64_t	size;                   // File size in bytes
+	int64_t		mtime_ns;               // Modification time in nanoseconds
+	int64_t		ctime_ns;               // Status change time in nanoseconds
+	uint64_t	inode;                  // Inode number
+	uint64_t	device;                 // Device holding the file
+} TrackedState;
+
+// Latest version of a tracked file kept in memory between tracks, so the
+// next version is diffed against it instead of one rebuilt from the chain
+typedef struct {
+	uint32_t	version;                // Version held in data, 0 if empty
+	uint32_t	size;                   // Bytes in data
+	uint8_t *	data;                   // Contents of that version
+	uint8_t		content_hash[CONTENT_HASH_SIZE]; // BLAKE3 of data
+} FileHead;
+
+// Read-only mapping of a manifest and its message heap
+typedef struct {
+	uint8_t *	map;                    // Mapping of the manifest
+	size_t		map_size;               // Size of the manifest mapping
+	uint8_t *	heap;                   // Mapping of the message heap, NULL if empty
+	size_t		heap_size;              // Size of the heap mapping
+	uint32_t	count;                  // Number of records
+} ManifestView;
+
+// Header of one record of a pack file (<name>.pack), followed by
+// delta_size bytes of delta operations
+#define PACK_RECORD_MAGIC 0x4b505646    // "FVPK"
+typedef struct {
+	uint32_t	magic;                  // PACK_RECORD_MAGIC
+	uint32_t	version;                // Version stored in the record
+	uint32_t	delta_size;             // Bytes of delta operations after the header
+} PackRecordHeader;
+
+// Header of the repository-wide catalog (<storage>/catalog), followed by
+// capacity CatalogEntry slots forming an open-addressing hash table
+#define CATALOG_MAGIC 0x54435646        // "FVCT"
+#define CATALOG_FORMAT_VERSION 2
+typedef struct {
+	uint32_t	magic;                  // CATALOG_MAGIC
+	uint32_t	format_version;         // CATALOG_FORMAT_VERSION
+	uint32_t	capacity;               // Number of slots
+	uint32_t	used;                   // Slots holding a name
+} CatalogHeader;
+
+// Summary of one tracked file in the catalog; an empty name marks a free slot
+typedef struct {
+	char		name[256];              // Canonical path of the file
+	uint32_t	latest_version;         // Latest stored version
+	uint32_t	version_count;          // Number of stored versions (0 once all are deleted)
+	uint64_t	total_delta;            // Sum of the delta sizes of all versions
+} CatalogEntry;
+
+// Where the delta and metadata of a stored version live
+typedef struct {
+	char		path[1024];             // Pack or loose .delta file holding the delta
+	uint64_t	offset;                 // Offset of the delta in path
+	uint32_t	size;                   // Bytes of delta operations
+	int		packed;                 // Whether the version lives in the pack
+	ManifestEntry	entry;                  // Manifest record of the version
+} StoredDelta;
+
+// How much of the storage is flushed to disk, and when
+typedef enum {
+	DURABILITY_NONE = 0,                    // Leave write-back to the kernel
+	DURABILITY_BATCH,                       // One barrier per batch in storage_commit()
+	DURABILITY_STRICT                       // Flush every write before it is referenced
+} DurabilityLevel;
+
+// Result of checking the stored versions of one tracked file
+typedef struct {
+	uint32_t	versions_checked;       // Versions found intact
+	uint32_t	bad_version;            // First damaged version, 0 if no single version is to blame
+	char		problem[256];           // What is wrong, empty if the file is intact
+} FileCheck;
+
+// Receives one version of a file from storage_walk_versions(); data is only valid during the call
+typedef int (*VersionSink)(uint32_t version, const uint8_t *data, uint32_t size, void *context);
+
+// Largest chunk a streamed apply hands to its OutputSink
+#define OUTPUT_SINK_CHUNK (64 * 1024)
+
+// Receives the output of a streamed apply in order; data is only valid during the call
+typedef int (*OutputSink)(const uint8_t *data, uint32_t size, void *context);
+
+// Version a streamed delta applies to: held in memory, or read a range at a time
+typedef struct {
+	const uint8_t *	data;                   // Whole base version, or NULL to read it through read
+	uint32_t	size;                   // Size of the base version
+	int		(*read)(void *context, uint32_t offset, uint32_t length, uint8_t *buffer); // Returns length, -1 on failure
+	void *		context;                // Passed to read
+} DeltaSource;
+
+// How a working file compares with the latest version of it
+typedef enum {
+	FILE_STATE_MODIFIED = 0,                // Contents differ from the latest version
+	FILE_STATE_UNCHANGED,                   // Contents match the latest version
+	FILE_STATE_UNKNOWN                      // Latest version has no content hash to compare with
+} FileState;
+
+// Delta contexts a StorageConfig keeps between tracks, one per concurrent diff
+#define STORAGE_DELTA_CONTEXTS 8
+
+// Files and directories a batch records for storage_commit() before it falls back to syncfs()
+#define STORAGE_SYNC_SLOTS 128
+
 // Storage system configuration
 typedef struct {
 	char		storage_dir[512];       // Base directory for storage
 	uint32_t	max_versions;           // Maximum versions to keep per file
 	int		compression_enabled;    // Whether to compress deltas
+	uint32_t	apply_threads;          // Threads for large delta applications (1 disables)
+	ThreadPool *	apply_pool;             // Created on first large application
+	DurabilityLevel durability;             // When writes are flushed to disk
+	int		sync_pending;           // Batch writes too many to record, flushed by syncfs()
+	int		sync_fds[STORAGE_SYNC_SLOTS]; // Descriptors with batch writes pending, -1 if free
+	int		verify_content;         // Check reconstructed versions against their content hash
+	DeltaContext *	delta_contexts[STORAGE_DELTA_CONTEXTS]; // Idle contexts kept for the next diffs
 } StorageConfig;
 
 // ============================================================================
@@ -149,21 +363,149 @@ StorageConfig * storage_init(const char *storage_dir);
 void storage_free(StorageConfig *config);
 
 // Delta storage operations
-int save_delta(StorageConfig *config, const char *filename, uint32_t version, const DeltaInfo *delta, const uint8_t *original_data, const char *message);
+int save_delta(StorageConfig *config, const char *filename, uint32_t version, const DeltaInfo *delta, const uint8_t *content_hash, const char *message);
 DeltaInfo * load_delta(StorageConfig *config, const char *filename, uint32_t version);
 
+int read_legacy_metadata(const char *path, FileMetadata *metadata);
+int storage_locate(StorageConfig *config, const char *filename, uint32_t version, StoredDelta *location);
+void storage_canonical_path(const char *filename, char *canonical, size_t max_len);
+int storage_object_dir(StorageConfig *config, const char *filename);
+
+// Storage object names, relative to the storage directory
+void generate_storage_filename(const char *original_filename, uint32_t version, char *storage_filename, size_t max_len);
+void generate_metadata_filename(const char *original_filename, uint32_t version, char *metadata_filename, size_t max_len);
+void generate_manifest_filename(const char *original_filename, char *manifest_filename, size_t max_len);
+void generate_pack_filename(const char *original_filename, char *pack_filename, size_t max_len);
+void generate_message_heap_filename(const char *original_filename, char *heap_filename, size_t max_len);
+void generate_lock_filename(const char *original_filename, char *lock_filename, size_t max_len);
+
 // Version management
 int get_file_versions(StorageConfig *config, const char *filename, uint32_t *versions, uint32_t max_versions);
+uint32_t * storage_list_versions(StorageConfig *config, const char *filename, uint32_t *count);
+int storage_latest_version(StorageConfig *config, const char *filename);
 int delete_version(StorageConfig *config, const char *filename, uint32_t version);
 int track_file_version(StorageConfig *config, const char *filename, const uint8_t *file_data, uint32_t file_size, const char *message);
+int track_file_state(StorageConfig *config, const char *filename, const uint8_t *file_data, uint32_t file_size, const char *message, const uint8_t *content_hash, const TrackedState *state, int *stored);
+int track_file_head(StorageConfig *config, const char *filename, const uint8_t *file_data, uint32_t file_size, const char *message, const uint8_t *content_hash, const TrackedState *state, FileHead *head, int *stored);
+void file_head_clear(FileHead *head);
+
+// Unchanged detection
+struct stat;
+void storage_tracked_state(const struct stat *st, uint32_t version, TrackedState *state);
+int storage_check_unchanged(StorageConfig *config, const char *filename, const TrackedState *state);
+int storage_file_state(StorageConfig *config, const char *filename, const struct stat *st, FileState *state);
+int storage_hash_file(const char *path, uint8_t *hash);
+
+// Version manifests
+int manifest_prepare(StorageConfig *config, const char *filename);
+int manifest_append(StorageConfig *config, const char *filename, const ManifestEntry *entry, const char *message);
+int manifest_read(StorageConfig *config, const char *filename, ManifestEntry **entries);
+int manifest_latest(StorageConfig *config, const char *filename, ManifestEntry *entry);
+int manifest_drop_uncommitted(StorageConfig *config, const char *filename);
+int manifest_find(StorageConfig *config, const char *filename, uint32_t version, ManifestEntry *entry);
+int manifest_find_at(StorageConfig *config, const char *filename, int64_t timestamp, ManifestEntry *entry);
+int manifest_rewrite(StorageConfig *config, const char *filename, const ManifestEntry *entries, uint32_t count);
+int manifest_message(StorageConfig *config, const char *filename, const ManifestEntry *entry, char *buffer, size_t size);
+ManifestView * manifest_view_open(StorageConfig *config, const char *filename);
+int manifest_view_entry(const ManifestView *view, uint32_t index, ManifestEntry *entry);
+const char * manifest_view_message(const ManifestView *view, const ManifestEntry *entry, uint32_t *length);
+void manifest_view_close(ManifestView *view);
+int manifest_owner(const char *manifest_file, char *filename, size_t size);
+int manifest_read_state(StorageConfig *config, const char *filename, TrackedState *state);
+int manifest_write_state(StorageConfig *config, const char *filename, const TrackedState *state);
+
+// Catalog of tracked files
+int catalog_add_version(StorageConfig *config, const char *filename, uint32_t version, uint64_t delta_size);
+int catalog_remove_version(StorageConfig *config, const char *filename, uint32_t latest_version, uint64_t delta_size);
+int catalog_read(StorageConfig *config, CatalogEntry **entries);
+int catalog_rebuild(StorageConfig *config);
+
+// Logging
+typedef void (*LogHandler)(const char *message, void *context);
+void storage_set_log_handler(LogHandler handler, void *context);
+void storage_log(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Durability
+int storage_parse_durability(const char *name, DurabilityLevel *level);
+int storage_sync_file(StorageConfig *config, int fd);
+int storage_sync_temp(int fd);
+int storage_sync_entry(StorageConfig *config, const char *path);
+int storage_commit(StorageConfig *config);
+
+// Integrity checks
+int storage_check_file(StorageConfig *config, const char *filename, FileCheck *check);
+
+// Advisory locks
+int storage_lock_path(const char *path, int exclusive);
+int storage_lock_file(StorageConfig *config, const char *filename);
+void storage_unlock(int fd);
+
+// Pack files
+int pack_append(StorageConfig *config, const char *filename, const uint8_t *record, size_t size, uint64_t *offset);
+int storage_migrate_file(StorageConfig *config, const char *filename);
 
 // Delta application
 int apply_delta(const DeltaInfo *delta, const uint8_t *original_data, uint8_t *output_buffer, uint32_t output_buffer_size);
 uint8_t * apply_delta_alloc(const uint8_t *original_data, uint32_t original_size, const DeltaInfo *delta);
+int64_t apply_delta_parallel(const DeltaInfo *delta, const uint8_t *original_data, uint32_t original_size, uint8_t *output_buffer, uint32_t output_buffer_size, ThreadPool *pool);
+int64_t apply_delta_to_sink(const DeltaInfo *delta, const DeltaSource *base, OutputSink sink, void *context);
 uint8_t * reconstruct_file_from_deltas(StorageConfig *config, const char *filename, uint32_t target_version, uint32_t *final_size);
+int storage_walk_versions(StorageConfig *config, const char *filename, uint32_t last_version, VersionSink sink, void *context);
+int restore_file_to_path(StorageConfig *config, const char *filename, uint32_t version, const char *output_path, uint32_t *final_size);
+int restore_version_to_sink(StorageConfig *config, const char *filename, uint32_t version, OutputSink sink, void *context, uint32_t *final_size);
+void storage_readahead(StorageConfig *config, const char *filename, uint32_t version);
 
 // Utility functions
 uint32_t calculate_hash(const uint8_t *data, uint32_t length);
 void print_delta_info(const DeltaInfo *delta);
 
+// ============================================================================
+// Random Access (Range Read) Structures
+// ============================================================================
+
+// One operation of a stored delta, positioned in the version it produces
+typedef struct {
+	DeltaOperationType	type;
+	uint32_t		offset;                 // Offset in the base version (for COPY)
+	uint32_t		length;                 // Number of bytes produced
+	uint32_t		output_offset;          // Prefix sum: first output byte of this operation
+	const uint8_t *		data;                   // Literal bytes inside the mapping (INSERT/REPLACE)
+} DeltaIndexEntry;
+
+// Output offset index over a memory-mapped delta
+typedef struct {
+	uint32_t		version;                // Version this delta produces
+	uint32_t		new_size;               // Size of the produced version
+	uint32_t		entry_count;            // Number of operations
+	DeltaIndexEntry *	entries;                // Operations sorted by output_offset
+	uint8_t *		map;                    // Read-only mapping of the pages holding the delta
+	size_t			map_size;               // Size of the mapping
+	uint64_t		map_offset;             // File offset of map[0]
+} DeltaIndex;
+
+// Random access reader over one version of a tracked file
+typedef struct {
+	StorageConfig *	config;
+	char		filename[256];          // Tracked filename
+	uint32_t	version;                // Version being read
+	DeltaIndex **	indexes;                // Lazily opened indexes, indexes[v - 1] for version v
+} VersionReader;
+
+// ============================================================================
+// Random Access (Range Read) Functions
+// ============================================================================
+
+DeltaIndex * delta_index_map(const char *path, uint64_t offset, uint32_t size, uint32_t version);
+DeltaIndex * delta_index_open(StorageConfig *config, const char *filename, uint32_t version);
+int delta_index_find(const DeltaIndex *index, uint32_t output_offset);
+void delta_index_free(DeltaIndex *index);
+int64_t apply_delta_to_fd(const DeltaIndex *delta, int delta_fd, const DeltaIndex *base, int base_fd, int output_fd);
+int64_t apply_index_parallel(const DeltaIndex *delta, const uint8_t *original_data, uint32_t original_size, uint8_t *output_buffer, uint32_t output_buffer_size, ThreadPool *pool);
+int64_t apply_index_to_sink(const DeltaIndex *delta, const DeltaSource *base, OutputSink sink, void *context);
+
+VersionReader * version_reader_open(StorageConfig *config, const char *filename, uint32_t version);
+uint32_t version_reader_size(VersionReader *reader);
+int64_t version_reader_read(VersionReader *reader, uint32_t offset, uint32_t length, uint8_t *output_buffer);
+void version_reader_free(VersionReader *reader);
+
 #endif // DELTA_STRUCTURES_H
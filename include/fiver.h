@@ -0,0 +1,101 @@
+#ifndef FIVER_H
+#define FIVER_H
+
+/**
+ * @file fiver.h
+ * @brief Public interface of libfiver, the fiver storage engine as a library
+ *
+ * A program opens a repository once and tracks, restores and lists versions
+ * of files through the handle. Every call reports failure with a status code
+ * instead of printing; fiver_strerror() turns a code into a sentence, and
+ * fiver_set_log() receives the engine's own explanations when they are
+ * wanted.
+ *
+ * A FiverRepo may be shared by any number of threads. Calls on the same
+ * file are serialized with the same locks the fiver command takes, so
+ * programs and fiver commands can work on one repository at once. A
+ * FiverHistory belongs to the thread using it.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Marks the functions libfiver.so exports; the engine's own stay hidden
+#define FIVER_API __attribute__((visibility("default")))
+
+// Bytes of the content hash of a version
+#define FIVER_HASH_SIZE 16
+
+// Result of a library call; errors are negative
+typedef enum {
+	FIVER_OK = 0,                           // Success
+	FIVER_DONE = 1,                         // A history has no more versions
+	FIVER_ERR_INVALID = -1,                 // An argument is missing or out of range
+	FIVER_ERR_NOMEM = -2,                   // Memory could not be allocated
+	FIVER_ERR_NO_REPO = -3,                 // The repository does not exist
+	FIVER_ERR_NOT_TRACKED = -4,             // The file has no stored versions
+	FIVER_ERR_NO_VERSION = -5,              // The file has no such version
+	FIVER_ERR_IO = -6,                      // The storage could not be read or written
+	FIVER_ERR_SINK = -7                     // A sink stopped a restore
+} FiverStatus;
+
+// Flags of fiver_open()
+#define FIVER_OPEN_EXISTING 0x1                 // Fail with FIVER_ERR_NO_REPO instead of creating the repository
+#define FIVER_OPEN_NO_SYNC 0x2                  // Leave write-back to the kernel, fiver_commit() does nothing
+#define FIVER_OPEN_STRICT 0x4                   // Flush every write before it is referenced
+#define FIVER_OPEN_VERIFY 0x8                   // Check restored versions against their content hash
+
+// Handle of an open repository
+typedef struct FiverRepo FiverRepo;
+
+// Iterator over the stored versions of one file
+typedef struct FiverHistory FiverHistory;
+
+// One stored version, as returned by fiver_history_next()
+typedef struct {
+	uint32_t	version;                // Version number
+	uint32_t	size;                   // Size of the version's contents
+	int64_t		timestamp;              // When it was stored (seconds since the epoch)
+	uint8_t		content_hash[FIVER_HASH_SIZE]; // BLAKE3 of the contents, all zero if unknown
+	const char *	message;                // Message, "" for none; valid until the next call
+} FiverVersionInfo;
+
+// Receives restored contents chunk by chunk; return nonzero to stop the restore
+typedef int (*FiverSink)(const uint8_t *data, size_t size, void *context);
+
+// Receives the engine's messages, see fiver_set_log()
+typedef void (*FiverLogHandler)(const char *message, void *context);
+
+// Repositories
+FIVER_API int fiver_open(const char *storage_dir, unsigned flags, FiverRepo **repo);
+FIVER_API int fiver_commit(FiverRepo *repo);
+FIVER_API void fiver_close(FiverRepo *repo);
+
+// Versions
+FIVER_API int fiver_track(FiverRepo *repo, const char *name, const uint8_t *data, size_t size, const char *message,
+			  uint32_t *version, int *stored);
+FIVER_API int fiver_latest(FiverRepo *repo, const char *name, uint32_t *version);
+FIVER_API int fiver_restore(FiverRepo *repo, const char *name, uint32_t version, uint8_t **data, size_t *size);
+FIVER_API int fiver_restore_to(FiverRepo *repo, const char *name, uint32_t version, FiverSink sink, void *context);
+
+// History
+FIVER_API int fiver_history_open(FiverRepo *repo, const char *name, FiverHistory **history);
+FIVER_API int fiver_history_next(FiverHistory *history, FiverVersionInfo *info);
+FIVER_API void fiver_history_close(FiverHistory *history);
+
+// Errors and messages
+FIVER_API const char * fiver_strerror(int status);
+FIVER_API void fiver_set_log(FiverLogHandler handler, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FIVER_H
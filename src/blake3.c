@@ -0,0 +1,423 @@
+/**
+ * @file blake3.c
+ * @brief BLAKE3 cryptographic hash
+ *
+ * A portable implementation of BLAKE3 in its default hashing mode, used for
+ * the content hashes stored with every version. Input is split into 1 KiB
+ * chunks whose chaining values are merged pairwise into a binary tree; the
+ * hasher keeps one chaining value per tree level, so any amount of input is
+ * hashed in constant memory and can be fed in pieces of any size.
+ *
+ * Chunks are independent until they are merged, so on x86 four whole chunks
+ * are compressed side by side in SSE2 registers, one chunk per 32-bit lane.
+ * Other targets compress one block at a time.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "delta_structures.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+
+// Domain separation flags
+#define BLAKE3_CHUNK_START (1u << 0)
+#define BLAKE3_CHUNK_END (1u << 1)
+#define BLAKE3_PARENT (1u << 2)
+#define BLAKE3_ROOT (1u << 3)
+
+static const uint32_t blake3_iv[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint8_t blake3_schedule[7][16] = {
+	{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15 },
+	{ 2,  6,  3,  10, 7,  0,  4,  13, 1,  11, 12, 5,  9,  14, 15, 8  },
+	{ 3,  4,  10, 12, 13, 2,  7,  14, 6,  5,  9,  0,  11, 15, 8,  1  },
+	{ 10, 7,  12, 9,  14, 3,  13, 15, 4,  0,  11, 2,  5,  8,  1,  6  },
+	{ 12, 13, 9,  11, 15, 10, 14, 8,  7,  2,  5,  3,  0,  1,  6,  4  },
+	{ 9,  14, 11, 5,  8,  12, 15, 1,  13, 3,  0,  10, 2,  6,  4,  7  },
+	{ 11, 15, 5,  0,  1,  9,  8,  6,  14, 10, 2,  12, 3,  4,  7,  13 },
+};
+
+static inline uint32_t rotr32(uint32_t w, unsigned c)
+{
+	return (w >> c) | (w << (32 - c));
+}
+
+static inline uint32_t load32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void store32(uint8_t *p, uint32_t w)
+{
+	p[0] = (uint8_t)w;
+	p[1] = (uint8_t)(w >> 8);
+	p[2] = (uint8_t)(w >> 16);
+	p[3] = (uint8_t)(w >> 24);
+}
+
+// The quarter-round mixing function
+static inline void blake3_g(uint32_t *s, int a, int b, int c, int d, uint32_t x, uint32_t y)
+{
+	s[a] = s[a] + s[b] + x;
+	s[d] = rotr32(s[d] ^ s[a], 16);
+	s[c] = s[c] + s[d];
+	s[b] = rotr32(s[b] ^ s[c], 12);
+	s[a] = s[a] + s[b] + y;
+	s[d] = rotr32(s[d] ^ s[a], 8);
+	s[c] = s[c] + s[d];
+	s[b] = rotr32(s[b] ^ s[c], 7);
+}
+
+// Compresses one 64-byte block into the 16-word state
+static void blake3_compress(const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN], uint8_t block_len,
+			    uint64_t counter, uint8_t flags, uint32_t out[16])
+{
+	uint32_t m[16];
+	uint32_t s[16];
+
+	for (int i = 0; i < 16; i++)
+		m[i] = load32(block + 4 * i);
+
+	for (int i = 0; i < 8; i++)
+		s[i] = cv[i];
+	s[8] = blake3_iv[0];
+	s[9] = blake3_iv[1];
+	s[10] = blake3_iv[2];
+	s[11] = blake3_iv[3];
+	s[12] = (uint32_t)counter;
+	s[13] = (uint32_t)(counter >> 32);
+	s[14] = block_len;
+	s[15] = flags;
+
+	for (int r = 0; r < 7; r++) {
+		const uint8_t *sched = blake3_schedule[r];
+		blake3_g(s, 0, 4, 8, 12, m[sched[0]], m[sched[1]]);
+		blake3_g(s, 1, 5, 9, 13, m[sched[2]], m[sched[3]]);
+		blake3_g(s, 2, 6, 10, 14, m[sched[4]], m[sched[5]]);
+		blake3_g(s, 3, 7, 11, 15, m[sched[6]], m[sched[7]]);
+		blake3_g(s, 0, 5, 10, 15, m[sched[8]], m[sched[9]]);
+		blake3_g(s, 1, 6, 11, 12, m[sched[10]], m[sched[11]]);
+		blake3_g(s, 2, 7, 8, 13, m[sched[12]], m[sched[13]]);
+		blake3_g(s, 3, 4, 9, 14, m[sched[14]], m[sched[15]]);
+	}
+
+	for (int i = 0; i < 8; i++) {
+		out[i] = s[i] ^ s[i + 8];
+		out[i + 8] = s[i + 8] ^ cv[i];
+	}
+}
+
+// Chaining value of a parent node over two child chaining values
+static void blake3_parent_cv(const uint32_t left[8], const uint32_t right[8], uint32_t out[8])
+{
+	uint8_t block[BLAKE3_BLOCK_LEN];
+	uint32_t words[16];
+
+	for (int i = 0; i < 8; i++) {
+		store32(block + 4 * i, left[i]);
+		store32(block + 32 + 4 * i, right[i]);
+	}
+	blake3_compress(blake3_iv, block, BLAKE3_BLOCK_LEN, 0, BLAKE3_PARENT, words);
+	memcpy(out, words, 8 * sizeof(uint32_t));
+}
+
+// Starts a new chunk
+static void blake3_chunk_reset(Blake3Hasher *hasher, uint64_t chunk_counter)
+{
+	memcpy(hasher->cv, blake3_iv, sizeof(hasher->cv));
+	hasher->chunk_counter = chunk_counter;
+	hasher->block_len = 0;
+	hasher->blocks_compressed = 0;
+}
+
+// Flags of the next block of the current chunk
+static uint8_t blake3_chunk_flags(const Blake3Hasher *hasher)
+{
+	return hasher->blocks_compressed == 0 ? BLAKE3_CHUNK_START : 0;
+}
+
+// Merges a finished chunk into the tree of chaining values
+static void blake3_push_chunk(Blake3Hasher *hasher, uint32_t cv[8], uint64_t total_chunks)
+{
+	// Every trailing zero bit of the chunk count completes one subtree
+	while ((total_chunks & 1) == 0) {
+		hasher->stack_len--;
+		blake3_parent_cv(hasher->stack[hasher->stack_len], cv, cv);
+		total_chunks >>= 1;
+	}
+	memcpy(hasher->stack[hasher->stack_len], cv, 8 * sizeof(uint32_t));
+	hasher->stack_len++;
+}
+
+#if defined(__SSE2__)
+
+// Chunks compressed side by side
+#define BLAKE3_SIMD_DEGREE 4
+
+#define ROTR128(x, c) _mm_or_si128(_mm_srli_epi32((x), (c)), _mm_slli_epi32((x), 32 - (c)))
+
+// The mixing function on one word of four chunks
+static inline void blake3_g4(__m128i *s, int a, int b, int c, int d, __m128i x, __m128i y)
+{
+	s[a] = _mm_add_epi32(_mm_add_epi32(s[a], s[b]), x);
+	s[d] = _mm_xor_si128(s[d], s[a]);
+	s[d] = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s[d], 0xB1), 0xB1);
+	s[c] = _mm_add_epi32(s[c], s[d]);
+	s[b] = ROTR128(_mm_xor_si128(s[b], s[c]), 12);
+	s[a] = _mm_add_epi32(_mm_add_epi32(s[a], s[b]), y);
+	s[d] = ROTR128(_mm_xor_si128(s[d], s[a]), 8);
+	s[c] = _mm_add_epi32(s[c], s[d]);
+	s[b] = ROTR128(_mm_xor_si128(s[b], s[c]), 7);
+}
+
+// One round on four chunks
+static inline void blake3_round4(__m128i *s, const __m128i *m, int r)
+{
+	const uint8_t *sched = blake3_schedule[r];
+
+	blake3_g4(s, 0, 4, 8, 12, m[sched[0]], m[sched[1]]);
+	blake3_g4(s, 1, 5, 9, 13, m[sched[2]], m[sched[3]]);
+	blake3_g4(s, 2, 6, 10, 14, m[sched[4]], m[sched[5]]);
+	blake3_g4(s, 3, 7, 11, 15, m[sched[6]], m[sched[7]]);
+	blake3_g4(s, 0, 5, 10, 15, m[sched[8]], m[sched[9]]);
+	blake3_g4(s, 1, 6, 11, 12, m[sched[10]], m[sched[11]]);
+	blake3_g4(s, 2, 7, 8, 13, m[sched[12]], m[sched[13]]);
+	blake3_g4(s, 3, 4, 9, 14, m[sched[14]], m[sched[15]]);
+}
+
+// Turns four rows of four words into four columns
+static inline void blake3_transpose4(__m128i *r0, __m128i *r1, __m128i *r2, __m128i *r3)
+{
+	__m128i ab_01 = _mm_unpacklo_epi32(*r0, *r1);
+	__m128i ab_23 = _mm_unpackhi_epi32(*r0, *r1);
+	__m128i cd_01 = _mm_unpacklo_epi32(*r2, *r3);
+	__m128i cd_23 = _mm_unpackhi_epi32(*r2, *r3);
+
+	*r0 = _mm_unpacklo_epi64(ab_01, cd_01);
+	*r1 = _mm_unpackhi_epi64(ab_01, cd_01);
+	*r2 = _mm_unpacklo_epi64(ab_23, cd_23);
+	*r3 = _mm_unpackhi_epi64(ab_23, cd_23);
+}
+
+// Chaining values of four consecutive whole chunks, none of them the root
+static void blake3_hash_chunks4(const uint8_t *input, uint64_t chunk_counter, uint32_t out[4][8])
+{
+	__m128i cv[8];
+	__m128i counter_low = _mm_set_epi32((int)(uint32_t)(chunk_counter + 3), (int)(uint32_t)(chunk_counter + 2),
+					    (int)(uint32_t)(chunk_counter + 1), (int)(uint32_t)chunk_counter);
+	__m128i counter_high = _mm_set_epi32((int)(uint32_t)((chunk_counter + 3) >> 32),
+					     (int)(uint32_t)((chunk_counter + 2) >> 32),
+					     (int)(uint32_t)((chunk_counter + 1) >> 32),
+					     (int)(uint32_t)(chunk_counter >> 32));
+
+	for (int i = 0; i < 8; i++)
+		cv[i] = _mm_set1_epi32((int)blake3_iv[i]);
+
+	for (int block = 0; block < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; block++) {
+		// Word i of the block in every chunk; x86 is little-endian like BLAKE3
+		__m128i m[16];
+		for (int row = 0; row < 4; row++) {
+			for (int lane = 0; lane < 4; lane++)
+				m[4 * row + lane] = _mm_loadu_si128((const __m128i *)(input + lane * BLAKE3_CHUNK_LEN +
+										      block * BLAKE3_BLOCK_LEN + 16 * row));
+			blake3_transpose4(&m[4 * row], &m[4 * row + 1], &m[4 * row + 2], &m[4 * row + 3]);
+		}
+
+		uint8_t flags = (block == 0 ? BLAKE3_CHUNK_START : 0) |
+				(block == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1 ? BLAKE3_CHUNK_END : 0);
+		__m128i s[16];
+		for (int i = 0; i < 8; i++)
+			s[i] = cv[i];
+		for (int i = 0; i < 4; i++)
+			s[8 + i] = _mm_set1_epi32((int)blake3_iv[i]);
+		s[12] = counter_low;
+		s[13] = counter_high;
+		s[14] = _mm_set1_epi32(BLAKE3_BLOCK_LEN);
+		s[15] = _mm_set1_epi32(flags);
+
+		// Spelled out so every message index is a constant
+		blake3_round4(s, m, 0);
+		blake3_round4(s, m, 1);
+		blake3_round4(s, m, 2);
+		blake3_round4(s, m, 3);
+		blake3_round4(s, m, 4);
+		blake3_round4(s, m, 5);
+		blake3_round4(s, m, 6);
+
+		for (int i = 0; i < 8; i++)
+			cv[i] = _mm_xor_si128(s[i], s[i + 8]);
+	}
+
+	uint32_t words[8][4];
+	for (int i = 0; i < 8; i++)
+		_mm_storeu_si128((__m128i *)words[i], cv[i]);
+	for (int lane = 0; lane < 4; lane++)
+		for (int i = 0; i < 8; i++)
+			out[lane][i] = words[i][lane];
+}
+
+#endif
+
+/**
+ * @brief Initializes a BLAKE3 hasher
+ *
+ * @param hasher Hasher to initialize. Must not be NULL.
+ */
+void blake3_init(Blake3Hasher *hasher)
+{
+	blake3_chunk_reset(hasher, 0);
+	hasher->stack_len = 0;
+}
+
+/**
+ * @brief Adds input to a BLAKE3 hash
+ *
+ * @param hasher Initialized hasher. Must not be NULL.
+ * @param data Input bytes. May be NULL if length is 0.
+ * @param length Number of input bytes.
+ *
+ * @note Feeding the input in several calls gives the same hash as one call.
+ */
+void blake3_update(Blake3Hasher *hasher, const void *data, size_t length)
+{
+	const uint8_t *input = data;
+
+	while (length > 0) {
+		// A full chunk is only finished once more input proves it is not the last
+		size_t chunk_len = (size_t)hasher->blocks_compressed * BLAKE3_BLOCK_LEN + hasher->block_len;
+		if (chunk_len == BLAKE3_CHUNK_LEN) {
+			uint32_t out[16];
+			blake3_compress(hasher->cv, hasher->block, hasher->block_len, hasher->chunk_counter,
+					blake3_chunk_flags(hasher) | BLAKE3_CHUNK_END, out);
+			uint64_t total_chunks = hasher->chunk_counter + 1;
+			blake3_push_chunk(hasher, out, total_chunks);
+			blake3_chunk_reset(hasher, total_chunks);
+		}
+
+#if defined(__SSE2__)
+		// Runs of whole chunks followed by more input skip the block buffer entirely
+		if (hasher->block_len == 0 && hasher->blocks_compressed == 0) {
+			while (length > BLAKE3_SIMD_DEGREE * BLAKE3_CHUNK_LEN) {
+				uint32_t cvs[BLAKE3_SIMD_DEGREE][8];
+				blake3_hash_chunks4(input, hasher->chunk_counter, cvs);
+				for (int i = 0; i < BLAKE3_SIMD_DEGREE; i++)
+					blake3_push_chunk(hasher, cvs[i], hasher->chunk_counter + i + 1);
+				blake3_chunk_reset(hasher, hasher->chunk_counter + BLAKE3_SIMD_DEGREE);
+				input += BLAKE3_SIMD_DEGREE * BLAKE3_CHUNK_LEN;
+				length -= BLAKE3_SIMD_DEGREE * BLAKE3_CHUNK_LEN;
+			}
+		}
+#endif
+
+		// Whole blocks of a chunk are compressed straight from the input
+		if (hasher->block_len == BLAKE3_BLOCK_LEN) {
+			uint32_t out[16];
+			blake3_compress(hasher->cv, hasher->block, BLAKE3_BLOCK_LEN, hasher->chunk_counter,
+					blake3_chunk_flags(hasher), out);
+			memcpy(hasher->cv, out, sizeof(hasher->cv));
+			hasher->blocks_compressed++;
+			hasher->block_len = 0;
+			continue;
+		}
+		while (hasher->block_len == 0 && length > BLAKE3_BLOCK_LEN &&
+		       hasher->blocks_compressed < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1) {
+			uint32_t out[16];
+			blake3_compress(hasher->cv, input, BLAKE3_BLOCK_LEN, hasher->chunk_counter,
+					blake3_chunk_flags(hasher), out);
+			memcpy(hasher->cv, out, sizeof(hasher->cv));
+			hasher->blocks_compressed++;
+			input += BLAKE3_BLOCK_LEN;
+			length -= BLAKE3_BLOCK_LEN;
+		}
+
+		size_t take = BLAKE3_BLOCK_LEN - hasher->block_len;
+		if (take > length)
+			take = length;
+		memcpy(hasher->block + hasher->block_len, input, take);
+		hasher->block_len += (uint8_t)take;
+		input += take;
+		length -= take;
+	}
+}
+
+/**
+ * @brief Produces the hash of the input added so far
+ *
+ * @param hasher Hasher. Must not be NULL. It is not modified, so more input
+ *               can still be added afterwards.
+ * @param out Output buffer. Must not be NULL.
+ * @param out_length Number of hash bytes to produce: 32 for the standard
+ *                   hash, fewer for a truncated one.
+ */
+void blake3_final(const Blake3Hasher *hasher, uint8_t *out, size_t out_length)
+{
+	// The last chunk, then each pending subtree, becomes the root's input
+	uint32_t cv[8];
+	uint8_t block[BLAKE3_BLOCK_LEN];
+	uint8_t block_len = hasher->block_len;
+	uint8_t flags = blake3_chunk_flags(hasher) | BLAKE3_CHUNK_END;
+	uint64_t counter = hasher->chunk_counter;
+
+	memcpy(cv, hasher->cv, sizeof(cv));
+	memset(block, 0, sizeof(block));
+	memcpy(block, hasher->block, hasher->block_len);
+
+	for (uint32_t level = hasher->stack_len; level > 0; level--) {
+		uint32_t words[16];
+		blake3_compress(cv, block, block_len, counter, flags, words);
+		for (int i = 0; i < 8; i++) {
+			store32(block + 4 * i, hasher->stack[level - 1][i]);
+			store32(block + 32 + 4 * i, words[i]);
+		}
+		memcpy(cv, blake3_iv, sizeof(cv));
+		block_len = BLAKE3_BLOCK_LEN;
+		counter = 0;
+		flags = BLAKE3_PARENT;
+	}
+
+	for (uint64_t output_block = 0; out_length > 0; output_block++) {
+		uint32_t words[16];
+		uint8_t bytes[BLAKE3_BLOCK_LEN];
+		blake3_compress(cv, block, block_len, output_block, flags | BLAKE3_ROOT, words);
+		for (int i = 0; i < 16; i++)
+			store32(bytes + 4 * i, words[i]);
+		size_t take = out_length < BLAKE3_BLOCK_LEN ? out_length : BLAKE3_BLOCK_LEN;
+		memcpy(out, bytes, take);
+		out += take;
+		out_length -= take;
+	}
+}
+
+/**
+ * @brief Hashes a buffer with BLAKE3 in one call
+ *
+ * @param data Input bytes. May be NULL if length is 0.
+ * @param length Number of input bytes.
+ * @param out Output buffer. Must not be NULL.
+ * @param out_length Number of hash bytes to produce.
+ *
+ * @example
+ * ```c
+ * uint8_t hash[CONTENT_HASH_SIZE];
+ * blake3_hash(data, size, hash, sizeof(hash));
+ * ```
+ */
+void blake3_hash(const void *data, size_t length, uint8_t *out, size_t out_length)
+{
+	Blake3Hasher hasher;
+
+	blake3_init(&hasher);
+	blake3_update(&hasher, data, length);
+	blake3_final(&hasher, out, out_length);
+}
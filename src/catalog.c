@@ -0,0 +1,677 @@
+/**
+ * @file catalog.c
+ * @brief Repository-wide catalog of tracked files
+ *
+ * The catalog (<storage>/catalog) holds one CatalogEntry per tracked file
+ * with its latest version, version count and total delta bytes. It is an
+ * open-addressing hash table stored on disk:
+ *
+ *   CatalogHeader | capacity x CatalogEntry
+ *
+ * A file's slot is found by hashing its name and probing linearly, so
+ * tracking a version updates one record in place with pread/pwrite. Listing
+ * all tracked files is one sequential read of the table. The table is
+ * rebuilt into a file twice as large when it is three quarters full. Updates
+ * hold <storage>/catalog.lock exclusively and listings hold it shared, so
+ * processes tracking different files can share the catalog safely.
+ *
+ * Entries are keyed by the canonical path of the file, the same path the
+ * file's objects are named after, so the catalog doubles as the map from
+ * object keys back to paths. It only summarizes the manifests and is rebuilt
+ * from them when it is missing, damaged or could not be updated, so older
+ * storage directories get a catalog the first time they are listed. Listings
+ * only read the catalog; a rebuild waits for the exclusive lock, and storage
+ * that cannot be written, such as a read-only mount, is listed by
+ * summarizing the manifests in memory instead.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "delta_structures.h"
+
+#define CATALOG_MIN_CAPACITY 64         // Slots of a new catalog
+#define CATALOG_READ_BATCH 4096         // Slots read per read() call when listing
+
+// Builds the full path of the catalog
+static void catalog_path(const StorageConfig *config, char *path, size_t len)
+{
+	snprintf(path, len, "%s/catalog", config->storage_dir);
+}
+
+static int catalog_read_table(int fd, const CatalogHeader *header, CatalogEntry **entries);
+static int catalog_read_file(StorageConfig *config, CatalogEntry **entries);
+static int catalog_scan(StorageConfig *config, CatalogEntry **entries);
+
+// Takes the catalog lock; updates hold it exclusively, listings shared
+static int catalog_lock(const StorageConfig *config, int exclusive)
+{
+	char path[1024];
+
+	snprintf(path, sizeof(path), "%s/catalog.lock", config->storage_dir);
+
+	// Listings never create the lock file; without one no catalog has been written
+	if (!exclusive && access(path, F_OK) == -1)
+		return -1;
+	return storage_lock_path(path, exclusive);
+}
+
+// Home slot of a name in a table of capacity slots
+static uint32_t catalog_slot(const char *name, uint32_t capacity)
+{
+	return calculate_hash((const uint8_t *)name, (uint32_t)strlen(name)) % capacity;
+}
+
+// Reads exactly size bytes at offset; -1 on error or short file
+static int catalog_pread(int fd, void *buffer, size_t size, off_t offset)
+{
+	uint8_t *bytes = buffer;
+
+	while (size > 0) {
+		ssize_t n = pread(fd, bytes, size, offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		bytes += n;
+		size -= (size_t)n;
+		offset += n;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Writes exactly size bytes at offset
+static int catalog_pwrite(int fd, const void *buffer, size_t size, off_t offset)
+{
+	const uint8_t *bytes = buffer;
+
+	while (size > 0) {
+		ssize_t n = pwrite(fd, bytes, size, offset);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		bytes += n;
+		size -= (size_t)n;
+		offset += n;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Reads and checks the header of an open catalog
+static int catalog_read_header(int fd, CatalogHeader *header)
+{
+	struct stat st;
+
+	if (catalog_pread(fd, header, sizeof(CatalogHeader), 0) != EXIT_SUCCESS ||
+	    header->magic != CATALOG_MAGIC || header->format_version != CATALOG_FORMAT_VERSION ||
+	    header->capacity == 0 || header->used > header->capacity || fstat(fd, &st) == -1 ||
+	    (uint64_t)st.st_size != sizeof(CatalogHeader) + (uint64_t)header->capacity * sizeof(CatalogEntry))
+		return -1;
+
+	return EXIT_SUCCESS;
+}
+
+// Writes entries as a new table of capacity slots and renames it over the catalog
+static int catalog_write(StorageConfig *config, const CatalogEntry *entries, uint32_t count, uint32_t capacity)
+{
+	CatalogEntry *slots = calloc(capacity, sizeof(CatalogEntry));
+
+	if (slots == NULL) {
+		storage_log("Failed to allocate catalog: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t slot = catalog_slot(entries[i].name, capacity);
+		while (slots[slot].name[0] != '\0')
+			slot = (slot + 1) % capacity;
+		slots[slot] = entries[i];
+	}
+
+	CatalogHeader header;
+	memset(&header, 0, sizeof(CatalogHeader));
+	header.magic = CATALOG_MAGIC;
+	header.format_version = CATALOG_FORMAT_VERSION;
+	header.capacity = capacity;
+	header.used = count;
+
+	char path[1024];
+	char temp_path[1100];
+	catalog_path(config, path, sizeof(path));
+	snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", path);
+
+	int fd = mkstemp(temp_path);
+	if (fd == -1) {
+		storage_log("Failed to write catalog: %s\n", strerror(errno));
+		free(slots);
+		return -1;
+	}
+
+	int result = catalog_pwrite(fd, &header, sizeof(CatalogHeader), 0);
+	if (result == EXIT_SUCCESS)
+		result = catalog_pwrite(fd, slots, (size_t)capacity * sizeof(CatalogEntry), sizeof(CatalogHeader));
+	if (fchmod(fd, 0644) == -1)
+		result = -1;
+	if (result == EXIT_SUCCESS)
+		result = storage_sync_temp(fd);
+	if (close(fd) == -1)
+		result = -1;
+	if (result == EXIT_SUCCESS && rename(temp_path, path) == -1)
+		result = -1;
+	if (result == EXIT_SUCCESS)
+		result = storage_sync_entry(config, path);
+
+	if (result != EXIT_SUCCESS) {
+		storage_log("Failed to write catalog: %s\n", strerror(errno));
+		unlink(temp_path);
+	}
+
+	free(slots);
+	return result;
+}
+
+// Smallest power-of-two capacity that keeps count entries at most half full
+static uint32_t catalog_capacity_for(uint32_t count)
+{
+	uint32_t capacity = CATALOG_MIN_CAPACITY;
+
+	while (capacity < UINT32_MAX / 2 && capacity / 2 < count)
+		capacity *= 2;
+	return capacity;
+}
+
+// Adds the summary of one tracked file's manifest to a growing entry array
+static int catalog_summarize(StorageConfig *config, const char *name, CatalogEntry **entries,
+			     uint32_t *count, uint32_t *capacity)
+{
+	ManifestEntry *versions = NULL;
+	int version_count = manifest_read(config, name, &versions);
+
+	if (version_count <= 0) {
+		free(versions);
+		return version_count;
+	}
+
+	if (*count == *capacity) {
+		uint32_t new_capacity = *capacity ? *capacity * 2 : 256;
+		CatalogEntry *new_entries = realloc(*entries, new_capacity * sizeof(CatalogEntry));
+		if (new_entries == NULL) {
+			free(versions);
+			return -1;
+		}
+		*entries = new_entries;
+		*capacity = new_capacity;
+	}
+
+	CatalogEntry *entry = &(*entries)[*count];
+	memset(entry, 0, sizeof(CatalogEntry));
+	entry->latest_version = versions[version_count - 1].version;
+	entry->version_count = (uint32_t)version_count;
+	storage_canonical_path(name, entry->name, sizeof(entry->name));
+	for (int i = 0; i < version_count; i++)
+		entry->total_delta += versions[i].delta_size;
+
+	free(versions);
+	(*count)++;
+	return EXIT_SUCCESS;
+}
+
+// Summarizes every manifest under objects/<kk>/<kk>/
+static int catalog_scan_objects(StorageConfig *config, CatalogEntry **entries, uint32_t *count,
+				uint32_t *capacity)
+{
+	char objects[1024];
+
+	snprintf(objects, sizeof(objects), "%s/objects", config->storage_dir);
+
+	DIR *top = opendir(objects);
+	if (top == NULL)
+		return errno == ENOENT ? EXIT_SUCCESS : -1;
+
+	int result = EXIT_SUCCESS;
+	struct dirent *first;
+	while (result == EXIT_SUCCESS && (first = readdir(top)) != NULL) {
+		if (first->d_name[0] == '.')
+			continue;
+		char first_path[1300];
+		snprintf(first_path, sizeof(first_path), "%s/%s", objects, first->d_name);
+		DIR *middle = opendir(first_path);
+		if (middle == NULL)
+			continue;
+
+		struct dirent *second;
+		while (result == EXIT_SUCCESS && (second = readdir(middle)) != NULL) {
+			if (second->d_name[0] == '.')
+				continue;
+			char second_path[1600];
+			snprintf(second_path, sizeof(second_path), "%s/%s", first_path, second->d_name);
+			DIR *leaf = opendir(second_path);
+			if (leaf == NULL)
+				continue;
+
+			struct dirent *ent;
+			while (result == EXIT_SUCCESS && (ent = readdir(leaf)) != NULL) {
+				size_t len = strlen(ent->d_name);
+				if (len <= 9 || strcmp(ent->d_name + len - 9, ".manifest") != 0)
+					continue;
+				char path[1900];
+				char name[256];
+				snprintf(path, sizeof(path), "%s/%s", second_path, ent->d_name);
+				if (manifest_owner(path, name, sizeof(name)) != EXIT_SUCCESS)
+					continue;
+				if (catalog_summarize(config, name, entries, count, capacity) < 0)
+					result = -1;
+			}
+			closedir(leaf);
+		}
+		closedir(middle);
+	}
+	closedir(top);
+
+	return result;
+}
+
+// Rebuilds the catalog from the manifests; the caller holds the catalog lock
+static int catalog_build(StorageConfig *config)
+{
+	CatalogEntry *entries = NULL;
+	uint32_t count = 0;
+	uint32_t capacity = 0;
+	int result = catalog_scan_objects(config, &entries, &count, &capacity);
+	if (result == EXIT_SUCCESS)
+		result = catalog_write(config, entries, count, catalog_capacity_for(count));
+	free(entries);
+
+	return result == EXIT_SUCCESS ? (int)count : -1;
+}
+
+/**
+ * @brief Rebuilds the catalog from the manifests in the storage directory
+ *
+ * Writes a new catalog summarizing every manifest under objects/. Each
+ * manifest names its file, so the rebuilt catalog maps every object back to
+ * the path it stores.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ *
+ * @return Number of tracked files on success, -1 on failure.
+ *
+ * @note This reads every manifest. It only runs when the catalog is missing
+ *       or damaged; normal updates are incremental. The catalog lock is held
+ *       meanwhile.
+ */
+int catalog_rebuild(StorageConfig *config)
+{
+	if (config == NULL) {
+		storage_log("Error: Invalid parameters for catalog rebuild\n");
+		return -1;
+	}
+
+	int lock = catalog_lock(config, 1);
+	if (lock == -1)
+		return -1;
+
+	int result = catalog_build(config);
+	storage_unlock(lock);
+	return result;
+}
+
+// Opens the catalog for update, rebuilding it first if it is missing or damaged
+static int catalog_open(StorageConfig *config, CatalogHeader *header)
+{
+	char path[1024];
+
+	catalog_path(config, path, sizeof(path));
+
+	int fd = open(path, O_RDWR);
+	if (fd != -1 && catalog_read_header(fd, header) == EXIT_SUCCESS)
+		return fd;
+	if (fd != -1)
+		close(fd);
+
+	if (catalog_build(config) < 0)
+		return -1;
+
+	fd = open(path, O_RDWR);
+	if (fd != -1 && catalog_read_header(fd, header) != EXIT_SUCCESS) {
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+// Finds the slot holding name, or the empty slot where it belongs; -1 on read error
+static int64_t catalog_probe(int fd, const CatalogHeader *header, const char *name, CatalogEntry *entry)
+{
+	uint32_t slot = catalog_slot(name, header->capacity);
+
+	for (uint32_t i = 0; i < header->capacity; i++) {
+		off_t offset = (off_t)(sizeof(CatalogHeader) + (uint64_t)slot * sizeof(CatalogEntry));
+		if (catalog_pread(fd, entry, sizeof(CatalogEntry), offset) != EXIT_SUCCESS)
+			return -1;
+		if (entry->name[0] == '\0' || strncmp(entry->name, name, sizeof(entry->name)) == 0)
+			return offset;
+		slot = (slot + 1) % header->capacity;
+	}
+
+	return -1;
+}
+
+// Applies a change to the entry of filename, creating it if needed
+static int catalog_update(StorageConfig *config, const char *filename, uint32_t latest_version,
+			  int32_t count_change, int64_t delta_change)
+{
+	CatalogHeader header;
+	int fd = catalog_open(config, &header);
+
+	if (fd == -1)
+		return -1;
+
+	// Entries are keyed by canonical path, like the objects they summarize
+	char name[256] = { 0 };
+	storage_canonical_path(filename, name, sizeof(name));
+
+	CatalogEntry entry;
+	int64_t offset = catalog_probe(fd, &header, name, &entry);
+	int is_new = offset >= 0 && entry.name[0] == '\0';
+
+	// Grow before a new entry would make the table more than three quarters full
+	if (is_new && (uint64_t)(header.used + 1) * 4 > (uint64_t)header.capacity * 3) {
+		CatalogEntry *entries = NULL;
+		int count = catalog_read_table(fd, &header, &entries);
+		close(fd);
+		if (count < 0)
+			return -1;
+		int result = catalog_write(config, entries, (uint32_t)count,
+					   catalog_capacity_for((uint32_t)count + 1));
+		free(entries);
+		if (result != EXIT_SUCCESS)
+			return -1;
+
+		return catalog_update(config, filename, latest_version, count_change, delta_change);
+	}
+
+	int result = offset >= 0 ? EXIT_SUCCESS : -1;
+	if (result == EXIT_SUCCESS && is_new) {
+		memset(&entry, 0, sizeof(CatalogEntry));
+		memcpy(entry.name, name, sizeof(entry.name));
+		header.used++;
+		result = catalog_pwrite(fd, &header, sizeof(CatalogHeader), 0);
+	}
+
+	if (result == EXIT_SUCCESS) {
+		int64_t version_count = (int64_t)entry.version_count + count_change;
+		int64_t total_delta = (int64_t)entry.total_delta + delta_change;
+		entry.version_count = version_count > 0 ? (uint32_t)version_count : 0;
+		entry.total_delta = total_delta > 0 ? (uint64_t)total_delta : 0;
+		entry.latest_version = entry.version_count > 0 ? latest_version : 0;
+		result = catalog_pwrite(fd, &entry, sizeof(CatalogEntry), (off_t)offset);
+	}
+	if (result == EXIT_SUCCESS)
+		result = storage_sync_file(config, fd);
+
+	if (close(fd) == -1)
+		result = -1;
+	return result;
+}
+
+// Drops a catalog that could not be updated so the next reader rebuilds it
+static void catalog_invalidate(StorageConfig *config)
+{
+	char path[1024];
+
+	catalog_path(config, path, sizeof(path));
+	if (unlink(path) == -1 && errno != ENOENT)
+		storage_log("Failed to remove stale catalog: %s\n", strerror(errno));
+}
+
+/**
+ * @brief Records a new version of a file in the catalog
+ *
+ * Updates the file's catalog entry in place, creating it for the first
+ * version. Creates the catalog from the manifests if it does not exist.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param version Version that was just stored.
+ * @param delta_size Delta bytes of the new version.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ *
+ * @note On failure the catalog is removed so that it is rebuilt from the
+ *       manifests instead of going stale.
+ *
+ * @example
+ * ```c
+ * catalog_add_version(config, "file.txt", 4, delta->delta_size);
+ * ```
+ */
+int catalog_add_version(StorageConfig *config, const char *filename, uint32_t version, uint64_t delta_size)
+{
+	if (config == NULL || filename == NULL || filename[0] == '\0') {
+		storage_log("Error: Invalid parameters for catalog update\n");
+		return -1;
+	}
+
+	int lock = catalog_lock(config, 1);
+	if (lock == -1)
+		return -1;
+
+	char path[1024];
+	catalog_path(config, path, sizeof(path));
+
+	// A catalog built now already includes the version that was just stored
+	int result;
+	if (access(path, F_OK) == -1 && errno == ENOENT)
+		result = catalog_build(config) < 0 ? -1 : EXIT_SUCCESS;
+	else
+		result = catalog_update(config, filename, version, 1, (int64_t)delta_size);
+
+	if (result != EXIT_SUCCESS)
+		catalog_invalidate(config);
+	storage_unlock(lock);
+	return result;
+}
+
+/**
+ * @brief Records the deletion of a version in the catalog
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param latest_version Latest version left after the deletion, 0 if none.
+ * @param delta_size Delta bytes of the deleted version.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ *
+ * @note A file whose last version is deleted keeps an empty entry, which
+ *       listings skip and which is reused if the file is tracked again.
+ */
+int catalog_remove_version(StorageConfig *config, const char *filename, uint32_t latest_version,
+			   uint64_t delta_size)
+{
+	if (config == NULL || filename == NULL || filename[0] == '\0') {
+		storage_log("Error: Invalid parameters for catalog update\n");
+		return -1;
+	}
+
+	int lock = catalog_lock(config, 1);
+	if (lock == -1)
+		return -1;
+
+	int result = catalog_update(config, filename, latest_version, -1, -(int64_t)delta_size);
+	if (result != EXIT_SUCCESS)
+		catalog_invalidate(config);
+	storage_unlock(lock);
+	return result;
+}
+
+// Orders catalog entries by name
+static int catalog_compare(const void *a, const void *b)
+{
+	return strcmp(((const CatalogEntry *)a)->name, ((const CatalogEntry *)b)->name);
+}
+
+/**
+ * @brief Reads every tracked file from the catalog
+ *
+ * Reads the catalog table sequentially and returns the entries of files
+ * that have at least one version, sorted by name.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param entries Output parameter for the entry array. Must not be NULL.
+ *                Set to NULL when no files are tracked. The caller frees it.
+ *
+ * @return Number of entries on success, -1 on failure.
+ *
+ * @note A missing or damaged catalog is rebuilt from the manifests first,
+ *       under the exclusive catalog lock. If the storage directory cannot be
+ *       written, the manifests are summarized in memory instead.
+ *
+ * @example
+ * ```c
+ * CatalogEntry *files = NULL;
+ * int count = catalog_read(config, &files);
+ * for (int i = 0; i < count; i++)
+ *     printf("%s: %u versions\n", files[i].name, files[i].version_count);
+ * free(files);
+ * ```
+ */
+int catalog_read(StorageConfig *config, CatalogEntry **entries)
+{
+	if (config == NULL || entries == NULL) {
+		storage_log("Error: Invalid parameters for catalog read\n");
+		return -1;
+	}
+
+	*entries = NULL;
+
+	int count = -1;
+	int lock = catalog_lock(config, 0);
+	if (lock != -1) {
+		count = catalog_read_file(config, entries);
+		storage_unlock(lock);
+		if (count >= 0)
+			return count;
+	}
+
+	// Rebuilding writes the catalog, so it waits for writers to finish
+	if (access(config->storage_dir, W_OK) == 0) {
+		lock = catalog_lock(config, 1);
+		if (lock != -1) {
+			// Another listing may have rebuilt it while the lock was free
+			count = catalog_read_file(config, entries);
+			if (count < 0 && catalog_build(config) >= 0)
+				count = catalog_read_file(config, entries);
+			storage_unlock(lock);
+			if (count >= 0)
+				return count;
+		}
+	}
+
+	return catalog_scan(config, entries);
+}
+
+// Reads the live entries of an open catalog sorted by name; the caller holds the catalog lock
+static int catalog_read_table(int fd, const CatalogHeader *header, CatalogEntry **entries)
+{
+	*entries = NULL;
+
+	CatalogEntry *result = malloc(((size_t)header->used + 1) * sizeof(CatalogEntry));
+	CatalogEntry *batch = malloc(CATALOG_READ_BATCH * sizeof(CatalogEntry));
+	if (result == NULL || batch == NULL) {
+		storage_log("Failed to allocate catalog entries: %s\n", strerror(errno));
+		free(result);
+		free(batch);
+		return -1;
+	}
+
+	uint32_t count = 0;
+	off_t offset = sizeof(CatalogHeader);
+	for (uint32_t done = 0; done < header->capacity; ) {
+		uint32_t n = header->capacity - done;
+		if (n > CATALOG_READ_BATCH)
+			n = CATALOG_READ_BATCH;
+		if (catalog_pread(fd, batch, (size_t)n * sizeof(CatalogEntry), offset) != EXIT_SUCCESS) {
+			storage_log("Failed to read catalog: %s\n", strerror(errno));
+			free(result);
+			free(batch);
+			return -1;
+		}
+		for (uint32_t i = 0; i < n && count < header->used; i++) {
+			if (batch[i].name[0] == '\0' || batch[i].version_count == 0)
+				continue;
+			result[count] = batch[i];
+			result[count].name[sizeof(result[count].name) - 1] = '\0';
+			count++;
+		}
+		done += n;
+		offset += (off_t)n * (off_t)sizeof(CatalogEntry);
+	}
+
+	free(batch);
+
+	if (count == 0) {
+		free(result);
+		return 0;
+	}
+
+	qsort(result, count, sizeof(CatalogEntry), catalog_compare);
+	*entries = result;
+	return (int)count;
+}
+
+// Reads the catalog without changing it; -1 if it is missing or damaged
+static int catalog_read_file(StorageConfig *config, CatalogEntry **entries)
+{
+	char path[1024];
+	CatalogHeader header;
+
+	catalog_path(config, path, sizeof(path));
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	int count = -1;
+	if (catalog_read_header(fd, &header) == EXIT_SUCCESS)
+		count = catalog_read_table(fd, &header, entries);
+	close(fd);
+	return count;
+}
+
+// Summarizes the manifests in memory, for storage where no catalog can be written
+static int catalog_scan(StorageConfig *config, CatalogEntry **entries)
+{
+	CatalogEntry *found = NULL;
+	uint32_t count = 0;
+	uint32_t capacity = 0;
+
+	if (catalog_scan_objects(config, &found, &count, &capacity) != EXIT_SUCCESS) {
+		storage_log("Failed to read tracked files: %s\n", strerror(errno));
+		free(found);
+		return -1;
+	}
+
+	if (count == 0) {
+		free(found);
+		return 0;
+	}
+
+	qsort(found, count, sizeof(CatalogEntry), catalog_compare);
+	*entries = found;
+	return (int)count;
+}
@@ -18,6 +18,12 @@
  * - Chunk-based approach: For small changes anywhere in the file (<1% of file)
  * - Rolling hash algorithm: For complex changes with rsync-like pattern matching
  *
+ * All working memory lives in a DeltaContext, which delta_create_in() reuses
+ * from one call to the next: the entries of the original's index come from
+ * one pool instead of one allocation per window, and INSERT operations point
+ * into the new file instead of copying it. delta_create() wraps a context
+ * used once and copies the delta out.
+ *
  * @author Fiver Development Team
  * @version 1.0
  */
@@ -45,12 +51,6 @@ static int compare_matches(const void *a, const void *b)
 	return 0;
 }
 
-// Simple match allocation - memory pool was causing issues
-static Match * match_alloc(void)
-{
-	return malloc(sizeof(Match));
-}
-
 // Forward declarations
 RollingHash * rolling_hash_new(uint32_t window_size);
 void rolling_hash_update(RollingHash *rh, uint8_t byte);
@@ -233,17 +233,15 @@ int verify_match(const uint8_t *original_data, uint32_t original_size,
 		      new_data + new_offset, length) == 0;
 }
 
-/**
- * Find the best match for a given position in the new file (optimized version)
- */
-Match * find_best_match_optimized(const uint8_t *original_data, uint32_t original_size,
-				  const uint8_t *new_data, uint32_t new_size,
-				  const HashTable *ht, uint32_t window_size,
-				  uint32_t new_pos, uint32_t min_match_length,
-				  RollingHash *rh)
+// Finds the longest match of the window at new_pos in the original; rh slides over the new file
+static int find_match(const uint8_t *original_data, uint32_t original_size,
+		      const uint8_t *new_data, uint32_t new_size,
+		      const HashTable *ht, uint32_t window_size,
+		      uint32_t new_pos, uint32_t min_match_length,
+		      RollingHash *rh, Match *best_match)
 {
 	if (new_pos + window_size > new_size)
-		return NULL;
+		return 0;
 
 	// Update rolling hash incrementally (much faster than recreating)
 	if (new_pos == 0) {
@@ -260,7 +258,6 @@ Match * find_best_match_optimized(const uint8_t *original_data, uint32_t origina
 	// Look for matches in original file
 	HashEntry *match_entry = hash_table_find((HashTable *)ht, hash);
 
-	Match *best_match = NULL;
 	uint32_t best_length = 0;
 
 	// Check all matches with this hash (simplified approach)
@@ -273,6 +270,13 @@ Match * find_best_match_optimized(const uint8_t *original_data, uint32_t origina
 			uint32_t original_offset = current->offset;
 			candidates_checked++;
 
+			// Reject hash collisions: the window itself must match byte for byte
+			if (original_offset + window_size > original_size ||
+			    memcmp(new_data + new_pos, original_data + original_offset, window_size) != 0) {
+				current = current->next;
+				continue;
+			}
+
 			// Try to extend the match beyond the window
 			uint32_t match_length = window_size;
 
@@ -283,8 +287,8 @@ Match * find_best_match_optimized(const uint8_t *original_data, uint32_t origina
 			       original_offset + match_length < original_size &&
 			       match_length < max_match_size) {
 				// Check 8 bytes at a time for even better performance
-				if (match_length + 8 <= new_size &&
-				    match_length + 8 <= original_size) {
+				if (new_pos + match_length + 8 <= new_size &&
+				    original_offset + match_length + 8 <= original_size) {
 					uint64_t *new_chunk = (uint64_t *)(new_data + new_pos + match_length);
 					uint64_t *orig_chunk = (uint64_t *)(original_data + original_offset + match_length);
 					if (*new_chunk == *orig_chunk) {
@@ -293,8 +297,8 @@ Match * find_best_match_optimized(const uint8_t *original_data, uint32_t origina
 					}
 				}
 				// Check 4 bytes at a time for better performance
-				if (match_length + 4 <= new_size &&
-				    match_length + 4 <= original_size) {
+				if (new_pos + match_length + 4 <= new_size &&
+				    original_offset + match_length + 4 <= original_size) {
 					uint32_t *new_chunk = (uint32_t *)(new_data + new_pos + match_length);
 					uint32_t *orig_chunk = (uint32_t *)(original_data + original_offset + match_length);
 					if (*new_chunk == *orig_chunk) {
@@ -314,21 +318,15 @@ Match * find_best_match_optimized(const uint8_t *original_data, uint32_t origina
 			if (match_length >= min_match_length && match_length > best_length) {
 				// Simple approach: just take the longest match
 				best_length = match_length;
-
-				// Create or update best match
-				if (best_match == NULL)
-					best_match = match_alloc();
-				if (best_match != NULL) {
-					best_match->original_offset = original_offset;
-					best_match->new_offset = new_pos;
-					best_match->length = match_length;
-				}
+				best_match->original_offset = original_offset;
+				best_match->new_offset = new_pos;
+				best_match->length = match_length;
 			}
 		}
 		current = current->next;
 	}
 
-	return best_match;
+	return best_length > 0;
 }
 
 /**
@@ -401,218 +399,322 @@ Match * find_best_match(const uint8_t *original_data, uint32_t original_size,
 }
 
 /**
- * Create delta operations from matches
+ * @brief Creates the working memory for creating deltas one after another
+ *
+ * The context starts small. Each delta_create_in() grows the parts it needs
+ * to the size of the files being diffed and keeps them, so once a context
+ * has diffed files as large as the next ones, diffing allocates nothing.
+ *
+ * @return Pointer to the new DeltaContext on success, NULL on failure.
+ *         Free it with delta_context_free().
+ *
+ * @note A context must only be used by one thread at a time.
+ *
+ * @example
+ * ```c
+ * DeltaContext *context = delta_context_new();
+ * for (int i = 0; i < count; i++) {
+ *     const DeltaInfo *delta = delta_create_in(context, old[i], old_sizes[i], new[i], new_sizes[i]);
+ *     // ... store delta before the next call ...
+ * }
+ * delta_context_free(context);
+ * ```
  */
-DeltaInfo * create_delta_operations(const uint8_t *original_data, uint32_t original_size,
-				    const uint8_t *new_data, uint32_t new_size,
-				    const DeltaState *state)
+DeltaContext * delta_context_new(void)
 {
-	(void)original_data; // Parameter not used in this implementation
-	if (state == NULL)
+	DeltaContext *context = calloc(1, sizeof(DeltaContext));
+
+	if (context == NULL)
 		return NULL;
 
-	DeltaInfo *delta = malloc(sizeof(DeltaInfo));
-	if (delta == NULL)
+	context->hash.window_size = DELTA_WINDOW_SIZE;
+	context->hash.window = context->window;
+
+	context->state.matches = malloc(DELTA_INITIAL_MATCHES * sizeof(Match));
+	if (context->state.matches == NULL) {
+		free(context);
 		return NULL;
+	}
+	context->state.matches_capacity = DELTA_INITIAL_MATCHES;
 
-	delta->original_size = original_size;
-	delta->new_size = 0; // Will be calculated from operations
-	delta->operation_count = 0;
-	delta->operations = NULL;
-	delta->delta_size = 0;
+	return context;
+}
 
-	// Sort matches by new_offset for processing in order
-	// Using system qsort for O(n log n) performance and stack safety
-	if (state->match_count > 1)
-		qsort(state->matches, state->match_count, sizeof(Match), compare_matches);
+/**
+ * @brief Returns the bytes of working memory a context holds
+ *
+ * @param context Context from delta_context_new(). Must not be NULL.
+ *
+ * @return Bytes allocated for the context and its buffers.
+ */
+size_t delta_context_footprint(const DeltaContext *context)
+{
+	size_t size = sizeof(DeltaContext);
+
+	if (context->index.buckets != NULL)
+		size += (size_t)context->index.bucket_count * sizeof(HashEntry *);
+	size += (size_t)context->entries_capacity * sizeof(HashEntry);
+	size += (size_t)context->state.matches_capacity * sizeof(Match);
+	size += (size_t)context->operations_capacity * sizeof(DeltaOperation);
+	return size;
+}
 
-	// Convert matches to delta operations
-	uint32_t current_new_pos = 0;
-	uint32_t operations_capacity = 10;
-	delta->operations = malloc(operations_capacity * sizeof(DeltaOperation));
+/**
+ * @brief Frees a context and all of its working memory
+ *
+ * @param context Context from delta_context_new(). Safe to pass NULL.
+ *
+ * @note Deltas returned by delta_create_in() become invalid.
+ */
+void delta_context_free(DeltaContext *context)
+{
+	if (context == NULL)
+		return;
 
-	if (delta->operations == NULL) {
-		free(delta);
-		return NULL;
+	free(context->index.buckets);
+	free(context->entries);
+	free(context->state.matches);
+	free(context->operations);
+	free(context);
+}
+
+// Empties the index of the original; clears only the buckets the last call used when they were few
+static int index_prepare(DeltaContext *context, uint32_t entry_count)
+{
+	HashTable *index = &context->index;
+
+	if (index->buckets == NULL) {
+		index->buckets = calloc(DELTA_BUCKET_COUNT, sizeof(HashEntry *));
+		if (index->buckets == NULL)
+			return -1;
+		index->bucket_count = DELTA_BUCKET_COUNT;
+	} else if (index->entry_count < index->bucket_count / 8) {
+		for (uint32_t i = 0; i < index->entry_count; i++)
+			index->buckets[context->entries[i].hash % index->bucket_count] = NULL;
+	} else {
+		memset(index->buckets, 0, index->bucket_count * sizeof(HashEntry *));
 	}
+	index->entry_count = 0;
 
-	for (uint32_t i = 0; i < state->match_count; i++) {
-		Match *match = &state->matches[i];
+	if (entry_count > context->entries_capacity) {
+		free(context->entries);
+		context->entries = malloc((size_t)entry_count * sizeof(HashEntry));
+		context->entries_capacity = context->entries != NULL ? entry_count : 0;
+		if (context->entries == NULL)
+			return -1;
+	}
 
-		// Add INSERT operation for any data before this match
-		if (match->new_offset > current_new_pos) {
-			uint32_t insert_length = match->new_offset - current_new_pos;
-
-			// Resize operations array if needed
-			if (delta->operation_count >= operations_capacity) {
-				operations_capacity *= 2;
-				DeltaOperation *new_ops = realloc(delta->operations,
-								  operations_capacity * sizeof(DeltaOperation));
-				if (new_ops == NULL) {
-					// Handle error
-					for (uint32_t j = 0; j < delta->operation_count; j++)
-						if (delta->operations[j].data != NULL)
-							free(delta->operations[j].data);
-					free(delta->operations);
-					free(delta);
-					return NULL;
-				}
-				delta->operations = new_ops;
-			}
+	return EXIT_SUCCESS;
+}
 
-			// Create INSERT operation
-			DeltaOperation *op = &delta->operations[delta->operation_count];
-			op->type = DELTA_INSERT;
-			op->offset = 0; // Not used for INSERT
-			op->length = insert_length;
-			op->data = malloc(insert_length);
-
-			if (op->data == NULL) {
-				// Handle error
-				for (uint32_t j = 0; j < delta->operation_count; j++)
-					if (delta->operations[j].data != NULL)
-						free(delta->operations[j].data);
-				free(delta->operations);
-				free(delta);
-				return NULL;
-			}
+// Adds a window of the original to the index, taking its entry from the pool
+static void index_insert(DeltaContext *context, uint32_t hash, uint32_t offset)
+{
+	HashTable *index = &context->index;
+	HashEntry *entry = &context->entries[index->entry_count];
+	uint32_t bucket_index = hash % index->bucket_count;
+
+	entry->hash = hash;
+	entry->offset = offset;
+	// Insert at head of chain, as hash_table_insert() does
+	entry->next = index->buckets[bucket_index];
+	index->buckets[bucket_index] = entry;
+	index->entry_count++;
+}
 
-			memcpy(op->data, new_data + current_new_pos, insert_length);
-			delta->operation_count++;
-			delta->delta_size += insert_length;
-		}
+// Makes room for count operations in the context's delta
+static int reserve_operations(DeltaContext *context, uint32_t count)
+{
+	if (count <= context->operations_capacity)
+		return EXIT_SUCCESS;
 
-		// Add COPY operation for the match
-		if (delta->operation_count >= operations_capacity) {
-			operations_capacity *= 2;
-			DeltaOperation *new_ops = realloc(delta->operations,
-							  operations_capacity * sizeof(DeltaOperation));
-			if (new_ops == NULL) {
-				// Handle error
-				for (uint32_t j = 0; j < delta->operation_count; j++)
-					if (delta->operations[j].data != NULL)
-						free(delta->operations[j].data);
-				free(delta->operations);
-				free(delta);
-				return NULL;
-			}
-			delta->operations = new_ops;
+	DeltaOperation *operations = realloc(context->operations, (size_t)count * sizeof(DeltaOperation));
+	if (operations == NULL)
+		return -1;
+
+	context->operations = operations;
+	context->operations_capacity = count;
+	context->delta.operations = operations;
+	return EXIT_SUCCESS;
+}
+
+// Appends an operation; INSERT data points into the new file instead of being copied
+static void add_operation(DeltaInfo *delta, DeltaOperationType type, uint32_t offset, uint32_t length,
+			  const uint8_t *data)
+{
+	DeltaOperation *op = &delta->operations[delta->operation_count++];
+
+	op->type = type;
+	op->offset = type == DELTA_COPY ? offset : 0;
+	op->length = length;
+	op->data = (uint8_t *)data;
+	if (type == DELTA_INSERT)
+		delta->delta_size += length;
+}
+
+// Turns the matches found in the new file into COPY operations with INSERTs between them
+static int build_operations(DeltaContext *context, const uint8_t *new_data, uint32_t new_size)
+{
+	DeltaState *state = &context->state;
+	DeltaInfo *delta = &context->delta;
+
+	// Matches are found in order of new_offset, so sorting is rarely needed
+	for (uint32_t i = 1; i < state->match_count; i++) {
+		if (state->matches[i].new_offset < state->matches[i - 1].new_offset) {
+			qsort(state->matches, state->match_count, sizeof(Match), compare_matches);
+			break;
 		}
+	}
 
-		DeltaOperation *op = &delta->operations[delta->operation_count];
-		op->type = DELTA_COPY;
-		op->offset = match->original_offset;
-		op->length = match->length;
-		op->data = NULL; // No data for COPY operations
-		delta->operation_count++;
+	if (reserve_operations(context, state->match_count * 2 + 1) != EXIT_SUCCESS)
+		return -1;
+
+	uint32_t current_new_pos = 0;
+	for (uint32_t i = 0; i < state->match_count; i++) {
+		Match *match = &state->matches[i];
 
+		// Add INSERT operation for any data before this match
+		if (match->new_offset > current_new_pos)
+			add_operation(delta, DELTA_INSERT, 0, match->new_offset - current_new_pos,
+				      new_data + current_new_pos);
+
+		add_operation(delta, DELTA_COPY, match->original_offset, match->length, NULL);
 		current_new_pos = match->new_offset + match->length;
 	}
 
 	// Add final INSERT operation if there's remaining data
-	if (current_new_pos < new_size) {
-		uint32_t insert_length = new_size - current_new_pos;
-
-		if (delta->operation_count >= operations_capacity) {
-			operations_capacity *= 2;
-			DeltaOperation *new_ops = realloc(delta->operations,
-							  operations_capacity * sizeof(DeltaOperation));
-			if (new_ops == NULL) {
-				// Handle error
-				for (uint32_t j = 0; j < delta->operation_count; j++)
-					if (delta->operations[j].data != NULL)
-						free(delta->operations[j].data);
-				free(delta->operations);
-				free(delta);
-				return NULL;
-			}
-			delta->operations = new_ops;
-		}
+	if (current_new_pos < new_size)
+		add_operation(delta, DELTA_INSERT, 0, new_size - current_new_pos, new_data + current_new_pos);
 
-		DeltaOperation *op = &delta->operations[delta->operation_count];
-		op->type = DELTA_INSERT;
-		op->offset = 0;
-		op->length = insert_length;
-		op->data = malloc(insert_length);
+	// Calculate the final new_size from operations
+	delta->new_size = 0;
+	for (uint32_t i = 0; i < delta->operation_count; i++)
+		delta->new_size += delta->operations[i].length;
 
-		if (op->data == NULL) {
-			// Handle error
-			for (uint32_t j = 0; j < delta->operation_count; j++)
-				if (delta->operations[j].data != NULL)
-					free(delta->operations[j].data);
-			free(delta->operations);
-			free(delta);
-			return NULL;
+	return EXIT_SUCCESS;
+}
+
+// Finds matches of the new file's windows in the original, keeping those at least min_beneficial long
+static uint32_t find_matches(DeltaContext *context, const uint8_t *original_data, uint32_t original_size,
+			     const uint8_t *new_data, uint32_t new_size, uint32_t min_match_length,
+			     uint32_t min_beneficial, uint32_t *skipped, int report)
+{
+	uint32_t window_size = DELTA_WINDOW_SIZE;
+	uint32_t match_count = 0;
+	uint32_t skipped_small_matches = 0;
+	uint32_t match_progress_interval = new_size / 1000; // Report every 0.1% for more frequent updates
+	if (match_progress_interval == 0) match_progress_interval = 1;
+
+	rolling_hash_reset(&context->hash);
+	context->state.match_count = 0;
+
+	// Process new file with sliding window
+	uint32_t i = 0;
+	uint32_t last_match_end = 0; // Track the end of the last match to prevent overlaps
+	while (i < new_size) {
+		// Skip positions that are already covered by previous matches
+		if (i < last_match_end) {
+			i++;
+			continue;
 		}
 
-		memcpy(op->data, new_data + current_new_pos, insert_length);
-		delta->operation_count++;
-		delta->delta_size += insert_length;
-	}
+		// Find best match starting at position i
+		Match match;
+		if (find_match(original_data, original_size, new_data, new_size, &context->index, window_size,
+			       i, min_match_length, &context->hash, &match)) {
+			// Cost-benefit analysis: only use matches that provide real compression benefit
+			if (match.length >= min_beneficial) {
+				// Check if this match overlaps with the previous match
+				if (match.new_offset >= last_match_end) {
+					// Add match to state
+					if (delta_state_add_match(&context->state, match.original_offset,
+								  match.new_offset, match.length) == 0) {
+						match_count++;
+						if (match_count <= 10) { // Only show first 10 matches to avoid spam
+							storage_log("  %s %u: original[%u:%u] -> new[%u:%u] (length=%u)\n",
+								    report ? "Match" : "Lenient Match",
+								    match_count, match.original_offset,
+								    match.original_offset + match.length - 1,
+								    match.new_offset, match.new_offset + match.length - 1,
+								    match.length);
+						}
+					}
 
-	// Calculate the final new_size from operations
-	uint32_t calculated_new_size = 0;
-	for (uint32_t i = 0; i < delta->operation_count; i++) {
-		DeltaOperation *op = &delta->operations[i];
-		switch (op->type) {
-		case DELTA_COPY:
-			calculated_new_size += op->length;
-			break;
-		case DELTA_INSERT:
-			calculated_new_size += op->length;
-			break;
-		case DELTA_REPLACE:
-			calculated_new_size += op->length;
-			break;
+					// Update last match end and skip ahead by match length
+					last_match_end = match.new_offset + match.length;
+					i += match.length;
+				} else {
+					// Match overlaps with previous match, skip it
+					skipped_small_matches++;
+					i++;
+				}
+			} else {
+				// Skip small matches that don't provide compression benefit
+				skipped_small_matches++;
+				// Move forward by 1 byte for small matches
+				i++;
+			}
+		} else {
+			// No match found, move forward by 1 byte
+			i++;
+		}
+
+		// Progress reporting
+		if (report && i % match_progress_interval == 0) {
+			uint32_t progress_percent = (uint32_t)((i * 100ULL) / new_size);
+			storage_log("\rFinding matches: %u%% (%u/%u bytes) - Found %u matches, skipped %u small",
+				    progress_percent, i, new_size, match_count, skipped_small_matches);
+			fflush(stdout);
 		}
 	}
-	delta->new_size = calculated_new_size;
 
-	return delta;
+	*skipped = skipped_small_matches;
+	return match_count;
 }
 
 /**
- * @brief Main delta creation function implementing three-tier compression strategy
+ * @brief Creates a delta using the working memory of a context
  *
- * Creates a delta between two files using a sophisticated three-tier approach
- * that automatically chooses the best compression strategy based on the nature
- * of changes. This is the primary entry point for delta compression.
- *
- * The algorithm uses three strategies:
- * 1. Simple approach: For small end-of-file changes (95%+ identical)
- * 2. Chunk-based approach: For small changes anywhere in the file (<1% of file)
- * 3. Rolling hash algorithm: For complex changes with rsync-like pattern matching
+ * Chooses between the same three strategies as delta_create() and returns
+ * the same operations, but builds them in the context instead of
+ * allocating them. The index of the original, the rolling hash, the match
+ * array and the operation array are all reused from the previous call and
+ * only grow when the files are larger than any diffed before; the index is
+ * emptied by clearing just the buckets the previous call filled.
  *
+ * @param context Context from delta_context_new(). Must not be NULL.
  * @param original_data Pointer to the original file data
  * @param original_size Size of the original file in bytes
  * @param new_data Pointer to the new file data
  * @param new_size Size of the new file in bytes
  *
- * @return Pointer to DeltaInfo structure containing the delta operations on success,
- *         NULL on failure. The caller is responsible for freeing the delta with delta_free().
+ * @return Pointer to the delta on success, NULL on failure. The delta
+ *         belongs to the context: do not pass it to delta_free().
  *
- * @note The function automatically chooses the most efficient compression strategy.
- *
- * @note For large files (>50MB), the algorithm uses more aggressive optimization
- *       to prevent excessive memory usage and processing time.
- *
- * @note The function includes progress reporting and detailed logging for monitoring.
+ * @note The delta stays valid until the next call on the context, and its
+ *       INSERT operations point into new_data rather than holding copies, so
+ *       new_data must outlive it too.
  *
  * @example
  * ```c
- * DeltaInfo *delta = delta_create(orig_data, orig_size, new_data, new_size);
- * if (delta != NULL) {
- *     // Use delta...
- *     delta_free(delta);
- * }
+ * const DeltaInfo *delta = delta_create_in(context, orig_data, orig_size, new_data, new_size);
+ * if (delta != NULL)
+ *     printf("%u operations\n", delta->operation_count);
  * ```
  */
-DeltaInfo * delta_create(const uint8_t *original_data, uint32_t original_size,
-			 const uint8_t *new_data, uint32_t new_size)
+const DeltaInfo * delta_create_in(DeltaContext *context, const uint8_t *original_data, uint32_t original_size,
+				  const uint8_t *new_data, uint32_t new_size)
 {
-	if (original_data == NULL || new_data == NULL)
+	if (context == NULL || original_data == NULL || new_data == NULL)
 		return NULL;
 
+	DeltaInfo *delta = &context->delta;
+	delta->original_size = original_size;
+	delta->new_size = new_size;
+	delta->operation_count = 0;
+	delta->operations = context->operations;
+	delta->delta_size = 0;
+
 	// For small changes, use a simple approach
 	if (new_size > original_size && (new_size - original_size) < 1000) {
 		// Small addition - check if it's just appended data
@@ -629,43 +731,18 @@ DeltaInfo * delta_create(const uint8_t *original_data, uint32_t original_size,
 
 		// If most of the file is identical, use simple approach
 		if (common_prefix > original_size * 0.95) { // 95% identical
-			printf("Detected small change (%.1f%% identical) - using simple approach\n",
-			       (common_prefix * 100.0) / original_size);
-
-			DeltaInfo *delta = malloc(sizeof(DeltaInfo));
-			if (delta == NULL) return NULL;
+			storage_log("Detected small change (%.1f%% identical) - using simple approach\n",
+				    (common_prefix * 100.0) / original_size);
 
-			delta->original_size = original_size;
-			delta->new_size = new_size;
-			delta->operation_count = 2; // COPY + INSERT
-			delta->delta_size = new_size - common_prefix;
-
-			delta->operations = malloc(2 * sizeof(DeltaOperation));
-			if (delta->operations == NULL) {
-				free(delta);
+			if (reserve_operations(context, 2) != EXIT_SUCCESS)
 				return NULL;
-			}
 
-			// COPY operation for the common prefix
-			delta->operations[0].type = DELTA_COPY;
-			delta->operations[0].offset = 0;
-			delta->operations[0].length = common_prefix;
-			delta->operations[0].data = NULL;
-
-			// INSERT operation for the new data
+			// COPY the common prefix, then INSERT the new data
 			uint32_t insert_length = new_size - common_prefix;
-			delta->operations[1].type = DELTA_INSERT;
-			delta->operations[1].offset = 0;
-			delta->operations[1].length = insert_length;
-			delta->operations[1].data = malloc(insert_length);
-			if (delta->operations[1].data == NULL) {
-				free(delta->operations);
-				free(delta);
-				return NULL;
-			}
-			memcpy(delta->operations[1].data, new_data + common_prefix, insert_length);
+			add_operation(delta, DELTA_COPY, 0, common_prefix, NULL);
+			add_operation(delta, DELTA_INSERT, 0, insert_length, new_data + common_prefix);
 
-			printf("Simple delta: COPY %u bytes + INSERT %u bytes\n", common_prefix, insert_length);
+			storage_log("Simple delta: COPY %u bytes + INSERT %u bytes\n", common_prefix, insert_length);
 			return delta;
 		}
 	}
@@ -703,100 +780,54 @@ DeltaInfo * delta_create(const uint8_t *original_data, uint32_t original_size,
 	int change_size_less_than_1_percent = change_size < original_size * 0.01;
 	if (total_identical_bytes > original_size * 0.8 || change_size_less_than_1_percent) {
 		if (change_size_less_than_1_percent)
-			printf("Detected small change (%u bytes, %.3f%% of file) - using chunk-based approach\n",
-			       change_size, (change_size * 100.0) / original_size);
+			storage_log("Detected small change (%u bytes, %.3f%% of file) - using chunk-based approach\n",
+				    change_size, (change_size * 100.0) / original_size);
 		else
-			printf("Detected large matching chunks (%.1f%% identical) - using chunk-based approach\n",
-			       (total_identical_bytes * 100.0) / original_size);
-
-		DeltaInfo *delta = malloc(sizeof(DeltaInfo));
-		if (delta == NULL) return NULL;
-
-		delta->original_size = original_size;
-		delta->new_size = new_size;
-		delta->operation_count = 0;
-		delta->delta_size = 0;
-		delta->operations = NULL;
-
-		// Allocate operations array (we'll need at most 4 operations: COPY + INSERT + COPY)
-		uint32_t operations_capacity = 4;
-		delta->operations = malloc(operations_capacity * sizeof(DeltaOperation));
-		if (delta->operations == NULL) {
-			free(delta);
+			storage_log("Detected large matching chunks (%.1f%% identical) - using chunk-based approach\n",
+				    (total_identical_bytes * 100.0) / original_size);
+
+		// At most COPY + INSERT + COPY
+		if (reserve_operations(context, 3) != EXIT_SUCCESS)
 			return NULL;
-		}
 
 		// COPY operation for the common prefix
-		if (common_prefix > 0) {
-			delta->operations[delta->operation_count].type = DELTA_COPY;
-			delta->operations[delta->operation_count].offset = 0;
-			delta->operations[delta->operation_count].length = common_prefix;
-			delta->operations[delta->operation_count].data = NULL;
-			delta->operation_count++;
-		}
+		if (common_prefix > 0)
+			add_operation(delta, DELTA_COPY, 0, common_prefix, NULL);
 
 		// INSERT operation for the middle part (if any)
 		uint32_t middle_start = common_prefix;
 		uint32_t middle_end = new_size - common_suffix;
-		if (middle_start < middle_end) {
-			uint32_t insert_length = middle_end - middle_start;
-			delta->operations[delta->operation_count].type = DELTA_INSERT;
-			delta->operations[delta->operation_count].offset = 0;
-			delta->operations[delta->operation_count].length = insert_length;
-			delta->operations[delta->operation_count].data = malloc(insert_length);
-			if (delta->operations[delta->operation_count].data == NULL) {
-				// Cleanup on error
-				for (uint32_t i = 0; i < delta->operation_count; i++)
-					if (delta->operations[i].data != NULL)
-						free(delta->operations[i].data);
-				free(delta->operations);
-				free(delta);
-				return NULL;
-			}
-			memcpy(delta->operations[delta->operation_count].data, new_data + middle_start, insert_length);
-			delta->delta_size += insert_length;
-			delta->operation_count++;
-		}
+		if (middle_start < middle_end)
+			add_operation(delta, DELTA_INSERT, 0, middle_end - middle_start, new_data + middle_start);
 
 		// COPY operation for the common suffix
-		if (common_suffix > 0) {
-			delta->operations[delta->operation_count].type = DELTA_COPY;
-			delta->operations[delta->operation_count].offset = original_size - common_suffix;
-			delta->operations[delta->operation_count].length = common_suffix;
-			delta->operations[delta->operation_count].data = NULL;
-			delta->operation_count++;
-		}
+		if (common_suffix > 0)
+			add_operation(delta, DELTA_COPY, original_size - common_suffix, common_suffix, NULL);
 
-		printf("Chunk-based delta: %u operations, %u bytes\n", delta->operation_count, delta->delta_size);
+		storage_log("Chunk-based delta: %u operations, %u bytes\n", delta->operation_count, delta->delta_size);
 		return delta;
 	}
 
 	// Algorithm parameters for complex changes
-	uint32_t window_size = 32;      // Sliding window size (increased for better performance)
-	uint32_t min_match_length = 32; // Minimum match length to consider (increased to reduce noise)
-	uint32_t bucket_count = 65536;  // Hash table size (increased for better distribution)
-
-	printf("Creating delta...\n");
-	printf("Original size: %u bytes\n", original_size);
-	printf("New size: %u bytes\n", new_size);
-	printf("Window size: %u bytes\n", window_size);
-	printf("Min match length: %u bytes\n", min_match_length);
+	uint32_t window_size = DELTA_WINDOW_SIZE;    // Sliding window size (increased for better performance)
+	uint32_t min_match_length = 32;             // Minimum match length to consider (increased to reduce noise)
 
-	// Memory management is now handled with simple malloc/free
+	storage_log("Creating delta...\n");
+	storage_log("Original size: %u bytes\n", original_size);
+	storage_log("New size: %u bytes\n", new_size);
+	storage_log("Window size: %u bytes\n", window_size);
+	storage_log("Min match length: %u bytes\n", min_match_length);
 
 	// Step 1: Build hash table from original file
-	HashTable *ht = hash_table_new(bucket_count);
-	if (ht == NULL) {
-		printf("Failed to create hash table\n");
+	if (index_prepare(context, original_size >= window_size ? original_size - window_size + 1 : 0) !=
+	    EXIT_SUCCESS) {
+		storage_log("Failed to create hash table\n");
 		return NULL;
 	}
 
-	printf("Building hash table from original file...\n");
-	RollingHash *rh = rolling_hash_new(window_size);
-	if (rh == NULL) {
-		hash_table_free(ht);
-		return NULL;
-	}
+	storage_log("Building hash table from original file...\n");
+	RollingHash *rh = &context->hash;
+	rolling_hash_reset(rh);
 
 	// Process original file with sliding window
 	uint32_t progress_interval = original_size / 200; // Report every 0.5%
@@ -808,41 +839,23 @@ DeltaInfo * delta_create(const uint8_t *original_data, uint32_t original_size,
 		if (i >= window_size - 1) {
 			uint32_t hash = rolling_hash_get(rh);
 			uint32_t offset = i - window_size + 1;
-			hash_table_insert(ht, hash, offset);
+			index_insert(context, hash, offset);
 		}
 
 		// Progress reporting
 		if (i % progress_interval == 0) {
 			uint32_t progress_percent = (uint32_t)((i * 100ULL) / original_size);
-			printf("\rProgress: %u%% (%u/%u bytes)",
-			       progress_percent, i, original_size);
+			storage_log("\rProgress: %u%% (%u/%u bytes)",
+				    progress_percent, i, original_size);
 			fflush(stdout);
 		}
 	}
-	printf("\n");
+	storage_log("\n");
 
-	printf("Hash table built with %u entries\n", ht->entry_count);
-	rolling_hash_free(rh);
+	storage_log("Hash table built with %u entries\n", context->index.entry_count);
 
 	// Step 2: Find matches in new file
-	printf("Finding matches in new file...\n");
-	DeltaState *state = delta_state_new(100);
-	if (state == NULL) {
-		hash_table_free(ht);
-		return NULL;
-	}
-
-	// Create rolling hash once and reuse it
-	RollingHash *match_rh = rolling_hash_new(window_size);
-	if (match_rh == NULL) {
-		delta_state_free(state);
-		hash_table_free(ht);
-		return NULL;
-	}
-
-	uint32_t match_count = 0;
-	uint32_t match_progress_interval = new_size / 1000; // Report every 0.1% for more frequent updates
-	if (match_progress_interval == 0) match_progress_interval = 1;
+	storage_log("Finding matches in new file...\n");
 
 	// Cost-benefit analysis: minimum match length that provides compression benefit
 	// For a match to be worthwhile, it should save more bytes than the overhead of storing it
@@ -856,186 +869,137 @@ DeltaInfo * delta_create(const uint8_t *original_data, uint32_t original_size,
 		min_beneficial_match_length = 32;       // More reasonable for large files
 	else if (new_size > 10 * 1024 * 1024)           // 10MB+
 		min_beneficial_match_length = 16;       // More reasonable for medium files
-	uint32_t skipped_small_matches = 0;
 
-	printf("Using minimum beneficial match length: %u bytes (file size: %u bytes)\n",
-	       min_beneficial_match_length, new_size);
+	storage_log("Using minimum beneficial match length: %u bytes (file size: %u bytes)\n",
+		    min_beneficial_match_length, new_size);
 
-	// Process new file with sliding window
-	uint32_t i = 0;
-	uint32_t last_match_end = 0; // Track the end of the last match to prevent overlaps
-	while (i < new_size) {
-		// Skip positions that are already covered by previous matches
-		if (i < last_match_end) {
-			i++;
-			continue;
-		}
+	uint32_t skipped_small_matches = 0;
+	uint32_t match_count = find_matches(context, original_data, original_size, new_data, new_size,
+					    min_match_length, min_beneficial_match_length, &skipped_small_matches, 1);
 
-		// Find best match starting at position i
-		Match *match = find_best_match_optimized(original_data, original_size,
-							 new_data, new_size, ht, window_size,
-							 i, min_match_length, match_rh);
+	// Final progress report
+	storage_log("\rFinding matches: 100%% (%u/%u bytes) - Found %u matches, skipped %u small\n",
+		    new_size, new_size, match_count, skipped_small_matches);
 
-		if (match != NULL) {
-			// Cost-benefit analysis: only use matches that provide real compression benefit
-			if (match->length >= min_beneficial_match_length) {
-				// Check if this match overlaps with the previous match
-				if (match->new_offset >= last_match_end) {
-					// Add match to state
-					if (delta_state_add_match(state, match->original_offset,
-								  match->new_offset, match->length) == 0) {
-						match_count++;
-						if (match_count <= 10) { // Only show first 10 matches to avoid spam
-							printf("  Match %u: original[%u:%u] -> new[%u:%u] (length=%u)\n",
-							       match_count, match->original_offset,
-							       match->original_offset + match->length - 1,
-							       match->new_offset, match->new_offset + match->length - 1,
-							       match->length);
-						}
-					}
+	storage_log("Match finding completed - Used %u beneficial matches, skipped %u small matches\n",
+		    match_count, skipped_small_matches);
 
-					// Update last match end and skip ahead by match length
-					last_match_end = match->new_offset + match->length;
-					i += match->length;
-				} else {
-					// Match overlaps with previous match, skip it
-					skipped_small_matches++;
-					i++;
-				}
-			} else {
-				// Skip small matches that don't provide compression benefit
-				skipped_small_matches++;
-				// Move forward by 1 byte for small matches
-				i++;
-			}
-			free(match);
-		} else {
-			// No match found, move forward by 1 byte
-			i++;
-		}
+	// If we have very few matches, try a more lenient approach
+	if (match_count < 10 && new_size > 1024 * 1024) { // Less than 10 matches for files > 1MB
+		storage_log("Too few matches found, trying more lenient approach...\n");
 
-		// Progress reporting
-		if (i % match_progress_interval == 0) {
-			uint32_t progress_percent = (uint32_t)((i * 100ULL) / new_size);
-			printf("\rFinding matches: %u%% (%u/%u bytes) - Found %u matches, skipped %u small",
-			       progress_percent, i, new_size, match_count, skipped_small_matches);
-			fflush(stdout);
-		}
-	}
+		// Search again with a more lenient minimum beneficial match length; its matches replace the first ones
+		uint32_t lenient_skipped = 0;
+		uint32_t lenient_match_count = find_matches(context, original_data, original_size, new_data, new_size,
+							    min_match_length, 32, &lenient_skipped, 0);
 
-	// Final progress report
-	printf("\rFinding matches: 100%% (%u/%u bytes) - Found %u matches, skipped %u small\n",
-	       new_size, new_size, match_count, skipped_small_matches);
+		storage_log("Lenient approach found %u matches, skipped %u small\n",
+			    lenient_match_count, lenient_skipped);
+	}
 
-	rolling_hash_free(match_rh);
+	// Step 3: Create delta operations
+	storage_log("Creating delta operations...\n");
+	if (build_operations(context, new_data, new_size) != EXIT_SUCCESS)
+		return NULL;
 
-	printf("Match finding completed - Used %u beneficial matches, skipped %u small matches\n",
-	       match_count, skipped_small_matches);
+	storage_log("Delta created with %u operations\n", delta->operation_count);
+	storage_log("Delta size: %u bytes\n", delta->delta_size);
 
-	// If we have very few matches, try a more lenient approach
-	if (match_count < 10 && new_size > 1024 * 1024) { // Less than 10 matches for files > 1MB
-		printf("Too few matches found, trying more lenient approach...\n");
+	// Calculate compression ratio
+	float compression_ratio = (float)delta->delta_size / new_size * 100.0f;
+	storage_log("Compression ratio: %.1f%%\n", compression_ratio);
 
-		// Reset and try again with more lenient parameters
-		delta_state_free(state);
-		state = delta_state_new(1000);
+	return delta;
+}
 
-		// Create a new rolling hash for the lenient approach
-		RollingHash *lenient_rh = rolling_hash_new(window_size);
-		if (lenient_rh == NULL) {
-			printf("Failed to create rolling hash for lenient approach\n");
-			// Continue with original state
-		} else {
-			// Try again with lower minimum beneficial match length
-			uint32_t lenient_min_beneficial = 32; // More lenient
-			uint32_t lenient_match_count = 0;
-			uint32_t lenient_skipped = 0;
-
-			// Process new file with more lenient parameters
-			uint32_t lenient_i = 0;
-			uint32_t lenient_last_match_end = 0;
-
-			while (lenient_i < new_size) {
-				// Skip positions that are already covered by previous matches
-				if (lenient_i < lenient_last_match_end) {
-					lenient_i++;
-					continue;
-				}
+// Copies a delta built in a context into memory of its own, freed with delta_free()
+static DeltaInfo * delta_copy(const DeltaInfo *source)
+{
+	if (source == NULL)
+		return NULL;
 
-				// Find best match starting at position i
-				Match *match = find_best_match_optimized(original_data, original_size,
-									 new_data, new_size, ht, window_size,
-									 lenient_i, min_match_length, lenient_rh);
-
-				if (match != NULL) {
-					// More lenient cost-benefit analysis
-					if (match->length >= lenient_min_beneficial) {
-						// Check if this match overlaps with the previous match
-						if (match->new_offset >= lenient_last_match_end) {
-							// Add match to state
-							if (delta_state_add_match(state, match->original_offset,
-										  match->new_offset, match->length) == 0) {
-								lenient_match_count++;
-								if (lenient_match_count <= 10) {
-									printf("  Lenient Match %u: original[%u:%u] -> new[%u:%u] (length=%u)\n",
-									       lenient_match_count, match->original_offset,
-									       match->original_offset + match->length - 1,
-									       match->new_offset, match->new_offset + match->length - 1,
-									       match->length);
-								}
-							}
-
-							// Update last match end and skip ahead by match length
-							lenient_last_match_end = match->new_offset + match->length;
-							lenient_i += match->length;
-						} else {
-							// Match overlaps with previous match, skip it
-							lenient_skipped++;
-							lenient_i++;
-						}
-					} else {
-						// Skip small matches that don't provide compression benefit
-						lenient_skipped++;
-						lenient_i++;
-					}
-					free(match);
-				} else {
-					// No match found, move forward by 1 byte
-					lenient_i++;
-				}
-			}
+	DeltaInfo *delta = malloc(sizeof(DeltaInfo));
+	if (delta == NULL)
+		return NULL;
 
-			printf("Lenient approach found %u matches, skipped %u small\n",
-			       lenient_match_count, lenient_skipped);
+	*delta = *source;
+	delta->operation_count = 0;
+	delta->operations = malloc((source->operation_count > 0 ? source->operation_count : 1) *
+				   sizeof(DeltaOperation));
+	if (delta->operations == NULL) {
+		free(delta);
+		return NULL;
+	}
 
-			// Use the lenient results if they're better
-			if (lenient_match_count > match_count) {
-				match_count = lenient_match_count;
-				skipped_small_matches = lenient_skipped;
-			}
+	for (uint32_t i = 0; i < source->operation_count; i++) {
+		DeltaOperation *op = &delta->operations[i];
+		*op = source->operations[i];
+		delta->operation_count++;
+		if (op->data == NULL)
+			continue;
 
-			rolling_hash_free(lenient_rh);
+		op->data = malloc(op->length);
+		if (op->data == NULL) {
+			delta_free(delta);
+			return NULL;
 		}
+		memcpy(op->data, source->operations[i].data, op->length);
 	}
 
-	// Step 3: Create delta operations
-	printf("Creating delta operations...\n");
-	DeltaInfo *delta = create_delta_operations(original_data, original_size,
-						   new_data, new_size, state);
-
-	if (delta != NULL) {
-		printf("Delta created with %u operations\n", delta->operation_count);
-		printf("Delta size: %u bytes\n", delta->delta_size);
+	return delta;
+}
 
-		// Calculate compression ratio
-		float compression_ratio = (float)delta->delta_size / new_size * 100.0f;
-		printf("Compression ratio: %.1f%%\n", compression_ratio);
-	}
+/**
+ * @brief Main delta creation function implementing three-tier compression strategy
+ *
+ * Creates a delta between two files using a sophisticated three-tier approach
+ * that automatically chooses the best compression strategy based on the nature
+ * of changes. This is the primary entry point for delta compression.
+ *
+ * The algorithm uses three strategies:
+ * 1. Simple approach: For small end-of-file changes (95%+ identical)
+ * 2. Chunk-based approach: For small changes anywhere in the file (<1% of file)
+ * 3. Rolling hash algorithm: For complex changes with rsync-like pattern matching
+ *
+ * @param original_data Pointer to the original file data
+ * @param original_size Size of the original file in bytes
+ * @param new_data Pointer to the new file data
+ * @param new_size Size of the new file in bytes
+ *
+ * @return Pointer to DeltaInfo structure containing the delta operations on success,
+ *         NULL on failure. The caller is responsible for freeing the delta with delta_free().
+ *
+ * @note The function automatically chooses the most efficient compression strategy.
+ *
+ * @note For large files (>50MB), the algorithm uses more aggressive optimization
+ *       to prevent excessive memory usage and processing time.
+ *
+ * @note The function includes progress reporting and detailed logging for monitoring.
+ *
+ * @note Diffing many files one after another is cheaper with one
+ *       DeltaContext and delta_create_in(), which this function wraps.
+ *
+ * @example
+ * ```c
+ * DeltaInfo *delta = delta_create(orig_data, orig_size, new_data, new_size);
+ * if (delta != NULL) {
+ *     // Use delta...
+ *     delta_free(delta);
+ * }
+ * ```
+ */
+DeltaInfo * delta_create(const uint8_t *original_data, uint32_t original_size,
+			 const uint8_t *new_data, uint32_t new_size)
+{
+	if (original_data == NULL || new_data == NULL)
+		return NULL;
 
-	// Cleanup
-	delta_state_free(state);
-	hash_table_free(ht);
+	DeltaContext *context = delta_context_new();
+	if (context == NULL)
+		return NULL;
 
+	DeltaInfo *delta = delta_copy(delta_create_in(context, original_data, original_size, new_data, new_size));
+	delta_context_free(context);
 	return delta;
 }
 
@@ -1096,38 +1060,38 @@ void delta_free(DeltaInfo *delta)
 void print_delta_info(const DeltaInfo *delta)
 {
 	if (delta == NULL) {
-		printf("Delta is NULL\n");
+		storage_log("Delta is NULL\n");
 		return;
 	}
 
-	printf("\n=== Delta Information ===\n");
-	printf("Original size: %u bytes\n", delta->original_size);
-	printf("New size: %u bytes\n", delta->new_size);
-	printf("Operation count: %u\n", delta->operation_count);
-	printf("Delta size: %u bytes\n", delta->delta_size);
-	printf("Compression ratio: %.1f%%\n",
+	storage_log("\n=== Delta Information ===\n");
+	storage_log("Original size: %u bytes\n", delta->original_size);
+	storage_log("New size: %u bytes\n", delta->new_size);
+	storage_log("Operation count: %u\n", delta->operation_count);
+	storage_log("Delta size: %u bytes\n", delta->delta_size);
+	storage_log("Compression ratio: %.1f%%\n",
 	       (float)delta->delta_size / delta->new_size * 100.0f);
 
-	printf("\nOperations:\n");
+	storage_log("\nOperations:\n");
 	for (uint32_t i = 0; i < delta->operation_count; i++) {
 		const DeltaOperation *op = &delta->operations[i];
 
 		switch (op->type) {
 		case DELTA_COPY:
-			printf("  %u: COPY original[%u:%u] (length=%u)\n",
+			storage_log("  %u: COPY original[%u:%u] (length=%u)\n",
 			       i, op->offset, op->offset + op->length - 1, op->length);
 			break;
 		case DELTA_INSERT:
-			printf("  %u: INSERT %u bytes: ", i, op->length);
+			storage_log("  %u: INSERT %u bytes: ", i, op->length);
 			// Print first few bytes as hex
 			for (uint32_t j = 0; j < op->length && j < 16; j++)
-				printf("%02X ", op->data[j]);
+				storage_log("%02X ", op->data[j]);
 			if (op->length > 16)
-				printf("...");
-			printf("\n");
+				storage_log("...");
+			storage_log("\n");
 			break;
 		case DELTA_REPLACE:
-			printf("  %u: REPLACE original[%u:%u] with %u bytes\n",
+			storage_log("  %u: REPLACE original[%u:%u] with %u bytes\n",
 			       i, op->offset, op->offset + op->length - 1, op->length);
 			break;
 		}
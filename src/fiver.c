@@ -22,21 +22,39 @@
  * - history: Display version history
  * - list: List all tracked files
  * - status: Show current file status
+ * - cat: Print a byte range of a stored version
+ * - migrate: Move loose version files into per-file packs
+ * - export: Write every version of a file to a directory
+ * - fsck: Check the integrity of stored versions
+ * - stats: Report storage and restore statistics
+ * - watch: Track files as they change
+ * - serve: Answer commands from a warm server process
  *
  * @author Fiver Development Team
  * @version 1.0
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <stdarg.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fnmatch.h>
 #include <ctype.h>
 #include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include "delta_structures.h"
 #include <errno.h>
 
@@ -47,11 +65,18 @@
 #define FIVER_VERSION "1.0.0"
 #define FIVER_DESCRIPTION "A fast file versioning system using delta compression"
 
+// Quiet time in milliseconds before a burst of changes is tracked
+#define WATCH_DEBOUNCE_MS 200
+
+// Memory in MiB for the versions a watcher keeps between changes
+#define WATCH_CACHE_MB 64
+
 // Command structure
 typedef struct {
 	const char *	name;
 	const char *	description;
 	int (*handler)(int argc, char *argv[]);
+	int		served;                 // Forwarded to a running server when one listens
 } Command;
 
 // Forward declarations for command handlers
@@ -61,16 +86,30 @@ int cmd_restore(int argc, char *argv[]);
 int cmd_history(int argc, char *argv[]);
 int cmd_list(int argc, char *argv[]);
 int cmd_status(int argc, char *argv[]);
+int cmd_cat(int argc, char *argv[]);
+int cmd_migrate(int argc, char *argv[]);
+int cmd_export(int argc, char *argv[]);
+int cmd_fsck(int argc, char *argv[]);
+int cmd_stats(int argc, char *argv[]);
+int cmd_watch(int argc, char *argv[]);
+int cmd_serve(int argc, char *argv[]);
 
 // Global command table
 static const Command commands[] = {
-	{ "track",   "Track a new version of a file",	     cmd_track	 },
-	{ "diff",    "Show differences between versions",    cmd_diff	 },
-	{ "restore", "Restore a file to a specific version", cmd_restore },
-	{ "history", "Show version history of a file",	     cmd_history },
-	{ "list",    "List all tracked files",		     cmd_list	 },
-	{ "status",  "Show current status of a file",	     cmd_status	 },
-	{ NULL,	     NULL,				     NULL	 } // End marker
+	{ "track",   "Track a new version of a file",	     cmd_track,   1 },
+	{ "diff",    "Show differences between versions",    cmd_diff,    0 },
+	{ "restore", "Restore a file to a specific version", cmd_restore, 1 },
+	{ "history", "Show version history of a file",	     cmd_history, 1 },
+	{ "list",    "List all tracked files",		     cmd_list,    0 },
+	{ "status",  "Show current status of a file",	     cmd_status,  1 },
+	{ "cat",     "Print a byte range of a stored version", cmd_cat,     1 },
+	{ "migrate", "Move loose version files into packs",  cmd_migrate, 0 },
+	{ "export",  "Write every version of a file to a directory", cmd_export,  0 },
+	{ "fsck",    "Check the integrity of stored versions", cmd_fsck,    0 },
+	{ "stats",   "Report storage and restore statistics", cmd_stats,   0 },
+	{ "watch",   "Track files as they change",	     cmd_watch,   0 },
+	{ "serve",   "Answer commands from a warm server process", cmd_serve,   0 },
+	{ NULL,	     NULL,				     NULL,        0 } // End marker
 };
 
 /**
@@ -184,6 +223,40 @@ void print_info(const char *format, ...)
 	va_end(args);
 }
 
+/**
+ * @brief Resolves the version a command operates on
+ *
+ * Replaces 0 with the latest version of the file and checks that any other
+ * version exists, printing an error if the file or version is unknown.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Tracked filename. Must not be NULL.
+ * @param version In: requested version, 0 for latest. Out: resolved version.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the version does not exist.
+ */
+static int resolve_version(StorageConfig *config, const char *filename, uint32_t *version)
+{
+	int latest_version = storage_latest_version(config, filename);
+
+	if (latest_version <= 0) {
+		print_error("No versions found for: %s", filename);
+		return EXIT_FAILURE;
+	}
+
+	if (*version == 0) {
+		*version = (uint32_t)latest_version;
+		return EXIT_SUCCESS;
+	}
+
+	if (manifest_find(config, filename, *version, NULL) != 1) {
+		print_error("Version %u not found for: %s", *version, filename);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
 /**
  * @brief Prints version information to stdout
  *
@@ -244,6 +317,8 @@ void print_usage(const char *program_name)
 	printf("  -v, --version  Show version information\n");
 	printf("  --verbose      Enable verbose output\n");
 	printf("  --quiet        Suppress non-error output\n");
+	printf("  --durability <level>  Flush writes: none, batch (default) or strict\n");
+	printf("  --verify       Check rebuilt versions against their content hash\n");
 
 	printf("\nExamples:\n");
 	printf("  %s track document.pdf\n", program_name);
@@ -252,6 +327,13 @@ void print_usage(const char *program_name)
 	printf("  %s history document.pdf\n", program_name);
 	printf("  %s list\n", program_name);
 	printf("  %s status document.pdf\n", program_name);
+	printf("  %s cat document.pdf --version 2 --range 0:4096\n", program_name);
+	printf("  %s migrate\n", program_name);
+	printf("  %s export document.pdf --all-versions --output-dir audit\n", program_name);
+	printf("  %s fsck --jobs 8\n", program_name);
+	printf("  %s stats --top 10\n", program_name);
+	printf("  %s watch -r src\n", program_name);
+	printf("  %s serve --jobs 4\n", program_name);
 
 	printf("\nFor more information about a command, run:\n");
 	printf("  %s <command> --help\n", program_name);
@@ -306,13 +388,23 @@ void print_command_help(const char *command_name)
 	// Command-specific help
 	if (strcmp(command_name, "track") == 0) {
 		printf("Arguments:\n");
-		printf("  <file>        Path to the file to track\n\n");
+		printf("  <file|dir>... Paths of the files (or, with --recursive, directories) to track\n\n");
 		printf("Options:\n");
 		printf(
 			"  --message, -m <msg>  Add a custom message for this version (max 255 characters)\n");
+		printf("  --recursive, -r      Track every regular file under the given directories\n");
+		printf("  --include <glob>     Only track files found in directories that match (repeatable)\n");
+		printf("  --exclude <glob>     Skip matching files and directories (repeatable)\n");
+		printf("  --jobs, -j <N>       Track N files at a time (default: number of CPUs)\n");
+		printf("  --json               Print one JSON object per file instead of a summary\n");
+		printf("  --durability <level> none: leave flushing to the kernel\n");
+		printf("                       batch: flush all files with one barrier at the end (default)\n");
+		printf("                       strict: flush every version as it is stored\n\n");
 		printf("Examples:\n");
 		printf("  fiver track document.pdf\n");
 		printf("  fiver track document.pdf --message \"Added new chapter\"\n");
+		printf("  fiver track *.conf --durability batch\n");
+		printf("  fiver track /etc/app --recursive --include '*.conf' --exclude '*.bak' --jobs 8\n");
 	} else if (strcmp(command_name, "diff") == 0) {
 		printf("Arguments:\n");
 		printf("  <file>        Path to the tracked file\n\n");
@@ -329,14 +421,26 @@ void print_command_help(const char *command_name)
 		printf("  <file>        Path to the tracked file\n\n");
 		printf("Options:\n");
 		printf("  --version <N>    Restore to specific version (default: latest)\n");
-		printf("  --output, -o <path>  Output file path (default: original path)\n");
+		printf("  --output, -o <path>  Output file path (default: original path), - for stdout\n");
 		printf("  --force          Overwrite existing file\n");
+		printf("  --verify         Refuse to restore contents that do not match their hash\n");
 		printf("  --json           Output in JSON format\n\n");
+		printf("Whole-tree options:\n");
+		printf("  --all                Restore every tracked file instead of one\n");
+		printf("  --output-dir <dir>   Directory the files are restored under (required)\n");
+		printf("  --at <time>          Newest version at or before the time, given as seconds\n");
+		printf("                       since the epoch or \"YYYY-MM-DD [HH:MM[:SS]]\" (local)\n");
+		printf("  --version-map <file> Restore the \"<file> <version>\" pairs listed in the file\n");
+		printf("  --include <glob>     Only restore matching files (repeatable)\n");
+		printf("  --exclude <glob>     Skip matching files (repeatable)\n");
+		printf("  --jobs, -j <N>       Restore N files at a time (default: number of CPUs)\n\n");
 		printf("Examples:\n");
 		printf("  fiver restore document.pdf\n");
 		printf("  fiver restore document.pdf --version 2\n");
 		printf("  fiver restore document.pdf --version 1 --force\n");
 		printf("  fiver restore document.pdf --version 2 --output old_version.pdf\n");
+		printf("  fiver restore backup.tar --output - | gzip > backup.tar.gz\n");
+		printf("  fiver restore --all --at \"2024-05-01 12:00\" --output-dir snapshot --jobs 8\n");
 	} else if (strcmp(command_name, "history") == 0) {
 		printf("Arguments:\n");
 		printf("  <file>        Path to the tracked file\n\n");
@@ -364,6 +468,91 @@ void print_command_help(const char *command_name)
 		printf("Examples:\n");
 		printf("  fiver status document.pdf\n");
 		printf("  fiver status document.pdf --json\n");
+	} else if (strcmp(command_name, "cat") == 0) {
+		printf("Arguments:\n");
+		printf("  <file>        Path to the tracked file\n\n");
+		printf("Options:\n");
+		printf("  --version <N>        Read from version N (default: latest)\n");
+		printf("  --range <off:len>    Read len bytes starting at off (default: whole file)\n\n");
+		printf("Examples:\n");
+		printf("  fiver cat document.pdf\n");
+		printf("  fiver cat document.pdf --version 2 --range 0:4096\n");
+		printf("  fiver cat app.log --range 1048576:65536\n");
+	} else if (strcmp(command_name, "migrate") == 0) {
+		printf("Moves versions stored as loose <file>_vN.delta/.meta files into\n");
+		printf("one pack per tracked file. Safe to run more than once.\n\n");
+		printf("Options:\n");
+		printf("  --json               Output in JSON format\n\n");
+		printf("Examples:\n");
+		printf("  fiver migrate\n");
+	} else if (strcmp(command_name, "export") == 0) {
+		printf("Arguments:\n");
+		printf("  <file>        Path to the tracked file\n\n");
+		printf("Rebuilds every version with one pass over the delta chain and\n");
+		printf("writes version N to <dir>/<name>.vN.\n\n");
+		printf("Options:\n");
+		printf("  --all-versions       Export versions 1 to latest (required)\n");
+		printf("  --output-dir <dir>   Directory the versions are written to (required)\n");
+		printf("  --force              Overwrite existing files\n");
+		printf("  --json               Output in JSON format\n\n");
+		printf("Examples:\n");
+		printf("  fiver export document.pdf --all-versions --output-dir audit\n");
+	} else if (strcmp(command_name, "fsck") == 0) {
+		printf("Arguments:\n");
+		printf("  [file]...     Tracked files to check (default: every tracked file)\n\n");
+		printf("Checks that every stored delta parses and matches its checksum, that\n");
+		printf("every operation stays within the version it applies to, and that every\n");
+		printf("version rebuilds to contents matching its hash.\n\n");
+		printf("Options:\n");
+		printf("  --jobs, -j <N>       Check N files at a time (default: number of CPUs)\n");
+		printf("  --json               Print one JSON object per file\n\n");
+		printf("Examples:\n");
+		printf("  fiver fsck\n");
+		printf("  fiver fsck --jobs 8 --json\n");
+	} else if (strcmp(command_name, "stats") == 0) {
+		printf("Arguments:\n");
+		printf("  [file]...     Tracked files to report on (default: every tracked file)\n\n");
+		printf("Reads only the catalog and manifests. The delta ratio of a version is\n");
+		printf("the share of its bytes its delta inserts; files averaging 50%% or more\n");
+		printf("are flagged as poor candidates for delta versioning.\n\n");
+		printf("Options:\n");
+		printf("  --top <N>            Rank the N versions inserting the most bytes (default: 5)\n");
+		printf("  --json               Output in JSON format\n\n");
+		printf("Examples:\n");
+		printf("  fiver stats\n");
+		printf("  fiver stats --top 10 --json\n");
+	} else if (strcmp(command_name, "watch") == 0) {
+		printf("Arguments:\n");
+		printf("  <file|dir>... Files or directories to watch\n\n");
+		printf("Runs until interrupted. A file is tracked once it has been written and\n");
+		printf("closed, or renamed into place, and no further change has arrived for\n");
+		printf("the debounce interval. The latest version of every recently tracked\n");
+		printf("file is kept in memory, so its next version is not rebuilt from disk.\n\n");
+		printf("Options:\n");
+		printf("  --recursive, -r      Watch directories and the directories under them\n");
+		printf("  --include <glob>     Only track files in directories matching glob (repeatable)\n");
+		printf("  --exclude <glob>     Skip files and directories matching glob (repeatable)\n");
+		printf("  --debounce <ms>      Quiet time before a burst is tracked (default: %d)\n", WATCH_DEBOUNCE_MS);
+		printf("  --cache-mb <N>       Memory for versions kept between changes (default: %d)\n", WATCH_CACHE_MB);
+		printf("  --jobs, -j <N>       Track N files at a time (default: number of CPUs)\n");
+		printf("  --json               Print one JSON object per tracked file\n\n");
+		printf("Examples:\n");
+		printf("  fiver watch notes.txt\n");
+		printf("  fiver watch -r src --exclude '*.o' --debounce 500\n");
+	} else if (strcmp(command_name, "serve") == 0) {
+		printf("Runs until interrupted. While it listens, track, restore, cat, history\n");
+		printf("and status in this directory are run by the server, which keeps the\n");
+		printf("storage open and recently tracked versions in memory. Their output and\n");
+		printf("exit status are the same; without a server they run as usual.\n\n");
+		printf("Options:\n");
+		printf("  --socket <path>      Socket to listen on (default: $FIVER_SOCKET or .fiver/serve.sock)\n");
+		printf("  --jobs, -j <N>       Worker processes answering requests (default: number of CPUs)\n");
+		printf("  --cache-mb <N>       Memory per worker for kept versions (default: %d)\n\n", WATCH_CACHE_MB);
+		printf("Clients use $FIVER_SOCKET or .fiver/serve.sock; set FIVER_SOCKET to an\n");
+		printf("empty string to run commands without the server.\n\n");
+		printf("Examples:\n");
+		printf("  fiver serve --jobs 4\n");
+		printf("  FIVER_SOCKET=/run/fiver.sock fiver serve\n");
 	}
 }
 
@@ -371,44 +560,45 @@ void print_command_help(const char *command_name)
 static int verbose_flag = 0;
 static int quiet_flag = 0;
 static char *message_flag = NULL;
+static DurabilityLevel durability_flag = DURABILITY_BATCH;
+static int verify_flag = 0;
 
-/**
- * @brief Main entry point for the fiver application
- *
- * Parses command-line arguments, processes global options, and dispatches
- * commands to their respective handlers. This function implements the
- * complete command-line interface for the fiver file versioning system.
- *
- * @param argc Number of command-line arguments. Must be >= 1.
- * @param argv Array of command-line argument strings. Must not be NULL.
- *
- * @return EXIT_SUCCESS on successful command execution, EXIT_FAILURE on error.
- *
- * @note The function processes global options (--verbose, --quiet, --message)
- *       before dispatching to command handlers.
- *
- * @note Command help is handled by print_command_help() for individual commands.
- *
- * @note The function validates commands against the commands array.
- *
- * @example
- * ```c
- * // Command line: fiver track file.txt --message "Update"
- * int result = main(4, {"fiver", "track", "file.txt", "--message", "Update"});
- * ```
- */
-int main(int argc, char *argv[argc + 1])
+// Storage a server worker keeps open for every command it runs, NULL in other processes
+static StorageConfig *served_storage = NULL;
+
+// Opens the repository's storage with the durability and verification chosen on the command line
+static StorageConfig * open_storage(void)
 {
-	if (argc < 2) {
-		print_usage(argv[0]);
-		return EXIT_FAILURE;
-	}
+	StorageConfig *config = served_storage;
 
-	if (argv == NULL) {
-		fprintf(stderr, "fiver: error: Invalid argument array\n");
-		return EXIT_FAILURE;
+	// Commands tracking files on several workers turn parallel application off for themselves
+	if (config != NULL)
+		config->apply_threads = thread_pool_cpu_count();
+	else
+		config = storage_init("./.fiver");
+
+	if (config != NULL) {
+		config->durability = durability_flag;
+		config->verify_content = verify_flag;
 	}
+	return config;
+}
+
+// Releases storage from open_storage(); a server's storage stays open with its writes committed
+static void close_storage(StorageConfig *config)
+{
+	if (config != NULL && config == served_storage)
+		storage_commit(config);
+	else
+		storage_free(config);
+}
+
+// Runs a command line on a server listening for this directory, see cmd_serve()
+static int serve_forward(int argc, char *argv[], int *result);
 
+// Runs a command line in this process; argv[0] is the program name
+static int run_command_line(int argc, char *argv[])
+{
 	// Check for global options first
 	if (argv[1] != NULL && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0)) {
 		print_usage(argv[0]);
@@ -456,6 +646,13 @@ int main(int argc, char *argv[argc + 1])
 				cmd_argv[j] = cmd_argv[j + 1];
 			cmd_argc--;
 			i--; // Recheck this position
+		} else if (strcmp(cmd_argv[i], "--verify") == 0) {
+			verify_flag = 1;
+			// Remove from arguments
+			for (int j = i; j < cmd_argc - 1; j++)
+				cmd_argv[j] = cmd_argv[j + 1];
+			cmd_argc--;
+			i--; // Recheck this position
 		} else if (strcmp(cmd_argv[i], "--quiet") == 0) {
 			quiet_flag = 1;
 			// Remove from arguments
@@ -479,6 +676,18 @@ int main(int argc, char *argv[argc + 1])
 				cmd_argv[j] = cmd_argv[j + 2];
 			cmd_argc -= 2;
 			i--; // Recheck this position
+		} else if (strcmp(cmd_argv[i], "--durability") == 0) {
+			if (i + 1 >= cmd_argc ||
+			    storage_parse_durability(cmd_argv[i + 1], &durability_flag) != EXIT_SUCCESS) {
+				print_error("--durability requires none, batch or strict");
+				return EXIT_FAILURE;
+			}
+
+			// Remove both --durability and its value from arguments
+			for (int j = i; j < cmd_argc - 2; j++)
+				cmd_argv[j] = cmd_argv[j + 2];
+			cmd_argc -= 2;
+			i--; // Recheck this position
 		}
 	}
 
@@ -492,81 +701,145 @@ int main(int argc, char *argv[argc + 1])
 }
 
 /**
- * @brief Tracks a new version of a file
+ * @brief Main entry point for the fiver application
  *
- * Implements the "track" command which creates a new version of a file
- * using delta compression. This command reads the file, creates a delta
- * from the previous version (if any), and stores it in the storage system.
+ * Parses command-line arguments, processes global options, and dispatches
+ * commands to their respective handlers. This function implements the
+ * complete command-line interface for the fiver file versioning system.
  *
- * @param argc Number of command arguments. Must be >= 1.
- * @param argv Array of command arguments. Must not be NULL.
+ * @param argc Number of command-line arguments. Must be >= 1.
+ * @param argv Array of command-line argument strings. Must not be NULL.
  *
- * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ * @return EXIT_SUCCESS on successful command execution, EXIT_FAILURE on error.
  *
- * @note The function validates file existence, readability, and type.
+ * @note The function processes global options (--verbose, --quiet, --message,
+ *       --durability, --verify) before dispatching to command handlers.
  *
- * @note The function supports the --message option for commit messages.
+ * @note Command help is handled by print_command_help() for individual commands.
  *
- * @note File data is read entirely into memory for processing.
+ * @note Commands marked as served are forwarded to a "fiver serve" process
+ *       listening for the current directory, if there is one, and otherwise
+ *       run in this process.
+ *
+ * @note The function validates commands against the commands array.
  *
  * @example
  * ```c
- * char *args[] = {"file.txt", "--message", "Updated file"};
- * int result = cmd_track(3, args);
+ * // Command line: fiver track file.txt --message "Update"
+ * int result = main(4, {"fiver", "track", "file.txt", "--message", "Update"});
  * ```
  */
-int cmd_track(int argc, char *argv[])
+int main(int argc, char *argv[argc + 1])
 {
-	if (argc < 1) {
-		print_error("track: missing file argument");
-		printf("Usage: fiver track <file> [options]\n");
+	if (argc < 2) {
+		print_usage(argv[0]);
 		return EXIT_FAILURE;
 	}
 
-	const char *filename = argv[0];
-	if (verbose_flag)
+	if (argv == NULL) {
+		fprintf(stderr, "fiver: error: Invalid argument array\n");
+		return EXIT_FAILURE;
+	}
+
+	// A server listening for this directory runs the command with its storage already open
+	int result;
+	if (serve_forward(argc, argv, &result))
+		return result;
+
+	return run_command_line(argc, argv);
+}
+
+// Bytes read (and hashed) at a time while tracking a file
+#define TRACK_READ_CHUNK (256 * 1024)
+
+// Prints a storage message on the stream passed as context
+static void print_storage_message(const char *message, void *context)
+{
+	fputs(message, context);
+}
+
+// Sends storage messages to stderr while stdout carries results, or back to stdout
+static void storage_messages_to_stderr(int enable)
+{
+	fflush(stdout);
+	storage_set_log_handler(print_storage_message, enable ? stderr : stdout);
+}
+
+// Outcome of tracking one file
+typedef enum {
+	TRACK_STORED,                           // A new version was stored
+	TRACK_UNCHANGED,                        // The contents match the latest version
+	TRACK_FAILED                            // The file could not be tracked
+} TrackOutcome;
+
+// One file of a track run and, once tracked, its result
+typedef struct {
+	StorageConfig *	config;                 // Storage shared by every worker
+	const char *	path;                   // File to track
+	FileHead *	head;                   // Latest version kept in memory, NULL if none
+	int		json;                   // stdout carries JSON results, so no progress is printed
+	TrackOutcome	outcome;                // What happened
+	int		version;                // Version holding the contents
+	size_t		bytes;                  // Bytes read from the file
+	char		error[256];             // Reason for TRACK_FAILED
+} TrackJob;
+
+// Records why a file could not be tracked
+static void track_fail(TrackJob *job, const char *format, const char *path)
+{
+	job->outcome = TRACK_FAILED;
+	snprintf(job->error, sizeof(job->error), format, path);
+}
+
+// Tracks one file into open storage; safe to run on several threads at once
+static void track_one(void *arg)
+{
+	TrackJob *job = arg;
+	StorageConfig *config = job->config;
+	const char *filename = job->path;
+
+	if (verbose_flag && !job->json)
 		print_info("Tracking file: %s", filename);
 
 	// Check if file exists
 	if (access(filename, F_OK) != 0) {
-		print_error("File does not exist: %s", filename);
-		return EXIT_FAILURE;
+		track_fail(job, "File does not exist: %s", filename);
+		return;
 	}
 
 	// Check if file is readable
 	if (access(filename, R_OK) != 0) {
-		print_error("File is not readable: %s", filename);
-		return EXIT_FAILURE;
+		track_fail(job, "File is not readable: %s", filename);
+		return;
 	}
 
 	// Check if it's a regular file
 	struct stat st;
 	if (stat(filename, &st) != 0) {
-		print_error("Cannot access file: %s", filename);
-		return EXIT_FAILURE;
+		track_fail(job, "Cannot access file: %s", filename);
+		return;
 	}
 
 	if (!S_ISREG(st.st_mode)) {
-		print_error("Not a regular file: %s", filename);
-		return EXIT_FAILURE;
+		track_fail(job, "Not a regular file: %s", filename);
+		return;
 	}
 
-	// Initialize storage
-	StorageConfig *config = storage_init("./.fiver");
-	if (config == NULL) {
-		print_error("Failed to initialize storage");
-		return EXIT_FAILURE;
+	// A file whose stat matches the one recorded at its last track is not read at all
+	TrackedState state;
+	storage_tracked_state(&st, 0, &state);
+	int unchanged = storage_check_unchanged(config, filename, &state);
+	if (unchanged > 0) {
+		job->outcome = TRACK_UNCHANGED;
+		job->version = unchanged;
+		return;
 	}
 
-	if (verbose_flag)
-		print_info("Storage initialized: %s", config->storage_dir);
-
 	// Read the file data
 	FILE *file = fopen(filename, "rb");
 	if (file == NULL) {
-		print_error("Cannot open file: %s", filename);
-		storage_free(config);
-		return EXIT_FAILURE;
+		track_fail(job, "Cannot open file: %s", filename);
+		return;
 	}
 
 	// Get file size
@@ -575,874 +848,3717 @@ int cmd_track(int argc, char *argv[])
 	fseek(file, 0, SEEK_SET);
 
 	if (file_size < 0) {
-		print_error("Cannot determine file size: %s", filename);
+		track_fail(job, "Cannot determine file size: %s", filename);
 		fclose(file);
-		storage_free(config);
-		return EXIT_FAILURE;
+		return;
 	}
 
 	if (file_size == 0) {
-		print_error("Cannot track empty file: %s", filename);
+		track_fail(job, "Cannot track empty file: %s", filename);
 		fclose(file);
-		storage_free(config);
-		return EXIT_FAILURE;
+		return;
 	}
 
 	// Allocate buffer and read file
 	uint8_t *file_data = malloc(file_size);
 	if (file_data == NULL) {
-		print_error("Out of memory");
+		track_fail(job, "Out of memory tracking %s", filename);
 		fclose(file);
-		storage_free(config);
-		return EXIT_FAILURE;
+		return;
 	}
 
-	size_t bytes_read = fread(file_data, 1, file_size, file);
+	// The content hash is computed in the same pass that reads the file
+	Blake3Hasher hasher;
+	blake3_init(&hasher);
+	size_t bytes_read = 0;
+	while (bytes_read < (size_t)file_size) {
+		size_t want = (size_t)file_size - bytes_read < TRACK_READ_CHUNK ?
+			      (size_t)file_size - bytes_read : TRACK_READ_CHUNK;
+		size_t n = fread(file_data + bytes_read, 1, want, file);
+		if (n == 0)
+			break;
+		blake3_update(&hasher, file_data + bytes_read, n);
+		bytes_read += n;
+	}
 	fclose(file);
 
+	uint8_t content_hash[CONTENT_HASH_SIZE];
+	blake3_final(&hasher, content_hash, sizeof(content_hash));
+
 	if (bytes_read != (size_t)file_size) {
-		print_error("Failed to read file: %s", filename);
+		track_fail(job, "Failed to read file: %s", filename);
 		free(file_data);
-		storage_free(config);
-		return EXIT_FAILURE;
+		return;
 	}
 
-	if (verbose_flag)
+	if (verbose_flag && !job->json)
 		print_info("Read %zu bytes from %s", bytes_read, filename);
 
 	// Track the file version
-	int result = track_file_version(config, filename, file_data, file_size, message_flag);
+	int stored = 0;
+	int result = track_file_head(config, filename, file_data, file_size, message_flag, content_hash,
+				     &state, job->head, &stored);
 
 	// Clean up file data
 	free(file_data);
 
 	if (result < 0) {
-		print_error("Failed to track file: %s", filename);
-		storage_free(config);
-		return EXIT_FAILURE;
+		track_fail(job, "Failed to track file: %s", filename);
+		return;
 	}
 
-	// Clean up storage config
-	storage_free(config);
-
-	print_success("Tracked %s (%zu bytes)", filename, bytes_read);
-	return EXIT_SUCCESS;
+	job->outcome = stored ? TRACK_STORED : TRACK_UNCHANGED;
+	job->version = result;
+	job->bytes = bytes_read;
 }
 
-/**
- * @brief Shows differences between file versions
- *
- * Implements the "diff" command which displays differences between
- * the current file and a specific version, or between two versions.
- * This command loads delta information and presents it in various formats.
- *
- * @param argc Number of command arguments. Must be >= 1.
- * @param argv Array of command arguments. Must not be NULL.
- *
- * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
- *
- * @note The function supports --version, --json, and --brief options.
- *
- * @note If no version is specified, the latest version is used.
- *
- * @note The function validates that the specified version exists.
- *
- * @example
- * ```c
- * char *args[] = {"file.txt", "--version", "2", "--json"};
- * int result = cmd_diff(4, args);
- * ```
- */
-int cmd_diff(int argc, char *argv[])
-{
-	if (argc < 1) {
-		print_error("diff: missing file argument");
-		printf("Usage: fiver diff <file> [options]\n");
-		return EXIT_FAILURE;
-	}
+// Latest version of a recently tracked file, kept for its next track
+typedef struct {
+	char *		path;                   // Tracked path
+	FileHead	head;                   // Kept version, empty once evicted
+	uint64_t	last_used;              // Batch that last claimed it
+} CachedHead;
 
-	const char *filename = argv[0];
+// Kept versions of the files a long-running command tracks again and again
+typedef struct {
+	CachedHead **	heads;                  // Sorted by path; entries never move
+	uint32_t	count;
+	uint32_t	capacity;
+	size_t		limit;                  // Bytes kept before the least recently used are evicted
+	uint64_t	batch;                  // Current batch, advanced before each one
+} HeadCache;
 
-	// Parse options: --version/-v, --json, --brief
-	uint32_t target_version = 0; // 0 => latest
-	int json_flag_local = 0;
-	int brief_flag_local = 0;
-	for (int i = 1; i < argc; i++) {
-		if (strcmp(argv[i], "--version") == 0 || strcmp(argv[i], "-v") == 0) {
-			if (i + 1 >= argc) {
-				print_error("--version requires a value");
-				return EXIT_FAILURE;
-			}
-			long v = strtol(argv[i + 1], NULL, 10);
-			if (v <= 0) {
-				print_error("Invalid version: %s", argv[i + 1]);
-				return EXIT_FAILURE;
-			}
-			target_version = (uint32_t)v;
-			i++;
-		} else if (strcmp(argv[i], "--json") == 0) {
-			json_flag_local = 1;
-		} else if (strcmp(argv[i], "--brief") == 0) {
-			brief_flag_local = 1;
-		} else {
-			print_error("Unknown option: %s", argv[i]);
-			return EXIT_FAILURE;
+// Claims the kept version of a file for the current batch, or NULL if another job of the batch has it
+static FileHead * head_cache_claim(HeadCache *cache, const char *path)
+{
+	uint32_t low = 0;
+	uint32_t high = cache->count;
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		int order = strcmp(cache->heads[mid]->path, path);
+		if (order == 0) {
+			CachedHead *cached = cache->heads[mid];
+			if (cached->last_used == cache->batch)
+				return NULL;
+			cached->last_used = cache->batch;
+			return &cached->head;
 		}
+		if (order < 0)
+			low = mid + 1;
+		else
+			high = mid;
 	}
 
-	if (verbose_flag) {
-		if (target_version > 0)
-			print_info("Showing diff for %s (version %u)", filename, target_version);
-		else
-			print_info("Showing diff for %s (latest)", filename);
+	if (cache->count == cache->capacity) {
+		uint32_t capacity = cache->capacity == 0 ? 64 : cache->capacity * 2;
+		CachedHead **heads = realloc(cache->heads, capacity * sizeof(CachedHead *));
+		if (heads == NULL)
+			return NULL;
+		cache->heads = heads;
+		cache->capacity = capacity;
 	}
 
-	// Initialize storage
-	StorageConfig *config = storage_init("./.fiver");
-	if (config == NULL) {
-		print_error("Failed to initialize storage");
-		return EXIT_FAILURE;
+	CachedHead *cached = calloc(1, sizeof(CachedHead));
+	if (cached == NULL || (cached->path = strdup(path)) == NULL) {
+		free(cached);
+		return NULL;
 	}
+	cached->last_used = cache->batch;
 
-	// Resolve latest version if needed
-	if (target_version == 0) {
-		uint32_t versions[256];
-		int count = get_file_versions(config, filename, versions, 256);
-		if (count <= 0) {
-			print_error("No versions found for: %s", filename);
-			storage_free(config);
-			return EXIT_FAILURE;
+	memmove(&cache->heads[low + 1], &cache->heads[low], (cache->count - low) * sizeof(CachedHead *));
+	cache->heads[low] = cached;
+	cache->count++;
+	return &cached->head;
+}
+
+// Empties the least recently used kept versions until they fit in the limit
+static void head_cache_evict(HeadCache *cache)
+{
+	size_t kept = 0;
+	for (uint32_t i = 0; i < cache->count; i++)
+		kept += cache->heads[i]->head.size;
+
+	while (kept > cache->limit) {
+		CachedHead *oldest = NULL;
+		for (uint32_t i = 0; i < cache->count; i++) {
+			CachedHead *cached = cache->heads[i];
+			if (cached->head.data != NULL && (oldest == NULL || cached->last_used < oldest->last_used))
+				oldest = cached;
 		}
-		uint32_t max_v = versions[0];
-		for (int i = 1; i < count; i++)
-			if (versions[i] > max_v)
-				max_v = versions[i];
-		target_version = max_v;
+		if (oldest == NULL)
+			break;
+		kept -= oldest->head.size;
+		file_head_clear(&oldest->head);
 	}
+}
 
-	// Load delta
-	DeltaInfo *delta = load_delta(config, filename, target_version);
-	if (delta == NULL) {
-		print_error("Failed to load delta for %s (version %u)", filename, target_version);
-		storage_free(config);
-		return EXIT_FAILURE;
+// Versions a server worker keeps between the tracks it runs
+static HeadCache served_heads;
+
+static void head_cache_free(HeadCache *cache)
+{
+	for (uint32_t i = 0; i < cache->count; i++) {
+		free(cache->heads[i]->path);
+		file_head_clear(&cache->heads[i]->head);
+		free(cache->heads[i]);
 	}
+	free(cache->heads);
+	memset(cache, 0, sizeof(HeadCache));
+}
 
-	// Output
-	if (json_flag_local) {
-		// Minimal JSON summary
-		printf("{\n");
-		printf("  \"file\": \"%s\",\n", filename);
-		printf("  \"version\": %u,\n", target_version);
-		printf("  \"original_size\": %u,\n", delta->original_size);
-		printf("  \"delta_size\": %u,\n", delta->delta_size);
-		printf("  \"operation_count\": %u\n", delta->operation_count);
-		printf("}\n");
-	} else if (brief_flag_local) {
-		printf("%s v%u: %u ops, delta %u bytes (orig %u)\n",
-		       filename, target_version, delta->operation_count, delta->delta_size,
-		       delta->original_size);
-	} else {
-		printf("Diff for %s (version %u):\n", filename, target_version);
-		print_delta_info(delta);
+// Growable list of paths to track
+typedef struct {
+	char **		paths;
+	uint32_t	count;
+	uint32_t	capacity;
+} PathList;
+
+static int path_list_add(PathList *list, const char *path)
+{
+	if (list->count == list->capacity) {
+		uint32_t capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+		char **paths = realloc(list->paths, capacity * sizeof(char *));
+		if (paths == NULL)
+			return -1;
+		list->paths = paths;
+		list->capacity = capacity;
 	}
 
-	delta_free(delta);
-	storage_free(config);
+	list->paths[list->count] = strdup(path);
+	if (list->paths[list->count] == NULL)
+		return -1;
+	list->count++;
 	return EXIT_SUCCESS;
 }
 
+static void path_list_free(PathList *list)
+{
+	for (uint32_t i = 0; i < list->count; i++)
+		free(list->paths[i]);
+	free(list->paths);
+}
+
+// Include and exclude globs of a recursive track
+typedef struct {
+	const char **	include;
+	int		include_count;
+	const char **	exclude;
+	int		exclude_count;
+} PathFilter;
+
+// Whether a glob matches a path: patterns with a '/' match the whole path, others the name
+static int glob_matches(const char *pattern, const char *path)
+{
+	if (strchr(pattern, '/') != NULL)
+		return fnmatch(pattern, path, FNM_PATHNAME) == 0;
+
+	const char *name = strrchr(path, '/');
+	return fnmatch(pattern, name != NULL ? name + 1 : path, 0) == 0;
+}
+
+static int path_excluded(const PathFilter *filter, const char *path)
+{
+	for (int i = 0; i < filter->exclude_count; i++)
+		if (glob_matches(filter->exclude[i], path))
+			return 1;
+	return 0;
+}
+
+static int path_included(const PathFilter *filter, const char *path)
+{
+	if (path_excluded(filter, path))
+		return 0;
+	if (filter->include_count == 0)
+		return 1;
+	for (int i = 0; i < filter->include_count; i++)
+		if (glob_matches(filter->include[i], path))
+			return 1;
+	return 0;
+}
+
+// Adds the regular files under dir to list; excluded directories are not entered
+static int collect_files(const char *dir, const PathFilter *filter, PathList *list)
+{
+	DIR *d = opendir(dir);
+	if (d == NULL) {
+		print_error("Cannot open directory %s: %s", dir, strerror(errno));
+		return -1;
+	}
+
+	int result = EXIT_SUCCESS;
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		// The storage directory is never tracked
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+		    strcmp(entry->d_name, ".fiver") == 0)
+			continue;
+
+		char path[4096];
+		if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) >= (int)sizeof(path)) {
+			print_error("Path too long: %s/%s", dir, entry->d_name);
+			result = -1;
+			continue;
+		}
+
+		// Symbolic links are not followed
+		struct stat st;
+		if (lstat(path, &st) != 0)
+			continue;
+
+		if (S_ISDIR(st.st_mode)) {
+			if (!path_excluded(filter, path) && collect_files(path, filter, list) != EXIT_SUCCESS)
+				result = -1;
+		} else if (S_ISREG(st.st_mode) && path_included(filter, path)) {
+			if (path_list_add(list, path) != EXIT_SUCCESS) {
+				print_error("Out of memory");
+				result = -1;
+				break;
+			}
+		}
+	}
+
+	closedir(d);
+	return result;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Prints a string as a JSON string literal
+static void print_json_string(const char *s)
+{
+	putchar('"');
+	for (; *s != '\0'; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	putchar('"');
+}
+
+// Prints the result of tracking one file as a JSON object on its own line
+static void print_track_json(const TrackJob *job)
+{
+	printf("{\"file\": ");
+	print_json_string(job->path);
+	if (job->outcome == TRACK_FAILED) {
+		printf(", \"status\": \"failed\", \"error\": ");
+		print_json_string(job->error);
+		printf("}\n");
+	} else {
+		printf(", \"status\": \"%s\", \"version\": %d, \"bytes\": %zu}\n",
+		       job->outcome == TRACK_STORED ? "stored" : "unchanged", job->version, job->bytes);
+	}
+}
+
 /**
- * @brief Restores a file to a specific version
+ * @brief Tracks a new version of one or more files
  *
- * Implements the "restore" command which reconstructs a file from
- * its delta chain and writes it to disk. This command can restore
- * to any previously tracked version.
+ * Implements the "track" command which creates a new version of each file
+ * using delta compression. For every file, this command reads it, creates a
+ * delta from the previous version (if any), and stores it in the storage
+ * system. Directories given with --recursive are walked for regular files.
+ * All files of one invocation are tracked on a pool of worker threads that
+ * share one storage configuration, and committed together: in batch
+ * durability mode they share a single flush at the end.
  *
  * @param argc Number of command arguments. Must be >= 1.
  * @param argv Array of command arguments. Must not be NULL.
  *
- * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ * @return EXIT_SUCCESS if every file was tracked, EXIT_FAILURE on any error.
  *
- * @note The function supports --version, --output, --force, and --json options.
+ * @note The function validates file existence, readability, and type.
+ *       A file that fails does not stop the remaining files.
  *
- * @note If no version is specified, the latest version is used.
+ * @note The function supports the --message option for commit messages,
+ *       which applies to every file of the invocation.
  *
- * @note The function prevents overwriting existing files unless --force is used.
+ * @note Supports --recursive (-r), --jobs (-j) N (default: number of CPUs),
+ *       repeatable --include and --exclude globs for files found in
+ *       directories, and --json for one JSON object per file. A glob with a
+ *       '/' matches the whole path, any other glob the file name. Excluded
+ *       directories are not entered, symbolic links are not followed and
+ *       .fiver directories are skipped.
+ *
+ * @note With several files, only failures are reported per file (every
+ *       file with --verbose), followed by one summary line.
+ *
+ * @note File data is read entirely into memory for processing.
+ *
+ * @note A file whose size, mtime, ctime and inode match those recorded at
+ *       its last track is reported unchanged without being read. Otherwise
+ *       contents equal to the latest version are recognized by their
+ *       content hash and stored no second time.
  *
  * @example
  * ```c
- * char *args[] = {"file.txt", "--version", "2", "--output", "old.txt"};
- * int result = cmd_restore(5, args);
+ * char *args[] = {"configs", "--recursive", "--include", "*.conf"};
+ * int result = cmd_track(4, args);
  * ```
  */
-int cmd_restore(int argc, char *argv[])
+int cmd_track(int argc, char *argv[])
 {
 	if (argc < 1) {
-		print_error("restore: missing file argument");
-		printf("Usage: fiver restore <file> [--version <N>] [options]\n");
-		printf("Options:\n");
-		printf("  --version <N>    Restore to specific version (default: latest)\n");
-		printf("  --force          Overwrite existing file\n");
-		printf("  --json           Output in JSON format\n");
-		printf("Examples:\n");
-		printf("  fiver restore document.pdf\n");
-		printf("  fiver restore document.pdf --version 2\n");
-		printf("  fiver restore document.pdf --version 1 --force\n");
+		print_error("track: missing file argument");
+		printf("Usage: fiver track <file|dir>... [options]\n");
 		return EXIT_FAILURE;
 	}
 
-	const char *filename = argv[0];
-	uint32_t target_version = 0; // 0 means latest
-	int force_flag = 0;
-	int json_flag = 0;
-	const char *output_path = NULL; // NULL means use original filename
+	// Options: --recursive, --jobs N, --include GLOB, --exclude GLOB, --json
+	int recursive = 0;
+	int json_output = 0;
+	uint32_t jobs = thread_pool_cpu_count();
+	PathFilter filter = { NULL, 0, NULL, 0 };
+	const char **include = calloc((size_t)argc, sizeof(char *));
+	const char **exclude = calloc((size_t)argc, sizeof(char *));
+	char **targets = calloc((size_t)argc, sizeof(char *));
+	int target_count = 0;
+	if (include == NULL || exclude == NULL || targets == NULL) {
+		print_error("Out of memory");
+		free(include);
+		free(exclude);
+		free(targets);
+		return EXIT_FAILURE;
+	}
+	filter.include = include;
+	filter.exclude = exclude;
 
-	// Parse options
-	for (int i = 1; i < argc; i++) {
-		if (strcmp(argv[i], "--version") == 0) {
-			if (i + 1 >= argc) {
-				print_error("--version requires a value");
-				return EXIT_FAILURE;
-			}
-			long v = strtol(argv[i + 1], NULL, 10);
-			if (v <= 0) {
-				print_error("Invalid version: %s (must be > 0)", argv[i + 1]);
-				return EXIT_FAILURE;
-			}
-			target_version = (uint32_t)v;
-			i++; // Skip the value
-		} else if (strcmp(argv[i], "--force") == 0) {
-			force_flag = 1;
+	int usage_error = 0;
+	for (int i = 0; i < argc && !usage_error; i++) {
+		if (strcmp(argv[i], "--recursive") == 0 || strcmp(argv[i], "-r") == 0) {
+			recursive = 1;
 		} else if (strcmp(argv[i], "--json") == 0) {
-			json_flag = 1;
-		} else if (strcmp(argv[i], "--output") == 0 || strcmp(argv[i], "-o") == 0) {
+			json_output = 1;
+		} else if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+			char *end = NULL;
+			long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+			if (i + 1 >= argc || *end != '\0' || value < 1 || value > 1024) {
+				print_error("--jobs requires a number from 1 to 1024");
+				usage_error = 1;
+			}
+			jobs = (uint32_t)value;
+			i++;
+		} else if (strcmp(argv[i], "--include") == 0 || strcmp(argv[i], "--exclude") == 0) {
 			if (i + 1 >= argc) {
-				print_error("--output requires a value");
-				return EXIT_FAILURE;
+				print_error("%s requires a glob", argv[i]);
+				usage_error = 1;
+			} else if (strcmp(argv[i], "--include") == 0) {
+				include[filter.include_count++] = argv[++i];
+			} else {
+				exclude[filter.exclude_count++] = argv[++i];
 			}
-			output_path = argv[i + 1];
-			i++; // Skip the value
-		} else {
+		} else if (argv[i][0] == '-' && argv[i][1] != '\0') {
 			print_error("Unknown option: %s", argv[i]);
-			return EXIT_FAILURE;
+			usage_error = 1;
+		} else {
+			targets[target_count++] = argv[i];
 		}
 	}
 
-	if (verbose_flag) {
-		print_info("Restoring file: %s", filename);
-		if (target_version > 0)
-			print_info("Target version: %u", target_version);
-		else
-			print_info("Target version: latest");
-	}
-
-	// Initialize storage
-	StorageConfig *config = storage_init("./.fiver");
-	if (config == NULL) {
-		print_error("Failed to initialize storage");
-		return EXIT_FAILURE;
+	if (!usage_error && target_count == 0) {
+		print_error("track: missing file argument");
+		usage_error = 1;
 	}
 
-	// Get available versions
-	uint32_t versions[512];
-	int count = get_file_versions(config, filename, versions, 512);
-	if (count <= 0) {
-		print_error("No versions found for: %s", filename);
-		storage_free(config);
-		return EXIT_FAILURE;
-	}
+	// Expand directories into the files under them
+	PathList files = { NULL, 0, 0 };
+	int walk_failed = 0;
+	for (int i = 0; i < target_count && !usage_error; i++) {
+		char target[4096];
+		snprintf(target, sizeof(target), "%s", targets[i]);
+		size_t length = strlen(target);
+		while (length > 1 && target[length - 1] == '/')
+			target[--length] = '\0';
 
-	// Find the target version
-	if (target_version == 0) {
-		// Find latest version
-		target_version = versions[0];
-		for (int i = 1; i < count; i++)
-			if (versions[i] > target_version)
-				target_version = versions[i];
-	} else {
-		// Validate that the target version exists
-		int version_exists = 0;
-		for (int i = 0; i < count; i++) {
-			if (versions[i] == target_version) {
-				version_exists = 1;
-				break;
+		struct stat st;
+		if (stat(target, &st) == 0 && S_ISDIR(st.st_mode)) {
+			if (!recursive) {
+				print_error("%s is a directory (use --recursive)", target);
+				walk_failed++;
+				continue;
 			}
-		}
-		if (!version_exists) {
-			print_error("Version %u not found for: %s", target_version, filename);
-			storage_free(config);
-			return EXIT_FAILURE;
+			uint32_t before = files.count;
+			if (collect_files(target, &filter, &files) != EXIT_SUCCESS)
+				walk_failed++;
+			qsort(files.paths + before, files.count - before, sizeof(char *), compare_paths);
+		} else if (path_list_add(&files, target) != EXIT_SUCCESS) {
+			print_error("Out of memory");
+			usage_error = 1;
 		}
 	}
 
-	// Determine the actual output path
-	const char *actual_output_path = output_path ? output_path : filename;
+	free(include);
+	free(exclude);
+	free(targets);
 
-	// Check if target file already exists
-	if (!force_flag && access(actual_output_path, F_OK) == 0) {
-		print_error("File %s already exists. Use --force to overwrite.", actual_output_path);
-		storage_free(config);
+	if (usage_error) {
+		path_list_free(&files);
 		return EXIT_FAILURE;
 	}
 
-	// Reconstruct the file
-	uint32_t file_size;
-	uint8_t *file_data = reconstruct_file_from_deltas(config, filename, target_version, &file_size);
-	if (file_data == NULL) {
-		print_error("Failed to reconstruct version %u of: %s", target_version, filename);
-		storage_free(config);
+	// Initialize storage
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		path_list_free(&files);
 		return EXIT_FAILURE;
 	}
 
-	// Write the file
-	FILE *output_file = fopen(actual_output_path, "wb");
-	if (output_file == NULL) {
-		print_error("Failed to create file: %s (%s)", actual_output_path, strerror(errno));
-		free(file_data);
-		storage_free(config);
+	if (verbose_flag)
+		print_info("Storage initialized: %s", config->storage_dir);
+
+	TrackJob *track_jobs = calloc(files.count > 0 ? files.count : 1, sizeof(TrackJob));
+	if (track_jobs == NULL) {
+		print_error("Out of memory");
+		close_storage(config);
+		path_list_free(&files);
 		return EXIT_FAILURE;
 	}
+	// A server diffs each file against the version it kept from the file's last track
+	served_heads.batch++;
+	for (uint32_t i = 0; i < files.count; i++) {
+		track_jobs[i].config = config;
+		track_jobs[i].path = files.paths[i];
+		track_jobs[i].json = json_output;
+		if (config == served_storage)
+			track_jobs[i].head = head_cache_claim(&served_heads, files.paths[i]);
+	}
+
+	// Files are spread over the workers; each file's own delta is applied on its worker
+	if (jobs > files.count)
+		jobs = files.count;
+	ThreadPool *pool = NULL;
+	if (jobs > 1) {
+		config->apply_threads = 1;
+		pool = thread_pool_new(jobs);
+	}
 
-	size_t written = fwrite(file_data, 1, file_size, output_file);
-	fclose(output_file);
+	// In JSON mode stdout carries only the results; storage messages go to stderr
+	if (json_output)
+		storage_messages_to_stderr(1);
 
-	if (written != file_size) {
-		print_error("Failed to write file: %s (wrote %zu of %u bytes)", actual_output_path, written,
-			    file_size);
-		free(file_data);
-		storage_free(config);
-		return EXIT_FAILURE;
+	thread_pool_run(pool, track_one, track_jobs, files.count, sizeof(TrackJob));
+	thread_pool_free(pool);
+	if (config == served_storage)
+		head_cache_evict(&served_heads);
+
+	// One durability barrier for the whole batch
+	int commit_failed = storage_commit(config) != EXIT_SUCCESS;
+
+	if (json_output)
+		storage_messages_to_stderr(0);
+
+	uint32_t stored = 0;
+	uint32_t unchanged = 0;
+	int failed = walk_failed;
+	for (uint32_t i = 0; i < files.count; i++) {
+		const TrackJob *job = &track_jobs[i];
+
+		if (job->outcome == TRACK_STORED)
+			stored++;
+		else if (job->outcome == TRACK_UNCHANGED)
+			unchanged++;
+		else
+			failed++;
+
+		if (json_output) {
+			print_track_json(job);
+		} else if (job->outcome == TRACK_FAILED) {
+			print_error("%s", job->error);
+		} else if (files.count == 1 || verbose_flag) {
+			if (job->outcome == TRACK_STORED)
+				print_success("Tracked %s (%zu bytes)", job->path, job->bytes);
+			else
+				print_success("Unchanged %s (version %d)", job->path, job->version);
+		}
 	}
 
-	// Output result
-	if (json_flag) {
-		printf("{\n");
-		printf("  \"file\": \"%s\",\n", filename);
-		printf("  \"output_file\": \"%s\",\n", actual_output_path);
-		printf("  \"restored_version\": %u,\n", target_version);
-		printf("  \"file_size\": %u,\n", file_size);
-		printf("  \"success\": true\n");
-		printf("}\n");
-	} else {
-		print_success("Restored %s to version %u (%u bytes) -> %s", filename, target_version,
-			      file_size, actual_output_path);
+	// Arguments that could not be walked count as one failed file each
+	int total = (int)files.count + walk_failed;
+	if (commit_failed) {
+		print_error("Failed to flush tracked versions to disk");
+		failed = total;
 	}
 
-	// Cleanup
-	free(file_data);
-	storage_free(config);
-	return EXIT_SUCCESS;
+	if (!json_output && total > 1)
+		print_success("%d files: %u stored, %u unchanged, %d failed", total, stored, unchanged, failed);
+	if (failed > 0 && total > 1)
+		print_error("Failed to track %d of %d files", failed, total);
+
+	// Clean up
+	free(track_jobs);
+	close_storage(config);
+	path_list_free(&files);
+	return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 /**
- * @brief Shows version history for a file
+ * @brief Shows differences between file versions
  *
- * Implements the "history" command which displays the complete version
- * history of a tracked file, including timestamps, operation counts,
- * delta sizes, and commit messages.
+ * Implements the "diff" command which displays differences between
+ * the current file and a specific version, or between two versions.
+ * This command loads delta information and presents it in various formats.
  *
  * @param argc Number of command arguments. Must be >= 1.
  * @param argv Array of command arguments. Must not be NULL.
  *
  * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
  *
- * @note The function supports --format and --limit options.
+ * @note The function supports --version, --json, and --brief options.
  *
- * @note Output formats include table, json, and brief.
+ * @note If no version is specified, the latest version is used.
  *
- * @note The function sorts versions in ascending order for display.
+ * @note The function validates that the specified version exists.
  *
  * @example
  * ```c
- * char *args[] = {"file.txt", "--format", "json", "--limit", "5"};
- * int result = cmd_history(5, args);
+ * char *args[] = {"file.txt", "--version", "2", "--json"};
+ * int result = cmd_diff(4, args);
  * ```
  */
-int cmd_history(int argc, char *argv[])
+int cmd_diff(int argc, char *argv[])
 {
 	if (argc < 1) {
-		print_error("history: missing file argument");
-		printf("Usage: fiver history <file> [options]\n");
+		print_error("diff: missing file argument");
+		printf("Usage: fiver diff <file> [options]\n");
 		return EXIT_FAILURE;
 	}
 
 	const char *filename = argv[0];
 
-	// Options: --format <fmt>, --limit <N>
-	const char *format = "table";   // table | json | brief
-	int limit = 0;                  // 0 => no limit
+	// Parse options: --version/-v, --json, --brief
+	uint32_t target_version = 0; // 0 => latest
+	int json_flag_local = 0;
+	int brief_flag_local = 0;
 	for (int i = 1; i < argc; i++) {
-		if (strcmp(argv[i], "--format") == 0) {
-			if (i + 1 >= argc) {
-				print_error("--format requires a value");
-				return EXIT_FAILURE;
-			}
-			format = argv[i + 1];
-			i++;
-		} else if (strcmp(argv[i], "--limit") == 0) {
+		if (strcmp(argv[i], "--version") == 0 || strcmp(argv[i], "-v") == 0) {
 			if (i + 1 >= argc) {
-				print_error("--limit requires a value");
+				print_error("--version requires a value");
 				return EXIT_FAILURE;
 			}
 			long v = strtol(argv[i + 1], NULL, 10);
-			if (v < 0) {
-				print_error("Invalid limit: %s", argv[i + 1]);
+			if (v <= 0) {
+				print_error("Invalid version: %s", argv[i + 1]);
 				return EXIT_FAILURE;
 			}
-			limit = (int)v;
+			target_version = (uint32_t)v;
 			i++;
+		} else if (strcmp(argv[i], "--json") == 0) {
+			json_flag_local = 1;
+		} else if (strcmp(argv[i], "--brief") == 0) {
+			brief_flag_local = 1;
 		} else {
 			print_error("Unknown option: %s", argv[i]);
 			return EXIT_FAILURE;
 		}
 	}
 
-	if (verbose_flag)
-		print_info("Showing history for file: %s", filename);
+	if (verbose_flag) {
+		if (target_version > 0)
+			print_info("Showing diff for %s (version %u)", filename, target_version);
+		else
+			print_info("Showing diff for %s (latest)", filename);
+	}
+
+	// Initialize storage
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		return EXIT_FAILURE;
+	}
+
+	// Resolve latest version if needed
+	if (target_version == 0) {
+		int latest_version = storage_latest_version(config, filename);
+		if (latest_version <= 0) {
+			print_error("No versions found for: %s", filename);
+			close_storage(config);
+			return EXIT_FAILURE;
+		}
+		target_version = (uint32_t)latest_version;
+	}
+
+	// Load delta
+	DeltaInfo *delta = load_delta(config, filename, target_version);
+	if (delta == NULL) {
+		print_error("Failed to load delta for %s (version %u)", filename, target_version);
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	// Output
+	if (json_flag_local) {
+		// Minimal JSON summary
+		printf("{\n");
+		printf("  \"file\": \"%s\",\n", filename);
+		printf("  \"version\": %u,\n", target_version);
+		printf("  \"original_size\": %u,\n", delta->original_size);
+		printf("  \"delta_size\": %u,\n", delta->delta_size);
+		printf("  \"operation_count\": %u\n", delta->operation_count);
+		printf("}\n");
+	} else if (brief_flag_local) {
+		printf("%s v%u: %u ops, delta %u bytes (orig %u)\n",
+		       filename, target_version, delta->operation_count, delta->delta_size,
+		       delta->original_size);
+	} else {
+		printf("Diff for %s (version %u):\n", filename, target_version);
+		print_delta_info(delta);
+	}
+
+	delta_free(delta);
+	close_storage(config);
+	return EXIT_SUCCESS;
+}
+
+// Outcome of restoring one file of a tree
+typedef enum {
+	RESTORE_DONE,                           // The version was written to the output directory
+	RESTORE_SKIPPED,                        // No version existed at the requested time
+	RESTORE_FAILED                          // The file could not be restored
+} RestoreOutcome;
+
+// One file of a whole-tree restore and, once restored, its result
+typedef struct {
+	StorageConfig *	config;                 // Storage shared by every worker
+	const char *	name;                   // Canonical path of the tracked file
+	uint32_t	version;                // Version to restore, 0 to pick one by at
+	int64_t		at;                     // Point in time to restore, -1 for the latest version
+	const char *	output_dir;             // Directory the tree is restored under
+	int		force;                  // Whether existing files are overwritten
+	RestoreOutcome	outcome;                // What happened
+	uint32_t	size;                   // Bytes restored
+	char		output[4096];           // Path the file was restored to
+	char		error[4096 + 256];      // Reason for RESTORE_FAILED, which may name output
+} RestoreJob;
+
+// Records why a file could not be restored
+static void restore_fail(RestoreJob *job, const char *format, const char *path)
+{
+	job->outcome = RESTORE_FAILED;
+	snprintf(job->error, sizeof(job->error), format, path);
+}
+
+// Creates the missing parent directories of path; concurrent callers may race harmlessly
+static int make_parent_dirs(const char *path)
+{
+	char dir[4096];
+	snprintf(dir, sizeof(dir), "%s", path);
+
+	for (char *p = dir + 1; *p != '\0'; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+			return -1;
+		*p = '/';
+	}
+	return EXIT_SUCCESS;
+}
+
+// Whether a canonical path has a ".." segment that would leave the output directory
+static int path_escapes(const char *path)
+{
+	for (const char *p = path; (p = strstr(p, "..")) != NULL; p += 2)
+		if ((p == path || p[-1] == '/') && (p[2] == '/' || p[2] == '\0'))
+			return 1;
+	return 0;
+}
+
+// Restores one file under the output directory; safe to run on several threads at once
+static void restore_one(void *arg)
+{
+	RestoreJob *job = arg;
+	StorageConfig *config = job->config;
+	const char *name = job->name;
+
+	if (path_escapes(name)) {
+		restore_fail(job, "Refusing to restore outside the output directory: %s", name);
+		return;
+	}
+
+	// Pick the version: named in the version map, the newest at the requested time, or the latest
+	if (job->version == 0 && job->at >= 0) {
+		ManifestEntry entry;
+		int found = manifest_find_at(config, name, job->at, &entry);
+		if (found < 0) {
+			restore_fail(job, "Failed to read versions of: %s", name);
+			return;
+		}
+		if (found == 0) {
+			job->outcome = RESTORE_SKIPPED;
+			return;
+		}
+		job->version = entry.version;
+	} else if (job->version == 0) {
+		int latest = storage_latest_version(config, name);
+		if (latest <= 0) {
+			restore_fail(job, "No versions found for: %s", name);
+			return;
+		}
+		job->version = (uint32_t)latest;
+	} else if (manifest_find(config, name, job->version, NULL) != 1) {
+		snprintf(job->error, sizeof(job->error), "Version %u not found for: %s", job->version, name);
+		job->outcome = RESTORE_FAILED;
+		return;
+	}
+
+	// Absolute paths are restored relative to the output directory as well
+	const char *relative = name;
+	while (*relative == '/')
+		relative++;
+	if (snprintf(job->output, sizeof(job->output), "%s/%s", job->output_dir, relative) >=
+	    (int)sizeof(job->output)) {
+		restore_fail(job, "Path too long: %s", name);
+		return;
+	}
+
+	if (!job->force && access(job->output, F_OK) == 0) {
+		restore_fail(job, "File %s already exists. Use --force to overwrite.", job->output);
+		return;
+	}
+
+	if (make_parent_dirs(job->output) != EXIT_SUCCESS) {
+		restore_fail(job, "Cannot create directories for %s", job->output);
+		return;
+	}
+
+	if (restore_file_to_path(config, name, job->version, job->output, &job->size) != EXIT_SUCCESS) {
+		snprintf(job->error, sizeof(job->error), "Failed to restore version %u of: %s",
+			 job->version, name);
+		job->outcome = RESTORE_FAILED;
+		return;
+	}
+
+	job->outcome = RESTORE_DONE;
+}
+
+// Parses seconds since the epoch or a local "YYYY-MM-DD[ HH:MM[:SS]]" time ('T' may separate)
+static int parse_timestamp(const char *text, int64_t *timestamp)
+{
+	char *end = NULL;
+	if (isdigit((unsigned char)text[0])) {
+		long long seconds = strtoll(text, &end, 10);
+		if (*end == '\0') {
+			*timestamp = seconds;
+			return EXIT_SUCCESS;
+		}
+	}
+
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
+	char separator = ' ';
+	int consumed = 0;
+	int fields = sscanf(text, "%4d-%2d-%2d%n%c%2d:%2d%n:%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+			    &consumed, &separator, &tm.tm_hour, &tm.tm_min, &consumed, &tm.tm_sec, &consumed);
+	if (fields < 3 || text[consumed] != '\0' || (fields > 3 && separator != ' ' && separator != 'T') ||
+	    fields == 4 || fields == 5)
+		return -1;
+
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	tm.tm_isdst = -1;
+	time_t t = mktime(&tm);
+	if (t == (time_t)-1)
+		return -1;
+
+	*timestamp = (int64_t)t;
+	return EXIT_SUCCESS;
+}
+
+// Reads "<file> <version>" lines into names and versions; blank lines and '#' comments are skipped
+static int read_version_map(const char *path, PathList *names, uint32_t **versions)
+{
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		print_error("Cannot open version map %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	uint32_t capacity = 0;
+	char line[4096];
+	int line_number = 0;
+	int result = EXIT_SUCCESS;
+	while (result == EXIT_SUCCESS && fgets(line, sizeof(line), file) != NULL) {
+		line_number++;
+		size_t length = strcspn(line, "\r\n");
+		line[length] = '\0';
+		while (length > 0 && isspace((unsigned char)line[length - 1]))
+			line[--length] = '\0';
+		if (length == 0 || line[0] == '#')
+			continue;
+
+		// The version is the last field, so file names may contain spaces
+		char *space = strrchr(line, ' ');
+		char *tab = strrchr(line, '\t');
+		if (tab != NULL && (space == NULL || tab > space))
+			space = tab;
+		char *end = NULL;
+		long version = space != NULL ? strtol(space + 1, &end, 10) : 0;
+		if (space == NULL || *end != '\0' || version <= 0) {
+			print_error("%s:%d: expected \"<file> <version>\"", path, line_number);
+			result = -1;
+			break;
+		}
+		while (space > line && isspace((unsigned char)space[-1]))
+			space--;
+		*space = '\0';
+
+		char canonical[256];
+		storage_canonical_path(line, canonical, sizeof(canonical));
+		if (names->count == capacity) {
+			capacity = capacity == 0 ? 64 : capacity * 2;
+			uint32_t *grown = realloc(*versions, capacity * sizeof(uint32_t));
+			if (grown == NULL) {
+				print_error("Out of memory");
+				result = -1;
+				break;
+			}
+			*versions = grown;
+		}
+		(*versions)[names->count] = (uint32_t)version;
+		if (path_list_add(names, canonical) != EXIT_SUCCESS) {
+			print_error("Out of memory");
+			result = -1;
+		}
+	}
+
+	fclose(file);
+	return result;
+}
+
+// Restores every tracked file, or those of a version map, under an output directory
+static int restore_all(int argc, char *argv[])
+{
+	const char *output_dir = NULL;
+	const char *version_map = NULL;
+	int64_t at = -1;
+	int force = 0;
+	int json_output = 0;
+	uint32_t jobs = thread_pool_cpu_count();
+	PathFilter filter = { NULL, 0, NULL, 0 };
+	const char **include = calloc((size_t)argc, sizeof(char *));
+	const char **exclude = calloc((size_t)argc, sizeof(char *));
+	if (include == NULL || exclude == NULL) {
+		print_error("Out of memory");
+		free(include);
+		free(exclude);
+		return EXIT_FAILURE;
+	}
+	filter.include = include;
+	filter.exclude = exclude;
+
+	int usage_error = 0;
+	for (int i = 0; i < argc && !usage_error; i++) {
+		if (strcmp(argv[i], "--all") == 0) {
+			continue;
+		} else if (strcmp(argv[i], "--force") == 0) {
+			force = 1;
+		} else if (strcmp(argv[i], "--json") == 0) {
+			json_output = 1;
+		} else if (strcmp(argv[i], "--at") == 0) {
+			if (i + 1 >= argc || parse_timestamp(argv[i + 1], &at) != EXIT_SUCCESS) {
+				print_error("--at requires seconds since the epoch or \"YYYY-MM-DD [HH:MM[:SS]]\"");
+				usage_error = 1;
+			}
+			i++;
+		} else if (strcmp(argv[i], "--version-map") == 0 || strcmp(argv[i], "--output-dir") == 0) {
+			if (i + 1 >= argc) {
+				print_error("%s requires a path", argv[i]);
+				usage_error = 1;
+			} else if (strcmp(argv[i], "--version-map") == 0) {
+				version_map = argv[++i];
+			} else {
+				output_dir = argv[++i];
+			}
+		} else if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+			char *end = NULL;
+			long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+			if (i + 1 >= argc || *end != '\0' || value < 1 || value > 1024) {
+				print_error("--jobs requires a number from 1 to 1024");
+				usage_error = 1;
+			}
+			jobs = (uint32_t)value;
+			i++;
+		} else if (strcmp(argv[i], "--include") == 0 || strcmp(argv[i], "--exclude") == 0) {
+			if (i + 1 >= argc) {
+				print_error("%s requires a glob", argv[i]);
+				usage_error = 1;
+			} else if (strcmp(argv[i], "--include") == 0) {
+				include[filter.include_count++] = argv[++i];
+			} else {
+				exclude[filter.exclude_count++] = argv[++i];
+			}
+		} else if (argv[i][0] == '-') {
+			print_error("Unknown option: %s", argv[i]);
+			usage_error = 1;
+		} else {
+			print_error("restore --all takes no file argument: %s", argv[i]);
+			usage_error = 1;
+		}
+	}
+
+	if (!usage_error && output_dir == NULL) {
+		print_error("restore --all requires --output-dir");
+		usage_error = 1;
+	}
+	if (!usage_error && at >= 0 && version_map != NULL) {
+		print_error("--at and --version-map cannot be combined");
+		usage_error = 1;
+	}
+
+	PathList names = { NULL, 0, 0 };
+	uint32_t *versions = NULL;
+	if (!usage_error && version_map != NULL && read_version_map(version_map, &names, &versions) != EXIT_SUCCESS)
+		usage_error = 1;
+
+	StorageConfig *config = NULL;
+	if (!usage_error) {
+		config = open_storage();
+		if (config == NULL) {
+			print_error("Failed to initialize storage");
+			usage_error = 1;
+		}
+	}
+
+	// Without a version map, every file in the catalog is restored
+	if (!usage_error && version_map == NULL) {
+		CatalogEntry *entries = NULL;
+		int count = catalog_read(config, &entries);
+		if (count < 0) {
+			print_error("Failed to read the catalog");
+			usage_error = 1;
+		}
+		for (int i = 0; i < count && !usage_error; i++) {
+			if (path_list_add(&names, entries[i].name) != EXIT_SUCCESS) {
+				print_error("Out of memory");
+				usage_error = 1;
+			}
+		}
+		free(entries);
+	}
+
+	RestoreJob *restore_jobs = NULL;
+	uint32_t job_count = 0;
+	if (!usage_error) {
+		restore_jobs = calloc(names.count > 0 ? names.count : 1, sizeof(RestoreJob));
+		if (restore_jobs == NULL) {
+			print_error("Out of memory");
+			usage_error = 1;
+		}
+	}
+	for (uint32_t i = 0; !usage_error && i < names.count; i++) {
+		if (!path_included(&filter, names.paths[i]))
+			continue;
+		RestoreJob *job = &restore_jobs[job_count++];
+		job->config = config;
+		job->name = names.paths[i];
+		job->version = versions != NULL ? versions[i] : 0;
+		job->at = at;
+		job->output_dir = output_dir;
+		job->force = force;
+	}
+
+	free(include);
+	free(exclude);
+
+	if (usage_error) {
+		close_storage(config);
+		path_list_free(&names);
+		free(versions);
+		free(restore_jobs);
+		return EXIT_FAILURE;
+	}
+
+	if (mkdir(output_dir, 0777) != 0 && errno != EEXIST) {
+		print_error("Cannot create %s: %s", output_dir, strerror(errno));
+		close_storage(config);
+		path_list_free(&names);
+		free(versions);
+		free(restore_jobs);
+		return EXIT_FAILURE;
+	}
+
+	// Files are spread over the workers; each file's own deltas are applied on its worker
+	if (jobs > job_count)
+		jobs = job_count;
+	ThreadPool *pool = NULL;
+	if (jobs > 1) {
+		config->apply_threads = 1;
+		pool = thread_pool_new(jobs);
+	}
+
+	// In JSON mode stdout carries only the results; storage messages go to stderr
+	if (json_output)
+		storage_messages_to_stderr(1);
+
+	thread_pool_run(pool, restore_one, restore_jobs, job_count, sizeof(RestoreJob));
+	thread_pool_free(pool);
+
+	if (json_output)
+		storage_messages_to_stderr(0);
+
+	uint32_t restored = 0;
+	uint32_t skipped = 0;
+	uint32_t failed = 0;
+	for (uint32_t i = 0; i < job_count; i++) {
+		const RestoreJob *job = &restore_jobs[i];
+
+		if (job->outcome == RESTORE_DONE)
+			restored++;
+		else if (job->outcome == RESTORE_SKIPPED)
+			skipped++;
+		else
+			failed++;
+
+		if (json_output) {
+			printf("{\"file\": ");
+			print_json_string(job->name);
+			if (job->outcome == RESTORE_FAILED) {
+				printf(", \"status\": \"failed\", \"error\": ");
+				print_json_string(job->error);
+				printf("}\n");
+			} else if (job->outcome == RESTORE_SKIPPED) {
+				printf(", \"status\": \"skipped\"}\n");
+			} else {
+				printf(", \"status\": \"restored\", \"version\": %u, \"bytes\": %u, \"output_file\": ",
+				       job->version, job->size);
+				print_json_string(job->output);
+				printf("}\n");
+			}
+		} else if (job->outcome == RESTORE_FAILED) {
+			print_error("%s", job->error);
+		} else if (verbose_flag) {
+			if (job->outcome == RESTORE_DONE)
+				print_success("Restored %s to version %u (%u bytes) -> %s", job->name, job->version,
+					      job->size, job->output);
+			else
+				print_info("Skipped %s (no version at that time)", job->name);
+		}
+	}
+
+	if (!json_output)
+		print_success("%u files: %u restored, %u skipped, %u failed", job_count, restored, skipped, failed);
+	if (failed > 0)
+		print_error("Failed to restore %u of %u files", failed, job_count);
+
+	free(restore_jobs);
+	free(versions);
+	path_list_free(&names);
+	close_storage(config);
+	return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Writes a chunk of a streamed restore to the descriptor in context
+static int write_chunk_to_fd(const uint8_t *data, uint32_t size, void *context)
+{
+	int fd = *(int *)context;
+
+	while (size > 0) {
+		ssize_t written = write(fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			print_error("Failed to write output (%s)", strerror(errno));
+			return -1;
+		}
+		data += written;
+		size -= (uint32_t)written;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Streams a version to stdout; storage messages go to stderr so stdout carries only the contents
+static int restore_to_stdout(StorageConfig *config, const char *filename, uint32_t version)
+{
+	int output_fd = STDOUT_FILENO;
+	storage_messages_to_stderr(1);
+
+	uint32_t file_size = 0;
+	int result = restore_version_to_sink(config, filename, version, write_chunk_to_fd, &output_fd, &file_size);
+
+	storage_messages_to_stderr(0);
+
+	if (result != EXIT_SUCCESS) {
+		print_error("Failed to restore version %u of: %s to stdout", version, filename);
+		return EXIT_FAILURE;
+	}
+
+	if (verbose_flag)
+		fprintf(stderr, "ℹ Restored %s to version %u (%u bytes) -> stdout\n", filename, version, file_size);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Restores a file to a specific version
+ *
+ * Implements the "restore" command which reconstructs a file from
+ * its delta chain and writes it to disk. This command can restore
+ * to any previously tracked version.
+ *
+ * @param argc Number of command arguments. Must be >= 1.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ *
+ * @note The function supports --version, --output, --force, and --json options.
+ *
+ * @note If no version is specified, the latest version is used.
+ *
+ * @note The function prevents overwriting existing files unless --force is used.
+ *
+ * @note The output is written to a temporary file and renamed into place, so an
+ *       interrupted restore never leaves a partially written file behind.
+ *
+ * @note With "--output -" the version is streamed to stdout a chunk at a time,
+ *       with constant memory whatever its size.
+ *
+ * @note With --all, every tracked file is restored under --output-dir on a
+ *       pool of --jobs workers: at its latest version, at the newest version
+ *       created at or before --at, or at the version a --version-map file
+ *       names for it. --include and --exclude globs select a subset.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"file.txt", "--version", "2", "--output", "old.txt"};
+ * int result = cmd_restore(5, args);
+ * ```
+ */
+int cmd_restore(int argc, char *argv[])
+{
+	if (argc < 1) {
+		print_error("restore: missing file argument");
+		printf("Usage: fiver restore <file> [--version <N>] [options]\n");
+		printf("       fiver restore --all --output-dir <dir> [--at <time>|--version-map <file>] [options]\n");
+		printf("Options:\n");
+		printf("  --version <N>    Restore to specific version (default: latest)\n");
+		printf("  --force          Overwrite existing file\n");
+		printf("  --json           Output in JSON format\n");
+		printf("Examples:\n");
+		printf("  fiver restore document.pdf\n");
+		printf("  fiver restore document.pdf --version 2\n");
+		printf("  fiver restore document.pdf --version 1 --force\n");
+		printf("  fiver restore --all --at \"2024-05-01 12:00\" --output-dir snapshot\n");
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < argc; i++)
+		if (strcmp(argv[i], "--all") == 0)
+			return restore_all(argc, argv);
+
+	const char *filename = argv[0];
+	uint32_t target_version = 0; // 0 means latest
+	int force_flag = 0;
+	int json_flag = 0;
+	const char *output_path = NULL; // NULL means use original filename
+
+	// Parse options
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--version") == 0) {
+			if (i + 1 >= argc) {
+				print_error("--version requires a value");
+				return EXIT_FAILURE;
+			}
+			long v = strtol(argv[i + 1], NULL, 10);
+			if (v <= 0) {
+				print_error("Invalid version: %s (must be > 0)", argv[i + 1]);
+				return EXIT_FAILURE;
+			}
+			target_version = (uint32_t)v;
+			i++; // Skip the value
+		} else if (strcmp(argv[i], "--force") == 0) {
+			force_flag = 1;
+		} else if (strcmp(argv[i], "--json") == 0) {
+			json_flag = 1;
+		} else if (strcmp(argv[i], "--output") == 0 || strcmp(argv[i], "-o") == 0) {
+			if (i + 1 >= argc) {
+				print_error("--output requires a value");
+				return EXIT_FAILURE;
+			}
+			output_path = argv[i + 1];
+			i++; // Skip the value
+		} else {
+			print_error("Unknown option: %s", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// "-" streams the version to stdout, which must then carry nothing else
+	int to_stdout = output_path != NULL && strcmp(output_path, "-") == 0;
+	if (to_stdout && json_flag) {
+		print_error("--json cannot be combined with --output -");
+		return EXIT_FAILURE;
+	}
+
+	if (verbose_flag && !to_stdout) {
+		print_info("Restoring file: %s", filename);
+		if (target_version > 0)
+			print_info("Target version: %u", target_version);
+		else
+			print_info("Target version: latest");
+	}
+
+	// Initialize storage
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		return EXIT_FAILURE;
+	}
+
+	// Find the target version
+	if (resolve_version(config, filename, &target_version) != EXIT_SUCCESS) {
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	if (to_stdout) {
+		int result = restore_to_stdout(config, filename, target_version);
+		close_storage(config);
+		return result;
+	}
+
+	// Determine the actual output path
+	const char *actual_output_path = output_path ? output_path : filename;
+
+	// Check if target file already exists
+	if (!force_flag && access(actual_output_path, F_OK) == 0) {
+		print_error("File %s already exists. Use --force to overwrite.", actual_output_path);
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	// Reconstruct into a temporary file and rename it over the output
+	uint32_t file_size;
+	if (restore_file_to_path(config, filename, target_version, actual_output_path, &file_size) != EXIT_SUCCESS) {
+		print_error("Failed to restore version %u of: %s to %s", target_version, filename,
+			    actual_output_path);
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	// Output result
+	if (json_flag) {
+		printf("{\n");
+		printf("  \"file\": \"%s\",\n", filename);
+		printf("  \"output_file\": \"%s\",\n", actual_output_path);
+		printf("  \"restored_version\": %u,\n", target_version);
+		printf("  \"file_size\": %u,\n", file_size);
+		printf("  \"success\": true\n");
+		printf("}\n");
+	} else {
+		print_success("Restored %s to version %u (%u bytes) -> %s", filename, target_version,
+			      file_size, actual_output_path);
+	}
+
+	// Cleanup
+	close_storage(config);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Shows version history for a file
+ *
+ * Implements the "history" command which displays the complete version
+ * history of a tracked file, including timestamps, operation counts,
+ * delta sizes, and commit messages.
+ *
+ * @param argc Number of command arguments. Must be >= 1.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ *
+ * @note The function supports --format and --limit options.
+ *
+ * @note Output formats include table, json, and brief.
+ *
+ * @note The function sorts versions in ascending order for display.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"file.txt", "--format", "json", "--limit", "5"};
+ * int result = cmd_history(5, args);
+ * ```
+ */
+int cmd_history(int argc, char *argv[])
+{
+	if (argc < 1) {
+		print_error("history: missing file argument");
+		printf("Usage: fiver history <file> [options]\n");
+		return EXIT_FAILURE;
+	}
+
+	const char *filename = argv[0];
+
+	// Options: --format <fmt>, --limit <N>
+	const char *format = "table";   // table | json | brief
+	int limit = 0;                  // 0 => no limit
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--format") == 0) {
+			if (i + 1 >= argc) {
+				print_error("--format requires a value");
+				return EXIT_FAILURE;
+			}
+			format = argv[i + 1];
+			i++;
+		} else if (strcmp(argv[i], "--limit") == 0) {
+			if (i + 1 >= argc) {
+				print_error("--limit requires a value");
+				return EXIT_FAILURE;
+			}
+			long v = strtol(argv[i + 1], NULL, 10);
+			if (v < 0) {
+				print_error("Invalid limit: %s", argv[i + 1]);
+				return EXIT_FAILURE;
+			}
+			limit = (int)v;
+			i++;
+		} else {
+			print_error("Unknown option: %s", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (verbose_flag)
+		print_info("Showing history for file: %s", filename);
+
+	// Initialize storage
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		return EXIT_FAILURE;
+	}
+
+	// Map the manifest; only the records that are printed get read
+	ManifestView *view = manifest_view_open(config, filename);
+	if (view == NULL || view->count == 0) {
+		print_error("No versions found for: %s", filename);
+		manifest_view_close(view);
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+	int count = (int)view->count;
+
+	int start_index = 0;
+	if (limit > 0 && limit < count)
+		start_index = count - limit; // show last <limit> entries
+
+	if (strcmp(format, "json") == 0) {
+		printf("{\n  \"file\": \"%s\",\n  \"versions\": [\n", filename);
+		int first = 1;
+		for (int idx = count - 1; idx >= start_index; idx--) {
+			ManifestEntry entry;
+			uint32_t message_length;
+			manifest_view_entry(view, (uint32_t)idx, &entry);
+			const char *message = manifest_view_message(view, &entry, &message_length);
+			if (!first)
+				printf(",\n");
+			first = 0;
+			printf(
+				"    { \"version\": %u, \"operations\": %u, \"delta_size\": %u, \"timestamp\": %ld, \"message\": \"%.*s\" }",
+				entry.version, entry.operation_count, entry.delta_size, (long)entry.timestamp,
+				(int)message_length, message);
+		}
+		printf("\n  ]\n}\n");
+	} else if (strcmp(format, "brief") == 0) {
+		for (int idx = count - 1; idx >= start_index; idx--) {
+			ManifestEntry entry;
+			uint32_t message_length;
+			manifest_view_entry(view, (uint32_t)idx, &entry);
+			const char *message = manifest_view_message(view, &entry, &message_length);
+			printf("v%u: %u ops, delta %u bytes%s%.*s\n", entry.version, entry.operation_count,
+			       entry.delta_size, message_length ? ", msg: " : "", (int)message_length, message);
+		}
+	} else { // table
+		printf("History for %s:\n", filename);
+		printf("Version  Timestamp            Ops  Delta  Message\n");
+		printf("-------  -------------------  ----  -----  -------\n");
+		char timebuf[64];
+		for (int idx = count - 1; idx >= start_index; idx--) {
+			ManifestEntry entry;
+			uint32_t message_length;
+			manifest_view_entry(view, (uint32_t)idx, &entry);
+			const char *message = manifest_view_message(view, &entry, &message_length);
+			time_t timestamp = (time_t)entry.timestamp;
+			struct tm *tm_info = localtime(&timestamp);
+			if (tm_info)
+				strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", tm_info);
+			else
+				strcpy(timebuf, "-");
+			printf("%-7u  %-19s  %-4u  %-5u  %.*s\n", entry.version, timebuf, entry.operation_count,
+			       entry.delta_size, (int)message_length, message);
+		}
+	}
+
+	manifest_view_close(view);
+	close_storage(config);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Lists all tracked files
+ *
+ * Implements the "list" command which displays all files currently
+ * being tracked by the fiver system, including version counts and
+ * optionally file sizes.
+ *
+ * @param argc Number of command arguments. Can be 0.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ *
+ * @note The function supports --show-sizes and --format options.
+ *
+ * @note The function reads the repository catalog, which is rebuilt from the
+ *       manifests if it is missing.
+ *
+ * @note Output formats include table and json.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"--show-sizes", "--format", "json"};
+ * int result = cmd_list(3, args);
+ * ```
+ */
+int cmd_list(int argc, char *argv[])
+{
+	if (verbose_flag)
+		print_info("Listing tracked files");
+
+	// Options: --show-sizes, --format <table|json>
+	int show_sizes = 0;
+	const char *format = "table";
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--show-sizes") == 0) {
+			show_sizes = 1;
+		} else if (strcmp(argv[i], "--format") == 0) {
+			if (i + 1 >= argc) {
+				print_error("--format requires a value");
+				return EXIT_FAILURE;
+			}
+			format = argv[i + 1];
+			i++;
+		} else {
+			print_error("Unknown option: %s", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	StorageConfig *config = open_storage();
+	if (!config) {
+		print_error("Failed to initialize storage");
+		return EXIT_FAILURE;
+	}
+
+	// One sequential read of the catalog covers every tracked file
+	CatalogEntry *summaries = NULL;
+	int summary_count = catalog_read(config, &summaries);
+	if (summary_count < 0) {
+		print_error("Cannot read the catalog in %s", config->storage_dir);
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	// Output
+	if (strcmp(format, "json") == 0) {
+		printf("{\n  \"files\": [\n");
+		for (int i = 0; i < summary_count; i++) {
+			if (i > 0)
+				printf(",\n");
+			printf("    { \"name\": ");
+			print_json_string(summaries[i].name);
+			printf(", \"versions\": %u, \"latest\": %u", summaries[i].version_count,
+			       summaries[i].latest_version);
+			if (show_sizes)
+				printf(", \"total_delta\": %llu", (unsigned long long)summaries[i].total_delta);
+			printf(" }");
+		}
+		printf("\n  ]\n}\n");
+	} else { // table (default)
+		if (show_sizes) {
+			printf("Tracked files:\n");
+			printf("Name                              Versions  Latest  TotalDelta\n");
+			printf("--------------------------------  --------  ------  ----------\n");
+			for (int i = 0; i < summary_count; i++) {
+				printf("%-32s  %-8u  %-6u  %-10llu\n", summaries[i].name,
+				       summaries[i].version_count, summaries[i].latest_version,
+				       (unsigned long long)summaries[i].total_delta);
+			}
+		} else {
+			printf("Tracked files:\n");
+			printf("Name                              Versions  Latest\n");
+			printf("--------------------------------  --------  ------\n");
+			for (int i = 0; i < summary_count; i++)
+				printf("%-32s  %-8u  %-6u\n", summaries[i].name,
+				       summaries[i].version_count, summaries[i].latest_version);
+		}
+	}
+
+	free(summaries);
+	close_storage(config);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Shows current status of a tracked file
+ *
+ * Implements the "status" command which displays the current status
+ * of a tracked file, including version information, timestamps,
+ * and comparison with the current file on disk.
+ *
+ * @param argc Number of command arguments. Must be >= 1.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ *
+ * @note The function supports --json option for machine-readable output.
+ *
+ * @note The function checks if the current file exists and whether it
+ *       matches the latest version: by its stat when that matches the one
+ *       recorded at the last track, by its size when that differs, and only
+ *       otherwise by hashing it. The delta chain is never replayed.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"file.txt", "--json"};
+ * int result = cmd_status(2, args);
+ * ```
+ */
+int cmd_status(int argc, char *argv[])
+{
+	if (argc < 1) {
+		print_error("status: missing file argument");
+		printf("Usage: fiver status <file> [options]\n");
+		return EXIT_FAILURE;
+	}
+
+	const char *filename = argv[0];
+
+	// Options: --json
+	int json_flag_local = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json_flag_local = 1;
+		} else {
+			print_error("Unknown option: %s", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (verbose_flag)
+		print_info("Showing status for file: %s", filename);
+
+	// Initialize storage
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		return EXIT_FAILURE;
+	}
+
+	// The latest record and the record count come straight from the mapped manifest
+	ManifestView *view = manifest_view_open(config, filename);
+	ManifestEntry latest;
+	if (view == NULL || manifest_view_entry(view, view->count - 1, &latest) != EXIT_SUCCESS) {
+		print_error("No versions found for: %s", filename);
+		manifest_view_close(view);
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+	int count = (int)view->count;
+	uint32_t latest_version = latest.version;
+	uint32_t message_length;
+	const char *message = manifest_view_message(view, &latest, &message_length);
+	time_t latest_timestamp = (time_t)latest.timestamp;
+
+	// Check if current file exists and compare
+	struct stat current_st;
+	int current_exists = (stat(filename, &current_st) == 0);
+
+	// Stat first, hash only if needed; the delta chain is never replayed
+	FileState file_state = FILE_STATE_UNKNOWN;
+	if (current_exists && storage_file_state(config, filename, &current_st, &file_state) != EXIT_SUCCESS)
+		file_state = FILE_STATE_UNKNOWN;
+	const char *up_to_date_json = file_state == FILE_STATE_UNCHANGED ? "true" :
+				      file_state == FILE_STATE_MODIFIED ? "false" : "\"unknown\"";
+
+	// Output
+	if (json_flag_local) {
+		printf("{\n");
+		printf("  \"file\": \"%s\",\n", filename);
+		printf("  \"tracked\": true,\n");
+		printf("  \"version_count\": %d,\n", count);
+		printf("  \"latest_version\": %u,\n", latest_version);
+		printf("  \"latest_timestamp\": %ld,\n", (long)latest_timestamp);
+		printf("  \"latest_operations\": %u,\n", latest.operation_count);
+		printf("  \"latest_delta_size\": %u,\n", latest.delta_size);
+		printf("  \"latest_message\": \"%.*s\",\n", (int)message_length, message);
+		printf("  \"current_file_exists\": %s,\n", current_exists ? "true" : "false");
+		if (current_exists) {
+			printf("  \"current_file_size\": %ld,\n", (long)current_st.st_size);
+			printf("  \"current_file_modified\": %ld,\n", (long)current_st.st_mtime);
+			printf("  \"is_up_to_date\": %s\n", up_to_date_json);
+		} else {
+			printf("  \"is_up_to_date\": false\n");
+		}
+		printf("}\n");
+	} else {
+		printf("Status for %s:\n", filename);
+		printf("  Tracked: yes\n");
+		printf("  Versions: %d\n", count);
+		printf("  Latest version: %u\n", latest_version);
+
+		char timebuf[64];
+		struct tm *tm_info = localtime(&latest_timestamp);
+		if (tm_info)
+			strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", tm_info);
+		else
+			strcpy(timebuf, "unknown");
+		printf("  Latest timestamp: %s\n", timebuf);
+		printf("  Latest operations: %u\n", latest.operation_count);
+		printf("  Latest delta size: %u bytes\n", latest.delta_size);
+		if (message_length > 0)
+			printf("  Latest message: %.*s\n", (int)message_length, message);
+
+		printf("  Current file: %s\n", current_exists ? "exists" : "missing");
+		if (current_exists) {
+			printf("  Current size: %ld bytes\n", (long)current_st.st_size);
+			printf("  Current modified: %s\n", ctime(&current_st.st_mtime));
+			if (file_state == FILE_STATE_UNCHANGED)
+				printf("  Up to date: yes\n");
+			else if (file_state == FILE_STATE_MODIFIED)
+				printf("  Up to date: no (modified since version %u)\n", latest_version);
+			else
+				printf("  Up to date: unknown (version %u has no content hash)\n", latest_version);
+		}
+	}
+
+	manifest_view_close(view);
+	close_storage(config);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prints a byte range of a stored version to stdout
+ *
+ * Implements the "cat" command which streams part or all of a stored
+ * version to stdout. Only the delta operations covering the requested
+ * range are resolved, so reading a few kilobytes of a large version does
+ * not reconstruct the whole file.
+ *
+ * @param argc Number of command arguments. Must be >= 1.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ *
+ * @note The function supports --version and --range options.
+ *
+ * @note A range extending past the end of the version is clamped to it.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"file.txt", "--version", "2", "--range", "0:4096"};
+ * int result = cmd_cat(5, args);
+ * ```
+ */
+int cmd_cat(int argc, char *argv[])
+{
+	if (argc < 1) {
+		print_error("cat: missing file argument");
+		printf("Usage: fiver cat <file> [--version <N>] [--range <off:len>]\n");
+		return EXIT_FAILURE;
+	}
+
+	const char *filename = argv[0];
+	uint32_t target_version = 0; // 0 => latest
+	unsigned long long range_offset = 0;
+	unsigned long long range_length = 0;
+	int has_range = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--version") == 0) {
+			if (i + 1 >= argc) {
+				print_error("--version requires a value");
+				return EXIT_FAILURE;
+			}
+			long v = strtol(argv[i + 1], NULL, 10);
+			if (v <= 0) {
+				print_error("Invalid version: %s (must be > 0)", argv[i + 1]);
+				return EXIT_FAILURE;
+			}
+			target_version = (uint32_t)v;
+			i++;
+		} else if (strcmp(argv[i], "--range") == 0) {
+			if (i + 1 >= argc) {
+				print_error("--range requires a value");
+				return EXIT_FAILURE;
+			}
+			char *end = NULL;
+			const char *spec = argv[i + 1];
+			errno = 0;
+			range_offset = strtoull(spec, &end, 10);
+			if (errno != 0 || end == spec || *end != ':' || !isdigit((unsigned char)end[1])) {
+				print_error("Invalid range: %s (expected off:len)", spec);
+				return EXIT_FAILURE;
+			}
+			const char *length_spec = end + 1;
+			range_length = strtoull(length_spec, &end, 10);
+			if (errno != 0 || *end != '\0') {
+				print_error("Invalid range: %s (expected off:len)", spec);
+				return EXIT_FAILURE;
+			}
+			has_range = 1;
+			i++;
+		} else {
+			print_error("Unknown option: %s", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		return EXIT_FAILURE;
+	}
+
+	if (resolve_version(config, filename, &target_version) != EXIT_SUCCESS) {
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	VersionReader *reader = version_reader_open(config, filename, target_version);
+	if (reader == NULL) {
+		print_error("Failed to open version %u of: %s", target_version, filename);
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	uint32_t version_size = version_reader_size(reader);
+	if (!has_range) {
+		range_offset = 0;
+		range_length = version_size;
+	}
+
+	if (range_offset > version_size) {
+		print_error("Range offset %llu is past the end of version %u (%u bytes)",
+			    range_offset, target_version, version_size);
+		version_reader_free(reader);
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+	if (range_length > version_size - range_offset)
+		range_length = version_size - range_offset;
+
+	if (verbose_flag)
+		fprintf(stderr, "ℹ Reading %llu bytes at offset %llu of %s (version %u)\n",
+			range_length, range_offset, filename, target_version);
+
+	// Stream the range in bounded chunks
+	uint8_t chunk[65536];
+	uint32_t offset = (uint32_t)range_offset;
+	uint32_t remaining = (uint32_t)range_length;
+	int result = EXIT_SUCCESS;
+	while (remaining > 0) {
+		uint32_t n = remaining < sizeof(chunk) ? remaining : (uint32_t)sizeof(chunk);
+		if (version_reader_read(reader, offset, n, chunk) < 0) {
+			print_error("Failed to read %u bytes at offset %u of: %s", n, offset, filename);
+			result = EXIT_FAILURE;
+			break;
+		}
+		if (fwrite(chunk, 1, n, stdout) != n) {
+			print_error("Failed to write output (%s)", strerror(errno));
+			result = EXIT_FAILURE;
+			break;
+		}
+		offset += n;
+		remaining -= n;
+	}
+	fflush(stdout);
+
+	version_reader_free(reader);
+	close_storage(config);
+	return result;
+}
+
+/**
+ * @brief Converts loose version files into per-file packs
+ *
+ * Implements the "migrate" command which finds every tracked file that still
+ * has versions stored as loose .delta and .meta files and moves them into
+ * the file's pack with storage_migrate_file().
+ *
+ * @param argc Number of command arguments. Can be 0.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ *
+ * @note The function supports the --json option.
+ *
+ * @note Running it again after a successful migration does nothing.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"--json"};
+ * int result = cmd_migrate(1, args);
+ * ```
+ */
+int cmd_migrate(int argc, char *argv[])
+{
+	int json_flag_local = 0;
+
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json_flag_local = 1;
+		} else {
+			print_error("Unknown option: %s", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		return EXIT_FAILURE;
+	}
+
+	DIR *dir = opendir(config->storage_dir);
+	if (dir == NULL) {
+		print_error("Cannot open storage dir: %s", config->storage_dir);
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	// Collect the tracked names behind the loose metadata files first; migrating removes them
+	char (*names)[256] = NULL;
+	int name_count = 0;
+	int name_capacity = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		size_t len = strlen(ent->d_name);
+		if (len < 6 || strcmp(ent->d_name + len - 5, ".meta") != 0)
+			continue;
+
+		char metadata_path[1024];
+		FileMetadata meta;
+		snprintf(metadata_path, sizeof(metadata_path), "%s/%s", config->storage_dir, ent->d_name);
+		if (read_legacy_metadata(metadata_path, &meta) != EXIT_SUCCESS || meta.filename[0] == '\0')
+			continue;
+
+		int seen = 0;
+		for (int i = 0; i < name_count && !seen; i++)
+			seen = strcmp(names[i], meta.filename) == 0;
+		if (seen)
+			continue;
+
+		if (name_count == name_capacity) {
+			name_capacity = name_capacity ? name_capacity * 2 : 16;
+			char (*new_names)[256] = realloc(names, (size_t)name_capacity * sizeof(*names));
+			if (new_names == NULL) {
+				print_error("Out of memory");
+				free(names);
+				closedir(dir);
+				close_storage(config);
+				return EXIT_FAILURE;
+			}
+			names = new_names;
+		}
+		memcpy(names[name_count], meta.filename, sizeof(meta.filename));
+		names[name_count][sizeof(names[0]) - 1] = '\0';
+		name_count++;
+	}
+	closedir(dir);
+
+	int result = EXIT_SUCCESS;
+	int files_migrated = 0;
+	int versions_migrated = 0;
+	for (int i = 0; i < name_count; i++) {
+		int moved = storage_migrate_file(config, names[i]);
+		if (moved < 0) {
+			print_error("Failed to migrate: %s", names[i]);
+			result = EXIT_FAILURE;
+			continue;
+		}
+		if (moved > 0) {
+			files_migrated++;
+			versions_migrated += moved;
+			if (verbose_flag)
+				print_info("Packed %d versions of %s", moved, names[i]);
+		}
+	}
+	free(names);
+
+	if (json_flag_local) {
+		printf("{\n");
+		printf("  \"files_migrated\": %d,\n", files_migrated);
+		printf("  \"versions_migrated\": %d,\n", versions_migrated);
+		printf("  \"success\": %s\n", result == EXIT_SUCCESS ? "true" : "false");
+		printf("}\n");
+	} else if (!quiet_flag) {
+		print_success("Migrated %d versions of %d files into packs", versions_migrated, files_migrated);
+	}
+
+	close_storage(config);
+	return result;
+}
+
+// Where cmd_export writes the versions handed over by the chain walk
+typedef struct {
+	const char *	output_dir;             // Directory receiving the versions
+	const char *	name;                   // Base name of the tracked file
+	int		force;                  // Whether existing files are overwritten
+	uint64_t	bytes;                  // Bytes written so far
+} ExportTarget;
+
+// Writes one version to <output_dir>/<name>.v<version>; a VersionSink
+static int export_version(uint32_t version, const uint8_t *data, uint32_t size, void *context)
+{
+	ExportTarget *target = context;
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s.v%u", target->output_dir, target->name, version);
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | (target->force ? 0 : O_EXCL), 0666);
+	if (fd == -1) {
+		if (errno == EEXIST)
+			print_error("File %s already exists. Use --force to overwrite.", path);
+		else
+			print_error("Cannot create %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	uint32_t written = 0;
+	while (written < size) {
+		ssize_t n = write(fd, data + written, size - written);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		written += (uint32_t)n;
+	}
+
+	if (close(fd) == -1 || written != size) {
+		print_error("Failed to write %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	target->bytes += size;
+	if (verbose_flag)
+		print_info("Exported version %u (%u bytes) -> %s", version, size, path);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Writes every version of a file to a directory
+ *
+ * Implements the "export" command which rebuilds versions 1 to latest of a
+ * tracked file with a single walk over its delta chain and writes version N
+ * to <output-dir>/<name>.vN as soon as it is built.
+ *
+ * @param argc Number of command arguments. Must be >= 1.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ *
+ * @note The function requires --all-versions and --output-dir, and supports
+ *       --force and --json.
+ *
+ * @note Unlike one restore per version, which replays the chain from
+ *       version 1 every time, the work is linear in the number of versions.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"file.txt", "--all-versions", "--output-dir", "audit"};
+ * int result = cmd_export(4, args);
+ * ```
+ */
+int cmd_export(int argc, char *argv[])
+{
+	if (argc < 1) {
+		print_error("export: missing file argument");
+		printf("Usage: fiver export <file> --all-versions --output-dir <dir> [options]\n");
+		return EXIT_FAILURE;
+	}
+
+	const char *filename = argv[0];
+	int all_versions = 0;
+	int force_flag = 0;
+	int json_flag = 0;
+	const char *output_dir = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--all-versions") == 0) {
+			all_versions = 1;
+		} else if (strcmp(argv[i], "--force") == 0) {
+			force_flag = 1;
+		} else if (strcmp(argv[i], "--json") == 0) {
+			json_flag = 1;
+		} else if (strcmp(argv[i], "--output-dir") == 0) {
+			if (i + 1 >= argc) {
+				print_error("--output-dir requires a path");
+				return EXIT_FAILURE;
+			}
+			output_dir = argv[++i];
+		} else {
+			print_error("Unknown option: %s", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!all_versions || output_dir == NULL) {
+		print_error("export requires --all-versions and --output-dir");
+		return EXIT_FAILURE;
+	}
+
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		return EXIT_FAILURE;
+	}
+
+	uint32_t latest = 0;
+	if (resolve_version(config, filename, &latest) != EXIT_SUCCESS) {
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	if (mkdir(output_dir, 0777) != 0 && errno != EEXIST) {
+		print_error("Cannot create %s: %s", output_dir, strerror(errno));
+		close_storage(config);
+		return EXIT_FAILURE;
+	}
+
+	const char *slash = strrchr(filename, '/');
+	ExportTarget target = { output_dir, slash != NULL ? slash + 1 : filename, force_flag, 0 };
+	int exported = storage_walk_versions(config, filename, latest, export_version, &target);
+	close_storage(config);
+
+	if (exported < 0) {
+		print_error("Failed to export the versions of: %s", filename);
+		return EXIT_FAILURE;
+	}
+
+	if (json_flag) {
+		printf("{\n");
+		printf("  \"file\": ");
+		print_json_string(filename);
+		printf(",\n  \"output_dir\": ");
+		print_json_string(output_dir);
+		printf(",\n");
+		printf("  \"versions_exported\": %d,\n", exported);
+		printf("  \"bytes_written\": %llu,\n", (unsigned long long)target.bytes);
+		printf("  \"success\": true\n");
+		printf("}\n");
+	} else {
+		print_success("Exported %d versions of %s (%llu bytes) -> %s", exported, filename,
+			      (unsigned long long)target.bytes, output_dir);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// One file of an fsck run and, once checked, its result
+typedef struct {
+	StorageConfig *	config;                 // Storage shared by every worker
+	const char *	name;                   // Canonical path of the tracked file
+	int		damaged;                // Whether a problem was found
+	FileCheck	check;                  // What was checked and found
+} FsckJob;
+
+// Checks one file; safe to run on several threads at once
+static void fsck_one(void *arg)
+{
+	FsckJob *job = arg;
+
+	job->damaged = storage_check_file(job->config, job->name, &job->check) != EXIT_SUCCESS;
+}
+
+/**
+ * @brief Checks the integrity of the stored versions of every tracked file
+ *
+ * Implements the "fsck" command which checks every file in the catalog, or
+ * the files given as arguments, with storage_check_file() on a pool of
+ * worker threads. For each version, the stored delta must parse and match
+ * its checksum, every operation must stay within the version it applies to,
+ * and the rebuilt contents must match the content hash.
+ *
+ * @param argc Number of command arguments. Can be 0.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS if every file is intact, EXIT_FAILURE on damage or error.
+ *
+ * @note Supports --jobs (-j) N (default: number of CPUs) and --json for one
+ *       JSON object per file.
+ *
+ * @note Each file is checked in a single pass down its delta chain, so the
+ *       work is linear in the number of versions.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"--jobs", "8"};
+ * int result = cmd_fsck(2, args);
+ * ```
+ */
+int cmd_fsck(int argc, char *argv[])
+{
+	int json_output = 0;
+	uint32_t jobs = thread_pool_cpu_count();
+	PathList names = { NULL, 0, 0 };
+
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json_output = 1;
+		} else if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+			char *end = NULL;
+			long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+			if (i + 1 >= argc || *end != '\0' || value < 1 || value > 1024) {
+				print_error("--jobs requires a number from 1 to 1024");
+				path_list_free(&names);
+				return EXIT_FAILURE;
+			}
+			jobs = (uint32_t)value;
+			i++;
+		} else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			print_error("Unknown option: %s", argv[i]);
+			path_list_free(&names);
+			return EXIT_FAILURE;
+		} else if (path_list_add(&names, argv[i]) != EXIT_SUCCESS) {
+			print_error("Out of memory");
+			path_list_free(&names);
+			return EXIT_FAILURE;
+		}
+	}
+
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		path_list_free(&names);
+		return EXIT_FAILURE;
+	}
+
+	// Without arguments, every file in the catalog is checked
+	if (names.count == 0) {
+		CatalogEntry *entries = NULL;
+		int count = catalog_read(config, &entries);
+		if (count < 0) {
+			print_error("Failed to read the catalog");
+			close_storage(config);
+			return EXIT_FAILURE;
+		}
+		for (int i = 0; i < count; i++) {
+			if (path_list_add(&names, entries[i].name) != EXIT_SUCCESS) {
+				print_error("Out of memory");
+				free(entries);
+				close_storage(config);
+				path_list_free(&names);
+				return EXIT_FAILURE;
+			}
+		}
+		free(entries);
+	}
+
+	FsckJob *fsck_jobs = calloc(names.count > 0 ? names.count : 1, sizeof(FsckJob));
+	if (fsck_jobs == NULL) {
+		print_error("Out of memory");
+		close_storage(config);
+		path_list_free(&names);
+		return EXIT_FAILURE;
+	}
+	for (uint32_t i = 0; i < names.count; i++) {
+		fsck_jobs[i].config = config;
+		fsck_jobs[i].name = names.paths[i];
+	}
+
+	if (jobs > names.count)
+		jobs = names.count;
+	ThreadPool *pool = jobs > 1 ? thread_pool_new(jobs) : NULL;
+
+	// In JSON mode stdout carries only the results; storage messages go to stderr
+	if (json_output)
+		storage_messages_to_stderr(1);
+
+	thread_pool_run(pool, fsck_one, fsck_jobs, names.count, sizeof(FsckJob));
+	thread_pool_free(pool);
+
+	if (json_output)
+		storage_messages_to_stderr(0);
+
+	uint32_t damaged = 0;
+	uint64_t versions = 0;
+	for (uint32_t i = 0; i < names.count; i++) {
+		const FsckJob *job = &fsck_jobs[i];
+
+		versions += job->check.versions_checked;
+		if (job->damaged)
+			damaged++;
+
+		if (json_output) {
+			printf("{\"file\": ");
+			print_json_string(job->name);
+			printf(", \"status\": \"%s\", \"versions_checked\": %u", job->damaged ? "damaged" : "ok",
+			       job->check.versions_checked);
+			if (job->damaged) {
+				printf(", \"version\": %u, \"problem\": ", job->check.bad_version);
+				print_json_string(job->check.problem);
+			}
+			printf("}\n");
+		} else if (job->damaged && job->check.bad_version > 0) {
+			print_error("%s: version %u: %s", job->name, job->check.bad_version, job->check.problem);
+		} else if (job->damaged) {
+			print_error("%s: %s", job->name, job->check.problem);
+		} else if (verbose_flag) {
+			print_success("%s: %u versions intact", job->name, job->check.versions_checked);
+		}
+	}
+
+	if (!json_output) {
+		if (damaged > 0)
+			print_error("%u of %u files are damaged", damaged, names.count);
+		else
+			print_success("Checked %u files, %llu versions: no problems found", names.count,
+				      (unsigned long long)versions);
+	}
+
+	free(fsck_jobs);
+	close_storage(config);
+	path_list_free(&names);
+	return damaged > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Files whose versions insert at least this share of their bytes on average delta poorly
+#define STATS_POOR_RATIO 0.5
+
+// Summary of the stored versions of one tracked file, read from its manifest
+typedef struct {
+	const char *	name;                   // Canonical path of the tracked file
+	uint32_t	versions;               // Stored versions
+	uint32_t	chain_depth;            // Deltas applied to restore the latest version
+	uint64_t	stored_bytes;           // Stored deltas and their record headers
+	uint64_t	logical_bytes;          // Sum of the sizes of every version
+	uint32_t	latest_size;            // Size of the latest version
+	double		mean_ratio;             // Mean of inserted bytes / size over versions after the first
+	double		max_ratio;              // Largest such ratio
+	uint32_t	max_ratio_version;      // Version with the largest ratio, 0 with a single version
+	uint64_t	restore_bytes;          // Bytes read and rebuilt to restore the latest version
+} FileStats;
+
+// One version in the ranking of versions by inserted bytes
+typedef struct {
+	const char *	name;                   // Canonical path of the tracked file
+	uint32_t	version;                // Version number
+	uint32_t	inserted;               // Literal bytes its delta inserts
+	uint32_t	file_size;              // Size of the version
+} HeavyVersion;
+
+// Keeps the count largest versions by inserted bytes, largest first
+static void rank_heavy_version(HeavyVersion *top, uint32_t count, uint32_t *used, const HeavyVersion *version)
+{
+	if (count == 0 || (*used == count && top[count - 1].inserted >= version->inserted))
+		return;
+
+	uint32_t pos = *used < count ? (*used)++ : count - 1;
+	while (pos > 0 && top[pos - 1].inserted < version->inserted) {
+		top[pos] = top[pos - 1];
+		pos--;
+	}
+	top[pos] = *version;
+}
+
+// Summarizes a file from its manifest records alone; no delta is read
+static int collect_file_stats(StorageConfig *config, const char *name, FileStats *stats,
+			      HeavyVersion *top, uint32_t top_count, uint32_t *top_used)
+{
+	memset(stats, 0, sizeof(FileStats));
+	stats->name = name;
+
+	ManifestView *view = manifest_view_open(config, name);
+	if (view == NULL)
+		return -1;
+
+	double ratio_sum = 0;
+	for (uint32_t i = 0; i < view->count; i++) {
+		ManifestEntry entry;
+		manifest_view_entry(view, i, &entry);
+
+		// Loose versions keep a FileMetadata in their .meta file
+		uint64_t record = entry.size + ((entry.flags & MANIFEST_ENTRY_PACKED) ?
+						sizeof(PackRecordHeader) : sizeof(FileMetadata));
+		stats->versions++;
+		stats->stored_bytes += record;
+		stats->logical_bytes += entry.file_size;
+		stats->restore_bytes += record + entry.file_size;
+		stats->chain_depth = entry.version;
+		stats->latest_size = entry.file_size;
+
+		// The first version stores the whole file; only later ones say how well deltas work
+		if (entry.version > 1 && entry.file_size > 0) {
+			double ratio = (double)entry.delta_size / entry.file_size;
+			ratio_sum += ratio;
+			if (stats->max_ratio_version == 0 || ratio > stats->max_ratio) {
+				stats->max_ratio = ratio;
+				stats->max_ratio_version = entry.version;
+			}
+
+			HeavyVersion heavy = { name, entry.version, entry.delta_size, entry.file_size };
+			rank_heavy_version(top, top_count, top_used, &heavy);
+		}
+	}
+
+	if (stats->versions > 1)
+		stats->mean_ratio = ratio_sum / (stats->versions - 1);
+	manifest_view_close(view);
+	return EXIT_SUCCESS;
+}
+
+// Whether a file's versions change so much of it that deltas barely save anything
+static int poor_candidate(const FileStats *stats)
+{
+	return stats->versions > 1 && stats->mean_ratio >= STATS_POOR_RATIO;
+}
+
+/**
+ * @brief Reports storage and restore statistics of tracked files
+ *
+ * Implements the "stats" command which reads the catalog and the manifest
+ * of every tracked file, or of the files given as arguments, without
+ * reading any delta. For each file it reports the chain depth, the bytes
+ * stored against the logical bytes of all versions, the mean and largest
+ * delta ratio (bytes a version inserts over its size), and the bytes read
+ * and rebuilt to restore the latest version. Totals follow, then the
+ * versions that insert the most bytes and the files that delta poorly.
+ *
+ * @param argc Number of command arguments. Can be 0.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ *
+ * @note Supports --top N (versions ranked by inserted bytes, default 5)
+ *       and --json.
+ *
+ * @note A file is flagged as a poor candidate when its versions insert at
+ *       least half of their bytes on average, as compressed, encrypted and
+ *       office formats do.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"--top", "10"};
+ * int result = cmd_stats(2, args);
+ * ```
+ */
+int cmd_stats(int argc, char *argv[])
+{
+	int json_output = 0;
+	uint32_t top_count = 5;
+	PathList names = { NULL, 0, 0 };
+
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json_output = 1;
+		} else if (strcmp(argv[i], "--top") == 0) {
+			char *end = NULL;
+			long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+			if (i + 1 >= argc || *end != '\0' || value < 0 || value > 1000) {
+				print_error("--top requires a number from 0 to 1000");
+				path_list_free(&names);
+				return EXIT_FAILURE;
+			}
+			top_count = (uint32_t)value;
+			i++;
+		} else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			print_error("Unknown option: %s", argv[i]);
+			path_list_free(&names);
+			return EXIT_FAILURE;
+		} else if (path_list_add(&names, argv[i]) != EXIT_SUCCESS) {
+			print_error("Out of memory");
+			path_list_free(&names);
+			return EXIT_FAILURE;
+		}
+	}
+
+	StorageConfig *config = open_storage();
+	if (config == NULL) {
+		print_error("Failed to initialize storage");
+		path_list_free(&names);
+		return EXIT_FAILURE;
+	}
+
+	// Without arguments, every file in the catalog is summarized
+	if (names.count == 0) {
+		CatalogEntry *entries = NULL;
+		int count = catalog_read(config, &entries);
+		if (count < 0) {
+			print_error("Cannot read the catalog in %s", config->storage_dir);
+			close_storage(config);
+			return EXIT_FAILURE;
+		}
+		for (int i = 0; i < count; i++) {
+			if (path_list_add(&names, entries[i].name) != EXIT_SUCCESS) {
+				print_error("Out of memory");
+				free(entries);
+				close_storage(config);
+				path_list_free(&names);
+				return EXIT_FAILURE;
+			}
+		}
+		free(entries);
+	}
+
+	FileStats *files = calloc(names.count > 0 ? names.count : 1, sizeof(FileStats));
+	HeavyVersion *top = calloc(top_count > 0 ? top_count : 1, sizeof(HeavyVersion));
+	if (files == NULL || top == NULL) {
+		print_error("Out of memory");
+		free(files);
+		free(top);
+		close_storage(config);
+		path_list_free(&names);
+		return EXIT_FAILURE;
+	}
+
+	uint32_t top_used = 0;
+	uint32_t file_count = 0;
+	int result = EXIT_SUCCESS;
+	for (uint32_t i = 0; i < names.count; i++) {
+		if (collect_file_stats(config, names.paths[i], &files[file_count], top, top_count, &top_used) !=
+		    EXIT_SUCCESS || files[file_count].versions == 0) {
+			print_error("No versions found for: %s", names.paths[i]);
+			result = EXIT_FAILURE;
+			continue;
+		}
+		file_count++;
+	}
+
+	// Totals over every file
+	FileStats total;
+	memset(&total, 0, sizeof(total));
+	uint32_t poor = 0;
+	uint32_t max_depth = 0;
+	double ratio_sum = 0;
+	uint32_t ratio_count = 0;
+	for (uint32_t i = 0; i < file_count; i++) {
+		const FileStats *f = &files[i];
+		total.versions += f->versions;
+		total.stored_bytes += f->stored_bytes;
+		total.logical_bytes += f->logical_bytes;
+		total.restore_bytes += f->restore_bytes;
+		if (f->chain_depth > max_depth)
+			max_depth = f->chain_depth;
+		if (f->versions > 1) {
+			ratio_sum += f->mean_ratio * (f->versions - 1);
+			ratio_count += f->versions - 1;
+		}
+		if (f->max_ratio_version != 0 && f->max_ratio > total.max_ratio)
+			total.max_ratio = f->max_ratio;
+		if (poor_candidate(f))
+			poor++;
+	}
+	total.mean_ratio = ratio_count > 0 ? ratio_sum / ratio_count : 0;
+
+	if (json_output) {
+		printf("{\n  \"files\": [\n");
+		for (uint32_t i = 0; i < file_count; i++) {
+			const FileStats *f = &files[i];
+			printf("    {\"name\": ");
+			print_json_string(f->name);
+			printf(", \"versions\": %u, \"chain_depth\": %u, \"stored_bytes\": %llu, "
+			       "\"logical_bytes\": %llu, \"latest_size\": %u, \"mean_delta_ratio\": %.4f, "
+			       "\"max_delta_ratio\": %.4f, \"restore_bytes\": %llu, \"poor_candidate\": %s}%s\n",
+			       f->versions, f->chain_depth, (unsigned long long)f->stored_bytes,
+			       (unsigned long long)f->logical_bytes, f->latest_size, f->mean_ratio, f->max_ratio,
+			       (unsigned long long)f->restore_bytes, poor_candidate(f) ? "true" : "false",
+			       i + 1 < file_count ? "," : "");
+		}
+		printf("  ],\n  \"insert_heavy_versions\": [\n");
+		for (uint32_t i = 0; i < top_used; i++) {
+			printf("    {\"name\": ");
+			print_json_string(top[i].name);
+			printf(", \"version\": %u, \"inserted_bytes\": %u, \"file_size\": %u}%s\n", top[i].version,
+			       top[i].inserted, top[i].file_size, i + 1 < top_used ? "," : "");
+		}
+		printf("  ],\n  \"totals\": {\"files\": %u, \"versions\": %u, \"max_chain_depth\": %u, "
+		       "\"stored_bytes\": %llu, \"logical_bytes\": %llu, \"mean_delta_ratio\": %.4f, "
+		       "\"max_delta_ratio\": %.4f, \"restore_bytes\": %llu, \"poor_candidates\": %u}\n}\n",
+		       file_count, total.versions, max_depth, (unsigned long long)total.stored_bytes,
+		       (unsigned long long)total.logical_bytes, total.mean_ratio, total.max_ratio,
+		       (unsigned long long)total.restore_bytes, poor);
+	} else {
+		printf("Name                              Versions  Stored      Logical     MeanRatio  MaxRatio  RestoreBytes\n");
+		printf("--------------------------------  --------  ----------  ----------  ---------  --------  ------------\n");
+		for (uint32_t i = 0; i < file_count; i++) {
+			const FileStats *f = &files[i];
+			printf("%-32s  %-8u  %-10llu  %-10llu  %8.1f%%  %7.1f%%  %-12llu\n", f->name, f->versions,
+			       (unsigned long long)f->stored_bytes, (unsigned long long)f->logical_bytes,
+			       f->mean_ratio * 100, f->max_ratio * 100, (unsigned long long)f->restore_bytes);
+		}
+
+		printf("\nTotals: %u files, %u versions, deepest chain %u\n", file_count, total.versions, max_depth);
+		printf("Stored %llu of %llu logical bytes", (unsigned long long)total.stored_bytes,
+		       (unsigned long long)total.logical_bytes);
+		if (total.logical_bytes > 0)
+			printf(" (%.1f%%)", 100.0 * (double)total.stored_bytes / (double)total.logical_bytes);
+		printf("\nDelta ratio: mean %.1f%%, max %.1f%%\n", total.mean_ratio * 100, total.max_ratio * 100);
+		printf("Restoring every latest version reads and rebuilds %llu bytes\n",
+		       (unsigned long long)total.restore_bytes);
+
+		if (top_used > 0) {
+			printf("\nVersions inserting the most bytes:\n");
+			for (uint32_t i = 0; i < top_used; i++)
+				printf("  %s v%u: %u of %u bytes inserted (%.1f%%)\n", top[i].name, top[i].version,
+				       top[i].inserted, top[i].file_size,
+				       top[i].file_size > 0 ? 100.0 * top[i].inserted / top[i].file_size : 0.0);
+		}
+
+		if (poor > 0) {
+			printf("\nPoor candidates (versions insert %.0f%% or more of their bytes on average;\n",
+			       STATS_POOR_RATIO * 100);
+			printf("compressed, encrypted and office formats delta poorly):\n");
+			for (uint32_t i = 0; i < file_count; i++)
+				if (poor_candidate(&files[i]))
+					printf("  %s: mean delta ratio %.1f%%\n", files[i].name, files[i].mean_ratio * 100);
+		}
+	}
+
+	free(files);
+	free(top);
+	close_storage(config);
+	path_list_free(&names);
+	return result;
+}
+
+// A burst still changing after this many debounce intervals is tracked anyway
+#define WATCH_MAX_DELAY 10
+
+// Directory watched for changes
+typedef struct {
+	int		wd;                     // inotify watch descriptor
+	char *		dir;                    // Path of the directory, as given or found under one
+	int		whole;                  // Every file in it is tracked, not only the named ones
+} WatchDir;
+
+// File named on the command line, watched through its directory
+typedef struct {
+	int		wd;                     // Watch descriptor of its directory
+	const char *	name;                   // Name within the directory
+	const char *	path;                   // Path as given, under which it is tracked
+} WatchFile;
+
+// State of a watcher, kept for as long as it runs
+typedef struct {
+	int		fd;                     // inotify instance
+	int		recursive;              // Directories created under watched ones are watched too
+	const PathFilter *filter;               // Include and exclude globs
+	WatchDir *	dirs;                   // Watched directories, sorted by watch descriptor
+	uint32_t	dir_count;
+	uint32_t	dir_capacity;
+	WatchFile *	files;                  // Files named on the command line
+	uint32_t	file_count;
+	HeadCache	heads;                  // Latest versions of recently tracked files
+} Watcher;
+
+// Set by SIGINT or SIGTERM in the long-running commands
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int signal)
+{
+	(void)signal;
+	stop_requested = 1;
+}
+
+static int64_t watch_now_ms(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Joins a directory and a name the way collect_files() does
+static int watch_path(const char *dir, const char *name, char *path, size_t max_len)
+{
+	const char *separator = dir[strlen(dir) - 1] == '/' ? "" : "/";
+	return snprintf(path, max_len, "%s%s%s", dir, separator, name) < (int)max_len ? EXIT_SUCCESS : -1;
+}
+
+// Finds a watched directory; the kernel hands out watch descriptors in increasing order
+static WatchDir * watch_dir_find(Watcher *watcher, int wd)
+{
+	uint32_t low = 0;
+	uint32_t high = watcher->dir_count;
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		if (watcher->dirs[mid].wd == wd)
+			return &watcher->dirs[mid];
+		if (watcher->dirs[mid].wd < wd)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return NULL;
+}
+
+// Starts watching a directory; one watched again, such as after a rename, takes its new path
+static int watch_dir_add(Watcher *watcher, const char *dir, int whole)
+{
+	int wd = inotify_add_watch(watcher->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+	if (wd == -1) {
+		if (errno == ENOSPC)
+			print_error("Cannot watch %s: too many watches (raise fs.inotify.max_user_watches)", dir);
+		else
+			print_error("Cannot watch %s: %s", dir, strerror(errno));
+		return -1;
+	}
+
+	char *copy = strdup(dir);
+	if (copy == NULL) {
+		print_error("Out of memory");
+		return -1;
+	}
+
+	WatchDir *existing = watch_dir_find(watcher, wd);
+	if (existing != NULL) {
+		free(existing->dir);
+		existing->dir = copy;
+		existing->whole |= whole;
+		return wd;
+	}
+
+	if (watcher->dir_count == watcher->dir_capacity) {
+		uint32_t capacity = watcher->dir_capacity == 0 ? 64 : watcher->dir_capacity * 2;
+		WatchDir *dirs = realloc(watcher->dirs, capacity * sizeof(WatchDir));
+		if (dirs == NULL) {
+			print_error("Out of memory");
+			free(copy);
+			return -1;
+		}
+		watcher->dirs = dirs;
+		watcher->dir_capacity = capacity;
+	}
+
+	// Descriptors of removed watches are reused only after the counter wraps; keep the order anyway
+	uint32_t at = watcher->dir_count;
+	while (at > 0 && watcher->dirs[at - 1].wd > wd)
+		at--;
+	memmove(&watcher->dirs[at + 1], &watcher->dirs[at], (watcher->dir_count - at) * sizeof(WatchDir));
+	watcher->dirs[at].wd = wd;
+	watcher->dirs[at].dir = copy;
+	watcher->dirs[at].whole = whole;
+	watcher->dir_count++;
+	return wd;
+}
+
+// Forgets a directory whose watch the kernel removed, because it was deleted or unmounted
+static void watch_dir_remove(Watcher *watcher, int wd)
+{
+	WatchDir *dir = watch_dir_find(watcher, wd);
+	if (dir == NULL)
+		return;
+
+	free(dir->dir);
+	uint32_t at = (uint32_t)(dir - watcher->dirs);
+	memmove(&watcher->dirs[at], &watcher->dirs[at + 1], (watcher->dir_count - at - 1) * sizeof(WatchDir));
+	watcher->dir_count--;
+}
+
+// Watches dir and, when recursive, the directories under it; files found are added to found
+static int watch_tree(Watcher *watcher, const char *dir, PathList *found)
+{
+	if (watch_dir_add(watcher, dir, 1) == -1)
+		return -1;
+
+	DIR *d = opendir(dir);
+	if (d == NULL) {
+		print_error("Cannot open directory %s: %s", dir, strerror(errno));
+		return -1;
+	}
+
+	int result = EXIT_SUCCESS;
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+		    strcmp(entry->d_name, ".fiver") == 0)
+			continue;
+
+		char path[4096];
+		if (watch_path(dir, entry->d_name, path, sizeof(path)) != EXIT_SUCCESS)
+			continue;
+
+		struct stat st;
+		if (lstat(path, &st) != 0)
+			continue;
+
+		if (S_ISDIR(st.st_mode) && watcher->recursive) {
+			if (!path_excluded(watcher->filter, path) && watch_tree(watcher, path, found) != EXIT_SUCCESS)
+				result = -1;
+		} else if (S_ISREG(st.st_mode) && found != NULL && path_included(watcher->filter, path)) {
+			path_list_add(found, path);
+		}
+	}
+
+	closedir(d);
+	return result;
+}
+
+// Queues every watched file after the kernel dropped events; unchanged files are skipped by their state
+static void watch_rescan(Watcher *watcher, PathList *pending)
+{
+	for (uint32_t i = 0; i < watcher->file_count; i++)
+		path_list_add(pending, watcher->files[i].path);
+
+	// watch_tree() appends to the table it walks; only the directories watched so far are scanned
+	uint32_t count = watcher->dir_count;
+	int recursive = watcher->recursive;
+	watcher->recursive = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (!watcher->dirs[i].whole)
+			continue;
+		char *dir = strdup(watcher->dirs[i].dir);
+		if (dir != NULL)
+			watch_tree(watcher, dir, pending);
+		free(dir);
+	}
+	watcher->recursive = recursive;
+}
+
+// Queues the file an event names, if it is one being watched
+static void watch_event(Watcher *watcher, const struct inotify_event *event, PathList *pending)
+{
+	if (event->mask & IN_Q_OVERFLOW) {
+		watch_rescan(watcher, pending);
+		return;
+	}
+	if (event->mask & IN_IGNORED) {
+		watch_dir_remove(watcher, event->wd);
+		return;
+	}
+	if (event->len == 0)
+		return;
+
+	WatchDir *dir = watch_dir_find(watcher, event->wd);
+	if (dir == NULL)
+		return;
+
+	char path[4096];
+	if (watch_path(dir->dir, event->name, path, sizeof(path)) != EXIT_SUCCESS)
+		return;
+
+	// A directory created or moved in is watched, and the files already in it tracked
+	if (event->mask & IN_ISDIR) {
+		if (watcher->recursive && dir->whole && (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+		    strcmp(event->name, ".fiver") != 0 && !path_excluded(watcher->filter, path))
+			watch_tree(watcher, path, pending);
+		return;
+	}
+
+	if (!(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)))
+		return;
+
+	for (uint32_t i = 0; i < watcher->file_count; i++) {
+		if (watcher->files[i].wd == event->wd && strcmp(watcher->files[i].name, event->name) == 0) {
+			path_list_add(pending, watcher->files[i].path);
+			return;
+		}
+	}
+
+	if (dir->whole && path_included(watcher->filter, path))
+		path_list_add(pending, path);
+}
+
+// Tracks the files changed since the last batch and prints what happened to them
+static int watch_flush(Watcher *watcher, StorageConfig *config, ThreadPool *pool, PathList *pending,
+		       int json_output)
+{
+	qsort(pending->paths, pending->count, sizeof(char *), compare_paths);
+
+	// Each file once; files deleted again before the burst settled are not tracked
+	PathList files = { NULL, 0, 0 };
+	for (uint32_t i = 0; i < pending->count; i++) {
+		struct stat st;
+		if (i > 0 && strcmp(pending->paths[i], pending->paths[i - 1]) == 0)
+			continue;
+		if (lstat(pending->paths[i], &st) != 0 || !S_ISREG(st.st_mode))
+			continue;
+		path_list_add(&files, pending->paths[i]);
+	}
+	path_list_free(pending);
+	memset(pending, 0, sizeof(PathList));
+
+	TrackJob *jobs = calloc(files.count > 0 ? files.count : 1, sizeof(TrackJob));
+	if (jobs == NULL) {
+		print_error("Out of memory");
+		path_list_free(&files);
+		return -1;
+	}
+
+	watcher->heads.batch++;
+	for (uint32_t i = 0; i < files.count; i++) {
+		jobs[i].config = config;
+		jobs[i].path = files.paths[i];
+		jobs[i].json = json_output;
+		jobs[i].head = head_cache_claim(&watcher->heads, files.paths[i]);
+	}
+
+	// In JSON mode stdout carries only the results; storage messages go to stderr
+	if (json_output)
+		storage_messages_to_stderr(1);
+
+	thread_pool_run(pool, track_one, jobs, files.count, sizeof(TrackJob));
+	int commit_failed = storage_commit(config) != EXIT_SUCCESS;
+
+	if (json_output)
+		storage_messages_to_stderr(0);
+
+	int failed = 0;
+	for (uint32_t i = 0; i < files.count; i++) {
+		const TrackJob *job = &jobs[i];
+
+		if (job->outcome == TRACK_FAILED)
+			failed++;
+
+		if (json_output)
+			print_track_json(job);
+		else if (job->outcome == TRACK_FAILED)
+			print_error("%s", job->error);
+		else if (job->outcome == TRACK_STORED)
+			print_success("Tracked %s as version %d (%zu bytes)", job->path, job->version, job->bytes);
+		else if (verbose_flag)
+			print_success("Unchanged %s (version %d)", job->path, job->version);
+	}
+
+	if (commit_failed) {
+		print_error("Failed to flush tracked versions to disk");
+		failed = (int)files.count;
+	}
+	fflush(stdout);
+
+	head_cache_evict(&watcher->heads);
+	free(jobs);
+	path_list_free(&files);
+	return failed > 0 ? -1 : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Tracks files as they change until interrupted
+ *
+ * Implements the "watch" command which asks the kernel (inotify) to report
+ * files that were written and closed, or renamed into place, in the watched
+ * files and directories. Changes arriving in a burst are collected until
+ * none has arrived for the debounce interval, then the changed files are
+ * tracked together on a pool of worker threads and committed with one
+ * durability barrier, exactly as "track" would.
+ *
+ * The watcher keeps its state between bursts: the open storage, the worker
+ * pool, the table of watched directories and the latest version of every
+ * recently tracked file. The next version of a file is diffed against the
+ * kept one instead of being rebuilt from its delta chain, so tracking a hot
+ * file costs a read of it and of its manifest, whatever its history.
+ *
+ * @param argc Number of command arguments. Must be >= 1.
+ * @param argv Array of command arguments. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS once stopped by SIGINT or SIGTERM, EXIT_FAILURE if
+ *         nothing could be watched.
+ *
+ * @note Supports --recursive (-r), --include and --exclude globs matched as
+ *       in "track", --debounce MS (default 200), --cache-mb N (default 64)
+ *       for the kept versions, least recently tracked evicted first,
+ *       --jobs (-j) N and --json for one JSON object per tracked file.
+ *
+ * @note Named files are watched through their directory, so editors that
+ *       save by renaming a new file over the old one are seen too. A burst
+ *       that keeps changing is tracked after ten debounce intervals anyway.
+ *
+ * @note When the kernel drops events, every watched file is queued again;
+ *       files whose state is unchanged are skipped without being read.
+ *
+ * @note Linux only: relies on inotify.
+ *
+ * @example
+ * ```c
+ * char *args[] = {"src", "--recursive", "--exclude", "*.o"};
+ * int result = cmd_watch(4, args);
+ * ```
+ */
+int cmd_watch(int argc, char *argv[])
+{
+	if (argc < 1) {
+		print_error("watch: missing file argument");
+		printf("Usage: fiver watch <file|dir>... [options]\n");
+		return EXIT_FAILURE;
+	}
+
+	// Options: --recursive, --include GLOB, --exclude GLOB, --debounce MS, --cache-mb N, --jobs N, --json
+	Watcher watcher;
+	memset(&watcher, 0, sizeof(Watcher));
+	watcher.heads.limit = (size_t)WATCH_CACHE_MB << 20;
+	int json_output = 0;
+	long debounce = WATCH_DEBOUNCE_MS;
+	uint32_t jobs = thread_pool_cpu_count();
+	PathFilter filter = { NULL, 0, NULL, 0 };
+	const char **include = calloc((size_t)argc, sizeof(char *));
+	const char **exclude = calloc((size_t)argc, sizeof(char *));
+	char **targets = calloc((size_t)argc, sizeof(char *));
+	WatchFile *files = calloc((size_t)argc, sizeof(WatchFile));
+	char **parents = calloc((size_t)argc, sizeof(char *));
+	int target_count = 0;
+	if (include == NULL || exclude == NULL || targets == NULL || files == NULL || parents == NULL) {
+		print_error("Out of memory");
+		free(include);
+		free(exclude);
+		free(targets);
+		free(files);
+		free(parents);
+		return EXIT_FAILURE;
+	}
+	filter.include = include;
+	filter.exclude = exclude;
+	watcher.filter = &filter;
+	watcher.files = files;
+
+	int usage_error = 0;
+	for (int i = 0; i < argc && !usage_error; i++) {
+		if (strcmp(argv[i], "--recursive") == 0 || strcmp(argv[i], "-r") == 0) {
+			watcher.recursive = 1;
+		} else if (strcmp(argv[i], "--json") == 0) {
+			json_output = 1;
+		} else if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+			char *end = NULL;
+			long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+			if (i + 1 >= argc || *end != '\0' || value < 1 || value > 1024) {
+				print_error("--jobs requires a number from 1 to 1024");
+				usage_error = 1;
+			}
+			jobs = (uint32_t)value;
+			i++;
+		} else if (strcmp(argv[i], "--debounce") == 0) {
+			char *end = NULL;
+			debounce = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+			if (i + 1 >= argc || *end != '\0' || debounce < 0 || debounce > 60000) {
+				print_error("--debounce requires milliseconds from 0 to 60000");
+				usage_error = 1;
+			}
+			i++;
+		} else if (strcmp(argv[i], "--cache-mb") == 0) {
+			char *end = NULL;
+			long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+			if (i + 1 >= argc || *end != '\0' || value < 0 || value > 1048576) {
+				print_error("--cache-mb requires a number from 0 to 1048576");
+				usage_error = 1;
+			}
+			watcher.heads.limit = (size_t)value << 20;
+			i++;
+		} else if (strcmp(argv[i], "--include") == 0 || strcmp(argv[i], "--exclude") == 0) {
+			if (i + 1 >= argc) {
+				print_error("%s requires a glob", argv[i]);
+				usage_error = 1;
+			} else if (strcmp(argv[i], "--include") == 0) {
+				include[filter.include_count++] = argv[++i];
+			} else {
+				exclude[filter.exclude_count++] = argv[++i];
+			}
+		} else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			print_error("Unknown option: %s", argv[i]);
+			usage_error = 1;
+		} else {
+			targets[target_count++] = argv[i];
+		}
+	}
+
+	if (!usage_error && target_count == 0) {
+		print_error("watch: missing file argument");
+		usage_error = 1;
+	}
+
+	watcher.fd = usage_error ? -1 : inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (!usage_error && watcher.fd == -1) {
+		print_error("Cannot watch for changes: %s", strerror(errno));
+		usage_error = 1;
+	}
+
+	// Directories are watched whole; files through the directory holding them
+	for (int i = 0; i < target_count && !usage_error; i++) {
+		char *target = targets[i];
+		size_t length = strlen(target);
+		while (length > 1 && target[length - 1] == '/')
+			target[--length] = '\0';
+
+		struct stat st;
+		if (stat(target, &st) == 0 && S_ISDIR(st.st_mode)) {
+			if (!watcher.recursive) {
+				print_error("%s is a directory (use --recursive)", target);
+				usage_error = 1;
+			} else if (watch_tree(&watcher, target, NULL) != EXIT_SUCCESS) {
+				usage_error = 1;
+			}
+			continue;
+		}
+
+		const char *slash = strrchr(target, '/');
+		parents[i] = slash == NULL ? strdup(".") :
+			     slash == target ? strdup("/") : strndup(target, (size_t)(slash - target));
+		WatchFile *file = &files[watcher.file_count];
+		file->path = target;
+		file->name = slash != NULL ? slash + 1 : target;
+		file->wd = parents[i] != NULL ? watch_dir_add(&watcher, parents[i], 0) : -1;
+		if (file->wd == -1)
+			usage_error = 1;
+		else
+			watcher.file_count++;
+	}
+
+	StorageConfig *config = usage_error ? NULL : open_storage();
+	if (!usage_error && config == NULL)
+		print_error("Failed to initialize storage");
+
+	ThreadPool *pool = NULL;
+	if (config != NULL && jobs > 1) {
+		config->apply_threads = 1;
+		pool = thread_pool_new(jobs);
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = request_stop;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	if (config != NULL && !json_output && !quiet_flag) {
+		print_info("Watching %u directories for changes (Ctrl-C to stop)", watcher.dir_count);
+		fflush(stdout);
+	}
+
+	// Events are read as they come; a burst is tracked once quiet or once it has lasted too long
+	PathList pending = { NULL, 0, 0 };
+	int64_t first_change = 0;
+	int64_t last_change = 0;
+	int failed = 0;
+	union {
+		struct inotify_event event;
+		char bytes[64 * 1024];
+	} buffer;
+
+	while (config != NULL && !stop_requested) {
+		int timeout = -1;
+		int64_t due = 0;
+		if (pending.count > 0) {
+			due = last_change + debounce;
+			if (due > first_change + debounce * WATCH_MAX_DELAY)
+				due = first_change + debounce * WATCH_MAX_DELAY;
+			int64_t now = watch_now_ms();
+			timeout = due > now ? (int)(due - now) : 0;
+		}
+
+		struct pollfd ready = { watcher.fd, POLLIN, 0 };
+		int events = poll(&ready, 1, timeout);
+		if (events == -1 && errno != EINTR) {
+			print_error("Failed to wait for changes: %s", strerror(errno));
+			failed = 1;
+			break;
+		}
+
+		if (events > 0) {
+			ssize_t length;
+			while ((length = read(watcher.fd, buffer.bytes, sizeof(buffer.bytes))) > 0) {
+				uint32_t before = pending.count;
+				for (char *p = buffer.bytes; p < buffer.bytes + length;) {
+					const struct inotify_event *event = (const struct inotify_event *)p;
+					watch_event(&watcher, event, &pending);
+					p += sizeof(struct inotify_event) + event->len;
+				}
+				if (pending.count > before) {
+					last_change = watch_now_ms();
+					if (before == 0)
+						first_change = last_change;
+				}
+			}
+		}
+
+		if (pending.count > 0 && watch_now_ms() >= due && due != 0)
+			watch_flush(&watcher, config, pool, &pending, json_output);
+	}
+
+	// Changes still settling when stopped are tracked before exiting
+	if (pending.count > 0)
+		watch_flush(&watcher, config, pool, &pending, json_output);
+
+	thread_pool_free(pool);
+	if (config != NULL)
+		close_storage(config);
+	if (watcher.fd != -1)
+		close(watcher.fd);
+	for (uint32_t i = 0; i < watcher.dir_count; i++)
+		free(watcher.dirs[i].dir);
+	free(watcher.dirs);
+	head_cache_free(&watcher.heads);
+	for (int i = 0; i < argc; i++)
+		free(parents[i]);
+	free(parents);
+	free(files);
+	free(include);
+	free(exclude);
+	free(targets);
+	path_list_free(&pending);
+	return config == NULL || failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Socket a server listens on, relative to the repository, unless FIVER_SOCKET names another
+#define SERVE_DEFAULT_SOCKET "./.fiver/serve.sock"
+
+// A request to a server is a ServeRequest, sent with the client's standard
+// input, output and error descriptors attached, then length bytes holding
+// the client's working directory and its argc arguments, each ending in a
+// NUL. The server runs the command on the client's descriptors, so its
+// output reaches the client's terminal or pipe unchanged, and answers with
+// a ServeReply.
+#define SERVE_REQUEST_MAGIC 0x51525646  // "FVRQ"
+#define SERVE_REPLY_MAGIC 0x50525646    // "FVRP"
+#define SERVE_MAX_REQUEST (1024 * 1024)
+
+typedef struct {
+	uint32_t	magic;                  // SERVE_REQUEST_MAGIC
+	uint32_t	argc;                   // Arguments after the working directory
+	uint32_t	length;                 // Bytes of strings that follow
+} ServeRequest;
+
+typedef struct {
+	uint32_t	magic;                  // SERVE_REPLY_MAGIC
+	uint32_t	declined;               // Not run: the client runs the command itself
+	int32_t		status;                 // Exit status of the command
+} ServeReply;
+
+// Set while a worker runs a request, which a signal then lets finish
+static volatile sig_atomic_t serve_busy = 0;
+
+// Whether workers log each request they run, from --verbose given to serve
+static int serve_log = 0;
+
+// Stops an idle worker at once, a busy one after its request
+static void serve_worker_stop(int signal)
+{
+	(void)signal;
+	if (!serve_busy)
+		_exit(EXIT_SUCCESS);
+	stop_requested = 1;
+}
+
+static const char * serve_socket_path(void)
+{
+	const char *path = getenv("FIVER_SOCKET");
+	return path != NULL ? path : SERVE_DEFAULT_SOCKET;
+}
+
+static int serve_write_all(int fd, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+	while (size > 0) {
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		size -= (size_t)n;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int serve_read_all(int fd, void *data, size_t size)
+{
+	uint8_t *p = data;
+	while (size > 0) {
+		ssize_t n = read(fd, p, size);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		size -= (size_t)n;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int serve_connect(const char *path)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path))
+		return -1;
+	strcpy(address.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int serve_forward(int argc, char *argv[], int *result)
+{
+	const Command *cmd = NULL;
+	for (const Command *c = commands; c->name != NULL; c++)
+		if (strcmp(c->name, argv[1]) == 0)
+			cmd = c;
+	if (cmd == NULL || !cmd->served ||
+	    (argc >= 3 && (strcmp(argv[2], "--help") == 0 || strcmp(argv[2], "-h") == 0)))
+		return 0;
+
+	// Without a socket, or with FIVER_SOCKET set empty, nothing is forwarded
+	const char *path = serve_socket_path();
+	struct stat st;
+	if (path[0] == '\0' || stat(path, &st) != 0 || !S_ISSOCK(st.st_mode))
+		return 0;
+
+	char cwd[4096];
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		return 0;
+
+	size_t length = strlen(cwd) + 1;
+	for (int i = 0; i < argc; i++)
+		length += strlen(argv[i]) + 1;
+	if (length > SERVE_MAX_REQUEST)
+		return 0;
+
+	char *strings = malloc(length);
+	if (strings == NULL)
+		return 0;
+	size_t used = 0;
+	memcpy(strings, cwd, strlen(cwd) + 1);
+	used += strlen(cwd) + 1;
+	for (int i = 0; i < argc; i++) {
+		memcpy(strings + used, argv[i], strlen(argv[i]) + 1);
+		used += strlen(argv[i]) + 1;
+	}
+
+	// A stale socket left by a server that is gone refuses the connection
+	int fd = serve_connect(path);
+	if (fd == -1) {
+		free(strings);
+		return 0;
+	}
+
+	ServeRequest request = { SERVE_REQUEST_MAGIC, (uint32_t)argc, (uint32_t)length };
+	struct iovec part = { &request, sizeof(request) };
+	int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	union {
+		struct cmsghdr header;
+		char bytes[CMSG_SPACE(sizeof(fds))];
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &part;
+	message.msg_iovlen = 1;
+	message.msg_control = control.bytes;
+	message.msg_controllen = sizeof(control.bytes);
+	struct cmsghdr *rights = CMSG_FIRSTHDR(&message);
+	rights->cmsg_level = SOL_SOCKET;
+	rights->cmsg_type = SCM_RIGHTS;
+	rights->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(rights), fds, sizeof(fds));
+
+	// Until the whole request is sent nothing has run, so the command can still run here
+	int sent = sendmsg(fd, &message, MSG_NOSIGNAL) == (ssize_t)sizeof(request) &&
+		   serve_write_all(fd, strings, length) == EXIT_SUCCESS;
+	free(strings);
+	if (!sent) {
+		close(fd);
+		return 0;
+	}
+
+	ServeReply reply;
+	if (serve_read_all(fd, &reply, sizeof(reply)) != EXIT_SUCCESS || reply.magic != SERVE_REPLY_MAGIC) {
+		close(fd);
+		print_error("Lost the connection to the server at %s", path);
+		*result = EXIT_FAILURE;
+		return 1;
+	}
+	close(fd);
+
+	if (reply.declined)
+		return 0;
+	*result = reply.status;
+	return 1;
+}
+
+// Receives a request header and the descriptors sent with it
+static int serve_receive(int connection, ServeRequest *request, int fds[3])
+{
+	union {
+		struct cmsghdr header;
+		char bytes[CMSG_SPACE(3 * sizeof(int))];
+	} control;
+	struct iovec part = { request, sizeof(ServeRequest) };
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &part;
+	message.msg_iovlen = 1;
+	message.msg_control = control.bytes;
+	message.msg_controllen = sizeof(control.bytes);
+
+	ssize_t n;
+	do
+		n = recvmsg(connection, &message, 0);
+	while (n == -1 && errno == EINTR);
+	if (n <= 0)
+		return -1;
+
+	int received = 0;
+	for (struct cmsghdr *c = CMSG_FIRSTHDR(&message); c != NULL; c = CMSG_NXTHDR(&message, c)) {
+		if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+			continue;
+		int count = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		for (int i = 0; i < count; i++) {
+			int fd;
+			memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+			if (received < 3)
+				fds[received++] = fd;
+			else
+				close(fd);
+		}
+	}
+
+	int result = received == 3 && !(message.msg_flags & MSG_CTRUNC) ? EXIT_SUCCESS : -1;
+	if (result == EXIT_SUCCESS && (size_t)n < sizeof(ServeRequest))
+		result = serve_read_all(connection, (uint8_t *)request + n, sizeof(ServeRequest) - (size_t)n);
+	if (result != EXIT_SUCCESS)
+		for (int i = 0; i < received; i++)
+			close(fds[i]);
+	return result;
+}
 
-	// Initialize storage
-	StorageConfig *config = storage_init("./.fiver");
-	if (config == NULL) {
-		print_error("Failed to initialize storage");
-		return EXIT_FAILURE;
-	}
+// Runs one request on the client's descriptors and answers it
+static void serve_request(int connection, const char *cwd, const int saved[3])
+{
+	ServeRequest request;
+	int fds[3];
+	if (serve_receive(connection, &request, fds) != EXIT_SUCCESS)
+		return;
 
-	// Get versions
-	uint32_t versions[512];
-	int count = get_file_versions(config, filename, versions, 512);
-	if (count <= 0) {
-		print_error("No versions found for: %s", filename);
-		storage_free(config);
-		return EXIT_FAILURE;
+	ServeReply reply = { SERVE_REPLY_MAGIC, 1, EXIT_FAILURE };
+	char *strings = NULL;
+	char **args = NULL;
+	if (request.magic == SERVE_REQUEST_MAGIC && request.argc >= 2 && request.argc <= SERVE_MAX_REQUEST / 2 &&
+	    request.length > 0 && request.length <= SERVE_MAX_REQUEST) {
+		strings = malloc(request.length);
+		args = calloc(request.argc + 1, sizeof(char *));
 	}
 
-	// Sort ascending for consistency
-	for (int i = 0; i < count - 1; i++) {
-		for (int j = i + 1; j < count; j++) {
-			if (versions[j] < versions[i]) {
-				uint32_t tmp = versions[i];
-				versions[i] = versions[j];
-				versions[j] = tmp;
-			}
+	// The strings must be exactly the working directory and argc NUL-terminated arguments
+	int valid = strings != NULL && args != NULL &&
+		    serve_read_all(connection, strings, request.length) == EXIT_SUCCESS &&
+		    strings[request.length - 1] == '\0';
+	const char *client_cwd = strings;
+	uint32_t count = 0;
+	for (size_t at = valid ? strlen(strings) + 1 : request.length; at < request.length; at += strlen(strings + at) + 1) {
+		if (count == request.argc) {
+			valid = 0;
+			break;
 		}
+		args[count++] = strings + at;
 	}
 
-	int start_index = 0;
-	if (limit > 0 && limit < count)
-		start_index = count - limit; // show last <limit> entries
+	// Only commands marked as served run here, and only for the directory this server serves
+	const Command *cmd = NULL;
+	if (valid && count == request.argc && strcmp(client_cwd, cwd) == 0)
+		for (const Command *c = commands; c->name != NULL; c++)
+			if (c->served && strcmp(c->name, args[1]) == 0)
+				cmd = c;
 
-	if (strcmp(format, "json") == 0) {
-		printf("{\n  \"file\": \"%s\",\n  \"versions\": [\n", filename);
-		int first = 1;
-		for (int idx = count - 1; idx >= start_index; idx--) {
-			uint32_t v = versions[idx];
-			// Read metadata
-			char metadata_filename[1024];
-			snprintf(metadata_filename, sizeof(metadata_filename), "%s/%s_v%u.meta",
-				 config->storage_dir, filename, v);
-			FILE *meta_file = fopen(metadata_filename, "rb");
-			FileMetadata meta;
-			memset(&meta, 0, sizeof(meta));
-			if (meta_file) {
-				fread(&meta, sizeof(FileMetadata), 1, meta_file);
-				fclose(meta_file);
-			}
-			if (!first)
-				printf(",\n");
-			first = 0;
-			printf(
-				"    { \"version\": %u, \"operations\": %u, \"delta_size\": %u, \"timestamp\": %ld, \"message\": \"%s\" }",
-				v, meta.operation_count, meta.delta_size, (long)meta.timestamp, meta.message);
-		}
-		printf("\n  ]\n}\n");
-	} else if (strcmp(format, "brief") == 0) {
-		for (int idx = count - 1; idx >= start_index; idx--) {
-			uint32_t v = versions[idx];
-			char metadata_filename[1024];
-			snprintf(metadata_filename, sizeof(metadata_filename), "%s/%s_v%u.meta",
-				 config->storage_dir, filename, v);
-			FILE *meta_file = fopen(metadata_filename, "rb");
-			FileMetadata meta;
-			memset(&meta, 0, sizeof(meta));
-			if (meta_file) {
-				fread(&meta, sizeof(FileMetadata), 1, meta_file);
-				fclose(meta_file);
-			}
-			printf("v%u: %u ops, delta %u bytes%s%s\n", v, meta.operation_count, meta.delta_size,
-			       meta.message[0] ? ", msg: " : "",
-			       meta.message[0] ? meta.message : "");
-		}
-	} else { // table
-		printf("History for %s:\n", filename);
-		printf("Version  Timestamp            Ops  Delta  Message\n");
-		printf("-------  -------------------  ----  -----  -------\n");
-		char timebuf[64];
-		for (int idx = count - 1; idx >= start_index; idx--) {
-			uint32_t v = versions[idx];
-			char metadata_filename[1024];
-			snprintf(metadata_filename, sizeof(metadata_filename), "%s/%s_v%u.meta",
-				 config->storage_dir, filename, v);
-			FILE *meta_file = fopen(metadata_filename, "rb");
-			FileMetadata meta;
-			memset(&meta, 0, sizeof(meta));
-			if (meta_file) {
-				fread(&meta, sizeof(FileMetadata), 1, meta_file);
-				fclose(meta_file);
-			}
-			struct tm *tm_info = localtime(&meta.timestamp);
-			if (tm_info)
-				strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", tm_info);
-			else
-				strcpy(timebuf, "-");
-			printf("%-7u  %-19s  %-4u  %-5u  %s\n", v, timebuf, meta.operation_count,
-			       meta.delta_size, meta.message);
+	if (cmd != NULL) {
+		fflush(stdout);
+		fflush(stderr);
+		for (int i = 0; i < 3; i++)
+			dup2(fds[i], i);
+
+		// Every request starts from the defaults of a fresh process
+		verbose_flag = 0;
+		quiet_flag = 0;
+		message_flag = NULL;
+		durability_flag = DURABILITY_BATCH;
+		verify_flag = 0;
+		errno = 0;
+
+		reply.declined = 0;
+		reply.status = run_command_line((int)count, args);
+
+		fflush(stdout);
+		fflush(stderr);
+		for (int i = 0; i < 3; i++)
+			dup2(saved[i], i);
+		message_flag = NULL;
+
+		if (serve_log) {
+			print_info("[%ld] %s %s: exit %d", (long)getpid(), args[1], count > 2 ? args[2] : "",
+				   reply.status);
+			fflush(stdout);
 		}
 	}
 
-	storage_free(config);
-	return EXIT_SUCCESS;
+	for (int i = 0; i < 3; i++)
+		close(fds[i]);
+	serve_write_all(connection, &reply, sizeof(reply));
+	free(args);
+	free(strings);
 }
 
-/**
- * @brief Lists all tracked files
- *
- * Implements the "list" command which displays all files currently
- * being tracked by the fiver system, including version counts and
- * optionally file sizes.
- *
- * @param argc Number of command arguments. Can be 0.
- * @param argv Array of command arguments. Must not be NULL.
- *
- * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
- *
- * @note The function supports --show-sizes and --format options.
- *
- * @note The function scans the storage directory for metadata files.
- *
- * @note Output formats include table and json.
- *
- * @example
- * ```c
- * char *args[] = {"--show-sizes", "--format", "json"};
- * int result = cmd_list(3, args);
- * ```
- */
-int cmd_list(int argc, char *argv[])
+// Answers requests until stopped; runs in a process of its own
+static int serve_worker(int listener, size_t cache_limit)
 {
-	if (verbose_flag)
-		print_info("Listing tracked files");
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = serve_worker_stop;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
 
-	// Options: --show-sizes, --format <table|json>
-	int show_sizes = 0;
-	const char *format = "table";
-	for (int i = 0; i < argc; i++) {
-		if (strcmp(argv[i], "--show-sizes") == 0) {
-			show_sizes = 1;
-		} else if (strcmp(argv[i], "--format") == 0) {
-			if (i + 1 >= argc) {
-				print_error("--format requires a value");
-				return EXIT_FAILURE;
-			}
-			format = argv[i + 1];
-			i++;
-		} else {
-			print_error("Unknown option: %s", argv[i]);
-			return EXIT_FAILURE;
-		}
-	}
+	char cwd[4096];
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		return EXIT_FAILURE;
 
-	StorageConfig *config = storage_init("./.fiver");
-	if (!config) {
-		print_error("Failed to initialize storage");
+	served_storage = open_storage();
+	if (served_storage == NULL)
 		return EXIT_FAILURE;
-	}
+	served_heads.limit = cache_limit;
 
-	// Aggregate by base filename
-	typedef struct {
-		char		name[256];
-		uint32_t	latest_version;
-		uint32_t	version_count;
-		uint64_t	total_delta;
-	} FileSummary;
+	// The worker's own descriptors, put back after each request
+	int saved[3] = { dup(STDIN_FILENO), dup(STDOUT_FILENO), dup(STDERR_FILENO) };
 
-	FileSummary summaries[1024];
-	int summary_count = 0;
+	while (!stop_requested) {
+		int connection = accept(listener, NULL, NULL);
+		if (connection == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			print_error("Failed to accept a request: %s", strerror(errno));
+			break;
+		}
 
-	DIR *dir = opendir(config->storage_dir);
-	if (!dir) {
-		print_error("Cannot open storage dir: %s", config->storage_dir);
-		storage_free(config);
-		return EXIT_FAILURE;
+		serve_busy = 1;
+		serve_request(connection, cwd, saved);
+		close(connection);
+		serve_busy = 0;
 	}
 
-	struct dirent *ent;
-	while ((ent = readdir(dir)) != NULL) {
-		const char *fname = ent->d_name;
-		size_t len = strlen(fname);
-		if (len < 6)
-			continue; // too short
-		// We care only about .meta files of pattern <base>_v<ver>.meta
-		if (len >= 5 && strcmp(fname + len - 5, ".meta") == 0) {
-			// Find "_v" from the end (suffix points at ".meta")
-			(void)(fname + len - 5); // points at ".meta"
-			// scan backwards to find 'v'
-			int idx_v = -1;
-			for (int i = (int)(len - 6); i >= 0; i--) {
-				if (fname[i] == 'v' && i > 0 && fname[i - 1] == '_') {
-					idx_v = i;
-					break;
-				}
-			}
-			if (idx_v < 0)
-				continue;
-			// base name is upto idx_v-1 (exclude "_v")
-			size_t base_len = (size_t)(idx_v - 1);
-			if (base_len >= sizeof(summaries[0].name))
-				base_len = sizeof(summaries[0].name) - 1;
-			char base[256];
-			memcpy(base, fname, base_len);
-			base[base_len] = '\0';
-
-			// parse version number after 'v' until '.'
-			uint32_t ver = 0;
-			for (size_t i = (size_t)idx_v + 1; i < len && fname[i] != '.'; i++) {
-				if (!isdigit((unsigned char)fname[i])) {
-					ver = 0;
-					break;
-				}
-				ver = ver * 10 + (uint32_t)(fname[i] - '0');
-			}
-			if (ver == 0)
-				continue;
+	for (int i = 0; i < 3; i++)
+		close(saved[i]);
+	head_cache_free(&served_heads);
+	storage_free(served_storage);
+	served_storage = NULL;
+	return EXIT_SUCCESS;
+}
 
-			// read metadata to get delta_size
-			char metadata_path[1024];
-			snprintf(metadata_path, sizeof(metadata_path), "%s/%s", config->storage_dir, fname);
-			FILE *mf = fopen(metadata_path, "rb");
-			FileMetadata meta;
-			memset(&meta, 0, sizeof(meta));
-			if (mf) {
-				fread(&meta, sizeof(FileMetadata), 1, mf);
-				fclose(mf);
-			}
+static pid_t serve_spawn(int listener, size_t cache_limit)
+{
+	fflush(stdout);
+	fflush(stderr);
+	pid_t parent = getpid();
+	pid_t pid = fork();
+	if (pid == 0) {
+		// Workers stop with the server, even one killed without a chance to stop them
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+		if (getppid() != parent)
+			_exit(EXIT_SUCCESS);
+		_exit(serve_worker(listener, cache_limit));
+	}
+	if (pid == -1)
+		print_error("Failed to start a server worker: %s", strerror(errno));
+	return pid;
+}
 
-			// find or add summary
-			int pos = -1;
-			for (int i = 0; i < summary_count; i++) {
-				if (strcmp(summaries[i].name, base) == 0) {
-					pos = i;
-					break;
-				}
-			}
-			if (pos < 0 && summary_count < (int)(sizeof(summaries) / sizeof(summaries[0]))) {
-				pos = summary_count++;
-				// Safe strncpy - we ensure null termination below
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wstringop-truncation"
-				strncpy(summaries[pos].name, base, sizeof(summaries[pos].name) - 1);
-#pragma GCC diagnostic pop
-				summaries[pos].name[sizeof(summaries[pos].name) - 1] = '\0';
-				summaries[pos].latest_version = 0;
-				summaries[pos].version_count = 0;
-				summaries[pos].total_delta = 0;
-			}
-			if (pos >= 0) {
-				summaries[pos].version_count += 1;
-				if (ver > summaries[pos].latest_version)
-					summaries[pos].latest_version = ver;
-				summaries[pos].total_delta += meta.delta_size;
-			}
-		}
+// Creates the listening socket, replacing one left behind by a server that is gone
+static int serve_listen(const char *path)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		print_error("Socket path is too long: %s", path);
+		return -1;
 	}
-	closedir(dir);
+	strcpy(address.sun_path, path);
 
-	// Output
-	if (strcmp(format, "json") == 0) {
-		printf("{\n  \"files\": [\n");
-		for (int i = 0; i < summary_count; i++) {
-			if (i > 0)
-				printf(",\n");
-			if (show_sizes) {
-				printf(
-					"    { \"name\": \"%s\", \"versions\": %u, \"latest\": %u, \"total_delta\": %llu }",
-					summaries[i].name, summaries[i].version_count, summaries[i].latest_version,
-					(unsigned long long)summaries[i].total_delta);
-			} else {
-				printf("    { \"name\": \"%s\", \"versions\": %u, \"latest\": %u }",
-				       summaries[i].name, summaries[i].version_count, summaries[i].latest_version);
-			}
-		}
-		printf("\n  ]\n}\n");
-	} else { // table (default)
-		if (show_sizes) {
-			printf("Tracked files:\n");
-			printf("Name                              Versions  Latest  TotalDelta\n");
-			printf("--------------------------------  --------  ------  ----------\n");
-			for (int i = 0; i < summary_count; i++) {
-				printf("%-32s  %-8u  %-6u  %-10llu\n", summaries[i].name,
-				       summaries[i].version_count, summaries[i].latest_version,
-				       (unsigned long long)summaries[i].total_delta);
-			}
-		} else {
-			printf("Tracked files:\n");
-			printf("Name                              Versions  Latest\n");
-			printf("--------------------------------  --------  ------\n");
-			for (int i = 0; i < summary_count; i++)
-				printf("%-32s  %-8u  %-6u\n", summaries[i].name,
-				       summaries[i].version_count, summaries[i].latest_version);
-		}
+	int running = serve_connect(path);
+	if (running != -1) {
+		close(running);
+		print_error("A server is already listening on %s", path);
+		return -1;
 	}
+	unlink(path);
 
-	storage_free(config);
-	return EXIT_SUCCESS;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		print_error("Failed to create socket: %s", strerror(errno));
+		return -1;
+	}
+
+	// Only the owner may connect: requests run with the server's permissions
+	mode_t mask = umask(0177);
+	int bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+	umask(mask);
+	if (bound == -1 || listen(fd, 128) == -1) {
+		print_error("Failed to listen on %s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
 }
 
 /**
- * @brief Shows current status of a tracked file
+ * @brief Answers commands from other fiver processes until interrupted
  *
- * Implements the "status" command which displays the current status
- * of a tracked file, including version information, timestamps,
- * and comparison with the current file on disk.
+ * Implements the "serve" command which listens on a UNIX socket for the
+ * track, restore, cat, history and status commands of other fiver
+ * invocations in the same directory. Each invocation first tries the
+ * socket and, if a server answers, hands it its arguments and its standard
+ * input, output and error; the server runs the command exactly as the
+ * client would have and returns the exit status. Without a server the
+ * client runs the command itself, so scripts need no changes.
  *
- * @param argc Number of command arguments. Must be >= 1.
+ * Requests are answered by a pool of worker processes that each keep the
+ * storage open and the latest version of the files they track in memory,
+ * so a request skips opening the storage, starting threads and rebuilding
+ * the previous version of a file from its delta chain.
+ *
+ * @param argc Number of command arguments. Can be 0.
  * @param argv Array of command arguments. Must not be NULL.
  *
- * @return EXIT_SUCCESS on success, EXIT_FAILURE on error.
+ * @return EXIT_SUCCESS once stopped by SIGINT or SIGTERM, EXIT_FAILURE if
+ *         the socket could not be set up or a worker failed.
  *
- * @note The function supports --json option for machine-readable output.
+ * @note Supports --socket PATH (default: FIVER_SOCKET, or
+ *       .fiver/serve.sock), --jobs (-j) N workers (default: number of
+ *       CPUs) and --cache-mb N of kept versions per worker (default: 64).
  *
- * @note The function checks if the current file exists and compares metadata.
+ * @note Clients find the server through FIVER_SOCKET or the default path.
+ *       Setting FIVER_SOCKET to an empty string turns forwarding off.
  *
- * @note Hash comparison is not yet implemented (marked as TODO).
+ * @note The socket is only accessible to its owner, since commands run
+ *       with the server's permissions. A worker that crashes is replaced.
  *
  * @example
  * ```c
- * char *args[] = {"file.txt", "--json"};
- * int result = cmd_status(2, args);
+ * char *args[] = {"--jobs", "4"};
+ * int result = cmd_serve(2, args);
  * ```
  */
-int cmd_status(int argc, char *argv[])
+int cmd_serve(int argc, char *argv[])
 {
-	if (argc < 1) {
-		print_error("status: missing file argument");
-		printf("Usage: fiver status <file> [options]\n");
-		return EXIT_FAILURE;
-	}
-
-	const char *filename = argv[0];
-
-	// Options: --json
-	int json_flag_local = 0;
-	for (int i = 1; i < argc; i++) {
-		if (strcmp(argv[i], "--json") == 0) {
-			json_flag_local = 1;
+	// Options: --socket PATH, --jobs N, --cache-mb N
+	const char *path = serve_socket_path();
+	uint32_t jobs = thread_pool_cpu_count();
+	size_t cache_limit = (size_t)WATCH_CACHE_MB << 20;
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--socket") == 0) {
+			if (i + 1 >= argc || argv[i + 1][0] == '\0') {
+				print_error("--socket requires a path");
+				return EXIT_FAILURE;
+			}
+			path = argv[++i];
+		} else if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+			char *end = NULL;
+			long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+			if (i + 1 >= argc || *end != '\0' || value < 1 || value > 1024) {
+				print_error("--jobs requires a number from 1 to 1024");
+				return EXIT_FAILURE;
+			}
+			jobs = (uint32_t)value;
+			i++;
+		} else if (strcmp(argv[i], "--cache-mb") == 0) {
+			char *end = NULL;
+			long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+			if (i + 1 >= argc || *end != '\0' || value < 0 || value > 1048576) {
+				print_error("--cache-mb requires a number from 0 to 1048576");
+				return EXIT_FAILURE;
+			}
+			cache_limit = (size_t)value << 20;
+			i++;
 		} else {
 			print_error("Unknown option: %s", argv[i]);
 			return EXIT_FAILURE;
 		}
 	}
 
-	if (verbose_flag)
-		print_info("Showing status for file: %s", filename);
+	if (path[0] == '\0') {
+		print_error("--socket requires a path");
+		return EXIT_FAILURE;
+	}
+	serve_log = verbose_flag;
 
-	// Initialize storage
-	StorageConfig *config = storage_init("./.fiver");
+	// The storage directory holds the default socket; workers open the storage themselves
+	StorageConfig *config = open_storage();
 	if (config == NULL) {
 		print_error("Failed to initialize storage");
 		return EXIT_FAILURE;
 	}
+	storage_free(config);
 
-	// Get versions
-	uint32_t versions[512];
-	int count = get_file_versions(config, filename, versions, 512);
-	if (count <= 0) {
-		print_error("No versions found for: %s", filename);
-		storage_free(config);
+	int listener = serve_listen(path);
+	if (listener == -1)
 		return EXIT_FAILURE;
-	}
-
-	// Find latest version
-	uint32_t latest_version = versions[0];
-	for (int i = 1; i < count; i++)
-		if (versions[i] > latest_version)
-			latest_version = versions[i];
 
-	// Load latest metadata
-	char metadata_filename[1024];
-	snprintf(metadata_filename, sizeof(metadata_filename), "%s/%s_v%u.meta",
-		 config->storage_dir, filename, latest_version);
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = request_stop;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
 
-	FILE *meta_file = fopen(metadata_filename, "rb");
-	if (meta_file == NULL) {
-		print_error("Cannot read metadata for version %u", latest_version);
-		storage_free(config);
+	pid_t *workers = calloc(jobs, sizeof(pid_t));
+	if (workers == NULL) {
+		print_error("Out of memory");
+		close(listener);
+		unlink(path);
 		return EXIT_FAILURE;
 	}
+	for (uint32_t i = 0; i < jobs; i++)
+		workers[i] = serve_spawn(listener, cache_limit);
 
-	FileMetadata meta;
-	memset(&meta, 0, sizeof(meta));
-	if (fread(&meta, sizeof(FileMetadata), 1, meta_file) != 1) {
-		print_error("Failed to read metadata");
-		fclose(meta_file);
-		storage_free(config);
-		return EXIT_FAILURE;
+	if (!quiet_flag) {
+		print_info("Serving on %s with %u workers (Ctrl-C to stop)", path, jobs);
+		fflush(stdout);
 	}
-	fclose(meta_file);
-
-	// Check if current file exists and compare
-	struct stat current_st;
-	int current_exists = (stat(filename, &current_st) == 0);
 
-	// For now, we'll skip hash comparison since calculate_hash is not implemented
-	// TODO: Implement proper hash comparison when calculate_hash is available
-
-	// Output
-	if (json_flag_local) {
-		printf("{\n");
-		printf("  \"file\": \"%s\",\n", filename);
-		printf("  \"tracked\": true,\n");
-		printf("  \"version_count\": %d,\n", count);
-		printf("  \"latest_version\": %u,\n", latest_version);
-		printf("  \"latest_timestamp\": %ld,\n", (long)meta.timestamp);
-		printf("  \"latest_operations\": %u,\n", meta.operation_count);
-		printf("  \"latest_delta_size\": %u,\n", meta.delta_size);
-		printf("  \"latest_message\": \"%s\",\n", meta.message);
-		printf("  \"current_file_exists\": %s,\n", current_exists ? "true" : "false");
-		if (current_exists) {
-			printf("  \"current_file_size\": %ld,\n", (long)current_st.st_size);
-			printf("  \"current_file_modified\": %ld,\n", (long)current_st.st_mtime);
-			printf("  \"is_up_to_date\": \"unknown\"\n");
-		} else {
-			printf("  \"is_up_to_date\": false\n");
+	// Crashed workers are replaced; one that exits, stopped like the server by Ctrl-C or failing, stops it
+	int result = EXIT_SUCCESS;
+	while (!stop_requested) {
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
 		}
-		printf("}\n");
-	} else {
-		printf("Status for %s:\n", filename);
-		printf("  Tracked: yes\n");
-		printf("  Versions: %d\n", count);
-		printf("  Latest version: %u\n", latest_version);
-
-		char timebuf[64];
-		struct tm *tm_info = localtime(&meta.timestamp);
-		if (tm_info)
-			strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", tm_info);
-		else
-			strcpy(timebuf, "unknown");
-		printf("  Latest timestamp: %s\n", timebuf);
-		printf("  Latest operations: %u\n", meta.operation_count);
-		printf("  Latest delta size: %u bytes\n", meta.delta_size);
-		if (meta.message[0])
-			printf("  Latest message: %s\n", meta.message);
 
-		printf("  Current file: %s\n", current_exists ? "exists" : "missing");
-		if (current_exists) {
-			printf("  Current size: %ld bytes\n", (long)current_st.st_size);
-			printf("  Current modified: %s\n", ctime(&current_st.st_mtime));
-			printf("  Up to date: unknown (hash comparison not implemented)\n");
+		int crashed = WIFSIGNALED(status) && WTERMSIG(status) != SIGINT && WTERMSIG(status) != SIGTERM;
+		for (uint32_t i = 0; i < jobs; i++) {
+			if (workers[i] != pid)
+				continue;
+			workers[i] = 0;
+			if (crashed) {
+				print_error("Server worker %ld died; starting another", (long)pid);
+				workers[i] = serve_spawn(listener, cache_limit);
+			} else {
+				if (WIFEXITED(status) && WEXITSTATUS(status) != EXIT_SUCCESS)
+					result = EXIT_FAILURE;
+				stop_requested = 1;
+			}
 		}
 	}
 
-	storage_free(config);
-	return EXIT_SUCCESS;
+	// Idle workers exit at once, busy ones after their request
+	for (uint32_t i = 0; i < jobs; i++)
+		if (workers[i] > 0)
+			kill(workers[i], SIGTERM);
+	while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+		;
+
+	close(listener);
+	unlink(path);
+	free(workers);
+	if (!quiet_flag)
+		print_info("Server stopped");
+	return result;
 }
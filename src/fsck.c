@@ -0,0 +1,254 @@
+/**
+ * @file fsck.c
+ * @brief Integrity checks of the stored versions of tracked files
+ *
+ * Checking a file streams once down its delta chain. For every version the
+ * stored delta is mapped and parsed, its bytes are compared with the
+ * checksum in the manifest record, the bounds of every operation are checked
+ * against the size of the version it applies to, and the version is rebuilt
+ * and hashed against its content hash. Two buffers take turns holding the
+ * previous version and receiving the next, so a file costs one read of each
+ * delta and one application per version, whatever the length of its chain.
+ *
+ * Nothing here writes to the storage, so any number of files can be checked
+ * at once, and alongside commands that track new versions. Only a pack that
+ * seems to hold more versions than its manifest lists makes the check wait
+ * for the file's writer lock, to tell a manifest that lost records from a
+ * track still in progress.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "delta_structures.h"
+
+// Records the first problem found in a file
+static int check_fail(FileCheck *check, uint32_t version, const char *format, ...)
+{
+	va_list args;
+
+	check->bad_version = version;
+	va_start(args, format);
+	vsnprintf(check->problem, sizeof(check->problem), format, args);
+	va_end(args);
+	return -1;
+}
+
+// Checks the operations of a delta against the version it applies to and rebuilds the next one
+static int check_apply(FileCheck *check, const DeltaIndex *index, const uint8_t *base, uint32_t base_size,
+		       uint8_t *output)
+{
+	uint32_t pos = 0;
+
+	for (uint32_t i = 0; i < index->entry_count; i++) {
+		const DeltaIndexEntry *op = &index->entries[i];
+
+		if (op->type == DELTA_COPY) {
+			if (base == NULL)
+				return check_fail(check, index->version,
+						  "operation %u copies from a version that does not exist", i);
+			if ((uint64_t)op->offset + op->length > base_size)
+				return check_fail(check, index->version,
+						  "operation %u copies past the end of the %u-byte previous version",
+						  i, base_size);
+			memcpy(output + pos, base + op->offset, op->length);
+		} else {
+			memcpy(output + pos, op->data, op->length);
+		}
+		pos += op->length;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Returns the latest version stored by a complete pack record from offset end on, 0 if there is none
+static uint32_t pack_latest_after(const char *pack_path, uint64_t end)
+{
+	int fd = open(pack_path, O_RDONLY);
+	if (fd == -1)
+		return 0;
+
+	struct stat st;
+	uint32_t latest = 0;
+	PackRecordHeader header;
+	while (fstat(fd, &st) == 0 && end + sizeof(header) <= (uint64_t)st.st_size) {
+		if (pread(fd, &header, sizeof(header), (off_t)end) != (ssize_t)sizeof(header) ||
+		    header.magic != PACK_RECORD_MAGIC || end + sizeof(header) + header.delta_size > (uint64_t)st.st_size)
+			break;
+		if (header.version > latest)
+			latest = header.version;
+		end += sizeof(header) + header.delta_size;
+	}
+
+	close(fd);
+	return latest;
+}
+
+// Fails if the pack stores a version after the last one the manifest lists
+static int check_pack_coverage(StorageConfig *config, const char *filename, FileCheck *check,
+			       const char *pack_path, uint64_t end, uint32_t latest_version)
+{
+	uint32_t stored = pack_latest_after(pack_path, end);
+	if (stored <= latest_version)
+		return EXIT_SUCCESS;
+
+	// A track may be between its pack and manifest appends; its writer lock waits for it to finish
+	int lock = storage_lock_file(config, filename);
+	ManifestEntry latest;
+	if (lock != -1 && manifest_latest(config, filename, &latest) == 1)
+		latest_version = latest.version;
+	storage_unlock(lock);
+
+	if (stored <= latest_version)
+		return EXIT_SUCCESS;
+	return check_fail(check, stored, "the pack stores this version but the manifest ends at version %u",
+			  latest_version);
+}
+
+/**
+ * @brief Checks that every stored version of a file is intact
+ *
+ * Walks the file's versions in order and stops at the first one that:
+ *   - is missing from the manifest, so later versions cannot be rebuilt,
+ *   - has a stored delta that is truncated, cannot be parsed or does not
+ *     match the checksum recorded when it was stored,
+ *   - has an operation reading past the end of the version it applies to,
+ *   - rebuilds to a size other than the one in its manifest record, or
+ *   - rebuilds to contents that do not match its content hash.
+ *
+ * It also fails if the pack holds a complete record of a version later
+ * than the last one the manifest lists, which means the manifest has lost
+ * records.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param check Output parameter for the result. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS if every version is intact, -1 otherwise; check
+ *         then names the first damaged version and the problem.
+ *
+ * @note Safe to call from several threads at once for different files or
+ *       the same file. Versions stored without a content hash are rebuilt
+ *       but cannot be compared with anything.
+ *
+ * @example
+ * ```c
+ * FileCheck check;
+ * if (storage_check_file(config, "file.txt", &check) != EXIT_SUCCESS)
+ *     printf("Version %u: %s\n", check.bad_version, check.problem);
+ * ```
+ */
+int storage_check_file(StorageConfig *config, const char *filename, FileCheck *check)
+{
+	if (config == NULL || filename == NULL || check == NULL) {
+		storage_log("Error: Invalid parameters for file check\n");
+		return -1;
+	}
+
+	memset(check, 0, sizeof(FileCheck));
+
+	ManifestView *view = manifest_view_open(config, filename);
+	if (view == NULL)
+		return check_fail(check, 0, storage_latest_version(config, filename) == 0 ?
+				  "the file is not tracked" : "the manifest cannot be read");
+	if (view->count == 0) {
+		manifest_view_close(view);
+		return check_fail(check, 0, "no versions are stored");
+	}
+
+	char pack_name[512];
+	char pack_path[1024];
+	generate_pack_filename(filename, pack_name, sizeof(pack_name));
+	snprintf(pack_path, sizeof(pack_path), "%s/%s", config->storage_dir, pack_name);
+
+	// buffers[current] holds the version just checked, the other one receives the next
+	uint8_t *buffers[2] = { NULL, NULL };
+	uint32_t capacity[2] = { 0, 0 };
+	uint32_t base_size = 0;
+	int current = 1;
+	int result = EXIT_SUCCESS;
+	uint64_t pack_end = 0;
+	static const uint8_t unknown_hash[CONTENT_HASH_SIZE];
+
+	for (uint32_t i = 0; i < view->count && result == EXIT_SUCCESS; i++) {
+		uint32_t version = i + 1;
+		ManifestEntry entry;
+		manifest_view_entry(view, i, &entry);
+		if (entry.version != version) {
+			result = check_fail(check, version, "the version is missing, so later versions cannot be rebuilt");
+			break;
+		}
+
+		char path[1024];
+		uint64_t offset = 0;
+		if (entry.flags & MANIFEST_ENTRY_PACKED) {
+			snprintf(path, sizeof(path), "%s", pack_path);
+			offset = entry.offset;
+			if (offset + entry.size > pack_end)
+				pack_end = offset + entry.size;
+		} else {
+			char name[512];
+			generate_storage_filename(filename, version, name, sizeof(name));
+			snprintf(path, sizeof(path), "%s/%s", config->storage_dir, name);
+		}
+
+		DeltaIndex *index = delta_index_map(path, offset, entry.size, version);
+		if (index == NULL) {
+			result = check_fail(check, version, "the stored delta is missing or cannot be parsed");
+			break;
+		}
+
+		int next = 1 - current;
+		const uint8_t *stored = index->map + (offset - index->map_offset);
+		if (calculate_hash(stored, entry.size) != entry.checksum) {
+			result = check_fail(check, version, "the stored delta does not match its checksum");
+		} else if (index->new_size != entry.file_size) {
+			result = check_fail(check, version, "the delta rebuilds %u bytes but the manifest records %u",
+					    index->new_size, entry.file_size);
+		} else if (capacity[next] < index->new_size) {
+			free(buffers[next]);
+			buffers[next] = malloc(index->new_size);
+			capacity[next] = buffers[next] != NULL ? index->new_size : 0;
+			if (buffers[next] == NULL)
+				result = check_fail(check, version, "out of memory rebuilding %u bytes", index->new_size);
+		}
+
+		if (result == EXIT_SUCCESS)
+			result = check_apply(check, index, version > 1 ? buffers[current] : NULL, base_size,
+					     buffers[next]);
+		delta_index_free(index);
+
+		if (result == EXIT_SUCCESS && memcmp(entry.content_hash, unknown_hash, CONTENT_HASH_SIZE) != 0) {
+			uint8_t hash[CONTENT_HASH_SIZE];
+			blake3_hash(buffers[next], entry.file_size, hash, sizeof(hash));
+			if (memcmp(hash, entry.content_hash, CONTENT_HASH_SIZE) != 0)
+				result = check_fail(check, version, "the rebuilt contents do not match the stored hash");
+		}
+
+		if (result == EXIT_SUCCESS) {
+			current = next;
+			base_size = entry.file_size;
+			check->versions_checked++;
+		}
+	}
+
+	if (result == EXIT_SUCCESS) {
+		ManifestEntry last;
+		manifest_view_entry(view, view->count - 1, &last);
+		result = check_pack_coverage(config, filename, check, pack_path, pack_end, last.version);
+	}
+
+	free(buffers[0]);
+	free(buffers[1]);
+	manifest_view_close(view);
+	return result;
+}
@@ -43,13 +43,13 @@ HashTable * hash_table_new(uint32_t bucket_count)
 {
 	// Validate input parameters
 	if (bucket_count == 0) {
-		printf("Error: bucket_count must be greater than 0\n");
+		storage_log("Error: bucket_count must be greater than 0\n");
 		return NULL;
 	}
 
 	HashTable *ht = malloc(sizeof(HashTable));
 	if (ht == NULL) {
-		printf("Failed to allocate memory for HashTable: %s\n", strerror(errno));
+		storage_log("Failed to allocate memory for HashTable: %s\n", strerror(errno));
 		return NULL;
 	}
 
@@ -58,7 +58,7 @@ HashTable * hash_table_new(uint32_t bucket_count)
 
 	ht->buckets = calloc(bucket_count, sizeof(HashEntry *));
 	if (ht->buckets == NULL) {
-		printf("Failed to allocate memory for buckets: %s\n", strerror(errno));
+		storage_log("Failed to allocate memory for buckets: %s\n", strerror(errno));
 		free(ht);
 		return NULL;
 	}
@@ -151,7 +151,7 @@ void hash_table_insert(HashTable *ht, uint32_t hash, uint32_t offset)
 
 	HashEntry *new_entry = malloc(sizeof(HashEntry));
 	if (new_entry == NULL) {
-		printf("Failed to allocate memory for HashEntry: %s\n", strerror(errno));
+		storage_log("Failed to allocate memory for HashEntry: %s\n", strerror(errno));
 		return;
 	}
 
@@ -0,0 +1,480 @@
+/**
+ * @file libfiver.c
+ * @brief The public libfiver interface on top of the storage engine
+ *
+ * Each call checks its arguments, runs the same engine functions the fiver
+ * command uses and maps the outcome to a FiverStatus. The engine explains
+ * its failures through storage_log(), which the library build keeps quiet
+ * unless the program asks for the messages with fiver_set_log().
+ *
+ * A repository handle is a StorageConfig that is never changed after
+ * fiver_open(), so threads can share it. Parallel application of large
+ * deltas is turned off for handles: its thread pool is made for one
+ * command at a time, and a program restoring on several threads already
+ * keeps the CPUs busy.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "delta_structures.h"
+#include "fiver.h"
+
+struct FiverRepo {
+	StorageConfig *config;
+};
+
+struct FiverHistory {
+	ManifestView *	view;                   // Snapshot of the file's manifest
+	uint32_t	next;                   // Index of the next record
+	char *		message;                // NUL-terminated copy of the last message
+	size_t		message_capacity;       // Bytes allocated for message
+};
+
+// A program's sink, called by the engine while it streams a restore
+typedef struct {
+	FiverSink	sink;
+	void *		context;
+	int		stopped;                // Set once the sink returned nonzero
+} SinkAdapter;
+
+// Passes a chunk to the program's sink and remembers if it asked to stop
+static int forward_chunk(const uint8_t *data, uint32_t size, void *context)
+{
+	SinkAdapter *adapter = context;
+
+	if (adapter->sink(data, size, adapter->context) != 0) {
+		adapter->stopped = 1;
+		return -1;
+	}
+	return EXIT_SUCCESS;
+}
+
+// Finds the record of a version, 0 meaning the latest one
+static int find_version(FiverRepo *repo, const char *name, uint32_t version, ManifestEntry *entry)
+{
+	int found = version == 0 ? manifest_latest(repo->config, name, entry) :
+		    manifest_find(repo->config, name, version, entry);
+
+	if (found == -1)
+		return FIVER_ERR_IO;
+	if (found == 1)
+		return FIVER_OK;
+	if (version == 0)
+		return FIVER_ERR_NOT_TRACKED;
+
+	ManifestEntry latest;
+	found = manifest_latest(repo->config, name, &latest);
+	if (found == -1)
+		return FIVER_ERR_IO;
+	return found == 0 ? FIVER_ERR_NOT_TRACKED : FIVER_ERR_NO_VERSION;
+}
+
+/**
+ * @brief Opens a repository
+ *
+ * @param storage_dir Storage directory, such as "project/.fiver". Must not be NULL.
+ * @param flags FIVER_OPEN_* flags, or 0 to create the repository if needed
+ *              and flush a batch of writes in fiver_commit().
+ * @param repo Output parameter for the handle. Must not be NULL.
+ *
+ * @return FIVER_OK on success, FIVER_ERR_NO_REPO if FIVER_OPEN_EXISTING is
+ *         given and the directory does not exist, or another error code.
+ *
+ * @note Close the handle with fiver_close() once no thread uses it.
+ *
+ * @example
+ * ```c
+ * FiverRepo *repo;
+ * int status = fiver_open(".fiver", FIVER_OPEN_EXISTING, &repo);
+ * if (status != FIVER_OK)
+ *     fprintf(stderr, "%s\n", fiver_strerror(status));
+ * ```
+ */
+int fiver_open(const char *storage_dir, unsigned flags, FiverRepo **repo)
+{
+	if (repo != NULL)
+		*repo = NULL;
+	if (storage_dir == NULL || repo == NULL || storage_dir[0] == '\0' ||
+	    strlen(storage_dir) >= sizeof(((StorageConfig *)NULL)->storage_dir))
+		return FIVER_ERR_INVALID;
+	if ((flags & FIVER_OPEN_NO_SYNC) && (flags & FIVER_OPEN_STRICT))
+		return FIVER_ERR_INVALID;
+
+	struct stat st;
+	if (flags & FIVER_OPEN_EXISTING) {
+		if (stat(storage_dir, &st) == -1)
+			return errno == ENOENT ? FIVER_ERR_NO_REPO : FIVER_ERR_IO;
+		if (!S_ISDIR(st.st_mode))
+			return FIVER_ERR_NO_REPO;
+	}
+
+	FiverRepo *handle = malloc(sizeof(FiverRepo));
+	if (handle == NULL)
+		return FIVER_ERR_NOMEM;
+
+	errno = 0;
+	handle->config = storage_init(storage_dir);
+	if (handle->config == NULL) {
+		int status = errno == ENOMEM ? FIVER_ERR_NOMEM : FIVER_ERR_IO;
+		free(handle);
+		return status;
+	}
+
+	StorageConfig *config = handle->config;
+	config->apply_threads = 1;
+	config->verify_content = (flags & FIVER_OPEN_VERIFY) != 0;
+	if (flags & FIVER_OPEN_NO_SYNC)
+		config->durability = DURABILITY_NONE;
+	else if (flags & FIVER_OPEN_STRICT)
+		config->durability = DURABILITY_STRICT;
+	else
+		config->durability = DURABILITY_BATCH;
+
+	*repo = handle;
+	return FIVER_OK;
+}
+
+/**
+ * @brief Makes every version tracked so far survive a crash
+ *
+ * @param repo Repository handle. Must not be NULL.
+ *
+ * @return FIVER_OK on success, FIVER_ERR_IO if the storage could not be flushed.
+ *
+ * @note Only needed with the default durability, which flushes a whole batch
+ *       of tracks with one barrier here. fiver_close() commits as well.
+ */
+int fiver_commit(FiverRepo *repo)
+{
+	if (repo == NULL)
+		return FIVER_ERR_INVALID;
+
+	return storage_commit(repo->config) == EXIT_SUCCESS ? FIVER_OK : FIVER_ERR_IO;
+}
+
+/**
+ * @brief Commits pending writes and closes a repository
+ *
+ * @param repo Repository handle, or NULL.
+ */
+void fiver_close(FiverRepo *repo)
+{
+	if (repo == NULL)
+		return;
+
+	storage_free(repo->config);
+	free(repo);
+}
+
+/**
+ * @brief Stores the given contents as the next version of a file
+ *
+ * Contents equal to the latest version are recognized by their content hash
+ * and not stored again.
+ *
+ * @param repo Repository handle. Must not be NULL.
+ * @param name Name the file is tracked under, such as "docs/a.txt". Must not be NULL.
+ * @param data Contents of the file. Must not be NULL.
+ * @param size Bytes in data. Must be between 1 and 4 GiB - 1.
+ * @param message Message stored with the version. Can be NULL.
+ * @param version Output parameter for the version holding the contents. Can be NULL.
+ * @param stored Output parameter set to 1 if a new version was stored and to
+ *               0 if the contents were unchanged. Can be NULL.
+ *
+ * @return FIVER_OK on success, an error code otherwise.
+ *
+ * @example
+ * ```c
+ * uint32_t version;
+ * int stored;
+ * if (fiver_track(repo, "notes.txt", data, size, "Draft", &version, &stored) == FIVER_OK && !stored)
+ *     printf("Unchanged since version %u\n", version);
+ * ```
+ */
+int fiver_track(FiverRepo *repo, const char *name, const uint8_t *data, size_t size, const char *message,
+		uint32_t *version, int *stored)
+{
+	if (version != NULL)
+		*version = 0;
+	if (stored != NULL)
+		*stored = 0;
+	if (repo == NULL || name == NULL || name[0] == '\0' || data == NULL || size == 0 || size > UINT32_MAX)
+		return FIVER_ERR_INVALID;
+
+	int result = track_file_state(repo->config, name, data, (uint32_t)size, message, NULL, NULL, stored);
+	if (result <= 0)
+		return FIVER_ERR_IO;
+
+	if (version != NULL)
+		*version = (uint32_t)result;
+	return FIVER_OK;
+}
+
+/**
+ * @brief Returns the latest stored version of a file
+ *
+ * @param repo Repository handle. Must not be NULL.
+ * @param name Name the file is tracked under. Must not be NULL.
+ * @param version Output parameter for the version. Must not be NULL.
+ *
+ * @return FIVER_OK on success, FIVER_ERR_NOT_TRACKED if the file has no
+ *         stored versions, or another error code.
+ */
+int fiver_latest(FiverRepo *repo, const char *name, uint32_t *version)
+{
+	if (version != NULL)
+		*version = 0;
+	if (repo == NULL || name == NULL || version == NULL)
+		return FIVER_ERR_INVALID;
+
+	ManifestEntry entry;
+	int status = find_version(repo, name, 0, &entry);
+	if (status == FIVER_OK)
+		*version = entry.version;
+	return status;
+}
+
+/**
+ * @brief Restores a version of a file into memory
+ *
+ * @param repo Repository handle. Must not be NULL.
+ * @param name Name the file is tracked under. Must not be NULL.
+ * @param version Version to restore, or 0 for the latest one.
+ * @param data Output parameter for the contents, to be released with free().
+ *             Must not be NULL.
+ * @param size Output parameter for the bytes in data. Must not be NULL.
+ *
+ * @return FIVER_OK on success, FIVER_ERR_NOT_TRACKED or FIVER_ERR_NO_VERSION
+ *         if there is nothing to restore, or another error code.
+ *
+ * @example
+ * ```c
+ * uint8_t *data;
+ * size_t size;
+ * if (fiver_restore(repo, "notes.txt", 3, &data, &size) == FIVER_OK) {
+ *     fwrite(data, 1, size, stdout);
+ *     free(data);
+ * }
+ * ```
+ */
+int fiver_restore(FiverRepo *repo, const char *name, uint32_t version, uint8_t **data, size_t *size)
+{
+	if (data != NULL)
+		*data = NULL;
+	if (size != NULL)
+		*size = 0;
+	if (repo == NULL || name == NULL || data == NULL || size == NULL)
+		return FIVER_ERR_INVALID;
+
+	ManifestEntry entry;
+	int status = find_version(repo, name, version, &entry);
+	if (status != FIVER_OK)
+		return status;
+
+	uint32_t restored_size = 0;
+	*data = reconstruct_file_from_deltas(repo->config, name, entry.version, &restored_size);
+	if (*data == NULL)
+		return FIVER_ERR_IO;
+
+	*size = restored_size;
+	return FIVER_OK;
+}
+
+/**
+ * @brief Restores a version of a file into a sink
+ *
+ * The contents reach the sink in order, in chunks of at most 64 KiB, as
+ * they are rebuilt: the version is never held in memory as a whole, so
+ * restoring a large file into a pipe or a compressor costs the same memory
+ * as restoring a small one.
+ *
+ * @param repo Repository handle. Must not be NULL.
+ * @param name Name the file is tracked under. Must not be NULL.
+ * @param version Version to restore, or 0 for the latest one.
+ * @param sink Called with each chunk. Must not be NULL.
+ * @param context Passed to every call of sink.
+ *
+ * @return FIVER_OK once the sink has received every byte, FIVER_ERR_SINK if
+ *         it returned nonzero, or another error code.
+ *
+ * @note With FIVER_OPEN_VERIFY the contents are checked once the sink has
+ *       received all of them; on FIVER_ERR_IO it must discard what it got.
+ */
+int fiver_restore_to(FiverRepo *repo, const char *name, uint32_t version, FiverSink sink, void *context)
+{
+	if (repo == NULL || name == NULL || sink == NULL)
+		return FIVER_ERR_INVALID;
+
+	ManifestEntry entry;
+	int status = find_version(repo, name, version, &entry);
+	if (status != FIVER_OK)
+		return status;
+
+	SinkAdapter adapter = { .sink = sink, .context = context };
+	if (restore_version_to_sink(repo->config, name, entry.version, forward_chunk, &adapter, NULL) != EXIT_SUCCESS)
+		return adapter.stopped ? FIVER_ERR_SINK : FIVER_ERR_IO;
+	return FIVER_OK;
+}
+
+/**
+ * @brief Starts listing the stored versions of a file, oldest first
+ *
+ * The history lists the versions stored when it was opened; versions
+ * tracked later are not included.
+ *
+ * @param repo Repository handle. Must not be NULL.
+ * @param name Name the file is tracked under. Must not be NULL.
+ * @param history Output parameter for the iterator. Must not be NULL.
+ *
+ * @return FIVER_OK on success, FIVER_ERR_NOT_TRACKED if the file is not
+ *         tracked, or another error code.
+ *
+ * @note Close the iterator with fiver_history_close() before closing the repository.
+ *
+ * @example
+ * ```c
+ * FiverHistory *history;
+ * FiverVersionInfo info;
+ * if (fiver_history_open(repo, "notes.txt", &history) == FIVER_OK) {
+ *     while (fiver_history_next(history, &info) == FIVER_OK)
+ *         printf("%u: %s\n", info.version, info.message);
+ *     fiver_history_close(history);
+ * }
+ * ```
+ */
+int fiver_history_open(FiverRepo *repo, const char *name, FiverHistory **history)
+{
+	if (history != NULL)
+		*history = NULL;
+	if (repo == NULL || name == NULL || history == NULL)
+		return FIVER_ERR_INVALID;
+
+	FiverHistory *iterator = calloc(1, sizeof(FiverHistory));
+	if (iterator == NULL)
+		return FIVER_ERR_NOMEM;
+
+	iterator->view = manifest_view_open(repo->config, name);
+	if (iterator->view == NULL) {
+		ManifestEntry entry;
+		int status = find_version(repo, name, 0, &entry);
+		free(iterator);
+		return status == FIVER_OK ? FIVER_ERR_IO : status;
+	}
+
+	*history = iterator;
+	return FIVER_OK;
+}
+
+/**
+ * @brief Returns the next version of a history
+ *
+ * @param history Iterator from fiver_history_open(). Must not be NULL.
+ * @param info Output parameter for the version. Must not be NULL. Its
+ *             message stays valid until the next call on the history.
+ *
+ * @return FIVER_OK if info holds a version, FIVER_DONE once every version
+ *         has been returned, or an error code.
+ */
+int fiver_history_next(FiverHistory *history, FiverVersionInfo *info)
+{
+	if (history == NULL || info == NULL)
+		return FIVER_ERR_INVALID;
+	if (history->next >= history->view->count)
+		return FIVER_DONE;
+
+	ManifestEntry entry;
+	if (manifest_view_entry(history->view, history->next, &entry) != EXIT_SUCCESS)
+		return FIVER_ERR_IO;
+
+	uint32_t length = 0;
+	const char *message = manifest_view_message(history->view, &entry, &length);
+	if (history->message_capacity < (size_t)length + 1) {
+		char *grown = realloc(history->message, (size_t)length + 1);
+		if (grown == NULL)
+			return FIVER_ERR_NOMEM;
+		history->message = grown;
+		history->message_capacity = (size_t)length + 1;
+	}
+	memcpy(history->message, message, length);
+	history->message[length] = '\0';
+
+	info->version = entry.version;
+	info->size = entry.file_size;
+	info->timestamp = entry.timestamp;
+	memcpy(info->content_hash, entry.content_hash, FIVER_HASH_SIZE);
+	info->message = history->message;
+	history->next++;
+	return FIVER_OK;
+}
+
+/**
+ * @brief Releases a history
+ *
+ * @param history Iterator from fiver_history_open(), or NULL.
+ */
+void fiver_history_close(FiverHistory *history)
+{
+	if (history == NULL)
+		return;
+
+	manifest_view_close(history->view);
+	free(history->message);
+	free(history);
+}
+
+/**
+ * @brief Describes a status code
+ *
+ * @param status Code returned by a library call.
+ *
+ * @return A sentence describing the code, never NULL.
+ */
+const char * fiver_strerror(int status)
+{
+	switch (status) {
+	case FIVER_OK:
+		return "Success";
+	case FIVER_DONE:
+		return "No more versions";
+	case FIVER_ERR_INVALID:
+		return "Invalid argument";
+	case FIVER_ERR_NOMEM:
+		return "Out of memory";
+	case FIVER_ERR_NO_REPO:
+		return "Repository does not exist";
+	case FIVER_ERR_NOT_TRACKED:
+		return "File is not tracked";
+	case FIVER_ERR_NO_VERSION:
+		return "Version does not exist";
+	case FIVER_ERR_IO:
+		return "Storage could not be read or written";
+	case FIVER_ERR_SINK:
+		return "Restore stopped by its sink";
+	default:
+		return "Unknown error";
+	}
+}
+
+/**
+ * @brief Receives the engine's explanations of what it does and why it fails
+ *
+ * The library discards them until a handler is set.
+ *
+ * @param handler Called with each message, or NULL to discard them again.
+ * @param context Passed to every call of handler.
+ *
+ * @note Set the handler before other threads use the library. It may be
+ *       called from several threads at once.
+ */
+void fiver_set_log(FiverLogHandler handler, void *context)
+{
+	storage_set_log_handler(handler, context);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file log.c
+ * @brief Where the storage engine's messages go
+ *
+ * The engine explains its failures and progress in plain sentences. The
+ * fiver command prints them on standard output as they happen; a program
+ * using the library usually does not want a library writing to its
+ * terminal, so in the library build they are dropped unless the program
+ * installs a handler of its own.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "delta_structures.h"
+
+#define LOG_MESSAGE_MAX 4096
+
+static LogHandler log_handler;
+static void *log_context;
+#ifdef FIVER_LIBRARY
+static int log_to_stdout = 0;
+#else
+static int log_to_stdout = 1;
+#endif
+
+/**
+ * @brief Sends the engine's messages to a handler instead of standard output
+ *
+ * @param handler Called with each formatted message, or NULL to drop them.
+ * @param context Passed to every call of handler.
+ *
+ * @note Install the handler before other threads use the storage. The
+ *       handler may be called from several threads at once.
+ *
+ * @example
+ * ```c
+ * static void to_stderr(const char *message, void *context)
+ * {
+ *     fputs(message, context);
+ * }
+ *
+ * storage_set_log_handler(to_stderr, stderr);
+ * ```
+ */
+void storage_set_log_handler(LogHandler handler, void *context)
+{
+	log_handler = handler;
+	log_context = context;
+	log_to_stdout = 0;
+}
+
+/**
+ * @brief Reports a message from the storage engine
+ *
+ * @param format printf-style format of the message, followed by its arguments.
+ *
+ * @note Messages longer than LOG_MESSAGE_MAX bytes are truncated when they
+ *       go to a handler.
+ */
+void storage_log(const char *format, ...)
+{
+	va_list args;
+
+	if (log_to_stdout) {
+		va_start(args, format);
+		vprintf(format, args);
+		va_end(args);
+		return;
+	}
+	if (log_handler == NULL)
+		return;
+
+	char message[LOG_MESSAGE_MAX];
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	log_handler(message, log_context);
+}
@@ -0,0 +1,1301 @@
+/**
+ * @file manifest.c
+ * @brief Append-only per-file version manifests
+ *
+ * Every tracked file has a manifest (<key>.manifest) in its object
+ * directory: a manifest header, which also records the file's canonical
+ * path and the state of the working file when it was last tracked, followed
+ * by one fixed-size record per stored version. Both are little-endian with
+ * explicit field offsets, so a storage directory reads the same on every
+ * host. New versions are appended, so records stay sorted by version and
+ * each version appears once; the rare rewrites (deleting a version,
+ * migrating to a pack) replace the whole file atomically.
+ *
+ * A record holds everything history and status print: timestamp, operation
+ * count, delta size and where the version's message lives. It also holds
+ * everything needed to apply the version's delta, so the pack stores nothing
+ * but the delta itself. Messages are
+ * kept out of the fixed stride in an append-only heap (<key>.messages).
+ * ManifestView maps both files, so a query touches only the pages of the
+ * records and messages it actually reads.
+ *
+ * The manifest is also the index of the file's pack: a record says where the
+ * version's delta starts in the pack and how long it is. Because records are
+ * sorted, the record of version N is found with one pread (or a short binary
+ * search once versions have been deleted), the latest version is the last
+ * record, a full listing is one read, and there is no limit on the number of
+ * versions.
+ *
+ * Storage directories written before manifests existed are imported by the
+ * first command that stores, deletes or migrates a version of a file, under
+ * the file's writer lock: the legacy .meta files are probed once and a
+ * manifest is created from them.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "delta_structures.h"
+
+// Byte offset of record index in a manifest
+#define MANIFEST_RECORD_OFFSET(index) \
+	((off_t)MANIFEST_HEADER_SIZE + (off_t)(index) * (off_t)MANIFEST_RECORD_SIZE)
+
+static void put_le32(uint8_t *p, uint32_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+	p[2] = (uint8_t)(value >> 16);
+	p[3] = (uint8_t)(value >> 24);
+}
+
+static void put_le64(uint8_t *p, uint64_t value)
+{
+	put_le32(p, (uint32_t)value);
+	put_le32(p + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+	return (uint64_t)get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+// Encodes a record into its MANIFEST_RECORD_SIZE on-disk form
+static void manifest_encode(const ManifestEntry *entry, uint8_t *record)
+{
+	memset(record, 0, MANIFEST_RECORD_SIZE);
+	put_le32(record + 0, entry->version);
+	put_le32(record + 4, entry->flags);
+	put_le64(record + 8, entry->offset);
+	put_le32(record + 16, entry->size);
+	put_le32(record + 20, entry->file_size);
+	put_le64(record + 24, (uint64_t)entry->timestamp);
+	put_le32(record + 32, entry->checksum);
+	put_le32(record + 36, entry->operation_count);
+	put_le32(record + 40, entry->delta_size);
+	put_le32(record + 44, entry->message_length);
+	put_le64(record + 48, entry->message_offset);
+	memcpy(record + 56, entry->content_hash, CONTENT_HASH_SIZE);
+	put_le32(record + 72, entry->original_size);
+}
+
+// Decodes an on-disk record
+static void manifest_decode(const uint8_t *record, ManifestEntry *entry)
+{
+	entry->version = get_le32(record + 0);
+	entry->flags = get_le32(record + 4);
+	entry->offset = get_le64(record + 8);
+	entry->size = get_le32(record + 16);
+	entry->file_size = get_le32(record + 20);
+	entry->timestamp = (int64_t)get_le64(record + 24);
+	entry->checksum = get_le32(record + 32);
+	entry->operation_count = get_le32(record + 36);
+	entry->delta_size = get_le32(record + 40);
+	entry->message_length = get_le32(record + 44);
+	entry->message_offset = get_le64(record + 48);
+	memcpy(entry->content_hash, record + 56, CONTENT_HASH_SIZE);
+	entry->original_size = get_le32(record + 72);
+}
+
+// Encodes the tracked state of a manifest header
+static void manifest_encode_state(const TrackedState *state, uint8_t *bytes)
+{
+	memset(bytes, 0, MANIFEST_STATE_SIZE);
+	put_le32(bytes + 0, state->version);
+	put_le64(bytes + 8, state->size);
+	put_le64(bytes + 16, (uint64_t)state->mtime_ns);
+	put_le64(bytes + 24, (uint64_t)state->ctime_ns);
+	put_le64(bytes + 32, state->inode);
+	put_le64(bytes + 40, state->device);
+}
+
+// Decodes the tracked state of a manifest header
+static void manifest_decode_state(const uint8_t *bytes, TrackedState *state)
+{
+	state->version = get_le32(bytes + 0);
+	state->size = get_le64(bytes + 8);
+	state->mtime_ns = (int64_t)get_le64(bytes + 16);
+	state->ctime_ns = (int64_t)get_le64(bytes + 24);
+	state->inode = get_le64(bytes + 32);
+	state->device = get_le64(bytes + 40);
+}
+
+// Encodes the manifest header of a tracked file
+static void manifest_encode_header(uint8_t *header, const char *filename)
+{
+	memset(header, 0, MANIFEST_HEADER_SIZE);
+	put_le32(header + 0, MANIFEST_MAGIC);
+	put_le32(header + 4, MANIFEST_FORMAT_VERSION);
+	put_le32(header + 8, MANIFEST_RECORD_SIZE);
+	put_le32(header + 12, MANIFEST_HEADER_SIZE);
+
+	// The path maps the hashed object name back to the file, NUL-padded
+	storage_canonical_path(filename, (char *)header + MANIFEST_PATH_OFFSET, MANIFEST_PATH_SIZE);
+}
+
+// Builds the full path of a file's manifest
+static void manifest_path(const StorageConfig *config, const char *filename, char *path, size_t len)
+{
+	char manifest_filename[512];
+
+	generate_manifest_filename(filename, manifest_filename, sizeof(manifest_filename));
+	snprintf(path, len, "%s/%s", config->storage_dir, manifest_filename);
+}
+
+// Builds the full path of a file's message heap
+static void message_heap_path(const StorageConfig *config, const char *filename, char *path, size_t len)
+{
+	char heap_filename[512];
+
+	generate_message_heap_filename(filename, heap_filename, sizeof(heap_filename));
+	snprintf(path, len, "%s/%s", config->storage_dir, heap_filename);
+}
+
+// Writes size bytes to fd, retrying short writes
+static int manifest_write_all(int fd, const uint8_t *bytes, size_t size)
+{
+	while (size > 0) {
+		ssize_t written = write(fd, bytes, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		bytes += written;
+		size -= (size_t)written;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Encodes and writes count records to fd
+static int manifest_write_entries(int fd, const ManifestEntry *entries, uint32_t count)
+{
+	uint8_t buffer[64 * MANIFEST_RECORD_SIZE];
+
+	for (uint32_t done = 0; done < count; ) {
+		uint32_t n = count - done;
+		if (n > 64)
+			n = 64;
+		for (uint32_t i = 0; i < n; i++)
+			manifest_encode(&entries[done + i], buffer + (size_t)i * MANIFEST_RECORD_SIZE);
+		if (manifest_write_all(fd, buffer, (size_t)n * MANIFEST_RECORD_SIZE) != EXIT_SUCCESS)
+			return -1;
+		done += n;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Cuts off a partial record left by an interrupted append so the next record stays aligned
+static int manifest_drop_partial(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) == -1)
+		return -1;
+
+	off_t records = st.st_size - MANIFEST_HEADER_SIZE;
+	if (records < 0 || records % MANIFEST_RECORD_SIZE == 0)
+		return EXIT_SUCCESS;
+
+	return ftruncate(fd, st.st_size - records % MANIFEST_RECORD_SIZE) == -1 ? -1 : EXIT_SUCCESS;
+}
+
+// Appends a message to a file's message heap and points the record at it; NULL or "" stores nothing
+static int message_heap_append(StorageConfig *config, const char *filename, ManifestEntry *entry,
+			       const char *message)
+{
+	entry->message_offset = 0;
+	entry->message_length = 0;
+	if (message == NULL || message[0] == '\0')
+		return EXIT_SUCCESS;
+
+	char path[1024];
+	message_heap_path(config, filename, path, sizeof(path));
+
+	if (storage_object_dir(config, filename) != EXIT_SUCCESS)
+		return -1;
+
+	int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (fd == -1) {
+		storage_log("Failed to open message heap for '%s': %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	size_t length = strlen(message);
+	int result = manifest_write_all(fd, (const uint8_t *)message, length);
+
+	// With O_APPEND the file position ends right after this message
+	off_t end = lseek(fd, 0, SEEK_CUR);
+	if (end == (off_t)-1)
+		result = -1;
+	if (result == EXIT_SUCCESS)
+		result = storage_sync_file(config, fd);
+	if (close(fd) == -1)
+		result = -1;
+	if (result == EXIT_SUCCESS && (uint64_t)end == length)
+		result = storage_sync_entry(config, path);
+
+	if (result != EXIT_SUCCESS) {
+		storage_log("Failed to write message heap for '%s': %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	entry->message_offset = (uint64_t)end - length;
+	entry->message_length = (uint32_t)length;
+	return EXIT_SUCCESS;
+}
+
+// Writes a complete manifest to a private file and moves it into place; replace=0 keeps an existing manifest
+static int manifest_install(StorageConfig *config, const char *filename, const ManifestEntry *entries,
+			    uint32_t count, int replace)
+{
+	char path[1024];
+	char temp_path[1100];
+
+	manifest_path(config, filename, path, sizeof(path));
+	snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", path);
+
+	if (storage_object_dir(config, filename) != EXIT_SUCCESS)
+		return -1;
+
+	int fd = mkstemp(temp_path);
+	if (fd == -1) {
+		storage_log("Failed to write manifest for '%s': %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	uint8_t header[MANIFEST_HEADER_SIZE];
+	manifest_encode_header(header, filename);
+
+	int result = manifest_write_all(fd, header, sizeof(header));
+	if (result == EXIT_SUCCESS)
+		result = manifest_write_entries(fd, entries, count);
+	if (fchmod(fd, 0644) == -1)
+		result = -1;
+	if (result == EXIT_SUCCESS)
+		result = storage_sync_temp(fd);
+	if (close(fd) == -1)
+		result = -1;
+
+	if (result == EXIT_SUCCESS) {
+		if (replace)
+			result = rename(temp_path, path) == -1 ? -1 : EXIT_SUCCESS;
+		else if (link(temp_path, path) == -1 && errno != EEXIST)
+			result = -1;
+	}
+	if (result == EXIT_SUCCESS)
+		result = storage_sync_entry(config, path);
+
+	if (result != EXIT_SUCCESS)
+		storage_log("Failed to write manifest for '%s': %s\n", filename, strerror(errno));
+	if (result != EXIT_SUCCESS || !replace)
+		unlink(temp_path);
+
+	return result;
+}
+
+// Fills the metadata-derived fields of a record and stores its message in the heap
+static int manifest_fill_from_metadata(StorageConfig *config, const char *filename, ManifestEntry *entry,
+				       const FileMetadata *metadata)
+{
+	entry->operation_count = metadata->operation_count;
+	entry->delta_size = metadata->delta_size;
+	entry->original_size = metadata->original_size;
+
+	char message[sizeof(metadata->message) + 1];
+	memcpy(message, metadata->message, sizeof(metadata->message));
+	message[sizeof(metadata->message)] = '\0';
+
+	return message_heap_append(config, filename, entry, message);
+}
+
+// Creates a manifest from the <name>_v<N>.meta/.delta files of a legacy storage directory
+static int manifest_import_legacy(StorageConfig *config, const char *filename)
+{
+	uint32_t capacity = 16;
+	uint32_t count = 0;
+	ManifestEntry *entries = malloc(capacity * sizeof(ManifestEntry));
+
+	if (entries == NULL)
+		return -1;
+
+	// Legacy trees were written in order starting at 1, so the first gap ends the scan
+	for (uint32_t version = 1;; version++) {
+		char metadata_filename[512];
+		char full_metadata_path[1024];
+
+		generate_metadata_filename(filename, version, metadata_filename, sizeof(metadata_filename));
+		snprintf(full_metadata_path, sizeof(full_metadata_path), "%s/%s",
+			 config->storage_dir, metadata_filename);
+		if (access(full_metadata_path, F_OK) != 0)
+			break;
+
+		char storage_filename[512];
+		char full_storage_path[1024];
+		generate_storage_filename(filename, version, storage_filename, sizeof(storage_filename));
+		snprintf(full_storage_path, sizeof(full_storage_path), "%s/%s",
+			 config->storage_dir, storage_filename);
+
+		// Legacy versions are loose files; read them directly rather than through the manifest
+		struct stat st;
+		FileMetadata metadata;
+		DeltaIndex *index = NULL;
+		if (stat(full_storage_path, &st) == 0 && st.st_size > 0 && st.st_size <= UINT32_MAX)
+			index = delta_index_map(full_storage_path, 0, (uint32_t)st.st_size, version);
+		if (index == NULL || read_legacy_metadata(full_metadata_path, &metadata) != EXIT_SUCCESS) {
+			storage_log("Cannot import version %u of '%s'\n", version, filename);
+			delta_index_free(index);
+			free(entries);
+			return -1;
+		}
+
+		if (count >= capacity) {
+			capacity *= 2;
+			ManifestEntry *new_entries = realloc(entries, capacity * sizeof(ManifestEntry));
+			if (new_entries == NULL) {
+				delta_index_free(index);
+				free(entries);
+				return -1;
+			}
+			entries = new_entries;
+		}
+
+		ManifestEntry *entry = &entries[count++];
+		memset(entry, 0, sizeof(ManifestEntry));
+		entry->version = version;
+		entry->size = (uint32_t)st.st_size;
+		entry->file_size = index->new_size;
+		entry->timestamp = (int64_t)metadata.timestamp;
+		entry->checksum = calculate_hash(index->map, (uint32_t)st.st_size);
+		delta_index_free(index);
+
+		if (manifest_fill_from_metadata(config, filename, entry, &metadata) != EXIT_SUCCESS) {
+			free(entries);
+			return -1;
+		}
+	}
+
+	if (count == 0) {
+		free(entries);
+		return 0;
+	}
+
+	// Link a private copy into place so concurrent importers cannot interleave
+	int result = manifest_install(config, filename, entries, count, 0);
+	free(entries);
+
+	return result == EXIT_SUCCESS ? (int)count : -1;
+}
+
+// Checks the header of an open manifest; -1 if it is damaged or in an unknown format
+static int manifest_check_header(int fd, uint8_t *header)
+{
+	ssize_t n = pread(fd, header, MANIFEST_HEADER_SIZE, 0);
+
+	if (n != MANIFEST_HEADER_SIZE || get_le32(header) != MANIFEST_MAGIC ||
+	    get_le32(header + 4) != MANIFEST_FORMAT_VERSION || get_le32(header + 8) != MANIFEST_RECORD_SIZE ||
+	    get_le32(header + 12) != MANIFEST_HEADER_SIZE)
+		return -1;
+
+	header[MANIFEST_PATH_OFFSET + MANIFEST_PATH_SIZE - 1] = '\0';
+	return EXIT_SUCCESS;
+}
+
+// Opens the manifest of a file with flags; -1 with errno ENOENT if untracked
+static int manifest_open(StorageConfig *config, const char *filename, int flags)
+{
+	char path[1024];
+
+	manifest_path(config, filename, path, sizeof(path));
+
+	int fd = open(path, flags);
+	if (fd == -1)
+		return -1;
+
+	uint8_t header[MANIFEST_HEADER_SIZE];
+	if (manifest_check_header(fd, header) != EXIT_SUCCESS) {
+		storage_log("Manifest for '%s' is damaged\n", filename);
+		close(fd);
+		errno = EIO;
+		return -1;
+	}
+
+	// Objects are named by a hash of the path, so the header decides whose they are
+	char canonical[1024];
+	const char *owner = (const char *)header + MANIFEST_PATH_OFFSET;
+	storage_canonical_path(filename, canonical, sizeof(canonical));
+	if (strcmp(owner, canonical) == 0)
+		return fd;
+
+	storage_log("Storage objects of '%s' belong to '%s'\n", filename, owner);
+	close(fd);
+	errno = EEXIST;
+	return -1;
+}
+
+/**
+ * @brief Finds the tracked file a manifest belongs to
+ *
+ * Reads the canonical path recorded in the manifest header.
+ *
+ * @param manifest_file Path of a manifest file. Must not be NULL.
+ * @param filename Output buffer for the tracked filename. Must not be NULL.
+ * @param size Size of the output buffer. Must be > 0.
+ *
+ * @return EXIT_SUCCESS on success, -1 if the owner cannot be determined.
+ *
+ * @example
+ * ```c
+ * char name[256];
+ * if (manifest_owner(".fiver/objects/3c/8e/3c8e0a1b2c3d4e5f.manifest", name, sizeof(name)) == EXIT_SUCCESS)
+ *     printf("%s\n", name);
+ * ```
+ */
+int manifest_owner(const char *manifest_file, char *filename, size_t size)
+{
+	if (manifest_file == NULL || filename == NULL || size == 0) {
+		storage_log("Error: Invalid parameters for manifest owner\n");
+		return -1;
+	}
+
+	filename[0] = '\0';
+
+	int fd = open(manifest_file, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	uint8_t header[MANIFEST_HEADER_SIZE];
+	int result = -1;
+	if (manifest_check_header(fd, header) == EXIT_SUCCESS) {
+		snprintf(filename, size, "%s", (const char *)header + MANIFEST_PATH_OFFSET);
+		result = filename[0] != '\0' ? EXIT_SUCCESS : -1;
+	}
+	close(fd);
+	return result;
+}
+
+/**
+ * @brief Makes sure a file's manifest covers versions stored before manifests existed
+ *
+ * If the file has no manifest but legacy <name>_v<N>.meta files exist, a
+ * manifest is created from them and the catalog is rebuilt to count them.
+ * Commands that store, delete or migrate versions call this first, so the
+ * new record lands after the existing ones.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ *
+ * @note The caller must hold the file's writer lock. Readers never import:
+ *       until a writer has, versions stored only in legacy files are not
+ *       listed.
+ */
+int manifest_prepare(StorageConfig *config, const char *filename)
+{
+	if (config == NULL || filename == NULL) {
+		storage_log("Error: Invalid parameters for manifest preparation\n");
+		return -1;
+	}
+
+	char path[1024];
+	manifest_path(config, filename, path, sizeof(path));
+	if (access(path, F_OK) == 0)
+		return EXIT_SUCCESS;
+	if (errno != ENOENT)
+		return -1;
+
+	int imported = manifest_import_legacy(config, filename);
+	if (imported < 0)
+		return -1;
+	if (imported > 0 && catalog_rebuild(config) < 0)
+		return -1;
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Appends a record to a file's manifest
+ *
+ * Stores the message in the file's message heap, then appends the record.
+ * Creates the manifest if it does not exist yet. The record is written with
+ * a single append, so concurrent readers see either the old manifest or the
+ * manifest with the whole record. The append is the commit point of a
+ * version: the pack record and message are flushed before it, according to
+ * the configured durability level, and a partial record left by a crash is
+ * dropped first. Batch mode flushes them only together with the record, so
+ * writers call manifest_drop_uncommitted() before deciding the next version.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param entry Record to append. Its message fields are ignored. Must not be NULL.
+ * @param message Version message. Can be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ *
+ * @example
+ * ```c
+ * ManifestEntry entry = { .version = 3, .file_size = size, .timestamp = time(NULL) };
+ * manifest_append(config, "file.txt", &entry, "Fix typo");
+ * ```
+ */
+int manifest_append(StorageConfig *config, const char *filename, const ManifestEntry *entry,
+		    const char *message)
+{
+	if (config == NULL || filename == NULL || entry == NULL) {
+		storage_log("Error: Invalid parameters for manifest append\n");
+		return -1;
+	}
+
+	int fd = manifest_open(config, filename, O_RDWR | O_APPEND);
+	if (fd == -1 && errno == ENOENT && manifest_install(config, filename, NULL, 0, 0) == EXIT_SUCCESS)
+		fd = manifest_open(config, filename, O_RDWR | O_APPEND);
+	if (fd == -1) {
+		storage_log("Failed to open manifest for '%s': %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	// A message left behind by a failed append is never referenced
+	ManifestEntry record = *entry;
+	int result = message_heap_append(config, filename, &record, message);
+	if (result == EXIT_SUCCESS)
+		result = manifest_drop_partial(fd);
+	if (result == EXIT_SUCCESS)
+		result = manifest_write_entries(fd, &record, 1);
+	if (result == EXIT_SUCCESS)
+		result = storage_sync_file(config, fd);
+	if (close(fd) == -1)
+		result = -1;
+
+	if (result != EXIT_SUCCESS)
+		storage_log("Failed to append to manifest for '%s': %s\n", filename, strerror(errno));
+
+	return result;
+}
+
+// Opens a manifest for reading and returns its record count through count; -1 with errno ENOENT if untracked
+static int manifest_open_counted(StorageConfig *config, const char *filename, uint32_t *count)
+{
+	int fd = manifest_open(config, filename, O_RDONLY);
+
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		errno = EIO;
+		return -1;
+	}
+
+	// A trailing partial record, left by an interrupted append, is ignored
+	*count = (uint32_t)(((size_t)st.st_size - MANIFEST_HEADER_SIZE) / MANIFEST_RECORD_SIZE);
+	return fd;
+}
+
+/**
+ * @brief Reads every record of a file's manifest
+ *
+ * Loads the whole manifest with a single read. A trailing partial record,
+ * left by an interrupted append, is ignored.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param entries Output parameter for the records, sorted by version. Set to
+ *                NULL when there are none. The caller is responsible for
+ *                freeing the array.
+ *
+ * @return Number of records on success (0 if the file is not tracked), -1 on failure.
+ */
+int manifest_read(StorageConfig *config, const char *filename, ManifestEntry **entries)
+{
+	if (config == NULL || filename == NULL || entries == NULL) {
+		storage_log("Error: Invalid parameters for manifest read\n");
+		return -1;
+	}
+
+	*entries = NULL;
+
+	uint32_t count = 0;
+	int fd = manifest_open_counted(config, filename, &count);
+	if (fd == -1)
+		return errno == ENOENT ? 0 : -1;
+
+	if (count == 0) {
+		close(fd);
+		return 0;
+	}
+
+	size_t wanted = (size_t)count * MANIFEST_RECORD_SIZE;
+	uint8_t *raw = malloc(wanted);
+	ManifestEntry *records = malloc((size_t)count * sizeof(ManifestEntry));
+	if (raw == NULL || records == NULL) {
+		free(raw);
+		free(records);
+		close(fd);
+		return -1;
+	}
+
+	size_t done = 0;
+	while (done < wanted) {
+		ssize_t n = pread(fd, raw + done, wanted - done, MANIFEST_RECORD_OFFSET(0) + (off_t)done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += (size_t)n;
+	}
+	close(fd);
+
+	if (done != wanted) {
+		storage_log("Failed to read manifest for '%s'\n", filename);
+		free(raw);
+		free(records);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+		manifest_decode(raw + (size_t)i * MANIFEST_RECORD_SIZE, &records[i]);
+	free(raw);
+
+	*entries = records;
+	return (int)count;
+}
+
+// Reads and decodes record index of an open manifest
+static int manifest_pread(int fd, uint32_t index, ManifestEntry *entry)
+{
+	uint8_t record[MANIFEST_RECORD_SIZE];
+	ssize_t n = pread(fd, record, sizeof(record), MANIFEST_RECORD_OFFSET(index));
+
+	if (n != (ssize_t)sizeof(record))
+		return -1;
+
+	manifest_decode(record, entry);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Returns the latest version recorded in a file's manifest
+ *
+ * Reads only the last record of the manifest.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param entry Output parameter for the record. Must not be NULL.
+ *
+ * @return 1 if a version was found, 0 if the file has no versions, -1 on failure.
+ */
+int manifest_latest(StorageConfig *config, const char *filename, ManifestEntry *entry)
+{
+	if (config == NULL || filename == NULL || entry == NULL) {
+		storage_log("Error: Invalid parameters for manifest lookup\n");
+		return -1;
+	}
+
+	uint32_t count = 0;
+	int fd = manifest_open_counted(config, filename, &count);
+	if (fd == -1)
+		return errno == ENOENT ? 0 : -1;
+
+	int result = count == 0 ? 0 : (manifest_pread(fd, count - 1, entry) == EXIT_SUCCESS ? 1 : -1);
+	close(fd);
+	return result;
+}
+
+// Returns the size of a storage file, 0 if it does not exist, -1 on failure
+static off_t storage_file_size(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) == 0)
+		return st.st_size;
+	return errno == ENOENT ? 0 : -1;
+}
+
+// Whether everything a record points at reached the disk: its pack bytes match their checksum, its message fits the heap
+static int manifest_record_committed(const char *pack_path, off_t pack_size, off_t heap_size,
+				     const ManifestEntry *entry)
+{
+	if (entry->message_length > 0 && entry->message_offset + entry->message_length > (uint64_t)heap_size)
+		return 0;
+
+	// Loose versions predate batched commits and were flushed before their record existed
+	if (!(entry->flags & MANIFEST_ENTRY_PACKED))
+		return 1;
+	if (entry->size == 0 || entry->offset + entry->size > (uint64_t)pack_size)
+		return 0;
+
+	DeltaIndex *index = delta_index_map(pack_path, entry->offset, entry->size, entry->version);
+	if (index == NULL)
+		return 0;
+
+	const uint8_t *stored = index->map + (entry->offset - index->map_offset);
+	int committed = calculate_hash(stored, entry->size) == entry->checksum;
+	delta_index_free(index);
+	return committed;
+}
+
+// Truncates a pack to size bytes, dropping the records of uncommitted versions
+static int manifest_cut_pack(StorageConfig *config, const char *pack_path, uint64_t size)
+{
+	int fd = open(pack_path, O_WRONLY);
+	if (fd == -1)
+		return -1;
+
+	int result = ftruncate(fd, (off_t)size) == -1 ? -1 : storage_sync_file(config, fd);
+	if (close(fd) == -1)
+		result = -1;
+	return result;
+}
+
+/**
+ * @brief Cuts off trailing records whose pack data never reached the disk
+ *
+ * In batch mode a version's pack record, message and manifest record are
+ * only flushed together by storage_commit(). A crash before it can leave a
+ * manifest record on disk without the bytes it points at. Such a record is
+ * treated as uncommitted: walking back from the last record, every record
+ * that points past the end of the pack or the message heap, or whose pack
+ * bytes fail their checksum, is truncated away together with any partial
+ * record, until the first intact one. The pack is cut back to where the
+ * first dropped version's record starts, so it holds no version the
+ * manifest does not list.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ *
+ * @return Number of records dropped on success (0 if the manifest is intact
+ *         or the file is not tracked), -1 on failure.
+ *
+ * @note The caller must hold the file's writer lock, so no append races the
+ *       truncation. Only the tail is checked: records before the last intact
+ *       one were committed by an earlier barrier. The catalog is rebuilt when
+ *       records are dropped.
+ */
+int manifest_drop_uncommitted(StorageConfig *config, const char *filename)
+{
+	if (config == NULL || filename == NULL) {
+		storage_log("Error: Invalid parameters for manifest recovery\n");
+		return -1;
+	}
+
+	int fd = manifest_open(config, filename, O_RDWR);
+	if (fd == -1)
+		return errno == ENOENT ? 0 : -1;
+
+	char pack_name[512];
+	char pack_path[1024];
+	char heap_path[1024];
+	generate_pack_filename(filename, pack_name, sizeof(pack_name));
+	snprintf(pack_path, sizeof(pack_path), "%s/%s", config->storage_dir, pack_name);
+	message_heap_path(config, filename, heap_path, sizeof(heap_path));
+
+	struct stat st;
+	off_t pack_size = storage_file_size(pack_path);
+	off_t heap_size = storage_file_size(heap_path);
+	if (pack_size < 0 || heap_size < 0 || fstat(fd, &st) == -1 || st.st_size < MANIFEST_HEADER_SIZE) {
+		close(fd);
+		return -1;
+	}
+
+	uint32_t total = (uint32_t)(((size_t)st.st_size - MANIFEST_HEADER_SIZE) / MANIFEST_RECORD_SIZE);
+	uint32_t count = total;
+	uint64_t pack_cut = (uint64_t)pack_size;
+	while (count > 0) {
+		ManifestEntry entry;
+		if (manifest_pread(fd, count - 1, &entry) != EXIT_SUCCESS) {
+			close(fd);
+			return -1;
+		}
+		if (manifest_record_committed(pack_path, pack_size, heap_size, &entry))
+			break;
+		storage_log("Dropping version %u of '%s': its data was never committed\n", entry.version, filename);
+		if ((entry.flags & MANIFEST_ENTRY_PACKED) && entry.offset >= sizeof(PackRecordHeader) &&
+		    entry.offset - sizeof(PackRecordHeader) < pack_cut)
+			pack_cut = entry.offset - sizeof(PackRecordHeader);
+		count--;
+	}
+
+	// The pack records of dropped versions go too, unless a kept version lies past them
+	for (uint32_t i = 0; i < count && pack_cut < (uint64_t)pack_size; i++) {
+		ManifestEntry entry;
+		if (manifest_pread(fd, i, &entry) != EXIT_SUCCESS) {
+			close(fd);
+			return -1;
+		}
+		if ((entry.flags & MANIFEST_ENTRY_PACKED) && entry.offset + entry.size > pack_cut)
+			pack_cut = (uint64_t)pack_size;
+	}
+
+	int result = EXIT_SUCCESS;
+	if (st.st_size != MANIFEST_RECORD_OFFSET(count)) {
+		if (ftruncate(fd, MANIFEST_RECORD_OFFSET(count)) == -1)
+			result = -1;
+		if (result == EXIT_SUCCESS)
+			result = storage_sync_file(config, fd);
+	}
+	if (close(fd) == -1)
+		result = -1;
+	if (result == EXIT_SUCCESS && pack_cut < (uint64_t)pack_size)
+		result = manifest_cut_pack(config, pack_path, pack_cut);
+
+	if (result != EXIT_SUCCESS) {
+		storage_log("Failed to repair manifest for '%s': %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	// The catalog may already count the dropped versions
+	if (count < total && catalog_rebuild(config) < 0)
+		return -1;
+
+	return (int)(total - count);
+}
+
+/**
+ * @brief Reads the state of the working file recorded when it was last tracked
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param state Output parameter for the state. Must not be NULL.
+ *
+ * @return 1 if a state is recorded, 0 if none is (or the file is not
+ *         tracked), -1 on failure.
+ *
+ * @note The state names the version it describes. It is only meaningful
+ *       while that version is still the latest one.
+ */
+int manifest_read_state(StorageConfig *config, const char *filename, TrackedState *state)
+{
+	if (config == NULL || filename == NULL || state == NULL) {
+		storage_log("Error: Invalid parameters for manifest state\n");
+		return -1;
+	}
+
+	memset(state, 0, sizeof(TrackedState));
+
+	int fd = manifest_open(config, filename, O_RDONLY);
+	if (fd == -1)
+		return errno == ENOENT ? 0 : -1;
+
+	uint8_t bytes[MANIFEST_STATE_SIZE];
+	ssize_t n = pread(fd, bytes, sizeof(bytes), MANIFEST_STATE_OFFSET);
+	close(fd);
+	if (n != (ssize_t)sizeof(bytes))
+		return -1;
+
+	manifest_decode_state(bytes, state);
+	return state->version != 0 ? 1 : 0;
+}
+
+/**
+ * @brief Records the state of the working file in its manifest
+ *
+ * Overwrites the header's state in place; the records are not touched.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param state State to record. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ *
+ * @note The caller must hold the file's writer lock.
+ *
+ * @example
+ * ```c
+ * TrackedState state;
+ * storage_tracked_state(&st, version, &state);
+ * manifest_write_state(config, "file.txt", &state);
+ * ```
+ */
+int manifest_write_state(StorageConfig *config, const char *filename, const TrackedState *state)
+{
+	if (config == NULL || filename == NULL || state == NULL) {
+		storage_log("Error: Invalid parameters for manifest state\n");
+		return -1;
+	}
+
+	// Not O_APPEND: Linux appends every pwrite to such a descriptor
+	int fd = manifest_open(config, filename, O_RDWR);
+	if (fd == -1) {
+		storage_log("Failed to open manifest for '%s': %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	uint8_t bytes[MANIFEST_STATE_SIZE];
+	manifest_encode_state(state, bytes);
+
+	int result = pwrite(fd, bytes, sizeof(bytes), MANIFEST_STATE_OFFSET) == (ssize_t)sizeof(bytes) ?
+		     EXIT_SUCCESS : -1;
+	if (result == EXIT_SUCCESS)
+		result = storage_sync_file(config, fd);
+	if (close(fd) == -1)
+		result = -1;
+
+	if (result != EXIT_SUCCESS)
+		storage_log("Failed to record the state of '%s': %s\n", filename, strerror(errno));
+	return result;
+}
+
+/**
+ * @brief Looks up the record of a version in a file's manifest
+ *
+ * Records are sorted by version, so the record of version N is normally
+ * record N - 1 and is read with a single pread. If versions have been
+ * deleted, a binary search over the records finds it instead.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param version Version to look up.
+ * @param entry Output parameter for the record. Can be NULL to only test existence.
+ *
+ * @return 1 if the version exists, 0 if it does not, -1 on failure.
+ */
+int manifest_find(StorageConfig *config, const char *filename, uint32_t version, ManifestEntry *entry)
+{
+	if (config == NULL || filename == NULL) {
+		storage_log("Error: Invalid parameters for manifest lookup\n");
+		return -1;
+	}
+
+	uint32_t count = 0;
+	int fd = manifest_open_counted(config, filename, &count);
+	if (fd == -1)
+		return errno == ENOENT ? 0 : -1;
+
+	ManifestEntry record;
+	int found = 0;
+
+	if (version > 0 && version <= count && manifest_pread(fd, version - 1, &record) == EXIT_SUCCESS &&
+	    record.version == version) {
+		found = 1;
+	} else {
+		uint32_t low = 0;
+		uint32_t high = count;
+		while (low < high) {
+			uint32_t mid = low + (high - low) / 2;
+			if (manifest_pread(fd, mid, &record) != EXIT_SUCCESS) {
+				close(fd);
+				return -1;
+			}
+			if (record.version == version) {
+				found = 1;
+				break;
+			}
+			if (record.version < version)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+	}
+	close(fd);
+
+	if (found && entry != NULL)
+		*entry = record;
+	return found;
+}
+
+/**
+ * @brief Finds the newest version of a file created at or before a time
+ *
+ * Versions are appended in creation order, so their timestamps ascend with
+ * the records and a binary search over them finds the version with
+ * O(log n) record reads.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param timestamp Point in time, in seconds since the epoch.
+ * @param entry Output parameter for the record of the version. Must not be NULL.
+ *
+ * @return 1 if such a version exists, 0 if every version is newer or the
+ *         file is not tracked, -1 on failure.
+ *
+ * @note If the clock went backwards between two tracks, the timestamps are
+ *       not sorted and the version found may not be the newest one.
+ *
+ * @example
+ * ```c
+ * ManifestEntry entry;
+ * if (manifest_find_at(config, "file.txt", time(NULL) - 86400, &entry) == 1)
+ *     printf("A day ago: v%u\n", entry.version);
+ * ```
+ */
+int manifest_find_at(StorageConfig *config, const char *filename, int64_t timestamp, ManifestEntry *entry)
+{
+	if (config == NULL || filename == NULL || entry == NULL) {
+		storage_log("Error: Invalid parameters for manifest lookup\n");
+		return -1;
+	}
+
+	uint32_t count = 0;
+	int fd = manifest_open_counted(config, filename, &count);
+	if (fd == -1)
+		return errno == ENOENT ? 0 : -1;
+
+	// Find the first record newer than timestamp; the one before it is the answer
+	ManifestEntry record;
+	uint32_t low = 0;
+	uint32_t high = count;
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		if (manifest_pread(fd, mid, &record) != EXIT_SUCCESS) {
+			close(fd);
+			return -1;
+		}
+		if (record.timestamp <= timestamp)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	int found = 0;
+	if (low > 0) {
+		if (manifest_pread(fd, low - 1, entry) != EXIT_SUCCESS) {
+			close(fd);
+			return -1;
+		}
+		found = 1;
+	}
+	close(fd);
+	return found;
+}
+
+/**
+ * @brief Reads the message of a version from the file's message heap
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param entry Record of the version. Must not be NULL.
+ * @param buffer Output buffer for the NUL-terminated message. Must not be NULL.
+ * @param size Size of buffer. Longer messages are truncated. Must be > 0.
+ *
+ * @return Length of the message written to buffer, -1 on failure.
+ */
+int manifest_message(StorageConfig *config, const char *filename, const ManifestEntry *entry,
+		     char *buffer, size_t size)
+{
+	if (config == NULL || filename == NULL || entry == NULL || buffer == NULL || size == 0) {
+		storage_log("Error: Invalid parameters for message read\n");
+		return -1;
+	}
+
+	buffer[0] = '\0';
+	if (entry->message_length == 0)
+		return 0;
+
+	char path[1024];
+	message_heap_path(config, filename, path, sizeof(path));
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		storage_log("Failed to open message heap for '%s': %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	size_t length = entry->message_length < size - 1 ? entry->message_length : size - 1;
+	ssize_t n = pread(fd, buffer, length, (off_t)entry->message_offset);
+	close(fd);
+	if (n != (ssize_t)length) {
+		storage_log("Failed to read message of version %u\n", entry->version);
+		buffer[0] = '\0';
+		return -1;
+	}
+
+	buffer[length] = '\0';
+	return (int)length;
+}
+
+/**
+ * @brief Replaces every record of a file's manifest
+ *
+ * Writes the new records to a temporary file and renames it over the
+ * manifest, so readers see either the old or the new manifest in full.
+ * The message heap is left alone; records keep pointing into it.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param entries New records, sorted by version. Can be NULL if count is 0.
+ * @param count Number of records.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ */
+int manifest_rewrite(StorageConfig *config, const char *filename, const ManifestEntry *entries, uint32_t count)
+{
+	if (config == NULL || filename == NULL || (entries == NULL && count > 0)) {
+		storage_log("Error: Invalid parameters for manifest rewrite\n");
+		return -1;
+	}
+
+	return manifest_install(config, filename, entries, count, 1);
+}
+
+// Maps a whole file read-only; an empty or missing file gives a NULL mapping
+static int manifest_map_file(const char *path, uint8_t **map, size_t *map_size)
+{
+	*map = NULL;
+	*map_size = 0;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return errno == ENOENT ? EXIT_SUCCESS : -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	if (st.st_size > 0) {
+		void *mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+		*map = mapping;
+		*map_size = (size_t)st.st_size;
+	}
+
+	close(fd);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Maps a file's manifest and message heap for reading
+ *
+ * Records and messages are decoded straight from the mappings on request,
+ * so reading a few records of a long manifest only faults in their pages.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ *
+ * @return Pointer to the new ManifestView on success, NULL if the file is
+ *         not tracked or on failure. Free it with manifest_view_close().
+ *
+ * @example
+ * ```c
+ * ManifestView *view = manifest_view_open(config, "file.txt");
+ * ManifestEntry entry;
+ * if (view != NULL && manifest_view_entry(view, view->count - 1, &entry) == EXIT_SUCCESS)
+ *     printf("Latest: v%u\n", entry.version);
+ * manifest_view_close(view);
+ * ```
+ */
+ManifestView * manifest_view_open(StorageConfig *config, const char *filename)
+{
+	if (config == NULL || filename == NULL) {
+		storage_log("Error: Invalid parameters for manifest view\n");
+		return NULL;
+	}
+
+	// Checks the header before the file is mapped
+	int fd = manifest_open(config, filename, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+	close(fd);
+
+	ManifestView *view = malloc(sizeof(ManifestView));
+	if (view == NULL) {
+		storage_log("Failed to allocate memory for ManifestView: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	char path[1024];
+	manifest_path(config, filename, path, sizeof(path));
+	int result = manifest_map_file(path, &view->map, &view->map_size);
+	view->heap = NULL;
+	view->heap_size = 0;
+	if (result == EXIT_SUCCESS) {
+		message_heap_path(config, filename, path, sizeof(path));
+		result = manifest_map_file(path, &view->heap, &view->heap_size);
+	}
+
+	if (result != EXIT_SUCCESS || view->map_size < MANIFEST_HEADER_SIZE) {
+		storage_log("Failed to map manifest for '%s': %s\n", filename, strerror(errno));
+		manifest_view_close(view);
+		return NULL;
+	}
+
+	view->count = (uint32_t)((view->map_size - MANIFEST_HEADER_SIZE) / MANIFEST_RECORD_SIZE);
+	return view;
+}
+
+/**
+ * @brief Decodes one record of a mapped manifest
+ *
+ * @param view Manifest view. Must not be NULL.
+ * @param index Record index, 0 to view->count - 1. Records are sorted by version.
+ * @param entry Output parameter for the record. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 if index is out of range.
+ */
+int manifest_view_entry(const ManifestView *view, uint32_t index, ManifestEntry *entry)
+{
+	if (view == NULL || entry == NULL || index >= view->count)
+		return -1;
+
+	manifest_decode(view->map + MANIFEST_RECORD_OFFSET(index), entry);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Returns the message of a record inside the mapped message heap
+ *
+ * @param view Manifest view. Must not be NULL.
+ * @param entry Record decoded from view. Must not be NULL.
+ * @param length Output parameter for the message length. Must not be NULL.
+ *
+ * @return Pointer to the message bytes, which are not NUL-terminated, or ""
+ *         with length 0 if the record has no readable message.
+ *
+ * @example
+ * ```c
+ * uint32_t length;
+ * const char *message = manifest_view_message(view, &entry, &length);
+ * printf("%.*s\n", (int)length, message);
+ * ```
+ */
+const char * manifest_view_message(const ManifestView *view, const ManifestEntry *entry, uint32_t *length)
+{
+	*length = 0;
+	if (view == NULL || entry == NULL || view->heap == NULL || entry->message_length == 0 ||
+	    entry->message_offset > view->heap_size ||
+	    entry->message_length > view->heap_size - entry->message_offset)
+		return "";
+
+	*length = entry->message_length;
+	return (const char *)view->heap + entry->message_offset;
+}
+
+/**
+ * @brief Unmaps and frees a manifest view
+ *
+ * @param view Manifest view. Safe to pass NULL.
+ */
+void manifest_view_close(ManifestView *view)
+{
+	if (view == NULL)
+		return;
+
+	if (view->map != NULL)
+		munmap(view->map, view->map_size);
+	if (view->heap != NULL)
+		munmap(view->heap, view->heap_size);
+	free(view);
+}
@@ -0,0 +1,265 @@
+/**
+ * @file pack.c
+ * @brief Append-only per-file pack files
+ *
+ * All versions of a tracked file are stored in one pack (<key>.pack) next to
+ * the file's manifest. Every version is a single record appended to the pack:
+ *
+ *   PackRecordHeader | delta operations
+ *
+ * The delta operations use the same layout as the loose .delta files of
+ * older storage directories. The pack has no index of its own: the file's manifest records where each
+ * version's delta starts and how long it is, along with everything else
+ * about the version, and readers map just that region.
+ *
+ * This module also converts storage directories that still hold loose
+ * <name>_vN.delta and <name>_vN.meta files into packs.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "delta_structures.h"
+
+/**
+ * @brief Appends a record to a file's pack
+ *
+ * Creates the pack if it does not exist yet and writes the record with a
+ * single append. The record is flushed according to the configured
+ * durability level before its offset is returned.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param record Record bytes, starting with a PackRecordHeader. Must not be NULL.
+ * @param size Size of the record in bytes.
+ * @param offset Output parameter for the pack offset of the record. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ *
+ * @note A failed append may leave a partial record at the end of the pack.
+ *       No manifest record points at it, so it is never read.
+ */
+int pack_append(StorageConfig *config, const char *filename, const uint8_t *record, size_t size,
+		uint64_t *offset)
+{
+	if (config == NULL || filename == NULL || record == NULL || offset == NULL) {
+		storage_log("Error: Invalid parameters for pack append\n");
+		return -1;
+	}
+
+	char pack_filename[512];
+	char full_pack_path[1024];
+	generate_pack_filename(filename, pack_filename, sizeof(pack_filename));
+	snprintf(full_pack_path, sizeof(full_pack_path), "%s/%s", config->storage_dir, pack_filename);
+
+	if (storage_object_dir(config, filename) != EXIT_SUCCESS)
+		return -1;
+
+	int fd = open(full_pack_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (fd == -1) {
+		storage_log("Failed to open pack file for writing: %s\n", strerror(errno));
+		return -1;
+	}
+
+	size_t done = 0;
+	while (done < size) {
+		ssize_t written = write(fd, record + done, size - done);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			storage_log("Failed to write pack file: %s\n", strerror(errno));
+			close(fd);
+			return -1;
+		}
+		done += (size_t)written;
+	}
+
+	// With O_APPEND the file position ends right after this record
+	off_t end = lseek(fd, 0, SEEK_CUR);
+	if (end == (off_t)-1 || storage_sync_file(config, fd) != EXIT_SUCCESS) {
+		storage_log("Failed to write pack file: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (close(fd) == -1) {
+		storage_log("Failed to write pack file: %s\n", strerror(errno));
+		return -1;
+	}
+
+	// The first record created the pack
+	*offset = (uint64_t)end - size;
+	if (*offset == 0 && storage_sync_entry(config, full_pack_path) != EXIT_SUCCESS)
+		return -1;
+	return EXIT_SUCCESS;
+}
+
+// Reads a whole loose file into a new buffer
+static uint8_t * read_loose_file(const char *path, uint32_t *size)
+{
+	FILE *file = fopen(path, "rb");
+
+	if (file == NULL) {
+		storage_log("Failed to open %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fileno(file), &st) == -1 || st.st_size <= 0 || st.st_size > UINT32_MAX) {
+		storage_log("Cannot read %s\n", path);
+		fclose(file);
+		return NULL;
+	}
+
+	uint8_t *data = malloc((size_t)st.st_size);
+	if (data == NULL || fread(data, 1, (size_t)st.st_size, file) != (size_t)st.st_size) {
+		storage_log("Failed to read %s\n", path);
+		free(data);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+	*size = (uint32_t)st.st_size;
+	return data;
+}
+
+// Packs a file's loose versions; the caller holds the file's writer lock
+static int migrate_locked(StorageConfig *config, const char *filename)
+{
+	if (manifest_prepare(config, filename) != EXIT_SUCCESS || manifest_drop_uncommitted(config, filename) < 0)
+		return -1;
+
+	ManifestEntry *entries = NULL;
+	int count = manifest_read(config, filename, &entries);
+	if (count <= 0)
+		return count;
+
+	int moved = 0;
+	for (int i = 0; i < count; i++) {
+		ManifestEntry *entry = &entries[i];
+		if (entry->flags & MANIFEST_ENTRY_PACKED)
+			continue;
+
+		char name[512];
+		char delta_path[1024];
+		generate_storage_filename(filename, entry->version, name, sizeof(name));
+		snprintf(delta_path, sizeof(delta_path), "%s/%s", config->storage_dir, name);
+
+		// The manifest record already holds what the .meta file says
+		uint32_t delta_size = 0;
+		uint8_t *delta_bytes = read_loose_file(delta_path, &delta_size);
+		if (delta_bytes == NULL) {
+			storage_log("Cannot migrate version %u of '%s'\n", entry->version, filename);
+			free(entries);
+			return -1;
+		}
+
+		size_t record_size = sizeof(PackRecordHeader) + delta_size;
+		uint8_t *record = malloc(record_size);
+		if (record == NULL) {
+			free(delta_bytes);
+			free(entries);
+			return -1;
+		}
+
+		PackRecordHeader header;
+		header.magic = PACK_RECORD_MAGIC;
+		header.version = entry->version;
+		header.delta_size = delta_size;
+		memcpy(record, &header, sizeof(PackRecordHeader));
+		memcpy(record + sizeof(PackRecordHeader), delta_bytes, delta_size);
+
+		uint64_t record_offset;
+		int result = pack_append(config, filename, record, record_size, &record_offset);
+		free(record);
+		free(delta_bytes);
+		if (result != EXIT_SUCCESS) {
+			free(entries);
+			return -1;
+		}
+
+		entry->flags |= MANIFEST_ENTRY_PACKED;
+		entry->offset = record_offset + sizeof(PackRecordHeader);
+		entry->size = delta_size;
+		moved++;
+	}
+
+	if (moved == 0) {
+		free(entries);
+		return 0;
+	}
+
+	// Flush the pack records before the manifest switches readers over to them, then drop
+	// the loose copies once the switch is durable
+	if (storage_commit(config) != EXIT_SUCCESS ||
+	    manifest_rewrite(config, filename, entries, (uint32_t)count) != EXIT_SUCCESS ||
+	    storage_commit(config) != EXIT_SUCCESS) {
+		free(entries);
+		return -1;
+	}
+
+	for (int i = 0; i < count; i++) {
+		char name[512];
+		char path[1024];
+
+		generate_storage_filename(filename, entries[i].version, name, sizeof(name));
+		snprintf(path, sizeof(path), "%s/%s", config->storage_dir, name);
+		unlink(path);
+		generate_metadata_filename(filename, entries[i].version, name, sizeof(name));
+		snprintf(path, sizeof(path), "%s/%s", config->storage_dir, name);
+		unlink(path);
+	}
+
+	free(entries);
+	return moved;
+}
+
+/**
+ * @brief Moves the loose versions of a tracked file into its pack
+ *
+ * Appends a pack record for every version that is still stored as loose
+ * .delta and .meta files, rewrites the manifest to point at the pack, and
+ * only then removes the loose files. Storage directories without a manifest
+ * are imported first.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ *
+ * @return Number of versions moved into the pack on success, -1 on failure.
+ *
+ * @note If the function fails before the manifest is rewritten, the loose
+ *       files are still the versions of record and nothing is lost.
+ *
+ * @note Holds the file's writer lock, so no version is tracked meanwhile.
+ *
+ * @example
+ * ```c
+ * int moved = storage_migrate_file(config, "file.txt");
+ * if (moved > 0)
+ *     printf("Packed %d versions\n", moved);
+ * ```
+ */
+int storage_migrate_file(StorageConfig *config, const char *filename)
+{
+	if (config == NULL || filename == NULL) {
+		storage_log("Error: Invalid parameters for migration\n");
+		return -1;
+	}
+
+	int lock = storage_lock_file(config, filename);
+	if (lock == -1)
+		return -1;
+
+	int result = migrate_locked(config, filename);
+	storage_unlock(lock);
+	return result;
+}
@@ -0,0 +1,427 @@
+/**
+ * @file range_read.c
+ * @brief Random-access reads from stored versions without full reconstruction
+ *
+ * This module answers "give me bytes [offset, offset + length) of version N"
+ * by resolving only the delta operations that cover the requested range.
+ * Each stored delta (its region of the pack, or a loose .delta file) is
+ * memory-mapped and indexed by the output offset of its operations (a
+ * prefix sum), so locating the operation for a byte is a binary search. COPY
+ * operations are resolved recursively against the previous version; INSERT
+ * and REPLACE bytes are copied straight out of the mapping.
+ *
+ * The cost of a read scales with the number of bytes requested and the
+ * operations that cover them, not with the size of the version.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "delta_structures.h"
+
+// Size of an operation header in a .delta file: type + offset + length
+#define DELTA_OP_HEADER_SIZE (sizeof(DeltaOperationType) + 2 * sizeof(uint32_t))
+
+/**
+ * @brief Memory-maps a delta stored in a file and builds its output offset index
+ *
+ * Maps the pages of path that hold the delta read-only and walks the
+ * operation headers once, recording for every operation the offset of the
+ * first byte it produces. Literal data is not copied: index entries point
+ * into the mapping.
+ *
+ * @param path File holding the delta: a loose .delta file or a pack. Must not be NULL.
+ * @param offset Offset of the first operation header in path.
+ * @param size Number of bytes of delta data.
+ * @param version Version the delta produces, used in messages.
+ *
+ * @return Pointer to the new DeltaIndex on success, NULL on failure.
+ *         The caller is responsible for freeing it with delta_index_free().
+ *
+ * @note The delta is validated while indexing: truncated headers or data
+ *       and unknown operation types cause the function to fail.
+ */
+DeltaIndex * delta_index_map(const char *path, uint64_t offset, uint32_t size, uint32_t version)
+{
+	if (path == NULL) {
+		storage_log("Error: Invalid parameters for delta index\n");
+		return NULL;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		storage_log("Failed to open delta file: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || size == 0 || offset + size > (uint64_t)st.st_size) {
+		storage_log("Delta of version %u is missing from %s\n", version, path);
+		close(fd);
+		return NULL;
+	}
+
+	// mmap() offsets must be page aligned; map from the page holding the first byte
+	uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+	uint64_t map_offset = offset - offset % page_size;
+	size_t map_size = (size_t)(offset - map_offset) + size;
+
+	uint8_t *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, (off_t)map_offset);
+	close(fd);
+	if (map == MAP_FAILED) {
+		storage_log("Failed to map delta file: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	DeltaIndex *index = malloc(sizeof(DeltaIndex));
+	if (index == NULL) {
+		munmap(map, map_size);
+		return NULL;
+	}
+
+	index->version = version;
+	index->new_size = 0;
+	index->entry_count = 0;
+	index->entries = NULL;
+	index->map = map;
+	index->map_size = map_size;
+	index->map_offset = map_offset;
+
+	uint32_t capacity = 16;
+	index->entries = malloc(capacity * sizeof(DeltaIndexEntry));
+	if (index->entries == NULL) {
+		delta_index_free(index);
+		return NULL;
+	}
+
+	size_t pos = (size_t)(offset - map_offset);
+	while (pos < index->map_size) {
+		if (index->map_size - pos < DELTA_OP_HEADER_SIZE) {
+			storage_log("Truncated operation header in version %u\n", version);
+			delta_index_free(index);
+			return NULL;
+		}
+
+		if (index->entry_count >= capacity) {
+			capacity *= 2;
+			DeltaIndexEntry *new_entries = realloc(index->entries,
+							       capacity * sizeof(DeltaIndexEntry));
+			if (new_entries == NULL) {
+				delta_index_free(index);
+				return NULL;
+			}
+			index->entries = new_entries;
+		}
+
+		DeltaIndexEntry *entry = &index->entries[index->entry_count];
+		memcpy(&entry->type, map + pos, sizeof(DeltaOperationType));
+		memcpy(&entry->offset, map + pos + sizeof(DeltaOperationType), sizeof(uint32_t));
+		memcpy(&entry->length, map + pos + sizeof(DeltaOperationType) + sizeof(uint32_t),
+		       sizeof(uint32_t));
+		pos += DELTA_OP_HEADER_SIZE;
+
+		entry->data = NULL;
+		switch (entry->type) {
+		case DELTA_COPY:
+			break;
+		case DELTA_INSERT:
+		case DELTA_REPLACE:
+			if (index->map_size - pos < entry->length) {
+				storage_log("Truncated data for operation %u in version %u\n",
+				       index->entry_count, version);
+				delta_index_free(index);
+				return NULL;
+			}
+			entry->data = map + pos;
+			pos += entry->length;
+			break;
+		default:
+			storage_log("Unknown operation type %d in version %u\n", (int)entry->type, version);
+			delta_index_free(index);
+			return NULL;
+		}
+
+		if (entry->length > UINT32_MAX - index->new_size) {
+			storage_log("Version %u is too large to index\n", version);
+			delta_index_free(index);
+			return NULL;
+		}
+
+		entry->output_offset = index->new_size;
+		index->new_size += entry->length;
+		index->entry_count++;
+	}
+
+	return index;
+}
+
+/**
+ * @brief Memory-maps a stored delta and builds its output offset index
+ *
+ * Looks the version up in the file's manifest and indexes its delta with
+ * delta_index_map(), whether it lives in the pack or in a loose .delta file.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param version Version whose delta should be indexed. Must be > 0.
+ *
+ * @return Pointer to the new DeltaIndex on success, NULL on failure.
+ *         The caller is responsible for freeing it with delta_index_free().
+ *
+ * @example
+ * ```c
+ * DeltaIndex *index = delta_index_open(config, "file.txt", 3);
+ * if (index != NULL) {
+ *     printf("Version 3 is %u bytes\n", index->new_size);
+ *     delta_index_free(index);
+ * }
+ * ```
+ */
+DeltaIndex * delta_index_open(StorageConfig *config, const char *filename, uint32_t version)
+{
+	if (config == NULL || filename == NULL || version == 0) {
+		storage_log("Error: Invalid parameters for delta index\n");
+		return NULL;
+	}
+
+	StoredDelta location;
+	if (storage_locate(config, filename, version, &location) != EXIT_SUCCESS)
+		return NULL;
+
+	return delta_index_map(location.path, location.offset, location.size, version);
+}
+
+/**
+ * @brief Finds the operation that produces a given output byte
+ *
+ * Binary searches the prefix sums of the index for the operation whose output
+ * range contains output_offset.
+ *
+ * @param index Delta index to search. Must not be NULL.
+ * @param output_offset Offset in the version produced by the delta.
+ *
+ * @return Index of the covering entry on success, -1 if the offset is out of range.
+ */
+int delta_index_find(const DeltaIndex *index, uint32_t output_offset)
+{
+	if (index == NULL || output_offset >= index->new_size)
+		return -1;
+
+	uint32_t low = 0;
+	uint32_t high = index->entry_count;
+
+	// Find the last entry whose output_offset <= output_offset
+	while (high - low > 1) {
+		uint32_t mid = low + (high - low) / 2;
+		if (index->entries[mid].output_offset <= output_offset)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	// Zero-length operations share an output_offset with their successor
+	while (low + 1 < index->entry_count && index->entries[low].length == 0)
+		low++;
+
+	return (int)low;
+}
+
+/**
+ * @brief Frees a delta index and unmaps its delta file
+ *
+ * @param index Delta index to free. Safe to pass NULL.
+ */
+void delta_index_free(DeltaIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	if (index->map != NULL)
+		munmap(index->map, index->map_size);
+	free(index->entries);
+	free(index);
+}
+
+/**
+ * @brief Opens a random-access reader over one version of a tracked file
+ *
+ * Only the index of the requested version is opened up front; indexes of
+ * older versions are opened on demand when a COPY operation refers to them.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param version Version to read. Must be > 0.
+ *
+ * @return Pointer to the new VersionReader on success, NULL on failure.
+ *         The caller is responsible for freeing it with version_reader_free().
+ *
+ * @example
+ * ```c
+ * VersionReader *reader = version_reader_open(config, "file.txt", 7);
+ * uint8_t header[512];
+ * int64_t n = version_reader_read(reader, 0, sizeof(header), header);
+ * version_reader_free(reader);
+ * ```
+ */
+VersionReader * version_reader_open(StorageConfig *config, const char *filename, uint32_t version)
+{
+	if (config == NULL || filename == NULL || version == 0) {
+		storage_log("Error: Invalid parameters for version reader\n");
+		return NULL;
+	}
+
+	VersionReader *reader = malloc(sizeof(VersionReader));
+	if (reader == NULL)
+		return NULL;
+
+	reader->config = config;
+	strncpy(reader->filename, filename, sizeof(reader->filename) - 1);
+	reader->filename[sizeof(reader->filename) - 1] = '\0';
+	reader->version = version;
+
+	reader->indexes = calloc(version, sizeof(DeltaIndex *));
+	if (reader->indexes == NULL) {
+		free(reader);
+		return NULL;
+	}
+
+	reader->indexes[version - 1] = delta_index_open(config, filename, version);
+	if (reader->indexes[version - 1] == NULL) {
+		version_reader_free(reader);
+		return NULL;
+	}
+
+	return reader;
+}
+
+// Returns the index of a version, opening it on first use
+static DeltaIndex * version_reader_index(VersionReader *reader, uint32_t version)
+{
+	if (reader->indexes[version - 1] == NULL)
+		reader->indexes[version - 1] = delta_index_open(reader->config, reader->filename, version);
+	return reader->indexes[version - 1];
+}
+
+/**
+ * @brief Returns the size of the version opened by the reader
+ *
+ * @param reader Version reader. Must not be NULL.
+ *
+ * @return Size of the version in bytes, 0 if reader is NULL.
+ */
+uint32_t version_reader_size(VersionReader *reader)
+{
+	if (reader == NULL)
+		return 0;
+	return reader->indexes[reader->version - 1]->new_size;
+}
+
+// Copies [offset, offset + length) of a version into output, following COPYs down the chain
+static int resolve_range(VersionReader *reader, uint32_t version, uint32_t offset,
+			 uint32_t length, uint8_t *output)
+{
+	DeltaIndex *index = version_reader_index(reader, version);
+
+	if (index == NULL)
+		return -1;
+
+	if (offset > index->new_size || length > index->new_size - offset) {
+		storage_log("Range %u:%u is outside version %u (%u bytes)\n",
+		       offset, length, version, index->new_size);
+		return -1;
+	}
+
+	if (length == 0)
+		return 0;
+
+	int i = delta_index_find(index, offset);
+	if (i < 0)
+		return -1;
+
+	uint32_t done = 0;
+	while (done < length && (uint32_t)i < index->entry_count) {
+		const DeltaIndexEntry *entry = &index->entries[i];
+		uint32_t skip = offset + done - entry->output_offset;
+		uint32_t count = entry->length - skip;
+		if (count > length - done)
+			count = length - done;
+
+		switch (entry->type) {
+		case DELTA_COPY:
+			if (version == 1) {
+				storage_log("COPY operation not allowed in version 1\n");
+				return -1;
+			}
+			if (resolve_range(reader, version - 1, entry->offset + skip, count,
+					  output + done) < 0)
+				return -1;
+			break;
+		case DELTA_INSERT:
+		case DELTA_REPLACE:
+			memcpy(output + done, entry->data + skip, count);
+			break;
+		}
+
+		done += count;
+		i++;
+	}
+
+	return done == length ? 0 : -1;
+}
+
+/**
+ * @brief Reads a byte range of a stored version
+ *
+ * Resolves only the operations covering [offset, offset + length), descending
+ * through the delta chain for COPY operations. No version is reconstructed in
+ * full.
+ *
+ * @param reader Version reader. Must not be NULL.
+ * @param offset First byte to read.
+ * @param length Number of bytes to read. offset + length must not exceed
+ *               version_reader_size().
+ * @param output_buffer Destination buffer of at least length bytes. Must not be NULL.
+ *
+ * @return Number of bytes read on success, -1 on failure. The count is 64-bit
+ *         because length can exceed INT_MAX.
+ */
+int64_t version_reader_read(VersionReader *reader, uint32_t offset, uint32_t length,
+			    uint8_t *output_buffer)
+{
+	if (reader == NULL || output_buffer == NULL) {
+		storage_log("Error: Invalid parameters for range read\n");
+		return -1;
+	}
+
+	if (resolve_range(reader, reader->version, offset, length, output_buffer) < 0)
+		return -1;
+
+	return (int64_t)length;
+}
+
+/**
+ * @brief Frees a version reader and every index it opened
+ *
+ * @param reader Version reader to free. Safe to pass NULL.
+ */
+void version_reader_free(VersionReader *reader)
+{
+	if (reader == NULL)
+		return;
+
+	if (reader->indexes != NULL)
+		for (uint32_t v = 0; v < reader->version; v++)
+			delta_index_free(reader->indexes[v]);
+	free(reader->indexes);
+	free(reader);
+}
@@ -46,13 +46,13 @@ RollingHash * rolling_hash_new(uint32_t window_size)
 {
 	// Validate input parameters
 	if (window_size == 0) {
-		printf("Error: window_size must be greater than 0\n");
+		storage_log("Error: window_size must be greater than 0\n");
 		return NULL;
 	}
 
 	RollingHash *rh = malloc(sizeof(RollingHash));
 	if (rh == NULL) {
-		printf("Failed to allocate memory for RollingHash: %s\n", strerror(errno));
+		storage_log("Failed to allocate memory for RollingHash: %s\n", strerror(errno));
 		return NULL;
 	}
 
@@ -61,7 +61,7 @@ RollingHash * rolling_hash_new(uint32_t window_size)
 	rh->window_size = window_size;
 	rh->window = calloc(window_size, sizeof(uint8_t)); // Initialize to zeros
 	if (rh->window == NULL) {
-		printf("Failed to allocate memory for window: %s\n", strerror(errno));
+		storage_log("Failed to allocate memory for window: %s\n", strerror(errno));
 		free(rh);
 		return NULL;
 	}
@@ -138,6 +138,32 @@ void rolling_hash_update(RollingHash *rh, uint8_t byte)
 	if (rh->b > 0xFFFF) rh->b &= 0xFFFF;
 }
 
+/**
+ * @brief Empties the window of a rolling hash so it can hash new data
+ *
+ * Leaves the hash as rolling_hash_new() returned it, without allocating.
+ *
+ * @param rh Pointer to the rolling hash structure. Safe to pass NULL.
+ *
+ * @example
+ * ```c
+ * rolling_hash_reset(rh);
+ * for (uint32_t i = 0; i < size; i++)
+ *     rolling_hash_update(rh, data[i]);
+ * ```
+ */
+void rolling_hash_reset(RollingHash *rh)
+{
+	if (rh == NULL)
+		return;
+
+	rh->a = 0;
+	rh->b = 0;
+	rh->window_pos = 0;
+	rh->bytes_in_window = 0;
+	memset(rh->window, 0, rh->window_size);
+}
+
 /**
  * @brief Gets the current hash value from the rolling hash
  *
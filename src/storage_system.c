@@ -15,25 +15,38 @@
  * - Safe filename generation and path handling
  *
  * Storage Format:
- * - Delta files: Binary format with operation headers and data
- * - Metadata files: Binary FileMetadata structure with file information
- * - Directory structure: Organized by filename with version suffixes
+ * - Objects: The pack, manifest and message heap of a tracked file live in
+ *   objects/kk/kk/<key>.*, keyed by a hash of the file's canonical path
+ * - Pack files: One append-only <key>.pack per tracked file holding a record
+ *   (PackRecordHeader, delta operations) per version
+ * - Manifest files: A header and one fixed-size little-endian record per
+ *   stored version, which doubles as the index of the pack
+ * - Message heaps: One append-only <key>.messages per tracked file holding
+ *   the version messages the manifest records point into
+ * - Loose files: <name>_vN.delta/.meta written before packs existed, read in
+ *   place until "fiver migrate" moves them into the pack
+ * - Directory structure: Objects fan out over objects/kk/kk/; loose legacy
+ *   files and the catalog sit at the top of the storage directory
  *
  * @author Fiver Development Team
  * @version 1.0
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <time.h>
 #include "delta_structures.h"
 
 // Forward declarations
-DeltaInfo * delta_create(const uint8_t *original_data, uint32_t original_size, const uint8_t *new_data, uint32_t new_size);
 void delta_free(DeltaInfo *delta);
 
 /**
@@ -54,6 +67,8 @@ void delta_free(DeltaInfo *delta);
  * @note Default configuration:
  *       - max_versions: 100
  *       - compression_enabled: 0 (disabled)
+ *       - apply_threads: number of online CPUs
+ *       - verify_content: 0 (reconstructed versions are not checked)
  *
  * @example
  * ```c
@@ -80,16 +95,25 @@ StorageConfig * storage_init(const char *storage_dir)
 
 	config->max_versions = 100;
 	config->compression_enabled = 0; // Disabled for now
+	config->apply_threads = thread_pool_cpu_count();
+	config->apply_pool = NULL;
+	config->durability = DURABILITY_BATCH;
+	config->sync_pending = 0;
+	for (int i = 0; i < STORAGE_SYNC_SLOTS; i++)
+		config->sync_fds[i] = -1;
+	config->verify_content = 0;
+	memset(config->delta_contexts, 0, sizeof(config->delta_contexts));
 
 	// Create storage directory if it doesn't exist
 	struct stat st = { 0 };
 	if (stat(config->storage_dir, &st) == -1) {
 		if (mkdir(config->storage_dir, 0755) == -1) {
-			printf("Failed to create storage directory: %s\n", strerror(errno));
+			storage_log("Failed to create storage directory: %s\n", strerror(errno));
 			free(config);
 			return NULL;
 		}
-		printf("Created storage directory: %s\n", config->storage_dir);
+		storage_sync_entry(config, config->storage_dir);
+		storage_log("Created storage directory: %s\n", config->storage_dir);
 	}
 
 	return config;
@@ -98,7 +122,10 @@ StorageConfig * storage_init(const char *storage_dir)
 /**
  * @brief Frees memory associated with storage configuration
  *
- * Safely frees all memory allocated for the StorageConfig structure.
+ * Safely frees all memory allocated for the StorageConfig structure,
+ * including the delta application thread pool if one was started and the
+ * delta contexts kept between tracks.
+ * Writes of a batch that was not committed yet are flushed first.
  * This function handles NULL pointers gracefully.
  *
  * @param config Pointer to the StorageConfig to free. Safe to pass NULL.
@@ -116,23 +143,37 @@ StorageConfig * storage_init(const char *storage_dir)
  */
 void storage_free(StorageConfig *config)
 {
-	if (config != NULL)
-		free(config);
+	if (config == NULL)
+		return;
+
+	storage_commit(config);
+	thread_pool_free(config->apply_pool);
+	for (int i = 0; i < STORAGE_DELTA_CONTEXTS; i++)
+		delta_context_free(config->delta_contexts[i]);
+	free(config);
+}
+
+// Bytes read at a time when hashing a file on disk
+#define HASH_READ_CHUNK (256 * 1024)
+
+// Formats a content hash as lowercase hex
+static void format_content_hash(const uint8_t *hash, char *checksum)
+{
+	for (int i = 0; i < CONTENT_HASH_SIZE; i++)
+		snprintf(checksum + 2 * i, 3, "%02x", hash[i]);
 }
 
 /**
- * @brief Calculates a simple checksum for data integrity verification
+ * @brief Calculates the content checksum of a version
  *
- * Computes a basic checksum by summing all bytes in the data buffer.
- * This provides a simple integrity check for stored files and deltas.
+ * Hashes the data with BLAKE3, truncated to CONTENT_HASH_SIZE bytes, and
+ * formats the hash as hex: the content hash kept in every version's manifest
+ * record, as text.
  *
  * @param data Pointer to the data buffer to checksum. Must not be NULL.
- * @param size Number of bytes to process. Must be > 0.
+ * @param size Number of bytes to process.
  * @param checksum Output buffer for the checksum string. Must be at least 64 bytes.
- *                 The checksum is formatted as an 8-character hexadecimal string.
- *
- * @note This is a simple checksum algorithm suitable for basic integrity checking.
- *       For production use, consider implementing CRC32 or SHA-256.
+ *                 The checksum is formatted as a 32-character hexadecimal string.
  *
  * @note The checksum string is null-terminated.
  *
@@ -146,20 +187,136 @@ void storage_free(StorageConfig *config)
 void calculate_checksum(const uint8_t *data, uint32_t size, char *checksum)
 {
 	if (data == NULL || checksum == NULL) {
-		printf("Error: Invalid parameters for checksum calculation\n");
+		storage_log("Error: Invalid parameters for checksum calculation\n");
 		return;
 	}
 
-	if (size == 0) {
-		strcpy(checksum, "00000000");
-		return;
+	uint8_t hash[CONTENT_HASH_SIZE];
+	blake3_hash(data, size, hash, sizeof(hash));
+	format_content_hash(hash, checksum);
+}
+
+/**
+ * @brief Calculates the content hash of a file on disk
+ *
+ * Streams the file through BLAKE3 in fixed-size reads, so a file of any
+ * size is hashed in constant memory.
+ *
+ * @param path Path of the file. Must not be NULL.
+ * @param hash Output buffer of CONTENT_HASH_SIZE bytes. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 if the file could not be read.
+ *
+ * @example
+ * ```c
+ * uint8_t hash[CONTENT_HASH_SIZE];
+ * if (storage_hash_file("file.txt", hash) == EXIT_SUCCESS)
+ *     // ... compare with a manifest record's content_hash ...
+ * ```
+ */
+int storage_hash_file(const char *path, uint8_t *hash)
+{
+	if (path == NULL || hash == NULL) {
+		storage_log("Error: Invalid parameters for file hashing\n");
+		return -1;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		storage_log("Failed to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	// The file is read once, front to back
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	uint8_t *buffer = malloc(HASH_READ_CHUNK);
+	if (buffer == NULL) {
+		storage_log("Failed to allocate read buffer: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	Blake3Hasher hasher;
+	blake3_init(&hasher);
+
+	int result = EXIT_SUCCESS;
+	for (;;) {
+		ssize_t n = read(fd, buffer, HASH_READ_CHUNK);
+		if (n == 0)
+			break;
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			storage_log("Failed to read %s: %s\n", path, strerror(errno));
+			result = -1;
+			break;
+		}
+		blake3_update(&hasher, buffer, (size_t)n);
+	}
+
+	if (result == EXIT_SUCCESS)
+		blake3_final(&hasher, hash, CONTENT_HASH_SIZE);
+
+	free(buffer);
+	close(fd);
+	return result;
+}
+
+/**
+ * @brief Continues a 32-bit FNV-1a hash over more data
+ *
+ * @param hash Hash of the data so far, or FNV_OFFSET_BASIS to start.
+ * @param data Data to add. Must not be NULL if length > 0.
+ * @param length Number of bytes to add.
+ *
+ * @return Hash of the data so far followed by data.
+ */
+static uint32_t hash_update(uint32_t hash, const uint8_t *data, size_t length)
+{
+	for (size_t i = 0; i < length; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
 	}
+	return hash;
+}
 
-	uint32_t sum = 0;
+// FNV-1a offset basis: the hash of no data
+#define FNV_OFFSET_BASIS 2166136261u
 
-	for (uint32_t i = 0; i < size; i++)
-		sum += data[i];
-	snprintf(checksum, 64, "%08x", sum);
+/**
+ * @brief Calculates a 32-bit FNV-1a hash of a buffer
+ *
+ * A cheap hash for lookups and for the checksums of stored delta bytes
+ * recorded in version manifests. Contents are checked with the BLAKE3
+ * hash of calculate_checksum() instead.
+ *
+ * @param data Data to hash. Can be NULL if length is 0.
+ * @param length Number of bytes to hash.
+ *
+ * @return The hash value; 2166136261 for empty input.
+ *
+ * @example
+ * ```c
+ * uint32_t hash = calculate_hash(file_data, file_size);
+ * ```
+ */
+uint32_t calculate_hash(const uint8_t *data, uint32_t length)
+{
+	if (data == NULL)
+		return FNV_OFFSET_BASIS;
+	return hash_update(FNV_OFFSET_BASIS, data, length);
+}
+
+// Copies a filename into safe_name with the characters that cannot appear in a storage name (/, \, :) replaced
+static void make_safe_name(const char *original_filename, char *safe_name, size_t max_len)
+{
+	strncpy(safe_name, original_filename, max_len - 1);
+	safe_name[max_len - 1] = '\0';
+
+	for (size_t i = 0; safe_name[i]; i++)
+		if (safe_name[i] == '/' || safe_name[i] == '\\' || safe_name[i] == ':')
+			safe_name[i] = '_';
 }
 
 /**
@@ -191,25 +348,18 @@ void generate_storage_filename(const char *original_filename, uint32_t version,
 			       char *storage_filename, size_t max_len)
 {
 	if (original_filename == NULL || storage_filename == NULL || max_len == 0) {
-		printf("Error: Invalid parameters for filename generation\n");
+		storage_log("Error: Invalid parameters for filename generation\n");
 		return;
 	}
 
 	if (version == 0) {
-		printf("Error: Version must be greater than 0\n");
+		storage_log("Error: Version must be greater than 0\n");
 		return;
 	}
 
 	// Create a safe filename by replacing problematic characters
 	char safe_name[256];
-
-	strncpy(safe_name, original_filename, sizeof(safe_name) - 1);
-	safe_name[sizeof(safe_name) - 1] = '\0';
-
-	// Replace problematic characters
-	for (int i = 0; safe_name[i]; i++)
-		if (safe_name[i] == '/' || safe_name[i] == '\\' || safe_name[i] == ':')
-			safe_name[i] = '_';
+	make_safe_name(original_filename, safe_name, sizeof(safe_name));
 
 	snprintf(storage_filename, max_len, "%s_v%u.delta", safe_name, version);
 }
@@ -243,158 +393,466 @@ void generate_metadata_filename(const char *original_filename, uint32_t version,
 				char *metadata_filename, size_t max_len)
 {
 	if (original_filename == NULL || metadata_filename == NULL || max_len == 0) {
-		printf("Error: Invalid parameters for metadata filename generation\n");
+		storage_log("Error: Invalid parameters for metadata filename generation\n");
 		return;
 	}
 
 	if (version == 0) {
-		printf("Error: Version must be greater than 0\n");
+		storage_log("Error: Version must be greater than 0\n");
 		return;
 	}
 
 	char safe_name[256];
+	make_safe_name(original_filename, safe_name, sizeof(safe_name));
 
-	strncpy(safe_name, original_filename, sizeof(safe_name) - 1);
-	safe_name[sizeof(safe_name) - 1] = '\0';
+	snprintf(metadata_filename, max_len, "%s_v%u.meta", safe_name, version);
+}
 
-	for (int i = 0; safe_name[i]; i++)
-		if (safe_name[i] == '/' || safe_name[i] == '\\' || safe_name[i] == ':')
-			safe_name[i] = '_';
+/**
+ * @brief Reduces a tracked filename to its canonical form
+ *
+ * Removes "./" segments, repeated and trailing slashes, so that every
+ * spelling of a path names the same tracked file. ".." is kept as is.
+ *
+ * @param filename Filename as given by the user. Must not be NULL.
+ * @param canonical Output buffer for the canonical path. Must not be NULL.
+ * @param max_len Size of the output buffer. Must be > 0.
+ *
+ * @example
+ * ```c
+ * char path[256];
+ * storage_canonical_path("./docs//a.txt", path, sizeof(path));
+ * // Result: "docs/a.txt"
+ * ```
+ */
+void storage_canonical_path(const char *filename, char *canonical, size_t max_len)
+{
+	size_t out = 0;
+	const char *p = filename;
+
+	while (*p != '\0' && out + 1 < max_len) {
+		// At the start of a segment: skip empty and "." segments, except a leading "/"
+		if (*p == '/') {
+			if (out == 0 && p == filename)
+				canonical[out++] = '/';
+			p++;
+			continue;
+		}
+		if (p[0] == '.' && (p[1] == '/' || p[1] == '\0')) {
+			p++;
+			continue;
+		}
 
-	snprintf(metadata_filename, max_len, "%s_v%u.meta", safe_name, version);
+		if (out > 0 && canonical[out - 1] != '/')
+			canonical[out++] = '/';
+		while (*p != '\0' && *p != '/' && out + 1 < max_len)
+			canonical[out++] = *p++;
+	}
+
+	canonical[out] = '\0';
+}
+
+// 64-bit FNV-1a of a string, the key of a tracked file's storage objects
+static uint64_t object_key(const char *canonical)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (const char *p = canonical; *p != '\0'; p++) {
+		hash ^= (uint8_t)*p;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Builds "objects/kk/kk/<key><extension>" for a tracked file
+static void generate_object_filename(const char *original_filename, const char *extension,
+				     char *object_filename, size_t max_len)
+{
+	char canonical[1024];
+
+	storage_canonical_path(original_filename, canonical, sizeof(canonical));
+
+	uint64_t key = object_key(canonical);
+	snprintf(object_filename, max_len, "objects/%02x/%02x/%016llx%s", (unsigned)(key >> 56),
+		 (unsigned)(key >> 48) & 0xff, (unsigned long long)key, extension);
+}
+
+/**
+ * @brief Creates the directories holding a tracked file's storage objects
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ */
+int storage_object_dir(StorageConfig *config, const char *filename)
+{
+	if (config == NULL || filename == NULL) {
+		storage_log("Error: Invalid parameters for object directory\n");
+		return -1;
+	}
+
+	char object_filename[512];
+	char path[1024];
+	generate_object_filename(filename, "", object_filename, sizeof(object_filename));
+
+	// objects/, objects/kk/ and objects/kk/kk/
+	const char *slash = object_filename;
+	while ((slash = strchr(slash, '/')) != NULL) {
+		snprintf(path, sizeof(path), "%s/%.*s", config->storage_dir, (int)(slash - object_filename),
+			 object_filename);
+		if (mkdir(path, 0755) == 0) {
+			if (storage_sync_entry(config, path) != EXIT_SUCCESS)
+				return -1;
+		} else if (errno != EEXIST) {
+			storage_log("Failed to create storage directory %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+		slash++;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Generates the manifest filename of a tracked file
+ *
+ * Storage objects are keyed by a 64-bit hash of the canonical path and fanned
+ * out over two levels of subdirectories, so no directory grows large. The
+ * hash is not unique: the manifest header records the path its objects
+ * belong to, and opening the manifest for another path fails.
+ *
+ * @param original_filename The original filename to convert. Must not be NULL.
+ * @param manifest_filename Output buffer for the generated filename. Must not be NULL.
+ * @param max_len Maximum length of the output buffer. Must be > 0.
+ *
+ * @note The output filename format is: "objects/kk/kk/key.manifest", where
+ *       key is 16 hex digits and kk are its first two bytes.
+ *
+ * @example
+ * ```c
+ * char filename[256];
+ * generate_manifest_filename("my/file.txt", filename, sizeof(filename));
+ * // Result: "objects/3c/8e/3c8e....manifest"
+ * ```
+ */
+void generate_manifest_filename(const char *original_filename, char *manifest_filename, size_t max_len)
+{
+	if (original_filename == NULL || manifest_filename == NULL || max_len == 0) {
+		storage_log("Error: Invalid parameters for manifest filename generation\n");
+		return;
+	}
+
+	generate_object_filename(original_filename, ".manifest", manifest_filename, max_len);
+}
+
+/**
+ * @brief Generates the pack filename of a tracked file
+ *
+ * @param original_filename The original filename to convert. Must not be NULL.
+ * @param pack_filename Output buffer for the generated filename. Must not be NULL.
+ * @param max_len Maximum length of the output buffer. Must be > 0.
+ *
+ * @note The output filename format is: "objects/kk/kk/key.pack"
+ *
+ * @example
+ * ```c
+ * char filename[256];
+ * generate_pack_filename("my/file.txt", filename, sizeof(filename));
+ * // Result: "objects/3c/8e/3c8e....pack"
+ * ```
+ */
+void generate_pack_filename(const char *original_filename, char *pack_filename, size_t max_len)
+{
+	if (original_filename == NULL || pack_filename == NULL || max_len == 0) {
+		storage_log("Error: Invalid parameters for pack filename generation\n");
+		return;
+	}
+
+	generate_object_filename(original_filename, ".pack", pack_filename, max_len);
+}
+
+/**
+ * @brief Generates the message heap filename of a tracked file
+ *
+ * @param original_filename The original filename to convert. Must not be NULL.
+ * @param heap_filename Output buffer for the generated filename. Must not be NULL.
+ * @param max_len Maximum length of the output buffer. Must be > 0.
+ *
+ * @note The output filename format is: "objects/kk/kk/key.messages"
+ *
+ * @example
+ * ```c
+ * char filename[256];
+ * generate_message_heap_filename("my/file.txt", filename, sizeof(filename));
+ * // Result: "objects/3c/8e/3c8e....messages"
+ * ```
+ */
+void generate_message_heap_filename(const char *original_filename, char *heap_filename, size_t max_len)
+{
+	if (original_filename == NULL || heap_filename == NULL || max_len == 0) {
+		storage_log("Error: Invalid parameters for message heap filename generation\n");
+		return;
+	}
+
+	generate_object_filename(original_filename, ".messages", heap_filename, max_len);
+}
+
+/**
+ * @brief Generates the lock filename of a tracked file
+ *
+ * @param original_filename The original filename to convert. Must not be NULL.
+ * @param lock_filename Output buffer for the generated filename. Must not be NULL.
+ * @param max_len Maximum length of the output buffer. Must be > 0.
+ *
+ * @note The output filename format is: "objects/kk/kk/key.lock"
+ */
+void generate_lock_filename(const char *original_filename, char *lock_filename, size_t max_len)
+{
+	if (original_filename == NULL || lock_filename == NULL || max_len == 0) {
+		storage_log("Error: Invalid parameters for lock filename generation\n");
+		return;
+	}
+
+	generate_object_filename(original_filename, ".lock", lock_filename, max_len);
 }
 
 /**
- * @brief Saves a delta and its metadata to persistent storage
+ * @brief Saves a delta to persistent storage
  *
- * Writes delta operations and associated metadata to disk in a structured
- * binary format. This function handles both the delta data and metadata
- * files, ensuring atomicity by cleaning up on failure.
+ * Appends one record holding the delta operations to the file's pack, then
+ * records the version, its sizes, timestamp and message in the file's
+ * manifest. The version only becomes visible once the manifest record is
+ * written.
  *
  * @param config Storage configuration. Must not be NULL.
  * @param filename Original filename for versioning. Must not be NULL.
  * @param version Version number to save. Must be > 0.
  * @param delta Delta information to save. Must not be NULL.
- * @param original_data Original file data for checksum calculation. Can be NULL.
+ * @param content_hash CONTENT_HASH_SIZE-byte BLAKE3 hash of the contents the
+ *                     delta produces, best computed while they are read. Can
+ *                     be NULL to store the version without one.
  * @param message Optional commit message. Can be NULL.
  *
  * @return EXIT_SUCCESS on success, -1 on failure.
  *
- * @note The function creates two files: .delta (operations) and .meta (metadata).
+ * @note The record is written with a single append. A record left behind by a
+ *       failure is never referenced by the manifest and is ignored.
  *
- * @note On failure, any partially created files are cleaned up.
+ * @note The contents are never rebuilt here to hash them. Versions stored
+ *       without a hash are not checked by --verify or status.
  *
- * @note The function calculates a checksum of the original data for integrity.
+ * @note The caller holds the file's writer lock (storage_lock_file()), as
+ *       track_file_head() does.
  *
  * @example
  * ```c
- * int result = save_delta(config, "file.txt", 2, delta, orig_data, "Updated file");
+ * uint8_t hash[CONTENT_HASH_SIZE];
+ * blake3_hash(new_data, new_size, hash, sizeof(hash));
+ * int result = save_delta(config, "file.txt", 2, delta, hash, "Updated file");
  * if (result != EXIT_SUCCESS) {
  *     // Handle save failure
  * }
  * ```
  */
 int save_delta(StorageConfig *config, const char *filename, uint32_t version,
-	       const DeltaInfo *delta, const uint8_t *original_data, const char *message)
+	       const DeltaInfo *delta, const uint8_t *content_hash, const char *message)
 {
 	if (config == NULL || filename == NULL || delta == NULL) {
-		printf("Error: Invalid parameters for delta save\n");
+		storage_log("Error: Invalid parameters for delta save\n");
 		return -1;
 	}
 
 	if (version == 0) {
-		printf("Error: Version must be greater than 0\n");
+		storage_log("Error: Version must be greater than 0\n");
 		return -1;
 	}
 
 	if (delta->operation_count == 0) {
-		printf("Error: Delta has no operations\n");
+		storage_log("Error: Delta has no operations\n");
 		return -1;
 	}
 
-	char storage_filename[512];
-	char metadata_filename[512];
-	char full_storage_path[1024];
-	char full_metadata_path[1024];
+	// Versions stored before manifests existed must be recorded ahead of this one
+	if (manifest_prepare(config, filename) != EXIT_SUCCESS)
+		return -1;
 
-	// Generate filenames
-	generate_storage_filename(filename, version, storage_filename, sizeof(storage_filename));
-	generate_metadata_filename(filename, version, metadata_filename, sizeof(metadata_filename));
+	// Size the pack record: header, then the operations
+	uint64_t stored_size = 0;
+	for (uint32_t i = 0; i < delta->operation_count; i++) {
+		const DeltaOperation *op = &delta->operations[i];
+		stored_size += sizeof(DeltaOperationType) + 2 * sizeof(uint32_t);
+		if (op->data != NULL)
+			stored_size += op->length;
+	}
 
-	// Create full paths
-	snprintf(full_storage_path, sizeof(full_storage_path), "%s/%s",
-		 config->storage_dir, storage_filename);
-	snprintf(full_metadata_path, sizeof(full_metadata_path), "%s/%s",
-		 config->storage_dir, metadata_filename);
+	if (stored_size > UINT32_MAX) {
+		storage_log("Error: Delta of version %u is too large to store\n", version);
+		return -1;
+	}
 
-	// Save delta data
-	FILE *delta_file = fopen(full_storage_path, "wb");
-	if (delta_file == NULL) {
-		printf("Failed to open delta file for writing: %s\n", strerror(errno));
+	size_t record_size = sizeof(PackRecordHeader) + (size_t)stored_size;
+	uint8_t *record = malloc(record_size);
+	if (record == NULL) {
+		storage_log("Failed to allocate pack record: %s\n", strerror(errno));
 		return -1;
 	}
 
-	// Write delta operations
+	PackRecordHeader *header = (PackRecordHeader *)record;
+	header->magic = PACK_RECORD_MAGIC;
+	header->version = version;
+	header->delta_size = (uint32_t)stored_size;
+
+	// Serialize delta operations; everything else about the version goes in its manifest record
+	uint8_t *delta_bytes = record + sizeof(PackRecordHeader);
+	uint8_t *out = delta_bytes;
 	for (uint32_t i = 0; i < delta->operation_count; i++) {
 		const DeltaOperation *op = &delta->operations[i];
 
-		// Write operation header
-		fwrite(&op->type, sizeof(DeltaOperationType), 1, delta_file);
-		fwrite(&op->offset, sizeof(uint32_t), 1, delta_file);
-		fwrite(&op->length, sizeof(uint32_t), 1, delta_file);
+		// Operation header
+		memcpy(out, &op->type, sizeof(DeltaOperationType));
+		out += sizeof(DeltaOperationType);
+		memcpy(out, &op->offset, sizeof(uint32_t));
+		out += sizeof(uint32_t);
+		memcpy(out, &op->length, sizeof(uint32_t));
+		out += sizeof(uint32_t);
+
+		// Operation data if present
+		if (op->data != NULL) {
+			memcpy(out, op->data, op->length);
+			out += op->length;
+		}
+	}
 
-		// Write operation data if present
-		if (op->data != NULL)
-			fwrite(op->data, sizeof(uint8_t), op->length, delta_file);
-	}
-
-	fclose(delta_file);
-
-	// Create and save metadata
-	FileMetadata metadata;
-	memset(&metadata, 0, sizeof(FileMetadata)); // Initialize to avoid uninitialized bytes
-	strncpy(metadata.filename, filename, sizeof(metadata.filename) - 1);
-	metadata.filename[sizeof(metadata.filename) - 1] = '\0';
-	metadata.version = version;
-	metadata.original_size = delta->original_size;
-	metadata.delta_size = delta->delta_size;
-	metadata.operation_count = delta->operation_count;
-	metadata.timestamp = time(NULL);
-	if (message != NULL) {
-		strncpy(metadata.message, message, sizeof(metadata.message) - 1);
-		metadata.message[sizeof(metadata.message) - 1] = '\0';
+	uint64_t record_offset;
+	if (pack_append(config, filename, record, record_size, &record_offset) != EXIT_SUCCESS) {
+		free(record);
+		return -1;
+	}
+
+	// The manifest record is what makes the version visible
+	ManifestEntry entry;
+	memset(&entry, 0, sizeof(ManifestEntry));
+	entry.version = version;
+	entry.flags = MANIFEST_ENTRY_PACKED;
+	entry.offset = record_offset + sizeof(PackRecordHeader);
+	entry.size = (uint32_t)stored_size;
+	entry.file_size = delta->new_size;
+	entry.original_size = delta->original_size;
+	entry.timestamp = (int64_t)time(NULL);
+	entry.checksum = calculate_hash(delta_bytes, (uint32_t)stored_size);
+	entry.operation_count = delta->operation_count;
+	entry.delta_size = delta->delta_size;
+	if (content_hash != NULL)
+		memcpy(entry.content_hash, content_hash, CONTENT_HASH_SIZE);
+	free(record);
+
+	if (manifest_append(config, filename, &entry, message) != EXIT_SUCCESS)
+		return -1;
+
+	storage_log("Saved delta version %u for '%s' (%u operations, %u bytes)\n",
+	       version, filename, delta->operation_count, delta->delta_size);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Finds where the delta of a version is stored
+ *
+ * Looks the version up in the file's manifest. Packed versions live in the
+ * file's pack; versions stored before packs existed live in loose .delta
+ * files. The manifest record comes along, so callers need nothing else to
+ * apply the delta.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param version Version to locate. Must be > 0.
+ * @param location Output parameter for the location. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 if the version does not exist or on failure.
+ *
+ * @example
+ * ```c
+ * StoredDelta location;
+ * if (storage_locate(config, "file.txt", 2, &location) == EXIT_SUCCESS)
+ *     printf("%u bytes at %s:%llu\n", location.size, location.path,
+ *            (unsigned long long)location.offset);
+ * ```
+ */
+int storage_locate(StorageConfig *config, const char *filename, uint32_t version, StoredDelta *location)
+{
+	if (config == NULL || filename == NULL || location == NULL || version == 0) {
+		storage_log("Error: Invalid parameters for version lookup\n");
+		return -1;
+	}
+
+	ManifestEntry entry;
+	int found = manifest_find(config, filename, version, &entry);
+	if (found != 1) {
+		if (found == 0)
+			storage_log("Version %u of '%s' is not stored\n", version, filename);
+		return -1;
+	}
+
+	char name[512];
+	if (entry.flags & MANIFEST_ENTRY_PACKED) {
+		generate_pack_filename(filename, name, sizeof(name));
+		snprintf(location->path, sizeof(location->path), "%s/%s", config->storage_dir, name);
+		location->offset = entry.offset;
 	} else {
-		metadata.message[0] = '\0'; // Empty message
+		generate_storage_filename(filename, version, name, sizeof(name));
+		snprintf(location->path, sizeof(location->path), "%s/%s", config->storage_dir, name);
+		location->offset = 0;
 	}
+	location->size = entry.size;
+	location->packed = (entry.flags & MANIFEST_ENTRY_PACKED) != 0;
+	location->entry = entry;
 
-	// Calculate checksum of original data
-	if (original_data != NULL)
-		calculate_checksum(original_data, delta->original_size, metadata.checksum);
-	else
-		strcpy(metadata.checksum, "00000000");
+	return EXIT_SUCCESS;
+}
 
-	FILE *meta_file = fopen(full_metadata_path, "wb");
-	if (meta_file == NULL) {
-		printf("Failed to open metadata file for writing: %s\n", strerror(errno));
-		unlink(full_storage_path); // Clean up delta file
+/**
+ * @brief Reads the FileMetadata of a legacy version
+ *
+ * Only versions stored before manifests existed have one, in a loose .meta
+ * file next to their .delta file.
+ *
+ * @param path Loose .meta file. Must not be NULL.
+ * @param metadata Output parameter for the metadata. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ */
+int read_legacy_metadata(const char *path, FileMetadata *metadata)
+{
+	if (path == NULL || metadata == NULL) {
+		storage_log("Error: Invalid parameters for metadata load\n");
 		return -1;
 	}
 
-	fwrite(&metadata, sizeof(FileMetadata), 1, meta_file);
-	fclose(meta_file);
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		storage_log("Failed to open metadata file: %s\n", strerror(errno));
+		return -1;
+	}
 
-	printf("Saved delta version %u for '%s' (%u operations, %u bytes)\n",
-	       version, filename, delta->operation_count, delta->delta_size);
+	memset(metadata, 0, sizeof(FileMetadata)); // Initialize to avoid uninitialized bytes
+	ssize_t n = pread(fd, metadata, sizeof(FileMetadata), 0);
+	close(fd);
+	if (n != (ssize_t)sizeof(FileMetadata)) {
+		storage_log("Failed to read metadata\n");
+		return -1;
+	}
 
 	return EXIT_SUCCESS;
 }
 
 /**
- * @brief Loads a delta and its metadata from persistent storage
+ * @brief Loads a delta from persistent storage
  *
- * Reads delta operations and metadata from disk, reconstructing the
- * DeltaInfo structure. This function handles both binary delta data
- * and metadata files.
+ * Decodes the delta operations into a DeltaInfo that owns copies of their
+ * literal bytes, for callers that keep or inspect a delta. The sizes and
+ * operation count come from the version's manifest record. Restores do not
+ * go through here: they apply the mapped delta directly.
  *
  * @param config Storage configuration. Must not be NULL.
  * @param filename Original filename to load. Must not be NULL.
@@ -403,12 +861,11 @@ int save_delta(StorageConfig *config, const char *filename, uint32_t version,
  * @return Pointer to DeltaInfo structure on success, NULL on failure.
  *         The caller is responsible for freeing the delta with delta_free().
  *
- * @note The function loads both .delta and .meta files for the specified version.
+ * @note The function maps the version's record in the pack, or its .delta
+ *       file if it was stored before packs existed, with delta_index_map().
  *
  * @note Memory allocation failures are handled gracefully and return NULL.
  *
- * @note The function calculates the new_size from operations during loading.
- *
  * @example
  * ```c
  * DeltaInfo *delta = load_delta(config, "file.txt", 2);
@@ -421,157 +878,152 @@ int save_delta(StorageConfig *config, const char *filename, uint32_t version,
 DeltaInfo * load_delta(StorageConfig *config, const char *filename, uint32_t version)
 {
 	if (config == NULL || filename == NULL) {
-		printf("Error: Invalid parameters for delta load\n");
+		storage_log("Error: Invalid parameters for delta load\n");
 		return NULL;
 	}
 
 	if (version == 0) {
-		printf("Error: Version must be greater than 0\n");
+		storage_log("Error: Version must be greater than 0\n");
 		return NULL;
 	}
 
-	char storage_filename[512];
-	char metadata_filename[512];
-	char full_storage_path[1024];
-	char full_metadata_path[1024];
-
-	// Generate filenames
-	generate_storage_filename(filename, version, storage_filename, sizeof(storage_filename));
-	generate_metadata_filename(filename, version, metadata_filename, sizeof(metadata_filename));
-
-	// Create full paths
-	snprintf(full_storage_path, sizeof(full_storage_path), "%s/%s",
-		 config->storage_dir, storage_filename);
-	snprintf(full_metadata_path, sizeof(full_metadata_path), "%s/%s",
-		 config->storage_dir, metadata_filename);
-
-	// Load metadata first
-	FILE *meta_file = fopen(full_metadata_path, "rb");
-	if (meta_file == NULL) {
-		printf("Failed to open metadata file: %s\n", strerror(errno));
+	StoredDelta location;
+	if (storage_locate(config, filename, version, &location) != EXIT_SUCCESS)
 		return NULL;
-	}
 
-	FileMetadata metadata;
-	memset(&metadata, 0, sizeof(FileMetadata)); // Initialize to avoid uninitialized bytes
-	if (fread(&metadata, sizeof(FileMetadata), 1, meta_file) != 1) {
-		printf("Failed to read metadata\n");
-		fclose(meta_file);
+	DeltaIndex *index = delta_index_map(location.path, location.offset, location.size, version);
+	if (index == NULL)
 		return NULL;
-	}
-	fclose(meta_file);
 
-	// Create delta structure
 	DeltaInfo *delta = malloc(sizeof(DeltaInfo));
 	if (delta == NULL) {
-		printf("Failed to allocate delta structure\n");
+		storage_log("Failed to allocate delta structure\n");
+		delta_index_free(index);
 		return NULL;
 	}
 
-	delta->original_size = metadata.original_size;
-	delta->new_size = 0; // Will be calculated from operations
-	delta->operation_count = metadata.operation_count;
-	delta->delta_size = metadata.delta_size;
-
-	// Allocate operations array
-	delta->operations = malloc(metadata.operation_count * sizeof(DeltaOperation));
+	delta->original_size = location.entry.original_size;
+	delta->new_size = index->new_size;
+	delta->operation_count = index->entry_count;
+	delta->delta_size = location.entry.delta_size;
+	delta->operations = calloc(index->entry_count > 0 ? index->entry_count : 1, sizeof(DeltaOperation));
 	if (delta->operations == NULL) {
-		printf("Failed to allocate operations array\n");
-		free(delta);
-		return NULL;
-	}
-
-	// Load delta operations
-	FILE *delta_file = fopen(full_storage_path, "rb");
-	if (delta_file == NULL) {
-		printf("Failed to open delta file: %s\n", strerror(errno));
-		free(delta->operations);
+		storage_log("Failed to allocate operations array\n");
 		free(delta);
+		delta_index_free(index);
 		return NULL;
 	}
 
-	for (uint32_t i = 0; i < metadata.operation_count; i++) {
+	for (uint32_t i = 0; i < index->entry_count; i++) {
+		const DeltaIndexEntry *entry = &index->entries[i];
 		DeltaOperation *op = &delta->operations[i];
 
-		// Read operation header
-		if (fread(&op->type, sizeof(DeltaOperationType), 1, delta_file) != 1 ||
-		    fread(&op->offset, sizeof(uint32_t), 1, delta_file) != 1 ||
-		    fread(&op->length, sizeof(uint32_t), 1, delta_file) != 1) {
-			printf("Failed to read operation %u\n", i);
-			// Clean up partial operations
-			for (uint32_t j = 0; j < i; j++)
-				if (delta->operations[j].data != NULL)
-					free(delta->operations[j].data);
-			free(delta->operations);
-			free(delta);
-			fclose(delta_file);
+		op->type = entry->type;
+		op->offset = entry->offset;
+		op->length = entry->length;
+		op->data = NULL;
+		if (entry->data == NULL)
+			continue;
+
+		// The DeltaInfo outlives the mapping, so literal bytes are copied out
+		op->data = malloc(entry->length > 0 ? entry->length : 1);
+		if (op->data == NULL) {
+			storage_log("Failed to allocate data for operation %u\n", i);
+			delta_free(delta);
+			delta_index_free(index);
 			return NULL;
 		}
+		memcpy(op->data, entry->data, entry->length);
+	}
 
-		// Read operation data if present
-		if (op->type == DELTA_INSERT || op->type == DELTA_REPLACE) {
-			op->data = malloc(op->length);
-			if (op->data == NULL) {
-				printf("Failed to allocate data for operation %u\n", i);
-				// Clean up
-				for (uint32_t j = 0; j < i; j++)
-					if (delta->operations[j].data != NULL)
-						free(delta->operations[j].data);
-				free(delta->operations);
-				free(delta);
-				fclose(delta_file);
-				return NULL;
-			}
+	delta_index_free(index);
 
-			if (fread(op->data, sizeof(uint8_t), op->length, delta_file) != op->length) {
-				printf("Failed to read data for operation %u\n", i);
-				free(op->data);
-				// Clean up
-				for (uint32_t j = 0; j < i; j++)
-					if (delta->operations[j].data != NULL)
-						free(delta->operations[j].data);
-				free(delta->operations);
-				free(delta);
-				fclose(delta_file);
-				return NULL;
-			}
-		} else {
-			op->data = NULL; // No data for COPY operations
-		}
-	}
+	storage_log("Loaded delta version %u for '%s' (%u operations, %u bytes)\n",
+	       version, filename, delta->operation_count, delta->delta_size);
 
-	fclose(delta_file);
+	return delta;
+}
 
-	// Calculate the new_size from operations
-	uint32_t calculated_new_size = 0;
-	for (uint32_t i = 0; i < delta->operation_count; i++) {
-		DeltaOperation *op = &delta->operations[i];
-		switch (op->type) {
-		case DELTA_COPY:
-			calculated_new_size += op->length;
-			break;
-		case DELTA_INSERT:
-			calculated_new_size += op->length;
-			break;
-		case DELTA_REPLACE:
-			calculated_new_size += op->length;
-			break;
-		}
+/**
+ * @brief Lists the versions of a file in ascending order
+ *
+ * Reads the file's manifest once.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param count Output parameter for the number of versions. Must not be NULL.
+ *              Set to 0 when the file has no versions, and to UINT32_MAX on failure.
+ *
+ * @return Array of count version numbers on success, NULL if there are none
+ *         or on failure. The caller is responsible for freeing the array.
+ *
+ * @example
+ * ```c
+ * uint32_t count;
+ * uint32_t *versions = storage_list_versions(config, "file.txt", &count);
+ * for (uint32_t i = 0; i < count; i++)
+ *     printf("v%u\n", versions[i]);
+ * free(versions);
+ * ```
+ */
+uint32_t * storage_list_versions(StorageConfig *config, const char *filename, uint32_t *count)
+{
+	if (config == NULL || filename == NULL || count == NULL) {
+		storage_log("Error: Invalid parameters for version listing\n");
+		if (count != NULL)
+			*count = UINT32_MAX;
+		return NULL;
 	}
-	delta->new_size = calculated_new_size;
 
-	printf("Loaded delta version %u for '%s' (%u operations, %u bytes)\n",
-	       version, filename, delta->operation_count, delta->delta_size);
+	ManifestEntry *entries = NULL;
+	int entry_count = manifest_read(config, filename, &entries);
+	if (entry_count <= 0) {
+		*count = entry_count == 0 ? 0 : UINT32_MAX;
+		return NULL;
+	}
 
-	return delta;
+	uint32_t *versions = malloc((size_t)entry_count * sizeof(uint32_t));
+	if (versions == NULL) {
+		free(entries);
+		*count = UINT32_MAX;
+		return NULL;
+	}
+
+	// Records are kept sorted by version
+	for (int i = 0; i < entry_count; i++)
+		versions[i] = entries[i].version;
+	free(entries);
+
+	*count = (uint32_t)entry_count;
+	return versions;
+}
+
+/**
+ * @brief Returns the latest version of a file
+ *
+ * Reads only the last record of the file's manifest.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ *
+ * @return Latest version number, 0 if the file is not tracked, -1 on failure.
+ */
+int storage_latest_version(StorageConfig *config, const char *filename)
+{
+	ManifestEntry entry;
+	int found = manifest_latest(config, filename, &entry);
+
+	if (found <= 0)
+		return found;
+	return (int)entry.version;
 }
 
 /**
  * @brief Retrieves a list of available versions for a specific file
  *
- * Scans the storage directory for metadata files belonging to the specified
- * filename and returns a list of available version numbers. This function
- * provides version discovery capabilities for the storage system.
+ * Returns the versions recorded in the file's manifest, in ascending
+ * order. Storage directories written before manifests existed are imported
+ * on first use.
  *
  * @param config Storage configuration. Must not be NULL.
  * @param filename Original filename to scan for. Must not be NULL.
@@ -580,10 +1032,8 @@ DeltaInfo * load_delta(StorageConfig *config, const char *filename, uint32_t ver
  *
  * @return Number of versions found on success, -1 on failure.
  *
- * @note This is a simplified implementation that checks versions 1-100.
- *       A production system would use glob() or readdir() for efficiency.
- *
- * @note The function only checks for the existence of metadata files.
+ * @note Only the first max_versions versions are returned. Use
+ *       storage_list_versions() to get all of them.
  *
  * @example
  * ```c
@@ -598,43 +1048,98 @@ int get_file_versions(StorageConfig *config, const char *filename,
 		      uint32_t *versions, uint32_t max_versions)
 {
 	if (config == NULL || filename == NULL || versions == NULL) {
-		printf("Error: Invalid parameters for version listing\n");
+		storage_log("Error: Invalid parameters for version listing\n");
 		return -1;
 	}
 
 	if (max_versions == 0) {
-		printf("Error: max_versions must be greater than 0\n");
+		storage_log("Error: max_versions must be greater than 0\n");
+		return -1;
+	}
+
+	uint32_t count = 0;
+	uint32_t *all = storage_list_versions(config, filename, &count);
+	if (count == UINT32_MAX)
+		return -1;
+
+	if (count > max_versions)
+		count = max_versions;
+	if (count > 0)
+		memcpy(versions, all, count * sizeof(uint32_t));
+	free(all);
+
+	return (int)count;
+}
+
+// Deletes a version; the caller holds the file's writer lock
+static int delete_locked(StorageConfig *config, const char *filename, uint32_t version)
+{
+	if (manifest_prepare(config, filename) != EXIT_SUCCESS || manifest_drop_uncommitted(config, filename) < 0)
+		return -1;
+
+	ManifestEntry *entries = NULL;
+	int count = manifest_read(config, filename, &entries);
+	if (count < 0)
+		return -1;
+
+	int index = -1;
+	for (int i = 0; i < count; i++) {
+		if (entries[i].version == version) {
+			index = i;
+			break;
+		}
+	}
+
+	if (index < 0) {
+		storage_log("Version %u of '%s' is not stored\n", version, filename);
+		free(entries);
 		return -1;
 	}
 
-	uint32_t version_count = 0;
+	ManifestEntry removed = entries[index];
+	memmove(&entries[index], &entries[index + 1], (size_t)(count - index - 1) * sizeof(ManifestEntry));
+
+	// Dropping the manifest record deletes the version; its pack bytes become unreferenced
+	int result = manifest_rewrite(config, filename, entries, (uint32_t)count - 1);
+	uint32_t latest_version = count > 1 ? entries[count - 2].version : 0;
+	free(entries);
+	if (result != EXIT_SUCCESS)
+		return -1;
 
-	// Scan storage directory for metadata files
-	char pattern[1024];
-	snprintf(pattern, sizeof(pattern), "%s/%s_v*.meta", config->storage_dir, filename);
+	if (catalog_remove_version(config, filename, latest_version, removed.delta_size) != EXIT_SUCCESS)
+		storage_log("Warning: Failed to update the catalog for '%s'\n", filename);
 
-	// This is a simplified implementation - in a real system, you'd use glob() or readdir()
-	// For now, we'll check for versions 1-100
-	for (uint32_t v = 1; v <= 100 && version_count < max_versions; v++) {
-		char metadata_filename[512];
-		char full_metadata_path[1024];
+	if (!(removed.flags & MANIFEST_ENTRY_PACKED)) {
+		char name[512];
+		char path[1024];
 
-		generate_metadata_filename(filename, v, metadata_filename, sizeof(metadata_filename));
-		snprintf(full_metadata_path, sizeof(full_metadata_path), "%s/%s",
-			 config->storage_dir, metadata_filename);
+		generate_storage_filename(filename, version, name, sizeof(name));
+		snprintf(path, sizeof(path), "%s/%s", config->storage_dir, name);
+		if (unlink(path) == -1) {
+			storage_log("Failed to delete delta file: %s\n", strerror(errno));
+			result = -1;
+		}
 
-		if (access(full_metadata_path, F_OK) == 0)
-			versions[version_count++] = v;
+		generate_metadata_filename(filename, version, name, sizeof(name));
+		snprintf(path, sizeof(path), "%s/%s", config->storage_dir, name);
+		if (unlink(path) == -1) {
+			storage_log("Failed to delete metadata file: %s\n", strerror(errno));
+			result = -1;
+		}
 	}
 
-	return version_count;
+	if (result == 0)
+		storage_log("Deleted version %u for '%s'\n", version, filename);
+
+	return result;
 }
 
 /**
  * @brief Deletes a specific version of a file from storage
  *
- * Removes both the delta file and metadata file for the specified version.
- * This function provides version cleanup capabilities for the storage system.
+ * Removes the version's record from the file's manifest. Loose .delta and
+ * .meta files of the version are removed as well; a packed version's bytes
+ * stay in the pack unreferenced.
  *
  * @param config Storage configuration. Must not be NULL.
  * @param filename Original filename to delete. Must not be NULL.
@@ -642,7 +1147,8 @@ int get_file_versions(StorageConfig *config, const char *filename,
  *
  * @return EXIT_SUCCESS on success, -1 on failure.
  *
- * @note The function attempts to delete both .delta and .meta files.
+ * @note The manifest is rewritten atomically, so readers never see a
+ *       half-deleted version. The file's writer lock is held meanwhile.
  *
  * @note Partial failures are reported but don't prevent the function from
  *       attempting to delete both files.
@@ -658,43 +1164,21 @@ int get_file_versions(StorageConfig *config, const char *filename,
 int delete_version(StorageConfig *config, const char *filename, uint32_t version)
 {
 	if (config == NULL || filename == NULL) {
-		printf("Error: Invalid parameters for version deletion\n");
+		storage_log("Error: Invalid parameters for version deletion\n");
 		return -1;
 	}
 
 	if (version == 0) {
-		printf("Error: Version must be greater than 0\n");
+		storage_log("Error: Version must be greater than 0\n");
 		return -1;
 	}
 
-	char storage_filename[512];
-	char metadata_filename[512];
-	char full_storage_path[1024];
-	char full_metadata_path[1024];
-
-	generate_storage_filename(filename, version, storage_filename, sizeof(storage_filename));
-	generate_metadata_filename(filename, version, metadata_filename, sizeof(metadata_filename));
-
-	snprintf(full_storage_path, sizeof(full_storage_path), "%s/%s",
-		 config->storage_dir, storage_filename);
-	snprintf(full_metadata_path, sizeof(full_metadata_path), "%s/%s",
-		 config->storage_dir, metadata_filename);
-
-	// Delete both files
-	int result = 0;
-	if (unlink(full_storage_path) == -1) {
-		printf("Failed to delete delta file: %s\n", strerror(errno));
-		result = -1;
-	}
-
-	if (unlink(full_metadata_path) == -1) {
-		printf("Failed to delete metadata file: %s\n", strerror(errno));
-		result = -1;
-	}
-
-	if (result == 0)
-		printf("Deleted version %u for '%s'\n", version, filename);
+	int lock = storage_lock_file(config, filename);
+	if (lock == -1)
+		return -1;
 
+	int result = delete_locked(config, filename, version);
+	storage_unlock(lock);
 	return result;
 }
 
@@ -731,12 +1215,12 @@ int apply_delta(const DeltaInfo *delta, const uint8_t *original_data,
 		uint8_t *output_buffer, uint32_t output_buffer_size)
 {
 	if (delta == NULL || output_buffer == NULL) {
-		printf("Error: Invalid parameters for delta application\n");
+		storage_log("Error: Invalid parameters for delta application\n");
 		return -1;
 	}
 
 	if (output_buffer_size < delta->new_size) {
-		printf("Error: Output buffer too small (%u < %u)\n", output_buffer_size, delta->new_size);
+		storage_log("Error: Output buffer too small (%u < %u)\n", output_buffer_size, delta->new_size);
 		return -1;
 	}
 
@@ -751,13 +1235,13 @@ int apply_delta(const DeltaInfo *delta, const uint8_t *original_data,
 		case DELTA_COPY:
 			// Check buffer bounds
 			if (output_pos + op->length > output_buffer_size) {
-				printf("Output buffer too small for COPY operation\n");
+				storage_log("Output buffer too small for COPY operation\n");
 				return -1;
 			}
 
 			// For first version, there should be no COPY operations
 			if (original_data == NULL) {
-				printf("COPY operation not allowed when original_data is NULL\n");
+				storage_log("COPY operation not allowed when original_data is NULL\n");
 				return -1;
 			}
 
@@ -770,7 +1254,7 @@ int apply_delta(const DeltaInfo *delta, const uint8_t *original_data,
 		case DELTA_INSERT:
 			// Check buffer bounds
 			if (output_pos + op->length > output_buffer_size) {
-				printf("Output buffer too small for INSERT operation\n");
+				storage_log("Output buffer too small for INSERT operation\n");
 				return -1;
 			}
 
@@ -782,7 +1266,7 @@ int apply_delta(const DeltaInfo *delta, const uint8_t *original_data,
 		case DELTA_REPLACE:
 			// Check buffer bounds
 			if (output_pos + op->length > output_buffer_size) {
-				printf("Output buffer too small for REPLACE operation\n");
+				storage_log("Output buffer too small for REPLACE operation\n");
 				return -1;
 			}
 
@@ -828,26 +1312,26 @@ uint8_t * apply_delta_alloc(const uint8_t *original_data, uint32_t original_size
 {
 	(void)original_size; // Parameter not used in this implementation
 	if (delta == NULL) {
-		printf("Error: Delta is NULL\n");
+		storage_log("Error: Delta is NULL\n");
 		return NULL;
 	}
 
 	if (delta->new_size == 0) {
-		printf("Error: Delta has zero new size\n");
+		storage_log("Error: Delta has zero new size\n");
 		return NULL;
 	}
 
 	// Allocate output buffer
 	uint8_t *output_buffer = malloc(delta->new_size);
 	if (output_buffer == NULL) {
-		printf("Failed to allocate output buffer\n");
+		storage_log("Failed to allocate output buffer\n");
 		return NULL;
 	}
 
 	// Apply delta
 	int result = apply_delta(delta, original_data, output_buffer, delta->new_size);
 	if (result < 0) {
-		printf("Failed to apply delta\n");
+		storage_log("Failed to apply delta\n");
 		free(output_buffer);
 		return NULL;
 	}
@@ -855,224 +1339,1783 @@ uint8_t * apply_delta_alloc(const uint8_t *original_data, uint32_t original_size
 	return output_buffer;
 }
 
+// Outputs smaller than this are applied on the calling thread
+#define PARALLEL_APPLY_MIN_BYTES (4u * 1024 * 1024)
+
+// Byte range of the output produced by one parallel apply task
+typedef struct {
+	const DeltaIndexEntry * entries;        // Operations with their output offsets
+	uint32_t		entry_count;
+	const uint8_t *		original_data;
+	uint8_t *		output_buffer;
+	uint32_t		start;          // First output byte of the slice
+	uint32_t		end;            // One past the last output byte of the slice
+} ApplySlice;
+
+// Copies the output bytes [slice->start, slice->end); bounds were validated up front
+static void apply_slice(void *arg)
+{
+	const ApplySlice *slice = arg;
+
+	// Binary search for the operation producing slice->start
+	uint32_t low = 0;
+	uint32_t high = slice->entry_count;
+	while (high - low > 1) {
+		uint32_t mid = low + (high - low) / 2;
+		if (slice->entries[mid].output_offset <= slice->start)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	uint32_t pos = slice->start;
+	for (uint32_t i = low; i < slice->entry_count && pos < slice->end; i++) {
+		const DeltaIndexEntry *op = &slice->entries[i];
+		if (op->length == 0 || op->output_offset + op->length <= pos)
+			continue;
+
+		uint32_t skip = pos - op->output_offset;
+		uint32_t count = op->length - skip;
+		if (count > slice->end - pos)
+			count = slice->end - pos;
+
+		const uint8_t *source = op->type == DELTA_COPY ?
+					slice->original_data + op->offset : op->data;
+		memcpy(slice->output_buffer + pos, source + skip, count);
+		pos += count;
+	}
+}
+
+// Copies total output bytes of validated operations, split over the pool when the output is large
+static int apply_entries(const DeltaIndexEntry *entries, uint32_t entry_count, uint64_t total,
+			 const uint8_t *original_data, uint8_t *output_buffer, ThreadPool *pool)
+{
+	uint32_t slice_count = 1;
+	if (pool != NULL && total >= PARALLEL_APPLY_MIN_BYTES) {
+		// A few slices per worker evens out uneven memory bandwidth
+		slice_count = thread_pool_size(pool) * 4;
+		if (slice_count == 0)
+			slice_count = 1;
+	}
+
+	ApplySlice *slices = malloc(slice_count * sizeof(ApplySlice));
+	if (slices == NULL) {
+		storage_log("Failed to allocate apply slices\n");
+		return -1;
+	}
+
+	uint32_t slice_size = (uint32_t)((total + slice_count - 1) / slice_count);
+	uint32_t used = 0;
+	for (uint32_t start = 0; used < slice_count && start < total; used++) {
+		uint32_t end = (uint64_t)start + slice_size < total ? start + slice_size : (uint32_t)total;
+		slices[used].entries = entries;
+		slices[used].entry_count = entry_count;
+		slices[used].original_data = original_data;
+		slices[used].output_buffer = output_buffer;
+		slices[used].start = start;
+		slices[used].end = end;
+		start = end;
+	}
+
+	if (used == 1)
+		apply_slice(&slices[0]);
+	else if (used > 1)
+		thread_pool_run(pool, apply_slice, slices, used, sizeof(ApplySlice));
+
+	free(slices);
+	return EXIT_SUCCESS;
+}
+
 /**
- * @brief Reconstructs a file from its complete delta chain
- *
- * Reconstructs a specific version by loading and applying all deltas from
- * version 1 up to the target version. This function handles the complete
- * reconstruction process for any version in the chain.
- *
- * @param config Storage configuration. Must not be NULL.
- * @param filename Original filename to reconstruct. Must not be NULL.
- * @param target_version Target version to reconstruct. Must be > 0.
- * @param final_size Output parameter for the final file size. Must not be NULL.
+ * @brief Applies delta operations using a thread pool for large outputs
  *
- * @return Pointer to allocated buffer containing reconstructed file on success,
- *         NULL on failure. The caller is responsible for freeing the buffer.
+ * Computes the output offset of every operation, validates all operation
+ * bounds once up front, then splits the output into byte ranges of equal
+ * size and copies them concurrently. Ranges are cut by bytes rather than by
+ * operations, so a single huge COPY is spread over all workers.
  *
- * @note The function loads version 1 as the base and applies subsequent deltas.
+ * @param delta Delta information containing operations. Must not be NULL.
+ * @param original_data Original file data for COPY operations. Can be NULL for first version.
+ * @param original_size Size of the original data, used to validate COPY operations.
+ * @param output_buffer Buffer to write reconstructed data. Must not be NULL.
+ * @param output_buffer_size Size of the output buffer. Must be >= the reconstructed size.
+ * @param pool Thread pool to run the copies on. If NULL, or if the output is
+ *             small, the copies run on the calling thread.
  *
- * @note Memory allocation failures are handled gracefully and return NULL.
+ * @return Number of bytes written on success, -1 on failure. The count is
+ *         64-bit so outputs of 2 GiB and more are not mistaken for errors.
  *
- * @note The function frees intermediate data to prevent memory leaks.
+ * @note No byte is written unless every operation passes validation.
  *
  * @example
  * ```c
- * uint32_t size;
- * uint8_t *file = reconstruct_file_from_deltas(config, "file.txt", 5, &size);
- * if (file != NULL) {
- *     // Use reconstructed file...
- *     free(file);
- * }
+ * ThreadPool *pool = thread_pool_new(0);
+ * int64_t size = apply_delta_parallel(delta, orig, orig_size, out, out_size, pool);
+ * thread_pool_free(pool);
  * ```
  */
-uint8_t * reconstruct_file_from_deltas(StorageConfig *config, const char *filename,
-				       uint32_t target_version, uint32_t *final_size)
+int64_t apply_delta_parallel(const DeltaInfo *delta, const uint8_t *original_data, uint32_t original_size,
+			     uint8_t *output_buffer, uint32_t output_buffer_size, ThreadPool *pool)
 {
-	if (config == NULL || filename == NULL || final_size == NULL) {
-		printf("Error: Invalid parameters for file reconstruction\n");
-		return NULL;
+	if (delta == NULL || output_buffer == NULL || (delta->operation_count > 0 && delta->operations == NULL)) {
+		storage_log("Error: Invalid parameters for delta application\n");
+		return -1;
 	}
 
-	if (target_version == 0) {
-		printf("Error: Target version must be greater than 0\n");
-		return NULL;
+	if (delta->operation_count == 0)
+		return 0;
+
+	DeltaIndexEntry *entries = malloc(delta->operation_count * sizeof(DeltaIndexEntry));
+	if (entries == NULL) {
+		storage_log("Failed to allocate operation offsets\n");
+		return -1;
 	}
 
-	// Start with version 1 (which is a full file)
-	uint8_t *current_data = NULL;
-	uint32_t current_size = 0;
+	// Validate every operation and compute prefix sums in one pass
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < delta->operation_count; i++) {
+		const DeltaOperation *op = &delta->operations[i];
 
-	// Load version 1 delta (which contains the full file)
-	DeltaInfo *delta = load_delta(config, filename, 1);
-	if (delta == NULL) {
-		printf("Failed to load version 1 delta\n");
-		return NULL;
+		switch (op->type) {
+		case DELTA_COPY:
+			if (original_data == NULL) {
+				storage_log("COPY operation not allowed when original_data is NULL\n");
+				free(entries);
+				return -1;
+			}
+			if ((uint64_t)op->offset + op->length > original_size) {
+				storage_log("COPY operation %u reads past the original (%u + %u > %u)\n",
+				       i, op->offset, op->length, original_size);
+				free(entries);
+				return -1;
+			}
+			break;
+		case DELTA_INSERT:
+		case DELTA_REPLACE:
+			if (op->data == NULL && op->length > 0) {
+				storage_log("Operation %u has no data\n", i);
+				free(entries);
+				return -1;
+			}
+			break;
+		default:
+			storage_log("Unknown operation type %d\n", (int)op->type);
+			free(entries);
+			return -1;
+		}
+
+		entries[i].type = op->type;
+		entries[i].offset = op->offset;
+		entries[i].length = op->length;
+		entries[i].output_offset = (uint32_t)total;
+		entries[i].data = op->data;
+		total += op->length;
+		if (total > output_buffer_size) {
+			storage_log("Error: Output buffer too small (%u bytes)\n", output_buffer_size);
+			free(entries);
+			return -1;
+		}
 	}
 
-	// Apply version 1 delta to get the initial file
-	current_data = apply_delta_alloc(NULL, 0, delta);
-	current_size = delta->new_size;
-	delta_free(delta);
+	int result = apply_entries(entries, delta->operation_count, total, original_data, output_buffer, pool);
+	free(entries);
+	return result == EXIT_SUCCESS ? (int64_t)total : -1;
+}
 
-	if (current_data == NULL) {
-		printf("Failed to apply version 1 delta\n");
-		return NULL;
+/**
+ * @brief Applies a memory-mapped delta using a thread pool for large outputs
+ *
+ * Same as apply_delta_parallel() for a delta indexed with delta_index_map().
+ * The index already holds every operation's output offset and points into
+ * the mapping for literal bytes, so nothing is allocated or decoded: only
+ * COPY bounds are checked before the copies start.
+ *
+ * @param delta Index of the delta to apply. Must not be NULL.
+ * @param original_data Version the delta applies to. Can be NULL for version 1.
+ * @param original_size Size of the original data, used to validate COPY operations.
+ * @param output_buffer Buffer to write reconstructed data. Must not be NULL.
+ * @param output_buffer_size Size of the output buffer. Must be >= delta->new_size.
+ * @param pool Thread pool to run the copies on. Can be NULL.
+ *
+ * @return Number of bytes written on success, -1 on failure.
+ */
+int64_t apply_index_parallel(const DeltaIndex *delta, const uint8_t *original_data, uint32_t original_size,
+			     uint8_t *output_buffer, uint32_t output_buffer_size, ThreadPool *pool)
+{
+	if (delta == NULL || output_buffer == NULL) {
+		storage_log("Error: Invalid parameters for delta application\n");
+		return -1;
 	}
 
-	// If we only need version 1, return it
-	if (target_version == 1) {
-		*final_size = current_size;
-		return current_data;
+	if (delta->new_size > output_buffer_size) {
+		storage_log("Error: Output buffer too small (%u < %u)\n", output_buffer_size, delta->new_size);
+		return -1;
 	}
 
-	// Apply subsequent deltas to reach the target version
-	for (uint32_t version = 2; version <= target_version; version++) {
-		delta = load_delta(config, filename, version);
-		if (delta == NULL) {
-			printf("Failed to load version %u delta\n", version);
-			free(current_data);
-			return NULL;
+	for (uint32_t i = 0; i < delta->entry_count; i++) {
+		const DeltaIndexEntry *entry = &delta->entries[i];
+		if (entry->type != DELTA_COPY)
+			continue;
+		if (original_data == NULL || (uint64_t)entry->offset + entry->length > original_size) {
+			storage_log("COPY operation %u of version %u reads past the %u-byte previous version\n",
+			       i, delta->version, original_size);
+			return -1;
 		}
+	}
 
-		// Apply the delta to get the next version
-		uint8_t *new_data = apply_delta_alloc(current_data, current_size, delta);
-		if (new_data == NULL) {
-			printf("Failed to apply version %u delta\n", version);
-			delta_free(delta);
-			free(current_data);
-			return NULL;
+	if (apply_entries(delta->entries, delta->entry_count, delta->new_size, original_data, output_buffer,
+			  pool) != EXIT_SUCCESS)
+		return -1;
+	return (int64_t)delta->new_size;
+}
+
+// Copies the len bytes at data (file offset in_offset of in_fd) to out_fd in the kernel, falling back to pwrite()
+static int copy_stored_range(int in_fd, const uint8_t *data, off_t in_offset, int out_fd,
+			     off_t out_offset, size_t len, int *kernel_copy)
+{
+	while (len > 0 && *kernel_copy) {
+		ssize_t copied = copy_file_range(in_fd, &in_offset, out_fd, &out_offset, len, 0);
+		if (copied > 0) {
+			data += copied;
+			len -= (size_t)copied;
+			continue;
+		}
+		if (copied == 0 || errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP ||
+		    errno == EINVAL || errno == EBADF) {
+			// Unsupported by this kernel or filesystem pair; stop trying for this restore
+			*kernel_copy = 0;
+			break;
 		}
+		if (errno != EINTR) {
+			storage_log("Failed to copy stored data: %s\n", strerror(errno));
+			return -1;
+		}
+	}
 
-		// Update current data and size
-		free(current_data);
-		current_data = new_data;
-		current_size = delta->new_size;
-		delta_free(delta);
+	while (len > 0) {
+		ssize_t written = pwrite(out_fd, data, len, out_offset);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			storage_log("Failed to write restored data: %s\n", strerror(errno));
+			return -1;
+		}
+		data += written;
+		out_offset += written;
+		len -= (size_t)written;
 	}
 
-	*final_size = current_size;
-	return current_data;
+	return EXIT_SUCCESS;
 }
 
 /**
- * @brief Tracks a new version of a file in the storage system
- *
- * Creates and stores a new version of a file by generating a delta from
- * the previous version and saving it to persistent storage. This is the
- * main entry point for file versioning operations.
- *
- * @param config Storage configuration. Must not be NULL.
- * @param filename Original filename to track. Must not be NULL.
- * @param file_data New file data to store. Must not be NULL.
- * @param file_size Size of the new file data. Must be > 0.
- * @param message Optional commit message. Can be NULL.
+ * @brief Applies a stored delta to a file descriptor, copying data kernel-side
  *
- * @return New version number on success, -1 on failure.
+ * Writes the version produced by delta into output_fd without staging it in
+ * user-space buffers. Literal bytes come from the delta file itself and COPY
+ * operations come from the stored base snapshot. Both are moved with
+ * copy_file_range(), which shares extents (reflinks) on filesystems that
+ * support it, such as XFS and btrfs.
  *
- * @note For the first version, creates a delta containing the entire file.
+ * @param delta Index of the delta to apply. Must not be NULL.
+ * @param delta_fd Open descriptor of the delta file behind delta.
+ * @param base Index of the base snapshot. May be NULL if delta has no COPY operations.
+ * @param base_fd Open descriptor of the delta file behind base, -1 if base is NULL.
+ * @param output_fd Destination descriptor, already sized to delta->new_size.
  *
- * @note The function automatically determines the next version number.
+ * @return Number of bytes written on success, -1 on failure.
  *
- * @note Memory allocation failures are handled gracefully and return -1.
+ * @note The base must be a snapshot: a delta without COPY operations, like
+ *       version 1. Its literal bytes are then the base file, byte for byte.
  *
- * @example
- * ```c
- * int version = track_file_version(config, "file.txt", data, size, "Updated file");
- * if (version > 0) {
- *     printf("Tracked as version %d\n", version);
- * }
- * ```
+ * @note If the kernel or filesystem cannot copy between the descriptors (for
+ *       example across filesystems), the bytes are written from the memory
+ *       mappings with pwrite() instead.
  */
-int track_file_version(StorageConfig *config, const char *filename,
-		       const uint8_t *file_data, uint32_t file_size, const char *message)
+int64_t apply_delta_to_fd(const DeltaIndex *delta, int delta_fd, const DeltaIndex *base, int base_fd,
+		      int output_fd)
 {
-	if (config == NULL || filename == NULL || file_data == NULL) {
-		printf("Error: Invalid parameters for file tracking\n");
+	if (delta == NULL || delta_fd < 0 || output_fd < 0 || (base != NULL && base_fd < 0)) {
+		storage_log("Error: Invalid parameters for delta application\n");
 		return -1;
 	}
 
-	if (file_size == 0) {
-		printf("Error: File size must be greater than 0\n");
-		return -1;
+	if (base != NULL) {
+		for (uint32_t i = 0; i < base->entry_count; i++) {
+			if (base->entries[i].type == DELTA_COPY) {
+				storage_log("Version %u is not a snapshot\n", base->version);
+				return -1;
+			}
+		}
 	}
 
-	// Get current version number
-	uint32_t versions[100];
-	int version_count = get_file_versions(config, filename, versions, 100);
-
-	uint32_t new_version = 1;
-	if (version_count > 0) {
-		// Find the highest version number
-		uint32_t max_version = versions[0];
-		for (int i = 1; i < version_count; i++)
-			if (versions[i] > max_version)
-				max_version = versions[i];
-		new_version = max_version + 1;
-	}
+	int kernel_copy = 1;
 
-	// Load the previous version if it exists
-	uint8_t *original_data = NULL;
-	uint32_t original_size = 0;
+	for (uint32_t i = 0; i < delta->entry_count; i++) {
+		const DeltaIndexEntry *entry = &delta->entries[i];
 
-	if (version_count > 0) {
-		// Reconstruct the previous version from the delta chain
-		original_data = reconstruct_file_from_deltas(config, filename, new_version - 1,
-							     &original_size);
-		if (original_data == NULL) {
-			printf("Failed to reconstruct previous version %u\n", new_version - 1);
-			return -1;
+		if (entry->type != DELTA_COPY) {
+			if (copy_stored_range(delta_fd, entry->data,
+					      (off_t)(delta->map_offset + (uint64_t)(entry->data - delta->map)), output_fd,
+					      entry->output_offset, entry->length, &kernel_copy) < 0)
+				return -1;
+			continue;
 		}
-	}
 
-	// Create delta from previous version (or empty if first version)
-	DeltaInfo *delta;
-	if (original_data != NULL) {
-		delta = delta_create(original_data, original_size, file_data, file_size);
-	} else {
-		// First version - create a delta that represents the entire file
-		delta = malloc(sizeof(DeltaInfo));
-		if (delta == NULL)
+		if (base == NULL || (uint64_t)entry->offset + entry->length > base->new_size) {
+			storage_log("COPY operation %u reads past the base version\n", i);
 			return -1;
+		}
 
-		delta->original_size = 0;
-		delta->new_size = file_size;
-		delta->operation_count = 1;
-		delta->delta_size = file_size;
+		// A COPY run may span several literal runs of the snapshot
+		uint32_t done = 0;
+		int j = delta_index_find(base, entry->offset);
+		while (done < entry->length && j >= 0 && (uint32_t)j < base->entry_count) {
+			const DeltaIndexEntry *source = &base->entries[j];
+			uint32_t skip = entry->offset + done - source->output_offset;
+			uint32_t count = source->length - skip;
+			if (count > entry->length - done)
+				count = entry->length - done;
+
+			if (copy_stored_range(base_fd, source->data + skip,
+					      (off_t)(base->map_offset + (uint64_t)(source->data - base->map) + skip), output_fd,
+					      (off_t)entry->output_offset + done, count, &kernel_copy) < 0)
+				return -1;
 
-		delta->operations = malloc(sizeof(DeltaOperation));
-		if (delta->operations == NULL) {
-			free(delta);
-			return -1;
+			done += count;
+			j++;
 		}
 
-		DeltaOperation *op = &delta->operations[0];
-		op->type = DELTA_INSERT;
-		op->offset = 0;
-		op->length = file_size;
-		op->data = malloc(file_size);
-
-		if (op->data == NULL) {
-			free(delta->operations);
-			free(delta);
+		if (done != entry->length) {
+			storage_log("COPY operation %u could not be resolved\n", i);
 			return -1;
 		}
-
-		memcpy(op->data, file_data, file_size);
 	}
 
-	if (delta == NULL) {
-		printf("Failed to create delta\n");
+	return (int64_t)delta->new_size;
+}
+
+// Output of a streamed apply, gathered into chunks of OUTPUT_SINK_CHUNK bytes
+typedef struct {
+	OutputSink	sink;
+	void *		context;
+	uint8_t *	buffer;                 // OUTPUT_SINK_CHUNK bytes
+	uint32_t	used;                   // Bytes waiting in buffer
+	uint32_t	produced;               // Bytes handed to the sink so far
+} SinkWriter;
+
+// Hands the buffered bytes to the sink
+static int sink_flush(SinkWriter *writer)
+{
+	if (writer->used == 0)
+		return EXIT_SUCCESS;
+	if (writer->sink(writer->buffer, writer->used, writer->context) != EXIT_SUCCESS)
 		return -1;
+	writer->produced += writer->used;
+	writer->used = 0;
+	return EXIT_SUCCESS;
+}
+
+// Writes bytes already in memory, passing whole chunks to the sink without copying them
+static int sink_put(SinkWriter *writer, const uint8_t *data, uint32_t length)
+{
+	while (length > 0) {
+		if (writer->used == 0 && length >= OUTPUT_SINK_CHUNK) {
+			if (writer->sink(data, OUTPUT_SINK_CHUNK, writer->context) != EXIT_SUCCESS)
+				return -1;
+			writer->produced += OUTPUT_SINK_CHUNK;
+			data += OUTPUT_SINK_CHUNK;
+			length -= OUTPUT_SINK_CHUNK;
+			continue;
+		}
+
+		uint32_t count = OUTPUT_SINK_CHUNK - writer->used;
+		if (count > length)
+			count = length;
+		memcpy(writer->buffer + writer->used, data, count);
+		writer->used += count;
+		data += count;
+		length -= count;
+		if (writer->used == OUTPUT_SINK_CHUNK && sink_flush(writer) != EXIT_SUCCESS)
+			return -1;
 	}
 
-	// Save the delta
-	int result = save_delta(config, filename, new_version, delta, original_data, message);
+	return EXIT_SUCCESS;
+}
 
-	// Cleanup
-	delta_free(delta);
-	if (original_data != NULL)
-		free(original_data);
+// Writes one operation, reading COPY bytes from the base straight into the chunk buffer
+static int sink_operation(SinkWriter *writer, const DeltaSource *base, DeltaOperationType type, uint32_t offset,
+			  uint32_t length, const uint8_t *data)
+{
+	if (type != DELTA_COPY)
+		return sink_put(writer, data, length);
 
+	if (base == NULL) {
+		storage_log("COPY operation not allowed without a base version\n");
+		return -1;
+	}
+	if ((uint64_t)offset + length > base->size) {
+		storage_log("COPY operation reads past the %u-byte base version\n", base->size);
+		return -1;
+	}
+	if (base->data != NULL)
+		return sink_put(writer, base->data + offset, length);
+
+	while (length > 0) {
+		uint32_t count = OUTPUT_SINK_CHUNK - writer->used;
+		if (count > length)
+			count = length;
+		if (base->read(base->context, offset, count, writer->buffer + writer->used) != (int)count) {
+			storage_log("Failed to read %u bytes at offset %u of the base version\n", count, offset);
+			return -1;
+		}
+		writer->used += count;
+		offset += count;
+		length -= count;
+		if (writer->used == OUTPUT_SINK_CHUNK && sink_flush(writer) != EXIT_SUCCESS)
+			return -1;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Applies delta operations into a sink, a bounded chunk at a time
+ *
+ * Streaming counterpart of apply_delta(): the output is never held in one
+ * buffer. It reaches the sink in order, in chunks of at most
+ * OUTPUT_SINK_CHUNK bytes, so restoring into a pipe, a socket or a
+ * compressor needs the same memory whatever the size of the version.
+ *
+ * @param delta Delta information containing operations. Must not be NULL.
+ * @param base Version the delta applies to, in memory or read through its
+ *             callback. Can be NULL for first versions.
+ * @param sink Called with each chunk of output. Must not be NULL.
+ * @param context Passed to every call of sink.
+ *
+ * @return Number of bytes produced on success, -1 on failure or if the sink
+ *         did not return EXIT_SUCCESS.
+ *
+ * @note Chunks of a base held in memory and runs of literal bytes are handed
+ *       to the sink in place; everything else goes through one
+ *       OUTPUT_SINK_CHUNK buffer allocated per call.
+ *
+ * @example
+ * ```c
+ * DeltaSource base = { .data = orig_data, .size = orig_size };
+ * int64_t size = apply_delta_to_sink(delta, &base, write_chunk, &out_fd);
+ * ```
+ */
+int64_t apply_delta_to_sink(const DeltaInfo *delta, const DeltaSource *base, OutputSink sink, void *context)
+{
+	if (delta == NULL || sink == NULL || (base != NULL && base->data == NULL && base->read == NULL)) {
+		storage_log("Error: Invalid parameters for delta application\n");
+		return -1;
+	}
+
+	SinkWriter writer = { .sink = sink, .context = context, .buffer = malloc(OUTPUT_SINK_CHUNK) };
+	if (writer.buffer == NULL) {
+		storage_log("Failed to allocate output buffer\n");
+		return -1;
+	}
+
+	int result = EXIT_SUCCESS;
+	for (uint32_t i = 0; i < delta->operation_count && result == EXIT_SUCCESS; i++) {
+		const DeltaOperation *op = &delta->operations[i];
+		result = sink_operation(&writer, base, op->type, op->offset, op->length, op->data);
+	}
+	if (result == EXIT_SUCCESS)
+		result = sink_flush(&writer);
+
+	free(writer.buffer);
+	return result == EXIT_SUCCESS ? (int64_t)writer.produced : -1;
+}
+
+/**
+ * @brief Applies a stored delta into a sink, a bounded chunk at a time
+ *
+ * Same as apply_delta_to_sink() for a delta memory-mapped with
+ * delta_index_map(). Literal bytes are handed to the sink straight out of
+ * the mapping.
+ *
+ * @param delta Index of the delta to apply. Must not be NULL.
+ * @param base Version the delta applies to. Can be NULL for version 1.
+ * @param sink Called with each chunk of output. Must not be NULL.
+ * @param context Passed to every call of sink.
+ *
+ * @return Number of bytes produced on success, -1 on failure or if the sink
+ *         did not return EXIT_SUCCESS.
+ */
+int64_t apply_index_to_sink(const DeltaIndex *delta, const DeltaSource *base, OutputSink sink, void *context)
+{
+	if (delta == NULL || sink == NULL || (base != NULL && base->data == NULL && base->read == NULL)) {
+		storage_log("Error: Invalid parameters for delta application\n");
+		return -1;
+	}
+
+	SinkWriter writer = { .sink = sink, .context = context, .buffer = malloc(OUTPUT_SINK_CHUNK) };
+	if (writer.buffer == NULL) {
+		storage_log("Failed to allocate output buffer\n");
+		return -1;
+	}
+
+	int result = EXIT_SUCCESS;
+	for (uint32_t i = 0; i < delta->entry_count && result == EXIT_SUCCESS; i++) {
+		const DeltaIndexEntry *entry = &delta->entries[i];
+		result = sink_operation(&writer, base, entry->type, entry->offset, entry->length, entry->data);
+	}
+	if (result == EXIT_SUCCESS)
+		result = sink_flush(&writer);
+
+	free(writer.buffer);
+	return result == EXIT_SUCCESS ? (int64_t)writer.produced : -1;
+}
+
+// Returns the storage thread pool, starting it on first use
+static ThreadPool * storage_apply_pool(StorageConfig *config)
+{
+	if (config->apply_pool == NULL && config->apply_threads > 1)
+		config->apply_pool = thread_pool_new(config->apply_threads);
+	return config->apply_pool;
+}
+
+// Applies a mapped delta into a buffer of delta->new_size bytes, in parallel when it is large
+static int storage_apply_into(StorageConfig *config, const uint8_t *original_data, uint32_t original_size,
+			      const DeltaIndex *delta, uint8_t *output_buffer)
+{
+	ThreadPool *pool = delta->new_size >= PARALLEL_APPLY_MIN_BYTES ? storage_apply_pool(config) : NULL;
+	int64_t result = apply_index_parallel(delta, original_data, original_size, output_buffer,
+					      delta->new_size, pool);
+	if (result != (int64_t)delta->new_size) {
+		storage_log("Failed to apply delta\n");
+		return -1;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Allocates the next version and applies a mapped delta to it, in parallel when it is large
+static uint8_t * storage_apply_delta(StorageConfig *config, const uint8_t *original_data,
+				     uint32_t original_size, const DeltaIndex *delta)
+{
+	if (delta->new_size == 0) {
+		storage_log("Error: Delta has zero new size\n");
+		return NULL;
+	}
+
+	uint8_t *output_buffer = malloc(delta->new_size);
+	if (output_buffer == NULL) {
+		storage_log("Failed to allocate output buffer\n");
+		return NULL;
+	}
+
+	if (storage_apply_into(config, original_data, original_size, delta, output_buffer) != EXIT_SUCCESS) {
+		free(output_buffer);
+		return NULL;
+	}
+
+	return output_buffer;
+}
+
+/**
+ * @brief Hints the kernel to start reading a stored version in the background
+ *
+ * Issues POSIX_FADV_WILLNEED for the stored delta of a version
+ * so that a later load_delta() or mapping finds it in the page cache. Missing files are
+ * ignored; this is only a hint.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param version Version to prefetch. Must be > 0.
+ */
+void storage_readahead(StorageConfig *config, const char *filename, uint32_t version)
+{
+	if (config == NULL || filename == NULL || version == 0)
+		return;
+
+	StoredDelta location;
+	if (storage_locate(config, filename, version, &location) != EXIT_SUCCESS)
+		return;
+
+	int fd = open(location.path, O_RDONLY);
+	if (fd != -1) {
+		posix_fadvise(fd, (off_t)location.offset, location.size, POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+}
+
+// Background loader that maps and indexes the next delta of a chain
+typedef struct {
+	StorageConfig *		config;
+	const char *		filename;
+	uint32_t		last_version;   // Last version to load
+	DeltaIndex *		ready;          // Indexed delta waiting for the consumer
+	uint32_t		ready_version;  // Version held in ready
+	int			failed;         // Set when a load fails
+	int			stopping;       // Set when the consumer gives up early
+	pthread_mutex_t		lock;
+	pthread_cond_t		changed;        // Signalled when ready, failed or stopping change
+	pthread_t		thread;
+} DeltaPrefetcher;
+
+// Loads versions 1..last_version in order, staying one delta ahead of the consumer
+static void * delta_prefetcher_run(void *arg)
+{
+	DeltaPrefetcher *prefetcher = arg;
+
+	for (uint32_t version = 1; version <= prefetcher->last_version; version++) {
+		// Let the kernel fetch the following version while this one is indexed
+		if (version < prefetcher->last_version)
+			storage_readahead(prefetcher->config, prefetcher->filename, version + 1);
+
+		// Indexing only touches the operation headers; ask for the literal bytes too
+		DeltaIndex *delta = delta_index_open(prefetcher->config, prefetcher->filename, version);
+		if (delta != NULL)
+			madvise(delta->map, delta->map_size, MADV_WILLNEED);
+
+		pthread_mutex_lock(&prefetcher->lock);
+		while (prefetcher->ready != NULL && !prefetcher->stopping)
+			pthread_cond_wait(&prefetcher->changed, &prefetcher->lock);
+
+		if (prefetcher->stopping || delta == NULL) {
+			if (delta == NULL)
+				prefetcher->failed = 1;
+			pthread_cond_broadcast(&prefetcher->changed);
+			pthread_mutex_unlock(&prefetcher->lock);
+			delta_index_free(delta);
+			return NULL;
+		}
+
+		prefetcher->ready = delta;
+		prefetcher->ready_version = version;
+		pthread_cond_broadcast(&prefetcher->changed);
+		pthread_mutex_unlock(&prefetcher->lock);
+	}
+
+	return NULL;
+}
+
+// Starts a prefetcher for versions 1..last_version, NULL if no thread could be started
+static DeltaPrefetcher * delta_prefetcher_start(StorageConfig *config, const char *filename,
+						uint32_t last_version)
+{
+	DeltaPrefetcher *prefetcher = malloc(sizeof(DeltaPrefetcher));
+
+	if (prefetcher == NULL)
+		return NULL;
+
+	prefetcher->config = config;
+	prefetcher->filename = filename;
+	prefetcher->last_version = last_version;
+	prefetcher->ready = NULL;
+	prefetcher->ready_version = 0;
+	prefetcher->failed = 0;
+	prefetcher->stopping = 0;
+	pthread_mutex_init(&prefetcher->lock, NULL);
+	pthread_cond_init(&prefetcher->changed, NULL);
+
+	if (pthread_create(&prefetcher->thread, NULL, delta_prefetcher_run, prefetcher) != 0) {
+		pthread_mutex_destroy(&prefetcher->lock);
+		pthread_cond_destroy(&prefetcher->changed);
+		free(prefetcher);
+		return NULL;
+	}
+
+	return prefetcher;
+}
+
+// Waits for the delta of the given version; NULL if loading it failed
+static DeltaIndex * delta_prefetcher_next(DeltaPrefetcher *prefetcher, uint32_t version)
+{
+	pthread_mutex_lock(&prefetcher->lock);
+	while (prefetcher->ready == NULL && !prefetcher->failed)
+		pthread_cond_wait(&prefetcher->changed, &prefetcher->lock);
+
+	DeltaIndex *delta = NULL;
+	if (prefetcher->ready != NULL && prefetcher->ready_version == version) {
+		delta = prefetcher->ready;
+		prefetcher->ready = NULL;
+		pthread_cond_broadcast(&prefetcher->changed);
+	}
+	pthread_mutex_unlock(&prefetcher->lock);
+
+	return delta;
+}
+
+// Stops the loader thread and releases anything it loaded ahead
+static void delta_prefetcher_stop(DeltaPrefetcher *prefetcher)
+{
+	if (prefetcher == NULL)
+		return;
+
+	pthread_mutex_lock(&prefetcher->lock);
+	prefetcher->stopping = 1;
+	pthread_cond_broadcast(&prefetcher->changed);
+	pthread_mutex_unlock(&prefetcher->lock);
+
+	pthread_join(prefetcher->thread, NULL);
+
+	delta_index_free(prefetcher->ready);
+	pthread_mutex_destroy(&prefetcher->lock);
+	pthread_cond_destroy(&prefetcher->changed);
+	free(prefetcher);
+}
+
+// Checks rebuilt contents, or the hasher they were streamed through, against the version's content hash
+static int verify_version(StorageConfig *config, const char *filename, uint32_t version,
+			  const uint8_t *data, uint32_t size, const Blake3Hasher *hasher)
+{
+	if (!config->verify_content)
+		return EXIT_SUCCESS;
+
+	ManifestEntry entry;
+	if (manifest_find(config, filename, version, &entry) != 1) {
+		storage_log("Failed to read the record of version %u\n", version);
+		return -1;
+	}
+
+	// Versions stored before content hashes existed cannot be checked
+	static const uint8_t unknown_hash[CONTENT_HASH_SIZE];
+	if (memcmp(entry.content_hash, unknown_hash, CONTENT_HASH_SIZE) == 0)
+		return EXIT_SUCCESS;
+
+	uint8_t hash[CONTENT_HASH_SIZE];
+	if (data != NULL)
+		blake3_hash(data, size, hash, sizeof(hash));
+	else
+		blake3_final(hasher, hash, sizeof(hash));
+	if (size != entry.file_size || memcmp(hash, entry.content_hash, CONTENT_HASH_SIZE) != 0) {
+		storage_log("Error: Version %u of '%s' is corrupt: its contents do not match the stored hash\n",
+		       version, filename);
+		return -1;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Rebuilds a version by applying its delta chain from version 1
+static uint8_t * reconstruct_chain(StorageConfig *config, const char *filename, uint32_t target_version,
+				   uint32_t *final_size)
+{
+	// Overlap reading version v + 1 with applying version v on longer chains
+	DeltaPrefetcher *prefetcher = NULL;
+	if (target_version > 2)
+		prefetcher = delta_prefetcher_start(config, filename, target_version);
+
+	// Start with version 1 (which is a full file) and apply subsequent deltas
+	uint8_t *current_data = NULL;
+	uint32_t current_size = 0;
+
+	for (uint32_t version = 1; version <= target_version; version++) {
+		DeltaIndex *delta = prefetcher != NULL ?
+				    delta_prefetcher_next(prefetcher, version) :
+				    delta_index_open(config, filename, version);
+		if (delta == NULL) {
+			storage_log("Failed to load version %u delta\n", version);
+			delta_prefetcher_stop(prefetcher);
+			free(current_data);
+			return NULL;
+		}
+
+		// Apply the delta to get the next version
+		uint8_t *new_data = storage_apply_delta(config, current_data, current_size, delta);
+		if (new_data == NULL) {
+			storage_log("Failed to apply version %u delta\n", version);
+			delta_index_free(delta);
+			delta_prefetcher_stop(prefetcher);
+			free(current_data);
+			return NULL;
+		}
+
+		// Update current data and size
+		free(current_data);
+		current_data = new_data;
+		current_size = delta->new_size;
+		delta_index_free(delta);
+	}
+
+	delta_prefetcher_stop(prefetcher);
+
+	*final_size = current_size;
+	return current_data;
+}
+
+/**
+ * @brief Reconstructs a file from its complete delta chain
+ *
+ * Reconstructs a specific version by loading and applying all deltas from
+ * version 1 up to the target version. This function handles the complete
+ * reconstruction process for any version in the chain.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename to reconstruct. Must not be NULL.
+ * @param target_version Target version to reconstruct. Must be > 0.
+ * @param final_size Output parameter for the final file size. Must not be NULL.
+ *
+ * @return Pointer to allocated buffer containing reconstructed file on success,
+ *         NULL on failure. The caller is responsible for freeing the buffer.
+ *
+ * @note The function loads version 1 as the base and applies subsequent deltas.
+ *
+ * @note Every delta is memory-mapped from the pack and applied in place,
+ *       without decoding it into a DeltaInfo. For chains longer than two
+ *       versions, a background thread maps and indexes version v + 1 (with
+ *       readahead hints for v + 2) while version v is being applied, so disk
+ *       reads overlap with the copies.
+ *
+ * @note With config->verify_content set, the result is checked against the
+ *       version's content hash and NULL is returned if it does not match.
+ *       Versions stored without a hash are not checked.
+ *
+ * @note Memory allocation failures are handled gracefully and return NULL.
+ *
+ * @note The function frees intermediate data to prevent memory leaks.
+ *
+ * @example
+ * ```c
+ * uint32_t size;
+ * uint8_t *file = reconstruct_file_from_deltas(config, "file.txt", 5, &size);
+ * if (file != NULL) {
+ *     // Use reconstructed file...
+ *     free(file);
+ * }
+ * ```
+ */
+uint8_t * reconstruct_file_from_deltas(StorageConfig *config, const char *filename,
+				       uint32_t target_version, uint32_t *final_size)
+{
+	if (config == NULL || filename == NULL || final_size == NULL) {
+		storage_log("Error: Invalid parameters for file reconstruction\n");
+		return NULL;
+	}
+
+	if (target_version == 0) {
+		storage_log("Error: Target version must be greater than 0\n");
+		return NULL;
+	}
+
+	uint8_t *data = reconstruct_chain(config, filename, target_version, final_size);
+	if (data != NULL && verify_version(config, filename, target_version, data, *final_size, NULL) != EXIT_SUCCESS) {
+		free(data);
+		return NULL;
+	}
+
+	return data;
+}
+
+/**
+ * @brief Rebuilds every version of a file in one pass over its delta chain
+ *
+ * Applies the deltas of versions 1 to last_version in order and hands each
+ * version to sink as soon as it is built, so exporting N versions costs N
+ * delta applications instead of the N * (N + 1) / 2 that separate
+ * reconstructions would. Two buffers are reused for the whole walk: each
+ * delta is applied from one into the other, and they swap roles after
+ * every version. They only grow when a version is larger than any before.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param last_version Last version to build, 0 for the latest.
+ * @param sink Called with each version in ascending order. Its data is only
+ *             valid until it returns. Must not be NULL.
+ * @param context Passed through to sink.
+ *
+ * @return Number of versions handed to sink on success, -1 on failure or
+ *         when sink returns anything but EXIT_SUCCESS, which stops the walk.
+ *
+ * @note Reading the deltas is overlapped with applying them, as in
+ *       reconstruct_file_from_deltas(). With config->verify_content set,
+ *       each version is checked against its content hash before sink sees it.
+ *
+ * @example
+ * ```c
+ * static int print_size(uint32_t version, const uint8_t *data, uint32_t size, void *context)
+ * {
+ *     printf("v%u: %u bytes\n", version, size);
+ *     return EXIT_SUCCESS;
+ * }
+ *
+ * int count = storage_walk_versions(config, "file.txt", 0, print_size, NULL);
+ * ```
+ */
+int storage_walk_versions(StorageConfig *config, const char *filename, uint32_t last_version,
+			  VersionSink sink, void *context)
+{
+	if (config == NULL || filename == NULL || sink == NULL) {
+		storage_log("Error: Invalid parameters for version walk\n");
+		return -1;
+	}
+
+	if (last_version == 0) {
+		int latest = storage_latest_version(config, filename);
+		if (latest <= 0) {
+			storage_log("No versions found for '%s'\n", filename);
+			return -1;
+		}
+		last_version = (uint32_t)latest;
+	}
+
+	DeltaPrefetcher *prefetcher = NULL;
+	if (last_version > 2)
+		prefetcher = delta_prefetcher_start(config, filename, last_version);
+
+	// buffers[current] holds the version just built, the other one receives the next
+	uint8_t *buffers[2] = { NULL, NULL };
+	uint32_t capacity[2] = { 0, 0 };
+	uint32_t current_size = 0;
+	int current = 1;
+	int result = EXIT_SUCCESS;
+
+	for (uint32_t version = 1; version <= last_version && result == EXIT_SUCCESS; version++) {
+		DeltaIndex *delta = prefetcher != NULL ?
+				    delta_prefetcher_next(prefetcher, version) :
+				    delta_index_open(config, filename, version);
+		if (delta == NULL) {
+			storage_log("Failed to load version %u delta\n", version);
+			result = -1;
+			break;
+		}
+
+		int next = 1 - current;
+		if (capacity[next] < delta->new_size) {
+			free(buffers[next]);
+			buffers[next] = malloc(delta->new_size);
+			capacity[next] = buffers[next] != NULL ? delta->new_size : 0;
+		}
+
+		if (buffers[next] == NULL && delta->new_size > 0) {
+			storage_log("Failed to allocate output buffer\n");
+			result = -1;
+		} else if (storage_apply_into(config, version > 1 ? buffers[current] : NULL,
+					      version > 1 ? current_size : 0, delta, buffers[next]) != EXIT_SUCCESS) {
+			storage_log("Failed to apply version %u delta\n", version);
+			result = -1;
+		} else {
+			current = next;
+			current_size = delta->new_size;
+			if (verify_version(config, filename, version, buffers[current], current_size, NULL) != EXIT_SUCCESS ||
+			    sink(version, buffers[current], current_size, context) != EXIT_SUCCESS)
+				result = -1;
+		}
+		delta_index_free(delta);
+	}
+
+	delta_prefetcher_stop(prefetcher);
+	free(buffers[0]);
+	free(buffers[1]);
+	return result == EXIT_SUCCESS ? (int)last_version : -1;
+}
+
+// Opens the file holding the stored delta of a version read-only
+static int open_stored_delta(StorageConfig *config, const char *filename, uint32_t version)
+{
+	StoredDelta location;
+
+	if (storage_locate(config, filename, version, &location) != EXIT_SUCCESS)
+		return -1;
+
+	return open(location.path, O_RDONLY);
+}
+
+// Restores a version whose base is the version 1 snapshot (or version 1 itself) with kernel copies
+static int restore_from_snapshot(StorageConfig *config, const char *filename, uint32_t version,
+				 int fd, uint32_t *new_size)
+{
+	DeltaIndex *delta = delta_index_open(config, filename, version);
+	DeltaIndex *base = version > 1 ? delta_index_open(config, filename, version - 1) : NULL;
+	int delta_fd = open_stored_delta(config, filename, version);
+	int base_fd = version > 1 ? open_stored_delta(config, filename, version - 1) : -1;
+	int result = -1;
+
+	if (delta != NULL && delta_fd != -1 && (version == 1 || (base != NULL && base_fd != -1)) &&
+	    ftruncate(fd, (off_t)delta->new_size) == 0 &&
+	    apply_delta_to_fd(delta, delta_fd, base, base_fd, fd) >= 0) {
+		*new_size = delta->new_size;
+		result = EXIT_SUCCESS;
+	}
+
+	if (base_fd != -1)
+		close(base_fd);
+	if (delta_fd != -1)
+		close(delta_fd);
+	delta_index_free(base);
+	delta_index_free(delta);
+	return result;
+}
+
+// Reconstructs the base in memory and applies the final delta into a mapping of fd
+static int restore_into_mapping(StorageConfig *config, const char *filename, uint32_t version,
+				int fd, uint32_t *new_size)
+{
+	// Everything up to the previous version is built in memory as the base
+	uint8_t *base_data = NULL;
+	uint32_t base_size = 0;
+	if (version > 1) {
+		base_data = reconstruct_chain(config, filename, version - 1, &base_size);
+		if (base_data == NULL)
+			return -1;
+	}
+
+	DeltaIndex *delta = delta_index_open(config, filename, version);
+	if (delta == NULL) {
+		storage_log("Failed to load version %u delta\n", version);
+		free(base_data);
+		return -1;
+	}
+
+	// A store into a mapped hole raises SIGBUS when the disk is full, so the blocks are
+	// reserved first. Where they cannot be, the version is built in memory and written.
+	uint8_t *output = MAP_FAILED;
+	int mapped = 0;
+	if (delta->new_size > 0 && posix_fallocate(fd, 0, (off_t)delta->new_size) == 0) {
+		output = mmap(NULL, delta->new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		mapped = output != MAP_FAILED;
+	}
+	if (!mapped && delta->new_size > 0) {
+		output = malloc(delta->new_size);
+		if (output == NULL)
+			output = MAP_FAILED;
+	}
+
+	int result = EXIT_SUCCESS;
+	if (delta->new_size > 0 && output == MAP_FAILED) {
+		storage_log("Failed to allocate memory for restored file: %s\n", strerror(errno));
+		result = -1;
+	} else if (delta->new_size > 0) {
+		ThreadPool *pool = delta->new_size >= PARALLEL_APPLY_MIN_BYTES ? storage_apply_pool(config) : NULL;
+		int64_t written = apply_index_parallel(delta, base_data, base_size, output, delta->new_size, pool);
+		if (written != (int64_t)delta->new_size) {
+			storage_log("Failed to apply version %u delta\n", version);
+			result = -1;
+		} else {
+			// Checked while the restored pages are still in memory
+			result = verify_version(config, filename, version, output, delta->new_size, NULL);
+		}
+
+		int kernel_copy = 0;
+		if (result == EXIT_SUCCESS && !mapped)
+			result = copy_stored_range(-1, output, 0, fd, 0, delta->new_size, &kernel_copy);
+
+		if (mapped)
+			munmap(output, delta->new_size);
+		else
+			free(output);
+	}
+
+	*new_size = delta->new_size;
+	delta_index_free(delta);
+	free(base_data);
+	return result;
+}
+
+// Gives the restored file the mode a plain overwrite or create of output_path would leave
+static int restore_file_mode(int fd, const char *output_path)
+{
+	struct stat st;
+	mode_t mode;
+
+	if (stat(output_path, &st) == 0) {
+		mode = st.st_mode & 07777;
+	} else {
+		mode_t mask = umask(0);
+		umask(mask);
+		mode = 0666 & ~mask;
+	}
+
+	if (fchmod(fd, mode) == -1) {
+		storage_log("Failed to set permissions for %s: %s\n", output_path, strerror(errno));
+		return -1;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Restores a version straight into a file on disk
+ *
+ * Writes the version into a temporary file next to output_path and renames
+ * it over output_path once it is complete, so readers see either the old file
+ * or the whole restored version, never a partial one.
+ *
+ * Versions 1 and 2 are built from the version 1 snapshot on disk with
+ * apply_delta_to_fd(), so their data never passes through user space. Later
+ * versions reconstruct their base in memory, reserve the temporary file's
+ * blocks with posix_fallocate() and apply the final delta directly into a
+ * shared mapping of it. On filesystems where the blocks cannot be reserved,
+ * the final version is built in memory and written instead, so a full disk
+ * fails the restore rather than killing the process with SIGBUS.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename to restore. Must not be NULL.
+ * @param version Version to restore. Must be > 0.
+ * @param output_path Destination path. Must not be NULL.
+ * @param final_size Output parameter for the restored size. Can be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ *
+ * @note An existing output_path keeps its permission bits; a new file gets
+ *       0666 minus the umask, like fopen() would give it.
+ *
+ * @note On failure the temporary file is removed and output_path is untouched.
+ *
+ * @note With config->verify_content set, the restored contents are checked
+ *       against the version's content hash before the file is renamed into
+ *       place, and every version is applied through a mapping so they can be.
+ *
+ * @example
+ * ```c
+ * uint32_t size;
+ * if (restore_file_to_path(config, "file.txt", 3, "file.txt", &size) == EXIT_SUCCESS)
+ *     printf("Restored %u bytes\n", size);
+ * ```
+ */
+int restore_file_to_path(StorageConfig *config, const char *filename, uint32_t version,
+			 const char *output_path, uint32_t *final_size)
+{
+	if (config == NULL || filename == NULL || output_path == NULL || version == 0) {
+		storage_log("Error: Invalid parameters for file restore\n");
+		return -1;
+	}
+
+	// The temporary file lives in the destination directory so rename() stays atomic
+	char temp_path[1024];
+	const char *slash = strrchr(output_path, '/');
+	if (slash != NULL)
+		snprintf(temp_path, sizeof(temp_path), "%.*s/.%s.fiver-XXXXXX",
+			 (int)(slash - output_path), output_path, slash + 1);
+	else
+		snprintf(temp_path, sizeof(temp_path), ".%s.fiver-XXXXXX", output_path);
+
+	int fd = mkstemp(temp_path);
+	if (fd == -1) {
+		storage_log("Failed to create temporary file for %s: %s\n", output_path, strerror(errno));
+		return -1;
+	}
+
+	uint32_t new_size = 0;
+	int result = -1;
+	if (version <= 2 && !config->verify_content)
+		result = restore_from_snapshot(config, filename, version, fd, &new_size);
+	if (result != EXIT_SUCCESS)
+		result = restore_into_mapping(config, filename, version, fd, &new_size);
+	if (result == EXIT_SUCCESS)
+		result = restore_file_mode(fd, output_path);
+
+	if (close(fd) == -1 && result == EXIT_SUCCESS) {
+		storage_log("Failed to write %s: %s\n", temp_path, strerror(errno));
+		result = -1;
+	}
+
+	if (result == EXIT_SUCCESS && rename(temp_path, output_path) == -1) {
+		storage_log("Failed to move restored file to %s: %s\n", output_path, strerror(errno));
+		result = -1;
+	}
+
+	if (result != EXIT_SUCCESS)
+		unlink(temp_path);
+	else if (final_size != NULL)
+		*final_size = new_size;
+
+	return result;
+}
+
+// Reads the base of a streamed restore from the previous version
+static int read_previous_version(void *context, uint32_t offset, uint32_t length, uint8_t *buffer)
+{
+	// Asked for at most OUTPUT_SINK_CHUNK bytes, so the count fits an int
+	return version_reader_read(context, offset, length, buffer) < 0 ? -1 : (int)length;
+}
+
+// Sink of a verified streamed restore: hashes every chunk on its way to the caller's sink
+typedef struct {
+	OutputSink	sink;
+	void *		context;
+	Blake3Hasher	hasher;
+} HashingSink;
+
+// Hashes a chunk and passes it on
+static int hash_and_forward(const uint8_t *data, uint32_t size, void *context)
+{
+	HashingSink *hashing = context;
+
+	blake3_update(&hashing->hasher, data, size);
+	return hashing->sink(data, size, hashing->context);
+}
+
+/**
+ * @brief Restores a version into a sink without holding it in memory
+ *
+ * Applies the version's stored delta with apply_index_to_sink(). Its base,
+ * the previous version, is read through a VersionReader, which resolves
+ * each COPY down the delta chain a chunk at a time. Memory therefore grows
+ * with the delta metadata of the chain, not with the size of any version,
+ * and the output reaches the sink in chunks of at most OUTPUT_SINK_CHUNK
+ * bytes.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename to restore. Must not be NULL.
+ * @param version Version to restore. Must be > 0.
+ * @param sink Called with each chunk of the version. Must not be NULL.
+ * @param context Passed to every call of sink.
+ * @param final_size Output parameter for the restored size. Can be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure or if the sink did not
+ *         return EXIT_SUCCESS.
+ *
+ * @note With config->verify_content set, the output is hashed as it streams
+ *       and checked against the version's content hash at the end. The sink
+ *       has received every byte by then, so a failure means it must discard
+ *       what it got.
+ *
+ * @example
+ * ```c
+ * uint32_t size;
+ * if (restore_version_to_sink(config, "file.txt", 3, write_chunk, &out_fd, &size) == EXIT_SUCCESS)
+ *     fprintf(stderr, "Streamed %u bytes\n", size);
+ * ```
+ */
+int restore_version_to_sink(StorageConfig *config, const char *filename, uint32_t version, OutputSink sink,
+			    void *context, uint32_t *final_size)
+{
+	if (config == NULL || filename == NULL || sink == NULL || version == 0) {
+		storage_log("Error: Invalid parameters for file restore\n");
+		return -1;
+	}
+
+	DeltaIndex *delta = delta_index_open(config, filename, version);
+	if (delta == NULL)
+		return -1;
+
+	VersionReader *reader = NULL;
+	DeltaSource base = { .read = read_previous_version };
+	if (version > 1) {
+		reader = version_reader_open(config, filename, version - 1);
+		if (reader == NULL) {
+			delta_index_free(delta);
+			return -1;
+		}
+		base.size = version_reader_size(reader);
+		base.context = reader;
+	}
+
+	HashingSink hashing = { .sink = sink, .context = context };
+	int64_t produced;
+	if (config->verify_content) {
+		blake3_init(&hashing.hasher);
+		produced = apply_index_to_sink(delta, reader != NULL ? &base : NULL, hash_and_forward, &hashing);
+	} else {
+		produced = apply_index_to_sink(delta, reader != NULL ? &base : NULL, sink, context);
+	}
+
+	int result = produced >= 0 ? EXIT_SUCCESS : -1;
+	if (result == EXIT_SUCCESS)
+		result = verify_version(config, filename, version, NULL, (uint32_t)produced, &hashing.hasher);
+
+	version_reader_free(reader);
+	delta_index_free(delta);
+
+	if (result == EXIT_SUCCESS && final_size != NULL)
+		*final_size = (uint32_t)produced;
+	return result;
+}
+
+// Records the state of the working file unless it may still change within the same timestamp
+static void record_state(StorageConfig *config, const char *filename, const TrackedState *state,
+			 uint32_t version)
+{
+	if (state == NULL)
+		return;
+
+	// A file modified within the last second could change again without its mtime moving
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	int64_t now_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	if (state->mtime_ns > now_ns - 1000000000)
+		return;
+
+	TrackedState recorded = *state;
+	recorded.version = version;
+
+	// The state only saves work later; the version is stored either way
+	if (manifest_write_state(config, filename, &recorded) != EXIT_SUCCESS)
+		storage_log("Warning: Failed to record the state of '%s'\n", filename);
+}
+
+// Keeps a copy of a version in head; a head that cannot be kept is emptied and rebuilt next time
+static void head_keep(FileHead *head, uint32_t version, const uint8_t *data, uint32_t size,
+		      const uint8_t *content_hash)
+{
+	if (head == NULL)
+		return;
+	if (head->version == version && head->size == size &&
+	    memcmp(head->content_hash, content_hash, CONTENT_HASH_SIZE) == 0)
+		return;
+
+	uint8_t *copy = realloc(head->data, size);
+	if (copy == NULL) {
+		file_head_clear(head);
+		return;
+	}
+
+	memcpy(copy, data, size);
+	head->data = copy;
+	head->size = size;
+	head->version = version;
+	memcpy(head->content_hash, content_hash, CONTENT_HASH_SIZE);
+}
+
+// Largest delta context kept for the next track; a larger one is freed after its diff
+#define DELTA_CONTEXT_KEEP_MAX (64 * 1024 * 1024)
+
+// Takes an idle delta context of the storage, or makes one; workers tracking in parallel share the config
+static DeltaContext * take_delta_context(StorageConfig *config)
+{
+	for (int i = 0; i < STORAGE_DELTA_CONTEXTS; i++) {
+		DeltaContext *context = __atomic_exchange_n(&config->delta_contexts[i], NULL, __ATOMIC_ACQUIRE);
+		if (context != NULL)
+			return context;
+	}
+
+	return delta_context_new();
+}
+
+// Keeps a delta context for the next track unless it grew too large or every slot is taken
+static void return_delta_context(StorageConfig *config, DeltaContext *context)
+{
+	if (context == NULL)
+		return;
+
+	if (delta_context_footprint(context) <= DELTA_CONTEXT_KEEP_MAX) {
+		for (int i = 0; i < STORAGE_DELTA_CONTEXTS; i++) {
+			DeltaContext *empty = NULL;
+			if (__atomic_compare_exchange_n(&config->delta_contexts[i], &empty, context, 0,
+							__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+				return;
+		}
+	}
+
+	delta_context_free(context);
+}
+
+// Stores the next version of a file; the caller holds the file's writer lock
+static int track_locked(StorageConfig *config, const char *filename, const uint8_t *file_data,
+			uint32_t file_size, const char *message, const uint8_t *content_hash,
+			const TrackedState *state, FileHead *head, int *stored)
+{
+	// Legacy versions are imported first; a crash in batch mode can leave
+	// records whose data never reached the disk
+	if (manifest_prepare(config, filename) != EXIT_SUCCESS || manifest_drop_uncommitted(config, filename) < 0) {
+		storage_log("Failed to recover versions of '%s'\n", filename);
+		return -1;
+	}
+
+	// Get current version number
+	ManifestEntry latest;
+	int found = manifest_latest(config, filename, &latest);
+	if (found < 0) {
+		storage_log("Failed to read versions of '%s'\n", filename);
+		return -1;
+	}
+
+	uint32_t latest_version = found ? latest.version : 0;
+	uint32_t new_version = latest_version + 1;
+
+	// Contents matching the latest version's hash need no new version
+	static const uint8_t unknown_hash[CONTENT_HASH_SIZE];
+	if (found && latest.file_size == file_size &&
+	    memcmp(latest.content_hash, unknown_hash, CONTENT_HASH_SIZE) != 0 &&
+	    memcmp(latest.content_hash, content_hash, CONTENT_HASH_SIZE) == 0) {
+		record_state(config, filename, state, latest_version);
+		head_keep(head, latest_version, file_data, file_size, content_hash);
+		return (int)latest_version;
+	}
+
+	// Load the previous version if it exists
+	const uint8_t *original_data = NULL;
+	uint8_t *rebuilt = NULL;
+	uint32_t original_size = 0;
+
+	if (latest_version > 0 && head != NULL && head->data != NULL && head->version == latest_version &&
+	    head->size == latest.file_size && memcmp(head->content_hash, latest.content_hash, CONTENT_HASH_SIZE) == 0) {
+		// The head kept by the last track is the previous version
+		original_data = head->data;
+		original_size = head->size;
+	} else if (latest_version > 0) {
+		// Reconstruct the previous version from the delta chain
+		rebuilt = reconstruct_file_from_deltas(config, filename, latest_version, &original_size);
+		if (rebuilt == NULL) {
+			storage_log("Failed to reconstruct previous version %u\n", latest_version);
+			return -1;
+		}
+		original_data = rebuilt;
+
+		// Versions stored without a hash are compared byte for byte
+		if (original_size == file_size && memcmp(original_data, file_data, file_size) == 0) {
+			free(rebuilt);
+			record_state(config, filename, state, latest_version);
+			head_keep(head, latest_version, file_data, file_size, content_hash);
+			return (int)latest_version;
+		}
+	}
+
+	// Create delta from previous version, or a single INSERT of the whole file for the first one
+	DeltaContext *context = NULL;
+	const DeltaInfo *delta;
+	DeltaOperation whole_file = { DELTA_INSERT, 0, file_size, (uint8_t *)file_data };
+	DeltaInfo first_delta = { 0, file_size, 1, &whole_file, file_size };
+	if (original_data != NULL) {
+		context = take_delta_context(config);
+		delta = delta_create_in(context, original_data, original_size, file_data, file_size);
+	} else {
+		delta = &first_delta;
+	}
+
+	if (delta == NULL) {
+		storage_log("Failed to create delta\n");
+		return_delta_context(config, context);
+		free(rebuilt);
+		return -1;
+	}
+
+	// Save the delta
+	int result = save_delta(config, filename, new_version, delta, content_hash, message);
+
+	// The version is stored either way; a catalog that failed to update is rebuilt on the next listing
+	if (result == 0 && catalog_add_version(config, filename, new_version, delta->delta_size) != EXIT_SUCCESS)
+		storage_log("Warning: Failed to update the catalog for '%s'\n", filename);
+	if (result == 0) {
+		record_state(config, filename, state, new_version);
+		if (stored != NULL)
+			*stored = 1;
+	}
+
+	// Cleanup
+	return_delta_context(config, context);
+	free(rebuilt);
+
+	if (result == 0)
+		head_keep(head, new_version, file_data, file_size, content_hash);
 	return result == 0 ? (int)new_version : -1;
 }
+
+/**
+ * @brief Tracks a new version of a file in the storage system
+ *
+ * Creates and stores a new version of a file by generating a delta from
+ * the previous version and saving it to persistent storage. This is the
+ * main entry point for file versioning operations.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename to track. Must not be NULL.
+ * @param file_data New file data to store. Must not be NULL.
+ * @param file_size Size of the new file data. Must be > 0.
+ * @param message Optional commit message. Can be NULL.
+ *
+ * @return New version number on success, the latest version if the contents
+ *         are unchanged, -1 on failure.
+ *
+ * @note For the first version, creates a delta containing the entire file.
+ *
+ * @note The function automatically determines the next version number.
+ *
+ * @note The new version is also counted in the repository catalog.
+ *
+ * @note Holds the file's writer lock while it works out and appends the next
+ *       version, so concurrent tracks of the same file get distinct versions.
+ *       Tracks of other files and readers are not blocked.
+ *
+ * @note Memory allocation failures are handled gracefully and return -1.
+ *
+ * @example
+ * ```c
+ * int version = track_file_version(config, "file.txt", data, size, "Updated file");
+ * if (version > 0) {
+ *     printf("Tracked as version %d\n", version);
+ * }
+ * ```
+ */
+int track_file_version(StorageConfig *config, const char *filename,
+		       const uint8_t *file_data, uint32_t file_size, const char *message)
+{
+	return track_file_state(config, filename, file_data, file_size, message, NULL, NULL, NULL);
+}
+
+/**
+ * @brief Tracks a new version of a file and records the working file's state
+ *
+ * Like track_file_version(), but contents equal to the latest version are
+ * recognized by their content hash and stored no second time. The state of
+ * the working file is recorded with the version it matches, so the next
+ * track can skip an unchanged file after a stat with
+ * storage_check_unchanged().
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename to track. Must not be NULL.
+ * @param file_data New file data to store. Must not be NULL.
+ * @param file_size Size of the new file data. Must be > 0.
+ * @param message Optional commit message. Can be NULL.
+ * @param content_hash CONTENT_HASH_SIZE-byte BLAKE3 hash of file_data, best
+ *                     computed while the file is read. Can be NULL to have it
+ *                     computed here.
+ * @param state State of the working file, taken before file_data was read.
+ *              Can be NULL.
+ * @param stored Output parameter set to 1 if a new version was stored and to
+ *               0 if the contents were unchanged. Can be NULL.
+ *
+ * @return Version holding the contents on success, -1 on failure.
+ *
+ * @note The state is not recorded for a file modified within the last
+ *       second, which could still change without its mtime moving.
+ *
+ * @example
+ * ```c
+ * TrackedState state;
+ * int stored;
+ * storage_tracked_state(&st, 0, &state);
+ * int version = track_file_state(config, "file.txt", data, size, NULL, NULL, &state, &stored);
+ * if (version > 0 && !stored)
+ *     printf("Unchanged since version %d\n", version);
+ * ```
+ */
+int track_file_state(StorageConfig *config, const char *filename, const uint8_t *file_data,
+		     uint32_t file_size, const char *message, const uint8_t *content_hash,
+		     const TrackedState *state, int *stored)
+{
+	return track_file_head(config, filename, file_data, file_size, message, content_hash, state, NULL, stored);
+}
+
+/**
+ * @brief Tracks a new version of a file against a version kept in memory
+ *
+ * Like track_file_state(), but the previous version is taken from head
+ * instead of being rebuilt from the delta chain when head still holds the
+ * latest stored version. Afterwards head holds the version matching
+ * file_data, ready for the next track of the same file. A process tracking
+ * the same files again and again, such as a watcher, then diffs each
+ * change against memory and reads only the manifest.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename to track. Must not be NULL.
+ * @param file_data New file data to store. Must not be NULL.
+ * @param file_size Size of the new file data. Must be > 0.
+ * @param message Optional commit message. Can be NULL.
+ * @param content_hash CONTENT_HASH_SIZE-byte BLAKE3 hash of file_data. Can
+ *                     be NULL to have it computed here.
+ * @param state State of the working file, taken before file_data was read.
+ *              Can be NULL.
+ * @param head Latest version of the file kept by an earlier call, or a
+ *             zeroed FileHead. Can be NULL to behave like track_file_state().
+ * @param stored Output parameter set to 1 if a new version was stored and to
+ *               0 if the contents were unchanged. Can be NULL.
+ *
+ * @return Version holding the contents on success, -1 on failure.
+ *
+ * @note A head that no longer matches the latest version, because another
+ *       process tracked the file in between, is ignored and replaced. One
+ *       that cannot be replaced for lack of memory is emptied.
+ *
+ * @note head must only be used for the file it was filled for, and by one
+ *       thread at a time. Release its memory with file_head_clear().
+ *
+ * @example
+ * ```c
+ * FileHead head = { 0 };
+ * track_file_head(config, "log.txt", data, size, NULL, NULL, NULL, &head, NULL);
+ * track_file_head(config, "log.txt", data2, size2, NULL, NULL, NULL, &head, NULL);
+ * file_head_clear(&head);
+ * ```
+ */
+int track_file_head(StorageConfig *config, const char *filename, const uint8_t *file_data,
+		    uint32_t file_size, const char *message, const uint8_t *content_hash,
+		    const TrackedState *state, FileHead *head, int *stored)
+{
+	if (stored != NULL)
+		*stored = 0;
+
+	if (config == NULL || filename == NULL || file_data == NULL) {
+		storage_log("Error: Invalid parameters for file tracking\n");
+		return -1;
+	}
+
+	if (file_size == 0) {
+		storage_log("Error: File size must be greater than 0\n");
+		return -1;
+	}
+
+	// The manifest header, catalog and readers hold the canonical path in MANIFEST_PATH_SIZE bytes
+	char canonical[1024];
+	storage_canonical_path(filename, canonical, sizeof(canonical));
+	if (strlen(canonical) >= MANIFEST_PATH_SIZE) {
+		storage_log("Error: Path '%s' is too long to track (at most %d bytes)\n", filename,
+			    MANIFEST_PATH_SIZE - 1);
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	uint8_t computed_hash[CONTENT_HASH_SIZE];
+	if (content_hash == NULL) {
+		blake3_hash(file_data, file_size, computed_hash, sizeof(computed_hash));
+		content_hash = computed_hash;
+	}
+
+	int lock = storage_lock_file(config, filename);
+	if (lock == -1)
+		return -1;
+
+	int result = track_locked(config, filename, file_data, file_size, message, content_hash, state, head, stored);
+	storage_unlock(lock);
+	return result;
+}
+
+/**
+ * @brief Releases the memory of a kept version
+ *
+ * @param head Head filled by track_file_head(). Can be NULL. Left empty and
+ *             ready for reuse.
+ */
+void file_head_clear(FileHead *head)
+{
+	if (head == NULL)
+		return;
+
+	free(head->data);
+	memset(head, 0, sizeof(FileHead));
+}
+
+/**
+ * @brief Captures the state of a working file from its stat
+ *
+ * @param st Result of stat() on the working file. Must not be NULL.
+ * @param version Version the file's contents match, 0 if unknown.
+ * @param state Output parameter for the state. Must not be NULL.
+ */
+void storage_tracked_state(const struct stat *st, uint32_t version, TrackedState *state)
+{
+	memset(state, 0, sizeof(TrackedState));
+	state->version = version;
+	state->size = (uint64_t)st->st_size;
+	state->mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+	state->ctime_ns = (int64_t)st->st_ctim.tv_sec * 1000000000 + st->st_ctim.tv_nsec;
+	state->inode = (uint64_t)st->st_ino;
+	state->device = (uint64_t)st->st_dev;
+}
+
+/**
+ * @brief Checks whether a working file is unchanged since it was last tracked
+ *
+ * Compares the file's stat with the state recorded when it was last tracked.
+ * Reads one manifest header and record; neither the file nor its versions
+ * are read.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename. Must not be NULL.
+ * @param state Current state of the working file. Must not be NULL.
+ *
+ * @return The latest version if the file is unchanged, 0 if it may have
+ *         changed (or no state is recorded), -1 on failure.
+ *
+ * @note A 0 only means the stat differs; track_file_state() still finds
+ *       out by the content hash whether the contents did.
+ *
+ * @example
+ * ```c
+ * TrackedState state;
+ * storage_tracked_state(&st, 0, &state);
+ * if (storage_check_unchanged(config, "file.txt", &state) > 0)
+ *     return EXIT_SUCCESS;   // Nothing to track
+ * ```
+ */
+int storage_check_unchanged(StorageConfig *config, const char *filename, const TrackedState *state)
+{
+	if (config == NULL || filename == NULL || state == NULL) {
+		storage_log("Error: Invalid parameters for unchanged check\n");
+		return -1;
+	}
+
+	TrackedState recorded;
+	int found = manifest_read_state(config, filename, &recorded);
+	if (found <= 0)
+		return found;
+
+	// A state describes its version only while no later version exists
+	int latest_version = storage_latest_version(config, filename);
+	if (latest_version <= 0)
+		return latest_version;
+
+	if (recorded.version != (uint32_t)latest_version || recorded.size != state->size ||
+	    recorded.mtime_ns != state->mtime_ns || recorded.ctime_ns != state->ctime_ns ||
+	    recorded.inode != state->inode || recorded.device != state->device)
+		return 0;
+
+	return latest_version;
+}
+
+/**
+ * @brief Compares a working file with the latest version of it
+ *
+ * Answers as cheaply as the file allows and never replays the delta chain:
+ * a stat that matches the state recorded at the last track means unchanged,
+ * a size that differs from the latest version means modified, and only
+ * otherwise is the file hashed and compared with the latest version's
+ * content hash.
+ *
+ * @param config Storage configuration. Must not be NULL.
+ * @param filename Original filename; also the path of the working file. Must not be NULL.
+ * @param st Result of stat() on the working file. Must not be NULL.
+ * @param state Output parameter for the comparison. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, -1 if the file is not tracked or on failure.
+ *
+ * @note A latest version stored before content hashes existed compares as
+ *       FILE_STATE_UNKNOWN unless its size already tells it apart.
+ *
+ * @example
+ * ```c
+ * struct stat st;
+ * FileState state;
+ * if (stat("file.txt", &st) == 0 &&
+ *     storage_file_state(config, "file.txt", &st, &state) == EXIT_SUCCESS &&
+ *     state == FILE_STATE_MODIFIED)
+ *     printf("file.txt has changes to track\n");
+ * ```
+ */
+int storage_file_state(StorageConfig *config, const char *filename, const struct stat *st, FileState *state)
+{
+	if (config == NULL || filename == NULL || st == NULL || state == NULL) {
+		storage_log("Error: Invalid parameters for file state\n");
+		return -1;
+	}
+
+	TrackedState current;
+	storage_tracked_state(st, 0, &current);
+	int unchanged = storage_check_unchanged(config, filename, &current);
+	if (unchanged < 0)
+		return -1;
+	if (unchanged > 0) {
+		*state = FILE_STATE_UNCHANGED;
+		return EXIT_SUCCESS;
+	}
+
+	ManifestEntry latest;
+	if (manifest_latest(config, filename, &latest) != 1)
+		return -1;
+
+	if ((uint64_t)st->st_size != latest.file_size) {
+		*state = FILE_STATE_MODIFIED;
+		return EXIT_SUCCESS;
+	}
+
+	static const uint8_t unknown_hash[CONTENT_HASH_SIZE];
+	if (memcmp(latest.content_hash, unknown_hash, CONTENT_HASH_SIZE) == 0) {
+		*state = FILE_STATE_UNKNOWN;
+		return EXIT_SUCCESS;
+	}
+
+	uint8_t hash[CONTENT_HASH_SIZE];
+	if (storage_hash_file(filename, hash) != EXIT_SUCCESS)
+		return -1;
+
+	*state = memcmp(hash, latest.content_hash, CONTENT_HASH_SIZE) == 0 ?
+		 FILE_STATE_UNCHANGED : FILE_STATE_MODIFIED;
+	return EXIT_SUCCESS;
+}
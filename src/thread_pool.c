@@ -0,0 +1,309 @@
+/**
+ * @file thread_pool.c
+ * @brief Fixed-size worker thread pool
+ *
+ * This module provides a small pthread-based pool of worker threads fed
+ * from a FIFO task queue. Callers can either submit independent tasks and
+ * wait for the pool to drain, or run a batch of tasks and wait for just
+ * that batch, which lets several threads share one pool safely.
+ *
+ * @author Fiver Development Team
+ * @version 1.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "delta_structures.h"
+
+// Completion tracking for tasks submitted by thread_pool_run()
+typedef struct {
+	uint32_t	pending;                // Tasks of the batch not yet finished
+	pthread_cond_t	done;                   // Signalled when pending drops to 0
+} TaskBatch;
+
+// A queued unit of work
+typedef struct Task {
+	ThreadPoolTask	fn;                     // Function to run
+	void *		arg;                    // Argument passed to fn
+	TaskBatch *	batch;                  // Owning batch, NULL for submitted tasks
+	struct Task *	next;                   // Next task in the queue
+} Task;
+
+struct ThreadPool {
+	pthread_mutex_t lock;                   // Protects every field below
+	pthread_cond_t	work_ready;             // Signalled when a task is queued
+	pthread_cond_t	idle;                   // Signalled when outstanding drops to 0
+	Task *		head;                   // Queue head (next task to run)
+	Task *		tail;                   // Queue tail
+	uint32_t	outstanding;            // Queued plus running tasks
+	int		shutting_down;          // Set by thread_pool_free()
+	uint32_t	thread_count;           // Number of worker threads
+	pthread_t *	threads;                // Worker thread handles
+};
+
+// Worker loop: pops tasks until the pool shuts down and the queue is empty
+static void * thread_pool_worker(void *arg)
+{
+	ThreadPool *pool = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->head == NULL && !pool->shutting_down)
+			pthread_cond_wait(&pool->work_ready, &pool->lock);
+
+		if (pool->head == NULL && pool->shutting_down)
+			break;
+
+		Task *task = pool->head;
+		pool->head = task->next;
+		if (pool->head == NULL)
+			pool->tail = NULL;
+		pthread_mutex_unlock(&pool->lock);
+
+		task->fn(task->arg);
+
+		pthread_mutex_lock(&pool->lock);
+		if (task->batch != NULL && --task->batch->pending == 0)
+			pthread_cond_broadcast(&task->batch->done);
+		if (--pool->outstanding == 0)
+			pthread_cond_broadcast(&pool->idle);
+		free(task);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+/**
+ * @brief Returns the number of online CPUs
+ *
+ * @return Number of online processors, at least 1.
+ */
+uint32_t thread_pool_cpu_count(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return cpus > 0 ? (uint32_t)cpus : 1;
+}
+
+/**
+ * @brief Creates a new thread pool
+ *
+ * Starts thread_count worker threads that wait for tasks.
+ *
+ * @param thread_count Number of worker threads. 0 uses one thread per online CPU.
+ *
+ * @return Pointer to the new ThreadPool on success, NULL on failure.
+ *         The caller is responsible for freeing it with thread_pool_free().
+ *
+ * @example
+ * ```c
+ * ThreadPool *pool = thread_pool_new(0);  // One worker per CPU
+ * thread_pool_submit(pool, work, arg);
+ * thread_pool_wait(pool);
+ * thread_pool_free(pool);
+ * ```
+ */
+ThreadPool * thread_pool_new(uint32_t thread_count)
+{
+	if (thread_count == 0)
+		thread_count = thread_pool_cpu_count();
+
+	ThreadPool *pool = malloc(sizeof(ThreadPool));
+	if (pool == NULL) {
+		storage_log("Failed to allocate memory for ThreadPool: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	pool->head = NULL;
+	pool->tail = NULL;
+	pool->outstanding = 0;
+	pool->shutting_down = 0;
+	pool->thread_count = 0;
+	pool->threads = malloc(thread_count * sizeof(pthread_t));
+	if (pool->threads == NULL) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_ready, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+
+	for (uint32_t i = 0; i < thread_count; i++) {
+		int rc = pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool);
+		if (rc != 0) {
+			storage_log("Failed to start worker thread: %s\n", strerror(rc));
+			thread_pool_free(pool);
+			return NULL;
+		}
+		pool->thread_count++;
+	}
+
+	return pool;
+}
+
+/**
+ * @brief Returns the number of worker threads in the pool
+ *
+ * @param pool Thread pool. May be NULL.
+ *
+ * @return Number of workers, 0 if pool is NULL.
+ */
+uint32_t thread_pool_size(const ThreadPool *pool)
+{
+	return pool != NULL ? pool->thread_count : 0;
+}
+
+// Appends a task to the queue; the caller must hold pool->lock
+static int thread_pool_enqueue(ThreadPool *pool, ThreadPoolTask fn, void *arg, TaskBatch *batch)
+{
+	Task *task = malloc(sizeof(Task));
+
+	if (task == NULL)
+		return -1;
+
+	task->fn = fn;
+	task->arg = arg;
+	task->batch = batch;
+	task->next = NULL;
+
+	if (pool->tail != NULL)
+		pool->tail->next = task;
+	else
+		pool->head = task;
+	pool->tail = task;
+	pool->outstanding++;
+	pthread_cond_signal(&pool->work_ready);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Queues a task for execution by a worker thread
+ *
+ * @param pool Thread pool. Must not be NULL.
+ * @param fn Function to run. Must not be NULL.
+ * @param arg Argument passed to fn.
+ *
+ * @return EXIT_SUCCESS on success, -1 on failure.
+ *
+ * @note Use thread_pool_wait() to wait for every submitted task to finish.
+ */
+int thread_pool_submit(ThreadPool *pool, ThreadPoolTask fn, void *arg)
+{
+	if (pool == NULL || fn == NULL)
+		return -1;
+
+	pthread_mutex_lock(&pool->lock);
+	int result = thread_pool_enqueue(pool, fn, arg, NULL);
+	pthread_mutex_unlock(&pool->lock);
+
+	return result;
+}
+
+/**
+ * @brief Waits until every queued and running task has finished
+ *
+ * @param pool Thread pool. Safe to pass NULL.
+ */
+void thread_pool_wait(ThreadPool *pool)
+{
+	if (pool == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->outstanding > 0)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Runs a batch of tasks and waits for that batch only
+ *
+ * Calls fn once for each element of the args array. Unlike
+ * thread_pool_wait(), this only waits for the tasks it queued, so several
+ * threads can run batches on the same pool concurrently.
+ *
+ * @param pool Thread pool. If NULL, the tasks run on the calling thread.
+ * @param fn Function to run. Must not be NULL.
+ * @param args Array of count task arguments, each arg_size bytes.
+ * @param count Number of tasks.
+ * @param arg_size Size of one element of args in bytes.
+ *
+ * @return EXIT_SUCCESS on success, -1 on invalid parameters.
+ *
+ * @note Must not be called from a worker of the same pool: the caller blocks
+ *       a worker while waiting.
+ */
+int thread_pool_run(ThreadPool *pool, ThreadPoolTask fn, void *args, uint32_t count, size_t arg_size)
+{
+	if (fn == NULL || (args == NULL && count > 0))
+		return -1;
+
+	uint8_t *arg_bytes = args;
+	if (pool == NULL || pool->thread_count == 0) {
+		for (uint32_t i = 0; i < count; i++)
+			fn(arg_bytes + i * arg_size);
+		return EXIT_SUCCESS;
+	}
+
+	TaskBatch batch;
+	batch.pending = 0;
+	pthread_cond_init(&batch.done, NULL);
+
+	uint32_t queued = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (; queued < count; queued++) {
+		if (thread_pool_enqueue(pool, fn, arg_bytes + queued * arg_size, &batch) != 0)
+			break;
+		batch.pending++;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	// Tasks that could not be queued (out of memory) run here
+	for (uint32_t i = queued; i < count; i++)
+		fn(arg_bytes + i * arg_size);
+
+	pthread_mutex_lock(&pool->lock);
+	while (batch.pending > 0)
+		pthread_cond_wait(&batch.done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_cond_destroy(&batch.done);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Stops the worker threads and frees the pool
+ *
+ * Tasks already queued are run before the workers exit.
+ *
+ * @param pool Thread pool to free. Safe to pass NULL.
+ */
+void thread_pool_free(ThreadPool *pool)
+{
+	if (pool == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutting_down = 1;
+	pthread_cond_broadcast(&pool->work_ready);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (uint32_t i = 0; i < pool->thread_count; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work_ready);
+	pthread_cond_destroy(&pool->idle);
+	free(pool->threads);
+	free(pool);
+}
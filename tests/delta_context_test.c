@@ -0,0 +1,190 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "delta_structures.h"
+
+// Built with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc to count the engine's allocations
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+static int allocations = 0;
+
+void* __wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    allocations++;
+    return __real_realloc(pointer, size);
+}
+
+#define PAIR_COUNT 5
+
+static int failures = 0;
+
+static void check(int condition, const char* what) {
+    if (condition) {
+        printf("✓ %s\n", what);
+    } else {
+        printf("✗ %s\n", what);
+        failures++;
+    }
+}
+
+// Pseudo-random bytes that repeat for the same seed
+static void fill(uint8_t* data, uint32_t size, uint32_t seed) {
+    for (uint32_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+// Pairs of versions taking each of delta_create()'s three approaches
+typedef struct {
+    const char* name;
+    uint8_t* original;
+    uint32_t original_size;
+    uint8_t* changed;
+    uint32_t changed_size;
+} Pair;
+
+static void make_pairs(Pair* pairs) {
+    uint32_t size = 200000;
+
+    // Appended data
+    pairs[0].name = "appended data";
+    pairs[0].original = malloc(size);
+    fill(pairs[0].original, size, 1);
+    pairs[0].original_size = size;
+    pairs[0].changed = malloc(size + 300);
+    memcpy(pairs[0].changed, pairs[0].original, size);
+    fill(pairs[0].changed + size, 300, 2);
+    pairs[0].changed_size = size + 300;
+
+    // A change in the middle
+    pairs[1].name = "change in the middle";
+    pairs[1].original = pairs[0].original;
+    pairs[1].original_size = size;
+    pairs[1].changed = malloc(size);
+    memcpy(pairs[1].changed, pairs[0].original, size);
+    memset(pairs[1].changed + size / 2, 'Z', 64);
+    pairs[1].changed_size = size;
+
+    // Blocks moved around and a new tail: only the rolling hash finds the matches
+    pairs[2].name = "moved blocks";
+    pairs[2].original = pairs[0].original;
+    pairs[2].original_size = size;
+    pairs[2].changed = malloc(size);
+    for (uint32_t block = 0; block < 40; block++)
+        memcpy(pairs[2].changed + block * 4096, pairs[0].original + ((block * 7) % 48) * 4096, 4096);
+    fill(pairs[2].changed + 40 * 4096, size - 40 * 4096, 3);
+    pairs[2].changed_size = 40 * 4096 + 5000;
+
+    // A smaller original, so the next pair must clear what this one indexed
+    pairs[3].name = "smaller file";
+    pairs[3].original = malloc(50000);
+    fill(pairs[3].original, 50000, 4);
+    pairs[3].original_size = 50000;
+    pairs[3].changed = malloc(30000);
+    memcpy(pairs[3].changed, pairs[3].original + 20000, 30000);
+    pairs[3].changed_size = 30000;
+
+    // Few enough windows that the next search clears only the buckets they filled
+    pairs[4].name = "small file";
+    pairs[4].original = malloc(6000);
+    fill(pairs[4].original, 6000, 5);
+    pairs[4].original_size = 6000;
+    pairs[4].changed = malloc(5000);
+    memcpy(pairs[4].changed, pairs[4].original + 1000, 3000);
+    fill(pairs[4].changed + 3000, 2000, 6);
+    pairs[4].changed_size = 5000;
+}
+
+static int same_delta(const DeltaInfo* a, const DeltaInfo* b) {
+    if (a == NULL || b == NULL || a->operation_count != b->operation_count || a->new_size != b->new_size ||
+        a->delta_size != b->delta_size)
+        return 0;
+    for (uint32_t i = 0; i < a->operation_count; i++) {
+        const DeltaOperation* x = &a->operations[i];
+        const DeltaOperation* y = &b->operations[i];
+        if (x->type != y->type || x->offset != y->offset || x->length != y->length)
+            return 0;
+        if (x->type == DELTA_INSERT && memcmp(x->data, y->data, x->length) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+static int applies_to(const DeltaInfo* delta, const Pair* pair) {
+    uint8_t* output = malloc(pair->changed_size);
+    int ok = apply_delta(delta, pair->original, output, pair->changed_size) == (int)pair->changed_size &&
+             memcmp(output, pair->changed, pair->changed_size) == 0;
+    free(output);
+    return ok;
+}
+
+int main() {
+    printf("Delta Context Test Suite\n");
+    printf("========================\n\n");
+
+    Pair pairs[PAIR_COUNT];
+    make_pairs(pairs);
+
+    DeltaContext* context = delta_context_new();
+    if (context == NULL) {
+        printf("✗ Failed to create context\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < PAIR_COUNT; i++) {
+            char what[128];
+            DeltaInfo* expected = delta_create(pairs[i].original, pairs[i].original_size, pairs[i].changed,
+                                               pairs[i].changed_size);
+            const DeltaInfo* delta = delta_create_in(context, pairs[i].original, pairs[i].original_size,
+                                                     pairs[i].changed, pairs[i].changed_size);
+            snprintf(what, sizeof(what), "Round %d, %s: same delta as delta_create() and it applies",
+                     round + 1, pairs[i].name);
+            check(same_delta(delta, expected) && applies_to(delta, &pairs[i]), what);
+            delta_free(expected);
+        }
+    }
+
+    // Only the rolling hash search turns a file into more than three operations
+    const DeltaInfo* moved = delta_create_in(context, pairs[2].original, pairs[2].original_size,
+                                             pairs[2].changed, pairs[2].changed_size);
+    check(moved != NULL && moved->operation_count > 3, "Moved blocks are found by the rolling hash search");
+
+    // The context has now seen every size, so another round needs no memory
+    allocations = 0;
+    for (int i = 0; i < PAIR_COUNT; i++)
+        delta_create_in(context, pairs[i].original, pairs[i].original_size, pairs[i].changed,
+                        pairs[i].changed_size);
+    int steady = allocations;
+    char what[128];
+    snprintf(what, sizeof(what), "Diffing again with a warm context allocates nothing (%d allocations)", steady);
+    check(steady == 0, what);
+
+    delta_context_free(context);
+    for (int i = 0; i < PAIR_COUNT; i++)
+        free(pairs[i].changed);
+    free(pairs[0].original);
+    free(pairs[3].original);
+    free(pairs[4].original);
+
+    if (failures != 0) {
+        printf("\n%d delta context tests failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("\nAll delta context tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,263 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "fiver.h"
+
+#define THREAD_COUNT 4
+#define THREAD_VERSIONS 20
+
+static int failures = 0;
+
+static void check(int condition, const char* what) {
+    if (condition) {
+        printf("✓ %s\n", what);
+    } else {
+        printf("✗ %s\n", what);
+        failures++;
+    }
+}
+
+// Collects restored chunks into one buffer
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t chunks;
+    size_t stop_after;
+} Collected;
+
+static int collect(const uint8_t* data, size_t size, void* context) {
+    Collected* collected = context;
+    if (collected->stop_after != 0 && collected->chunks == collected->stop_after)
+        return 1;
+    uint8_t* grown = realloc(collected->data, collected->size + size);
+    if (grown == NULL)
+        return 1;
+    memcpy(grown + collected->size, data, size);
+    collected->data = grown;
+    collected->size += size;
+    collected->chunks++;
+    return 0;
+}
+
+static int log_messages = 0;
+
+static void count_message(const char* message, void* context) {
+    (void)context;
+    if (message[0] != '\0')
+        __atomic_add_fetch(&log_messages, 1, __ATOMIC_RELAXED);
+}
+
+void test_repository(const char* dir) {
+    printf("=== Repository Test ===\n");
+
+    FiverRepo* repo = NULL;
+    char missing[1024];
+    snprintf(missing, sizeof(missing), "%s/missing", dir);
+    check(fiver_open(missing, FIVER_OPEN_EXISTING, &repo) == FIVER_ERR_NO_REPO && repo == NULL,
+          "Opening a missing repository with FIVER_OPEN_EXISTING fails");
+    check(fiver_open(dir, FIVER_OPEN_NO_SYNC | FIVER_OPEN_STRICT, &repo) == FIVER_ERR_INVALID,
+          "Conflicting durability flags are rejected");
+
+    fiver_set_log(count_message, NULL);
+    snprintf(missing, sizeof(missing), "%s/no/such/parent", dir);
+    check(fiver_open(missing, 0, &repo) == FIVER_ERR_IO && log_messages > 0,
+          "A repository that cannot be created reports FIVER_ERR_IO and logs why");
+    fiver_set_log(NULL, NULL);
+
+    check(fiver_open(dir, 0, &repo) == FIVER_OK && repo != NULL, "Repository created");
+    fiver_close(repo);
+    check(fiver_open(dir, FIVER_OPEN_EXISTING | FIVER_OPEN_VERIFY, &repo) == FIVER_OK, "Repository reopened");
+    fiver_close(repo);
+}
+
+void test_track_and_restore(const char* dir) {
+    printf("=== Track and Restore Test ===\n");
+
+    FiverRepo* repo;
+    if (fiver_open(dir, FIVER_OPEN_VERIFY, &repo) != FIVER_OK) {
+        check(0, "Repository opened");
+        return;
+    }
+
+    const char* texts[] = { "first draft\n", "first draft\nsecond line\n", "second line only\n" };
+    const char* messages[] = { "Start", NULL, "Rewrite" };
+    uint32_t version = 0;
+    int stored = 0;
+    int ok = 1;
+    for (int i = 0; i < 3; i++) {
+        ok &= fiver_track(repo, "notes.txt", (const uint8_t*)texts[i], strlen(texts[i]), messages[i],
+                          &version, &stored) == FIVER_OK && version == (uint32_t)i + 1 && stored == 1;
+    }
+    check(ok, "Three versions tracked");
+
+    check(fiver_track(repo, "notes.txt", (const uint8_t*)texts[2], strlen(texts[2]), NULL, &version,
+                      &stored) == FIVER_OK && version == 3 && stored == 0,
+          "Unchanged contents are not stored again");
+    check(fiver_track(repo, "notes.txt", (const uint8_t*)"", 0, NULL, NULL, NULL) == FIVER_ERR_INVALID,
+          "Empty contents are rejected");
+    check(fiver_latest(repo, "notes.txt", &version) == FIVER_OK && version == 3, "Latest version is 3");
+    check(fiver_latest(repo, "unknown.txt", &version) == FIVER_ERR_NOT_TRACKED, "Unknown file is not tracked");
+
+    for (uint32_t v = 0; v <= 3; v++) {
+        uint8_t* data;
+        size_t size;
+        const char* expected = texts[v == 0 ? 2 : v - 1];
+        char what[64];
+        snprintf(what, sizeof(what), "Version %u restored into a buffer", v);
+        int status = fiver_restore(repo, "notes.txt", v, &data, &size);
+        check(status == FIVER_OK && size == strlen(expected) && memcmp(data, expected, size) == 0, what);
+        free(data);
+    }
+
+    uint8_t* data;
+    size_t size;
+    check(fiver_restore(repo, "notes.txt", 9, &data, &size) == FIVER_ERR_NO_VERSION && data == NULL,
+          "Missing version reports FIVER_ERR_NO_VERSION");
+    check(fiver_restore(repo, "unknown.txt", 1, &data, &size) == FIVER_ERR_NOT_TRACKED,
+          "Unknown file reports FIVER_ERR_NOT_TRACKED");
+
+    // Large enough to reach the sink in several chunks
+    size_t big_size = 300 * 1024 + 17;
+    uint8_t* big = malloc(big_size);
+    for (size_t i = 0; i < big_size; i++)
+        big[i] = (uint8_t)(i * 7 + i / 4096);
+    fiver_track(repo, "big.bin", big, big_size, NULL, NULL, NULL);
+    big[1000] ^= 0xff;
+    fiver_track(repo, "big.bin", big, big_size, NULL, NULL, NULL);
+
+    Collected collected = { 0 };
+    check(fiver_restore_to(repo, "big.bin", 2, collect, &collected) == FIVER_OK && collected.size == big_size &&
+          memcmp(collected.data, big, big_size) == 0 && collected.chunks > 1,
+          "Version restored into a sink chunk by chunk");
+    free(collected.data);
+
+    Collected stopped = { .stop_after = 2 };
+    check(fiver_restore_to(repo, "big.bin", 0, collect, &stopped) == FIVER_ERR_SINK && stopped.chunks == 2,
+          "A sink returning nonzero stops the restore");
+    free(stopped.data);
+    free(big);
+
+    check(fiver_commit(repo) == FIVER_OK, "Tracked versions committed");
+    fiver_close(repo);
+}
+
+void test_history(const char* dir) {
+    printf("=== History Test ===\n");
+
+    FiverRepo* repo;
+    if (fiver_open(dir, FIVER_OPEN_EXISTING, &repo) != FIVER_OK) {
+        check(0, "Repository opened");
+        return;
+    }
+
+    FiverHistory* history;
+    FiverVersionInfo info;
+    check(fiver_history_open(repo, "unknown.txt", &history) == FIVER_ERR_NOT_TRACKED && history == NULL,
+          "History of an unknown file reports FIVER_ERR_NOT_TRACKED");
+
+    if (fiver_history_open(repo, "notes.txt", &history) == FIVER_OK) {
+        const char* messages[] = { "Start", "", "Rewrite" };
+        uint32_t count = 0;
+        int ok = 1;
+        int status;
+        while ((status = fiver_history_next(history, &info)) == FIVER_OK) {
+            ok &= count < 3 && info.version == count + 1 && strcmp(info.message, messages[count]) == 0 &&
+                  info.timestamp > 0 && info.size > 0;
+            count++;
+        }
+        check(ok && count == 3 && status == FIVER_DONE, "History lists three versions with their messages");
+        fiver_history_close(history);
+    } else {
+        check(0, "History opened");
+    }
+
+    check(strcmp(fiver_strerror(FIVER_ERR_NO_VERSION), "Version does not exist") == 0,
+          "Status codes have descriptions");
+    fiver_close(repo);
+}
+
+// One thread's share of the concurrency test
+typedef struct {
+    FiverRepo* repo;
+    int id;
+    int ok;
+} Worker;
+
+static void* worker_run(void* arg) {
+    Worker* worker = arg;
+    char own[64];
+    char text[128];
+    snprintf(own, sizeof(own), "thread%d.txt", worker->id);
+    worker->ok = 1;
+
+    for (int v = 1; v <= THREAD_VERSIONS; v++) {
+        snprintf(text, sizeof(text), "thread %d writes version %d\n", worker->id, v);
+        uint32_t version;
+        worker->ok &= fiver_track(worker->repo, own, (const uint8_t*)text, strlen(text), NULL, &version,
+                                  NULL) == FIVER_OK && version == (uint32_t)v;
+
+        // Every thread also adds versions to one shared file
+        snprintf(text, sizeof(text), "shared file from thread %d, round %d\n", worker->id, v);
+        worker->ok &= fiver_track(worker->repo, "shared.txt", (const uint8_t*)text, strlen(text), NULL, NULL,
+                                  NULL) == FIVER_OK;
+
+        uint8_t* data;
+        size_t size;
+        snprintf(text, sizeof(text), "thread %d writes version %d\n", worker->id, v);
+        worker->ok &= fiver_restore(worker->repo, own, 0, &data, &size) == FIVER_OK && size == strlen(text) &&
+                      memcmp(data, text, size) == 0;
+        free(data);
+    }
+    return NULL;
+}
+
+void test_threads(const char* dir) {
+    printf("=== Concurrency Test ===\n");
+
+    FiverRepo* repo;
+    if (fiver_open(dir, 0, &repo) != FIVER_OK) {
+        check(0, "Repository opened");
+        return;
+    }
+
+    pthread_t threads[THREAD_COUNT];
+    Worker workers[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        workers[i] = (Worker){ .repo = repo, .id = i };
+        pthread_create(&threads[i], NULL, worker_run, &workers[i]);
+    }
+
+    int ok = 1;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+        ok &= workers[i].ok;
+    }
+    check(ok, "Threads sharing one handle track and restore their own files");
+
+    uint32_t latest;
+    check(fiver_latest(repo, "shared.txt", &latest) == FIVER_OK && latest == THREAD_COUNT * THREAD_VERSIONS,
+          "Versions of a file tracked from every thread are all stored");
+    fiver_close(repo);
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = argc > 1 ? argv[1] : "./libfiver_test_storage";
+
+    printf("Library Test Suite\n");
+    printf("==================\n\n");
+
+    test_repository(dir);
+    test_track_and_restore(dir);
+    test_history(dir);
+    test_threads(dir);
+
+    if (failures != 0) {
+        printf("\n%d library tests failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("\nAll library tests passed\n");
+    return EXIT_SUCCESS;
+}
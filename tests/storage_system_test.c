@@ -7,7 +7,7 @@
 StorageConfig* storage_init(const char* storage_dir);
 void storage_free(StorageConfig* config);
 int save_delta(StorageConfig* config, const char* filename, uint32_t version,
-               const DeltaInfo* delta, const uint8_t* original_data, const char* message);
+               const DeltaInfo* delta, const uint8_t* content_hash, const char* message);
 DeltaInfo* load_delta(StorageConfig* config, const char* filename, uint32_t version);
 int get_file_versions(StorageConfig* config, const char* filename,
                      uint32_t* versions, uint32_t max_versions);
@@ -56,9 +56,10 @@ void test_basic_storage() {
     printf("✓ Delta created\n");
     print_delta_info(delta);
 
-    // Save delta
-    int result = save_delta(config, "test_file.txt", 1, delta,
-                           (const uint8_t*)original_text, NULL);
+    // Save delta with the hash of the contents it produces
+    uint8_t content_hash[CONTENT_HASH_SIZE];
+    blake3_hash(new_text, new_size, content_hash, sizeof(content_hash));
+    int result = save_delta(config, "test_file.txt", 1, delta, content_hash, NULL);
 
     if (result == 0) {
         printf("✓ Delta saved successfully\n");
@@ -145,7 +146,7 @@ void test_version_management() {
                            (const uint8_t*)versions[i], strlen(versions[i]));
 
         if (delta != NULL) {
-            int result = save_delta(config, filename, i + 1, delta, original_data, NULL);
+            int result = save_delta(config, filename, i + 1, delta, NULL, NULL);
             if (result == 0) {
                 printf("✓ Version %d saved successfully\n", i + 1);
             } else {
@@ -214,7 +215,7 @@ void test_binary_storage() {
     }
 
     // Save delta
-    if (save_delta(config, "binary_test.bin", 1, delta, original_binary, NULL) == 0) {
+    if (save_delta(config, "binary_test.bin", 1, delta, NULL, NULL) == 0) {
         printf("✓ Binary delta saved successfully\n");
 
         // Load and apply delta
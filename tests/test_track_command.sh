@@ -84,11 +84,26 @@ check_file_exists() {
     fi
 }
 
+# Function to print the storage path of a tracked file's object
+# Objects are named after the 64-bit FNV-1a hash of the canonical path
+object_path() {
+    local name="$1"
+    local extension="$2"
+    local hash=$(( 0xcbf29ce484222325 ))
+    local i
+    for (( i = 0; i < ${#name}; i++ )); do
+        hash=$(( (hash ^ $(printf '%d' "'${name:i:1}")) * 0x100000001b3 ))
+    done
+    local key
+    key=$(printf '%016x' "$hash")
+    echo ".fiver/objects/${key:0:2}/${key:2:2}/${key}${extension}"
+}
+
 # Function to cleanup test files
 cleanup() {
     echo -e "${YELLOW}Cleaning up test files...${NC}"
-    rm -f test_file.txt empty_file.txt test_binary.bin large_test_file.bin file1.txt file2.txt "test file with spaces.txt" message_test.txt list1.txt list2.txt status_test.txt delta_test1.txt delta_test2.txt original_size_test.txt restore_test.txt output_test_v1.txt output_test_v2.txt output_test_json.txt existing_output.txt diff_test.txt hist.txt small_delta_test.txt
-    rm -rf .fiver
+    rm -f test_file.txt empty_file.txt test_binary.bin large_test_file.bin file1.txt file2.txt "test file with spaces.txt" message_test.txt list1.txt list2.txt status_test.txt delta_test1.txt delta_test2.txt original_size_test.txt restore_test.txt output_test_v1.txt output_test_v2.txt output_test_json.txt existing_output.txt diff_test.txt hist.txt small_delta_test.txt parallel_test.bin parallel_v1.bin parallel_v2.bin parallel_out_v1.bin parallel_out_v2.bin many_versions.txt many_versions_out.txt legacy.txt legacy_out.txt collide_x.txt collide_out.txt batch1.txt batch2.txt batch_out.txt lock_test.txt lock_other_*.txt verify_test.txt verify_out.txt stats_random.bin watch_out.txt serve_out.txt serve_test.txt serve_restored.txt libfiver_test delta_context_test stream_out.txt snapshot_test.bin snapshot_v1.bin snapshot_v2.bin snapshot_out.bin chain_test.bin chain_v*.bin chain_out.bin chain_cut.bin damaged.txt damaged_manifest.bak alias.txt 'quote"name.txt'
+    rm -rf .fiver catalog_files collide tree_test tree_restore export_test watch_test libfiver_test_storage
     echo "Cleanup complete"
     echo ""
 }
@@ -166,46 +181,57 @@ else
 fi
 
 # Test 10: Check storage files were created
-check_file_exists ".fiver/test_file.txt_v1.delta"
-check_file_exists ".fiver/test_file.txt_v1.meta"
+check_file_exists "$(object_path 'test_file.txt' .pack)"
+check_file_exists "$(object_path 'test_file.txt' .manifest)"
 
-# Test 11: Track same file again (version 2)
-run_test_with_output "Track same file (version 2)" "./fiver track test_file.txt" 0 "Tracked test_file.txt"
+# Test 11: Tracking unchanged contents stores nothing; changed contents become version 2
+run_test_with_output "Track unchanged file" "./fiver track test_file.txt" 0 "Unchanged test_file.txt (version 1)"
+echo "Hello again, fiver!" >> test_file.txt
+run_test_with_output "Track changed file (version 2)" "./fiver track test_file.txt" 0 "Tracked test_file.txt"
 
-# Test 12: Check version 2 files were created
-check_file_exists ".fiver/test_file.txt_v2.delta"
-check_file_exists ".fiver/test_file.txt_v2.meta"
+# Test 12: Check version 2 went into the pack, not into loose files
+run_test "No loose version files" "test ! -e .fiver/test_file.txt_v2.delta && test ! -e .fiver/test_file.txt_v2.meta" 0
 
 # Test 13: Track with verbose mode
+echo "Hello once more, fiver!" >> test_file.txt
 run_test_with_output "Track with verbose mode" "./fiver track --verbose test_file.txt" 0 "Read.*bytes from test_file.txt"
 
-# Test 14: Check version 3 files were created
-check_file_exists ".fiver/test_file.txt_v3.delta"
-check_file_exists ".fiver/test_file.txt_v3.meta"
+# Test 14: Check version 3 was recorded in the manifest
+run_test_with_output "Version 3 recorded" "./fiver status test_file.txt" 0 "Latest version: 3"
+
+# Test 14a: A file that is settled on disk is skipped after a stat, without being read;
+# same-size edits are still caught by the change time even when the mtime is put back
+touch -d '2020-01-01 00:00:00' test_file.txt
+run_test_with_output "Record state of settled file" "./fiver track test_file.txt" 0 "Unchanged test_file.txt (version 3)"
+run_test_with_output "Unchanged file is not read" "./fiver track --verbose test_file.txt | grep -c 'Read.*bytes' || true" 0 "^0$"
+sed -i 's/fiver!$/FIVER!/' test_file.txt
+touch -d '2020-01-01 00:00:00' test_file.txt
+run_test_with_output "Same-size edit with old mtime tracked" "./fiver track test_file.txt" 0 "Tracked test_file.txt"
+run_test_with_output "Same-size edit is version 4" "./fiver status test_file.txt" 0 "Latest version: 4"
 
 # Test 15: Track binary file
 dd if=/dev/urandom of=test_binary.bin bs=1024 count=1 > /dev/null 2>&1
 run_test_with_output "Track binary file" "./fiver track test_binary.bin" 0 "Tracked test_binary.bin"
 
 # Test 16: Check binary file storage
-check_file_exists ".fiver/test_binary.bin_v1.delta"
-check_file_exists ".fiver/test_binary.bin_v1.meta"
+check_file_exists "$(object_path 'test_binary.bin' .pack)"
+check_file_exists "$(object_path 'test_binary.bin' .manifest)"
 
 # Test 17: Track file with spaces in name
 echo "test content" > "test file with spaces.txt"
 run_test_with_output "Track file with spaces" "./fiver track 'test file with spaces.txt'" 0 "Tracked test file with spaces.txt"
 
 # Test 18: Check file with spaces storage
-check_file_exists ".fiver/test file with spaces.txt_v1.delta"
-check_file_exists ".fiver/test file with spaces.txt_v1.meta"
+check_file_exists "$(object_path 'test file with spaces.txt' .pack)"
+check_file_exists "$(object_path 'test file with spaces.txt' .manifest)"
 
 # Test 19: Track large file (1MB)
 dd if=/dev/urandom of=large_test_file.bin bs=1M count=1 > /dev/null 2>&1
 run_test_with_output "Track large file" "./fiver track large_test_file.bin" 0 "Tracked large_test_file.bin"
 
 # Test 20: Check large file storage
-check_file_exists ".fiver/large_test_file.bin_v1.delta"
-check_file_exists ".fiver/large_test_file.bin_v1.meta"
+check_file_exists "$(object_path 'large_test_file.bin' .pack)"
+check_file_exists "$(object_path 'large_test_file.bin' .manifest)"
 
 # Test 21: Multiple files tracking
 echo "file1 content" > file1.txt
@@ -213,8 +239,8 @@ echo "file2 content" > file2.txt
 run_test_with_output "Track multiple files" "./fiver track file1.txt && ./fiver track file2.txt" 0 "Tracked"
 
 # Test 22: Check multiple files storage
-check_file_exists ".fiver/file1.txt_v1.delta"
-check_file_exists ".fiver/file2.txt_v1.delta"
+check_file_exists "$(object_path file1.txt .pack)"
+check_file_exists "$(object_path file2.txt .pack)"
 
 # Test 23: Invalid command
 run_test_with_output "Invalid command" "./fiver invalid_command" 1 "Unknown command"
@@ -320,9 +346,27 @@ run_test_with_output "List with sizes" "./fiver list --show-sizes" 0 "TotalDelta
 # Test 47: List json format
 run_test_with_output "List json" "./fiver list --format json" 0 "\"files\""
 
+# Test 47a: Names are escaped in JSON output
+echo "quoted" > 'quote"name.txt'
+./fiver track 'quote"name.txt' > /dev/null 2>&1
+run_test_with_output "List json escapes names" "./fiver list --format json" 0 '"name": "quote\\"name.txt"'
+
 # Test 48: List unknown option
 run_test_with_output "List unknown option" "./fiver list --bogus" 1 "Unknown option"
 
+# Test 48a: Tracking keeps the catalog up to date
+run_test "Catalog created" "test -f .fiver/catalog" 0
+run_test_with_output "Catalog counts versions" "./fiver list --format json" 0 "\"name\": \"list2.txt\", \"versions\": 2, \"latest\": 2"
+
+# Test 48b: The catalog grows past its initial size
+mkdir -p catalog_files
+for i in $(seq 1 70); do echo "catalog $i" > catalog_files/f$i.txt; ./fiver track catalog_files/f$i.txt > /dev/null 2>&1; done
+run_test_with_output "Catalog grows" "./fiver list | grep -c 'catalog_files/f'" 0 "^70$"
+
+# Test 48c: A missing catalog is rebuilt from the manifests
+rm -f .fiver/catalog
+run_test_with_output "Catalog rebuilt" "./fiver list --format json" 0 "\"name\": \"list2.txt\", \"versions\": 2, \"latest\": 2"
+
 # Status command tests
 # Test 49: Status help
 run_test_with_output "Status help" "./fiver status --help" 0 "Usage: fiver status"
@@ -346,6 +390,17 @@ run_test_with_output "Status json" "./fiver status status_test.txt --json" 0 "\"
 # Test 54: Status unknown option
 run_test_with_output "Status unknown option" "./fiver status status_test.txt --bogus" 1 "Unknown option"
 
+# Test 54a: Up-to-date detection by stat, by size and by content hash
+run_test_with_output "Status up to date by hash" "./fiver status status_test.txt" 0 "Up to date: yes"
+run_test_with_output "Status json up to date" "./fiver status status_test.txt --json" 0 "\"is_up_to_date\": true"
+touch -d '2020-01-01 00:00:00' status_test.txt
+./fiver track status_test.txt > /dev/null 2>&1
+run_test_with_output "Status up to date by stat" "./fiver status status_test.txt" 0 "Up to date: yes"
+echo "status content, edited" > status_test.txt
+run_test_with_output "Status modified by size" "./fiver status status_test.txt" 0 "Up to date: no (modified since version 1)"
+echo "STATUS CONTENT" > status_test.txt
+run_test_with_output "Status modified by hash" "./fiver status status_test.txt --json" 0 "\"is_up_to_date\": false"
+
 # Delta algorithm fixes tests
 # Test 55: Verify new_size calculation for first version
 echo "First version content" > delta_test1.txt
@@ -446,6 +501,304 @@ run_test_with_output "Output to existing file" "./fiver restore restore_test.txt
 # Test 78: Verify existing file was overwritten
 run_test_with_output "Verify existing file overwritten" "cat existing_output.txt" 0 "Restore test v1"
 
+# Test 78h: Restore of a large file uses the parallel delta application path
+dd if=/dev/urandom of=parallel_test.bin bs=1M count=6 > /dev/null 2>&1
+cp parallel_test.bin parallel_v1.bin
+run_test_with_output "Track large file for parallel restore" "./fiver track parallel_test.bin" 0 "Tracked parallel_test.bin"
+printf 'patched' | dd of=parallel_test.bin bs=1 seek=3000000 conv=notrunc > /dev/null 2>&1
+cp parallel_test.bin parallel_v2.bin
+run_test_with_output "Track large file v2 for parallel restore" "./fiver track parallel_test.bin" 0 "Tracked parallel_test.bin"
+run_test "Parallel restore v1" "./fiver restore parallel_test.bin --version 1 --output parallel_out_v1.bin && cmp parallel_out_v1.bin parallel_v1.bin" 0
+run_test "Parallel restore v2" "./fiver restore parallel_test.bin --version 2 --output parallel_out_v2.bin && cmp parallel_out_v2.bin parallel_v2.bin" 0
+
+# Test 78h2: Version 2 is restored from the version 1 snapshot with copy_file_range,
+# its COPY runs moved out of the snapshot around an insertion, a deletion and an append
+dd if=/dev/urandom of=snapshot_test.bin bs=64K count=40 > /dev/null 2>&1
+cp snapshot_test.bin snapshot_v1.bin
+run_test "Track snapshot base" "./fiver track snapshot_test.bin" 0
+{ head -c 700000 snapshot_v1.bin; printf 'inserted in the middle'; tail -c +700001 snapshot_v1.bin | head -c 1000000; tail -c +1800001 snapshot_v1.bin | tail -c +4097; printf 'appended'; } > snapshot_test.bin
+cp snapshot_test.bin snapshot_v2.bin
+run_test "Track version 2 over the snapshot" "./fiver track snapshot_test.bin" 0
+run_test "Snapshot restore of version 2 is byte-for-byte" "./fiver restore snapshot_test.bin --version 2 --output snapshot_out.bin --force && cmp snapshot_out.bin snapshot_v2.bin" 0
+run_test "Snapshot restore of version 1 is byte-for-byte" "./fiver restore snapshot_test.bin --version 1 --output snapshot_out.bin --force && cmp snapshot_out.bin snapshot_v1.bin" 0
+
+# Test 78i: Forced restore over an existing file keeps its permissions and leaves no temporary file behind
+chmod 640 parallel_out_v1.bin
+run_test "Restore keeps permissions" "./fiver restore parallel_test.bin --version 2 --output parallel_out_v1.bin --force && cmp parallel_out_v1.bin parallel_v2.bin && [ \"\$(stat -c %a parallel_out_v1.bin)\" = 640 ] && ! ls -a | grep -q fiver-" 0
+
+# Test 78j: More than 100 versions of one file
+for i in $(seq 1 105); do echo "manifest version $i" > many_versions.txt; ./fiver track many_versions.txt > /dev/null 2>&1; done
+run_test_with_output "Track past 100 versions" "./fiver status many_versions.txt" 0 "Latest version: 105"
+run_test_with_output "Restore version past 100" "./fiver restore many_versions.txt --version 103 --output many_versions_out.txt && cat many_versions_out.txt" 0 "manifest version 103"
+
+# Test 78j2: Restores down a long chain load each next delta on the prefetch thread
+# while the current one is applied; every version must come back byte-for-byte
+dd if=/dev/urandom of=chain_test.bin bs=64K count=16 > /dev/null 2>&1
+for i in $(seq 1 24); do
+    printf 'edit %02d' "$i" | dd of=chain_test.bin bs=1 seek=$(( i * 40000 )) conv=notrunc > /dev/null 2>&1
+    if [ $(( i % 5 )) -eq 0 ]; then printf 'grown by version %d' "$i" >> chain_test.bin; fi
+    if [ $(( i % 7 )) -eq 0 ]; then head -c -3000 chain_test.bin > chain_cut.bin && mv chain_cut.bin chain_test.bin; fi
+    cp chain_test.bin "chain_v$i.bin"
+    ./fiver track chain_test.bin > /dev/null 2>&1
+done
+run_test_with_output "Track a long chain" "./fiver status chain_test.bin" 0 "Latest version: 24"
+run_test "Long chain restores are byte-for-byte" "for v in 3 4 11 17 24; do ./fiver restore chain_test.bin --version \$v --output chain_out.bin --force && cmp chain_out.bin chain_v\$v.bin || exit 1; done" 0
+run_test "Long chain streams are byte-for-byte" "./fiver restore chain_test.bin --version 23 --output - | cmp - chain_v23.bin" 0
+
+# Test 78l: Manifests have a versioned header and keep messages in a separate heap
+echo "heap message" >> many_versions.txt
+./fiver track many_versions.txt -m "stored in the heap" > /dev/null 2>&1
+run_test_with_output "Manifest header" "head -c 4 \"\$(object_path many_versions.txt .manifest)\"" 0 "^FVMN$"
+run_test_with_output "History reads messages from the heap" "./fiver history many_versions.txt --format json --limit 1" 0 "\"version\": 106.*\"message\": \"stored in the heap\""
+run_test_with_output "History limit" "./fiver history many_versions.txt --format brief --limit 3 | wc -l" 0 "^3$"
+
+# Test 78m: Objects are keyed by the canonical path, so names that flatten alike do not collide
+mkdir -p collide
+echo "nested file" > collide/x.txt
+echo "flat file" > collide_x.txt
+./fiver track ./collide//x.txt > /dev/null 2>&1
+./fiver track collide_x.txt > /dev/null 2>&1
+run_test_with_output "Nested and flat names stored apart" "./fiver restore collide/x.txt --version 1 --output collide_out.txt --force && cat collide_out.txt" 0 "^nested file$"
+run_test_with_output "Flat name keeps its own versions" "./fiver restore collide_x.txt --version 1 --output collide_out.txt --force && cat collide_out.txt" 0 "^flat file$"
+run_test "Object sharded by path hash" "test -f \"\$(object_path collide/x.txt .manifest)\"" 0
+
+# Test 78n: Several files tracked in one batch, durability levels, and recovery from a torn append
+echo "batch one" > batch1.txt
+echo "batch two" > batch2.txt
+run_test_with_output "Track several files in one batch" "./fiver track batch1.txt batch2.txt" 0 "2 files: 2 stored, 0 unchanged, 0 failed"
+run_test_with_output "Batch reports failed files" "./fiver track batch1.txt missing_batch.txt" 1 "Failed to track 1 of 2 files"
+echo "batch one strict" > batch1.txt
+run_test "Track with strict durability" "./fiver track batch1.txt --durability strict" 0
+run_test_with_output "Unknown durability level" "./fiver track batch1.txt --durability sometimes" 1 "none, batch or strict"
+printf 'torn' >> "$(object_path batch1.txt .manifest)"
+echo "batch one after crash" > batch1.txt
+./fiver track batch1.txt --durability none > /dev/null 2>&1
+run_test_with_output "Append after a torn record" "./fiver history batch1.txt --format brief --limit 1" 0 "^v3:"
+run_test_with_output "Restore after a torn record" "./fiver restore batch1.txt --output batch_out.txt --force && cat batch_out.txt" 0 "^batch one after crash$"
+
+# Test 78n2: A manifest record whose pack bytes never reached the disk is cut off by the next track
+echo "batch one lost" > batch1.txt
+./fiver track batch1.txt > /dev/null 2>&1
+truncate -s -2 "$(object_path batch1.txt .pack)"
+echo "batch one recovered" > batch1.txt
+run_test_with_output "Track drops a record past the pack end" "./fiver track batch1.txt" 0 "Dropping version 4"
+run_test_with_output "Uncommitted version replaced" "./fiver restore batch1.txt --version 4 --output batch_out.txt --force && cat batch_out.txt" 0 "^batch one recovered$"
+echo "batch one garbled" > batch1.txt
+./fiver track batch1.txt > /dev/null 2>&1
+pack_file="$(object_path batch1.txt .pack)"
+printf 'X' | dd of="$pack_file" bs=1 seek=$(( $(stat -c %s "$pack_file") - 1 )) conv=notrunc > /dev/null 2>&1
+echo "batch one final" > batch1.txt
+run_test_with_output "Track drops a record failing its checksum" "./fiver track batch1.txt" 0 "Dropping version 5"
+run_test_with_output "Catalog rebuilt after recovery" "./fiver list | grep batch1.txt" 0 "batch1.txt *5 *5"
+run_test "Earlier versions intact after recovery" "./fiver fsck batch1.txt && ./fiver restore batch1.txt --version 3 --output batch_out.txt --force && grep -q 'batch one after crash' batch_out.txt" 0
+
+# Test 78n3: A manifest that lost its header or records is reported, never replaced
+for i in 1 2 3; do echo "damaged $i" > damaged.txt; ./fiver track damaged.txt > /dev/null 2>&1; done
+manifest_file="$(object_path damaged.txt .manifest)"
+cp "$manifest_file" damaged_manifest.bak
+: > "$manifest_file"
+run_test_with_output "Empty manifest reported as damaged" "./fiver history damaged.txt" 1 "damaged"
+run_test "Track refuses a damaged manifest" "./fiver track damaged.txt --message retry" 1
+run_test "Damaged manifest left alone" "test ! -s \"$manifest_file\"" 0
+run_test_with_output "Fsck reports the damaged manifest" "./fiver fsck damaged.txt" 1 "damaged.txt"
+cp damaged_manifest.bak "$manifest_file"
+truncate -s -80 "$manifest_file"
+run_test_with_output "Fsck reports a manifest covering less than its pack" "./fiver fsck damaged.txt" 1 "version 3: the pack stores this version but the manifest ends at version 2"
+cp damaged_manifest.bak "$manifest_file"
+run_test "Fsck accepts the restored manifest" "./fiver fsck damaged.txt" 0
+
+# Test 78n4: Objects are named by a hash of the path; a manifest recording another path is
+# never used, as if the two paths collided
+echo "alias" > alias.txt
+alias_manifest="$(object_path alias.txt .manifest)"
+mkdir -p "$(dirname "$alias_manifest")"
+cp "$manifest_file" "$alias_manifest"
+run_test_with_output "History refuses another file's manifest" "./fiver history alias.txt" 1 "belong to 'damaged.txt'"
+run_test "Track refuses another file's manifest" "./fiver track alias.txt" 1
+rm -f "$alias_manifest"
+long_dir="long_path_$(printf 'a%.0s' $(seq 1 100))/$(printf 'b%.0s' $(seq 1 100))"
+mkdir -p "$long_dir"
+echo "long" > "$long_dir/$(printf 'c%.0s' $(seq 1 60)).txt"
+run_test_with_output "Paths of 256 bytes or more are not tracked" "./fiver track $long_dir/*.txt" 1 "too long"
+rm -rf long_path_*
+
+# Test 78o: Concurrent tracks of one file are serialized, so unchanged contents are stored
+# once; other files proceed in parallel
+echo "locked content" > lock_test.txt
+for i in $(seq 1 8); do ./fiver track lock_test.txt > /dev/null 2>&1 & done
+for i in $(seq 1 4); do echo "parallel $i" > "lock_other_$i.txt"; ./fiver track "lock_other_$i.txt" > /dev/null 2>&1 & done
+wait
+run_test_with_output "Concurrent tracks serialized" "./fiver history lock_test.txt --format brief | wc -l" 0 "^1$"
+run_test_with_output "Concurrent catalog updates" "./fiver list | grep -c 'lock_'" 0 "^5$"
+
+# Test 78p: --verify checks restored versions against their content hash. The first
+# literal byte of version 1 sits after the pack record header (12 bytes) and
+# the operation header (12 bytes).
+echo "verified content" > verify_test.txt
+./fiver track verify_test.txt > /dev/null 2>&1
+echo "verified content, second version" > verify_test.txt
+./fiver track verify_test.txt > /dev/null 2>&1
+run_test_with_output "Verified restore of intact versions" "./fiver restore verify_test.txt --version 2 --output verify_out.txt --force --verify && cat verify_out.txt" 0 "^verified content, second version$"
+printf 'V' | dd of="$(object_path verify_test.txt .pack)" bs=1 seek=24 conv=notrunc 2> /dev/null
+run_test_with_output "Verified restore detects corruption" "./fiver restore verify_test.txt --version 1 --output verify_out.txt --force --verify" 1 "is corrupt"
+run_test_with_output "Corrupt version not written" "cat verify_out.txt" 0 "^verified content, second version$"
+run_test_with_output "Unverified restore skips the check" "./fiver restore verify_test.txt --version 1 --output verify_out.txt --force && cat verify_out.txt" 0 "^Verified content$"
+
+# Test 78t: fsck checks every stored version of every file down its chain
+run_test_with_output "Fsck intact file" "./fiver fsck restore_test.txt" 0 "Checked 1 files, 3 versions: no problems found"
+run_test_with_output "Fsck finds the corrupt delta" "./fiver fsck verify_test.txt" 1 "verify_test.txt: version 1: the stored delta does not match its checksum"
+run_test_with_output "Fsck whole storage in parallel" "./fiver fsck --jobs 4" 1 "^fiver: error: 1 of [0-9]* files are damaged"
+run_test_with_output "Fsck JSON lines" "./fiver fsck verify_test.txt restore_test.txt --json" 1 '"status": "damaged", "versions_checked": 0, "version": 1'
+run_test_with_output "Fsck untracked file" "./fiver fsck untracked_fsck.txt" 1 "the file is not tracked"
+
+# Test 78q: Recursive tracks walk directories on a worker pool, filtered by globs
+mkdir -p tree_test/sub/deep tree_test/skip tree_test/.fiver
+echo "top" > tree_test/a.conf
+echo "sub" > tree_test/sub/b.conf
+echo "deep" > tree_test/sub/deep/c.conf
+echo "backup" > tree_test/sub/b.conf.bak
+echo "skipped" > tree_test/skip/d.conf
+echo "storage" > tree_test/.fiver/e.conf
+run_test_with_output "Directory needs --recursive" "./fiver track tree_test" 1 "is a directory (use --recursive)"
+run_test_with_output "Recursive track with globs" "./fiver track tree_test/ -r --jobs 4 --include '*.conf' --exclude skip" 0 "3 files: 3 stored, 0 unchanged, 0 failed"
+run_test_with_output "Excluded directory not tracked" "./fiver list | grep -c 'tree_test/'" 0 "^3$"
+echo "deep, changed" > tree_test/sub/deep/c.conf
+run_test_with_output "Recursive retrack stores only changes" "./fiver track tree_test --recursive --include '*.conf' --exclude skip" 0 "3 files: 1 stored, 2 unchanged, 0 failed"
+run_test_with_output "JSON lines per file" "./fiver track tree_test -r -j 2 --include '*.conf' --exclude skip --json | head -1" 0 '^{"file": "tree_test/a.conf", "status": "unchanged", "version": 1, "bytes": 4}$'
+run_test_with_output "JSON lines carry only results" "./fiver track tree_test -r --exclude '*.conf' --json missing_tree.txt | grep -vc '^{' || true" 0 "^0$"
+run_test_with_output "Path globs match the whole path" "./fiver track tree_test -r --include 'tree_test/sub/*' --json | wc -l" 0 "^2$"
+run_test_with_output "Invalid job count" "./fiver track tree_test -r --jobs 0" 1 "jobs requires a number"
+run_test_with_output "Unknown track option" "./fiver track tree_test --bogus" 1 "Unknown option"
+
+# Test 78r: Whole-tree restores pick each file's version in parallel
+run_test_with_output "Restore all needs an output dir" "./fiver restore --all" 1 "requires --output-dir"
+run_test_with_output "Restore tree at latest versions" "./fiver restore --all --include 'tree_test/*' --include 'tree_test/*/*' --include 'tree_test/*/*/*' --output-dir tree_restore --jobs 4" 0 "4 files: 4 restored, 0 skipped, 0 failed"
+run_test_with_output "Restored tree matches" "diff -r tree_test/sub/deep tree_restore/tree_test/sub/deep && cat tree_restore/tree_test/sub/deep/c.conf" 0 "^deep, changed$"
+run_test_with_output "Restore all keeps existing files" "./fiver restore --all --include 'tree_test/*' --include 'tree_test/*/*' --include 'tree_test/*/*/*' --output-dir tree_restore" 1 "already exists"
+run_test_with_output "Restore before the first version" "./fiver restore --all --include 'tree_test/*' --include 'tree_test/*/*' --include 'tree_test/*/*/*' --at 0 --output-dir tree_restore" 0 "4 files: 0 restored, 4 skipped, 0 failed"
+run_test_with_output "Restore at a time" "./fiver restore --all --include 'tree_test/*' --include 'tree_test/*/*' --include 'tree_test/*/*/*' --at \"\$(date '+%Y-%m-%d %H:%M:%S')\" --output-dir tree_restore --force --json | grep -c '\"restored\"'" 0 "^4$"
+printf '# file version\ntree_test/sub/deep/c.conf 1\n' > tree_restore/map
+run_test_with_output "Restore from a version map" "./fiver restore --all --version-map tree_restore/map --output-dir tree_restore/mapped && cat tree_restore/mapped/tree_test/sub/deep/c.conf" 0 "^deep$"
+run_test_with_output "Invalid restore time" "./fiver restore --all --at yesterday --output-dir tree_restore" 1 "at requires seconds"
+
+# Test 78k: Storage written before packs and manifests is imported by the first
+# track, under the file's writer lock, and moved into a pack by migrate. The .delta file is cut out of a one-record
+# pack after its PackRecordHeader (12 bytes); the 600-byte FileMetadata names
+# the file, version 1, a 15-byte delta and one operation.
+echo "legacy content" > legacy.txt
+./fiver track legacy.txt > /dev/null 2>&1
+{ printf 'legacy.txt'; head -c 246 /dev/zero; printf '\001\000\000\000\000\000\000\000\017\000\000\000\001\000\000\000'; head -c 328 /dev/zero; } > .fiver/legacy.txt_v1.meta
+tail -c +13 "$(object_path legacy.txt .pack)" > .fiver/legacy.txt_v1.delta
+rm -f "$(object_path legacy.txt .pack)" "$(object_path legacy.txt .manifest)"
+run_test "Readers do not import legacy versions" "! ./fiver history legacy.txt && test ! -e \"\$(object_path legacy.txt .manifest)\"" 0
+echo "legacy content v2" > legacy.txt
+run_test_with_output "Track on top of legacy versions" "./fiver track legacy.txt" 0 "Tracked legacy.txt"
+run_test_with_output "Import legacy versions" "./fiver history legacy.txt --format brief | tail -1" 0 "^v1:"
+run_test "Manifest recreated" "test -f \"\$(object_path legacy.txt .manifest)\"" 0
+run_test_with_output "Catalog counts imported versions" "./fiver list | grep legacy.txt" 0 "legacy.txt *2 *2"
+run_test_with_output "Migrate loose versions" "./fiver migrate" 0 "Migrated 1 versions of 1 files"
+run_test "Loose files removed" "test ! -e .fiver/legacy.txt_v1.delta && test ! -e .fiver/legacy.txt_v1.meta" 0
+run_test_with_output "Restore migrated version" "./fiver restore legacy.txt --version 1 --output legacy_out.txt --force && cat legacy_out.txt" 0 "^legacy content$"
+run_test_with_output "Migrate is idempotent" "./fiver migrate --json" 0 "\"versions_migrated\": 0"
+
+# Test 78s: Export writes every version from one walk over the delta chain
+run_test_with_output "Export needs --all-versions" "./fiver export restore_test.txt --output-dir export_test" 1 "requires --all-versions and --output-dir"
+run_test_with_output "Export all versions" "./fiver export restore_test.txt --all-versions --output-dir export_test" 0 "Exported 3 versions of restore_test.txt"
+run_test "Exported versions match" "./fiver cat restore_test.txt --version 1 | cmp - export_test/restore_test.txt.v1 && ./fiver cat restore_test.txt --version 2 | cmp - export_test/restore_test.txt.v2 && ./fiver cat restore_test.txt --version 3 | cmp - export_test/restore_test.txt.v3" 0
+run_test_with_output "Export keeps existing files" "./fiver export restore_test.txt --all-versions --output-dir export_test" 1 "already exists"
+run_test_with_output "Export with --force and JSON" "./fiver export restore_test.txt --all-versions --output-dir export_test --force --json" 0 '"versions_exported": 3'
+
+# Test 78u: Stats summarize chains from the manifests alone
+head -c 4096 /dev/urandom > stats_random.bin
+./fiver track stats_random.bin > /dev/null 2>&1
+head -c 4096 /dev/urandom > stats_random.bin
+./fiver track stats_random.bin > /dev/null 2>&1
+run_test_with_output "Stats of one file" "./fiver stats restore_test.txt" 0 "^restore_test.txt  *3 "
+run_test_with_output "Stats flag poor candidates" "./fiver stats stats_random.bin restore_test.txt" 0 "stats_random.bin: mean delta ratio 100.0%"
+run_test_with_output "Stats rank insert-heavy versions" "./fiver stats stats_random.bin --top 1" 0 "stats_random.bin v2: 4096 of 4096 bytes inserted"
+run_test_with_output "Stats JSON" "./fiver stats stats_random.bin --json" 0 '"poor_candidate": true'
+run_test_with_output "Stats of every file" "./fiver stats" 0 "^Totals: [0-9]* files"
+run_test_with_output "Stats of an untracked file" "./fiver stats untracked_stats.txt" 1 "No versions found"
+
+# Test 78v: Watch tracks closed writes and renames, and directories created while running
+mkdir -p watch_test
+echo "watched v1" > watch_test/a.txt
+./fiver watch watch_test --recursive --exclude "*.tmp" --debounce 50 > watch_out.txt 2>&1 &
+WATCH_PID=$!
+sleep 0.5
+echo "watched v2" > watch_test/a.txt
+sleep 0.3
+echo "watched v3" > watch_test/a.txt
+echo "scratch" > watch_test/b.tmp
+mkdir watch_test/sub
+echo "renamed in" > watch_test/new.part
+mv watch_test/new.part watch_test/sub/c.txt
+sleep 0.5
+kill -INT $WATCH_PID
+wait $WATCH_PID
+WATCH_EXIT=$?
+run_test_with_output "Watch stops cleanly" "echo $WATCH_EXIT" 0 "^0$"
+run_test_with_output "Watch reports tracked files" "cat watch_out.txt" 0 "Tracked watch_test/a.txt as version 2"
+run_test_with_output "Watch tracks each burst" "./fiver cat watch_test/a.txt --version 2" 0 "^watched v3$"
+run_test_with_output "Watch tracks files renamed into new directories" "./fiver cat watch_test/sub/c.txt" 0 "^renamed in$"
+run_test_with_output "Watch skips excluded files" "./fiver cat watch_test/b.tmp" 1 "No versions found"
+run_test_with_output "Watch requires recursive for directories" "./fiver watch watch_test" 1 "is a directory"
+run_test_with_output "Watch rejects a bad debounce" "./fiver watch watch_test -r --debounce x" 1 "debounce requires milliseconds"
+
+# Test 78w: Commands are forwarded to a running server with unchanged output
+echo "served v1" > serve_test.txt
+./fiver serve --jobs 2 --verbose > serve_out.txt 2>&1 &
+SERVE_PID=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do [ -S .fiver/serve.sock ] && break; sleep 0.1; done
+run_test_with_output "Served track" "./fiver track serve_test.txt" 0 "Tracked serve_test.txt"
+echo "served v2" > serve_test.txt
+run_test_with_output "Served track with message" "./fiver track serve_test.txt -m 'from client'" 0 "Tracked serve_test.txt"
+run_test_with_output "Served history" "./fiver history serve_test.txt" 0 "from client"
+run_test_with_output "Served status" "./fiver status serve_test.txt" 0 "Up to date: yes"
+run_test_with_output "Served cat" "./fiver cat serve_test.txt --version 1" 0 "^served v1$"
+run_test_with_output "Served restore" "./fiver restore serve_test.txt --version 1 --output serve_restored.txt && cat serve_restored.txt" 0 "^served v1$"
+run_test_with_output "Served errors keep their exit status" "./fiver restore serve_test.txt" 1 "already exists"
+run_test_with_output "Server refuses a second server" "./fiver serve" 1 "already listening"
+kill -TERM $SERVE_PID
+wait $SERVE_PID
+run_test_with_output "Server ran the requests" "cat serve_out.txt" 0 "track serve_test.txt: exit 0"
+run_test "Server removes its socket" "test ! -e .fiver/serve.sock" 0
+
+# Test 78x: Programs using libfiver track, restore and list versions, also from several threads
+run_test_with_output "Library API" "gcc -std=c99 -Iinclude -o libfiver_test tests/libfiver_test.c libfiver.a -pthread && ./libfiver_test libfiver_test_storage" 0 "All library tests passed"
+
+# Test 78y: A reused delta context builds the same deltas as delta_create() and stops allocating once warm
+run_test_with_output "Delta context reuse" "gcc -std=c99 -Iinclude -o delta_context_test tests/delta_context_test.c libfiver.a -pthread -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc && ./delta_context_test" 0 "All delta context tests passed"
+
+# Test 78z: "--output -" streams a version to stdout a chunk at a time, down the whole delta chain
+run_test "Streamed restore of a large file" "./fiver restore parallel_test.bin --version 2 --output - | cmp - parallel_v2.bin && ./fiver restore parallel_test.bin --version 1 --output - | cmp - parallel_v1.bin" 0
+run_test_with_output "Streamed restore through a delta chain" "./fiver cat restore_test.txt --version 3 > stream_out.txt && ./fiver restore restore_test.txt --version 3 --output - | cmp - stream_out.txt && echo identical" 0 "^identical$"
+run_test_with_output "Streamed restore carries only the contents" "./fiver restore restore_test.txt --version 1 --output - --verbose 2> /dev/null" 0 "^Restore test v1$"
+run_test_with_output "Streamed restore rejects JSON" "./fiver restore restore_test.txt --output - --json" 1 "cannot be combined"
+run_test_with_output "Streamed restore detects corruption" "./fiver restore verify_test.txt --version 1 --output - --verify > /dev/null" 1 "is corrupt"
+
+# Cat command tests
+# Test 78a: Cat help
+run_test_with_output "Cat help" "./fiver cat --help" 0 "Usage: fiver cat"
+
+# Test 78b: Cat missing file
+run_test_with_output "Cat missing file" "./fiver cat" 1 "missing file argument"
+
+# Test 78c: Cat no versions
+run_test_with_output "Cat no versions" "./fiver cat untracked_cat.txt" 1 "No versions found"
+
+# Test 78d: Cat whole version
+run_test_with_output "Cat version 1" "./fiver cat restore_test.txt --version 1" 0 "Restore test v1"
+
+# Test 78e: Cat byte range resolved through the delta chain
+run_test_with_output "Cat range" "./fiver cat restore_test.txt --version 2 --range 8:7" 0 "^test v2$"
+
+# Test 78f: Cat invalid range
+run_test_with_output "Cat invalid range" "./fiver cat restore_test.txt --range abc" 1 "Invalid range"
+
+# Test 78g: Cat range past the end of the version
+run_test_with_output "Cat range past end" "./fiver cat restore_test.txt --range 100000:1" 1 "past the end"
+
 # Small delta tests for end-of-file changes
 # Test 79: Small change at end of file should produce small delta
 echo "This is a test file with some content that we will modify at the end" > small_delta_test.txt
@@ -464,9 +817,11 @@ echo "test content" > message_test.txt
 run_test_with_output "Track with message" "./fiver track message_test.txt --message 'Test message'" 0 "Tracked message_test.txt"
 
 # Test 27: Track with short message flag
+echo "more test content" >> message_test.txt
 run_test_with_output "Track with short message flag" "./fiver track message_test.txt -m 'Short flag test'" 0 "Tracked message_test.txt"
 
 # Test 28: Track without message (should work)
+echo "even more test content" >> message_test.txt
 run_test_with_output "Track without message" "./fiver track message_test.txt" 0 "Tracked message_test.txt"
 
 # Test 29: Message flag without value
@@ -489,12 +844,12 @@ if [ -d ".fiver" ]; then
     echo ""
 
     # Count files
-    delta_files=$(find .fiver -name "*.delta" | wc -l)
-    meta_files=$(find .fiver -name "*.meta" | wc -l)
+    pack_files=$(find .fiver -name "*.pack" | wc -l)
+    manifest_files=$(find .fiver -name "*.manifest" | wc -l)
 
-    echo "Found $delta_files delta files and $meta_files meta files"
+    echo "Found $pack_files pack files and $manifest_files manifest files"
 
-    if [ "$delta_files" -gt 0 ] && [ "$meta_files" -gt 0 ]; then
+    if [ "$pack_files" -gt 0 ] && [ "$pack_files" -eq "$manifest_files" ]; then
         echo -e "${GREEN}✓ PASS${NC}: Storage structure looks correct"
         ((TESTS_PASSED++))
     else